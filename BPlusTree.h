@@ -0,0 +1,1555 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "BinarySearchTree.h"
+#include "SimdSearch.h"
+
+/*!
+    Имплементация B+-дерева
+    Допускается дублирование ключей (аналог multimap)
+    Элементы с равными ключами хранятся в порядке вставки
+
+    Пары хранятся отсортированными массивами в листьях размером около NodeBytes,
+    листья связаны в двусвязный список, внутренние узлы содержат только
+    разделяющие ключи. Интерфейс совпадает с BinarySearchTree, поэтому дерево
+    может служить движком Map и Set.
+    В отличие от BinarySearchTree вставка и удаление сдвигают элементы внутри
+    листьев и делают итераторы недействительными.
+*/
+template <typename Key,
+          typename Value,
+          typename Compare = std::less<Key>,
+          size_t NodeBytes = 256>
+class BPlusTree
+{
+    using _Item = std::pair<Key, Value>;
+
+    struct Inner;
+
+    struct NodeBase
+    {
+        explicit NodeBase(bool isLeaf);
+        Inner* parent = nullptr;
+        size_t count = 0; //!< число пар в листе или ключей во внутреннем узле
+        bool isLeaf;
+    };
+
+    //! Для векторного поиска лист хранит копию своих ключей подряд
+    static constexpr bool _mirrorsKeys = KeySearch<Key, Compare>::vectorized;
+    static constexpr size_t _leafEntryBytes = sizeof(_Item) + (_mirrorsKeys ? sizeof(Key) : 0);
+    static constexpr size_t _leafHeader = sizeof(NodeBase) + 2 * sizeof(void*);
+    static constexpr size_t _innerHeader = sizeof(NodeBase) + sizeof(void*);
+    static constexpr size_t _leafCapacity =
+        NodeBytes > _leafHeader + 8 * _leafEntryBytes
+        ? (NodeBytes - _leafHeader) / _leafEntryBytes : 8;
+    static constexpr size_t _innerCapacity =
+        NodeBytes > _innerHeader + 8 * (sizeof(Key) + sizeof(void*))
+        ? (NodeBytes - _innerHeader) / (sizeof(Key) + sizeof(void*)) : 8;
+    // минимальная заполненность всех узлов, кроме корня
+    static constexpr size_t _leafMin = _leafCapacity / 2;
+    static constexpr size_t _innerMin = (_innerCapacity - 1) / 2;
+    //! Число одновременных спусков в findBatch
+    static constexpr size_t _batchWidth = 16;
+    //! Пакет от size() / _rebuildRatio элементов выгоднее слить с деревом, чем вставлять по одному
+    static constexpr size_t _rebuildRatio = 32;
+
+    struct LeafKeys
+    {
+        Key keys[_leafCapacity];
+    };
+    struct NoLeafKeys {};
+
+    struct Leaf : NodeBase, std::conditional_t<_mirrorsKeys, LeafKeys, NoLeafKeys>
+    {
+        Leaf();
+        _Item* items();
+        const _Item* items() const;
+        Leaf* prev = nullptr;
+        Leaf* next = nullptr;
+        alignas(_Item) unsigned char storage[_leafCapacity * sizeof(_Item)];
+    };
+
+    struct Inner : NodeBase
+    {
+        Inner();
+        Key* keys();
+        const Key* keys() const;
+        NodeBase* children[_innerCapacity + 1];
+        alignas(Key) unsigned char storage[_innerCapacity * sizeof(Key)];
+    };
+
+    // поиск по типу K, отличному от Key, доступен только с прозрачным компаратором
+    template <typename K, typename Result>
+    using _IfTransparent = std::enable_if_t<IsTransparentCompare<Compare, K>::value, Result>;
+
+public:
+    //! Конструктор по умолчанию
+    BPlusTree() = default;
+    //! Ключи упорядочиваются компаратором compare
+    explicit BPlusTree(const Compare& compare);
+    //! Построение за O(n) из отсортированного по ключу диапазона пар [first, last)
+    template <typename ForwardIt>
+    BPlusTree(ForwardIt first, ForwardIt last);
+
+    //! Копирование, структура дерева повторяется без повторных вставок
+    explicit BPlusTree(const BPlusTree& other);
+    BPlusTree& operator=(const BPlusTree& other);
+    //! Перемещение
+    explicit BPlusTree(BPlusTree&& other) noexcept;
+    BPlusTree& operator=(BPlusTree&& other) noexcept;
+
+    //! Деструктор
+    ~BPlusTree();
+
+    /*!
+        Итератор B+-дерева
+
+        Обходит листья по списку от меньшего ключа к большему
+    */
+    class Iterator
+    {
+    public:
+        Iterator(Leaf* leaf, size_t index);
+
+        std::pair<Key, Value>& operator*();
+        const std::pair<Key, Value>& operator*() const;
+
+        std::pair<Key, Value>* operator->();
+        const std::pair<Key, Value>* operator->() const;
+
+        Iterator operator++();
+        Iterator operator++(int);
+
+        Iterator operator--();
+        Iterator operator--(int);
+
+        bool operator==(const Iterator& other) const;
+        bool operator!=(const Iterator& other) const;
+
+    private:
+        Leaf* _leaf;
+        size_t _index;
+    };
+
+    /*!
+        Константный итератор
+    */
+    class ConstIterator
+    {
+    public:
+        ConstIterator(const Leaf* leaf, size_t index);
+
+        const std::pair<Key, Value>& operator*() const;
+
+        const std::pair<Key, Value>* operator->() const;
+
+        ConstIterator operator++();
+        ConstIterator operator++(int);
+
+        ConstIterator operator--();
+        ConstIterator operator--(int);
+
+        bool operator==(const ConstIterator& other) const;
+        bool operator!=(const ConstIterator& other) const;
+
+    private:
+        const Leaf* _leaf;
+        size_t _index;
+    };
+
+    // вставить элемент с ключем key и значением value
+    // возвращает итератор на вставленный элемент
+    Iterator insert(const Key& key, const Value& value);
+    Iterator insert(Key&& key, Value&& value);
+
+    // вставить элемент, пара ключ-значение создается из args
+    template <typename... Args>
+    Iterator emplace(Args&&... args);
+
+    // вставить элемент, только если элемента с ключем key еще нет
+    // второй элемент пары - была ли вставка
+    template <typename... Args>
+    std::pair<Iterator, bool> tryEmplace(const Key& key, Args&&... args);
+    template <typename... Args>
+    std::pair<Iterator, bool> tryEmplace(Key&& key, Args&&... args);
+
+    // заменить значение элемента position
+    template <typename V>
+    void assignValue(Iterator position, V&& value);
+
+    // удалить все элементы с ключем key
+    void erase(const Key& key);
+    template <typename K>
+    _IfTransparent<K, void> erase(const K& key);
+
+    // вставить все пары диапазона [first, last), результат как у цикла insert
+    // пакет сортируется; небольшой вставляется по возрастанию ключей, крупный
+    // сливается с содержимым дерева за один проход, и дерево строится заново за O(n + m)
+    template <typename ForwardIt>
+    void insertBatch(ForwardIt first, ForwardIt last);
+    // удалить все элементы с ключами из диапазона [first, last), стратегия та же
+    template <typename ForwardIt>
+    void eraseBatch(ForwardIt first, ForwardIt last);
+
+    // найти первый элемент в дереве, равный ключу key
+    ConstIterator find(const Key& key) const;
+    Iterator find(const Key& key);
+    template <typename K>
+    _IfTransparent<K, ConstIterator> find(const K& key) const;
+    template <typename K>
+    _IfTransparent<K, Iterator> find(const K& key);
+
+    // найти первые элементы для всех ключей [first, last), результаты пишутся в out по порядку
+    // спуски группы ключей идут уровень за уровнем попеременно, следующий узел каждого
+    // спуска запрашивается заранее, и промахи кэша разных спусков перекрываются
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out);
+    // то же, в out пишется bool - есть ли элемент с таким ключем
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+
+    // первый элемент с ключем не меньше key
+    Iterator lowerBound(const Key& key);
+    ConstIterator lowerBound(const Key& key) const;
+    template <typename K>
+    _IfTransparent<K, Iterator> lowerBound(const K& key);
+    template <typename K>
+    _IfTransparent<K, ConstIterator> lowerBound(const K& key) const;
+
+    // первый элемент с ключем больше key
+    Iterator upperBound(const Key& key);
+    ConstIterator upperBound(const Key& key) const;
+    template <typename K>
+    _IfTransparent<K, Iterator> upperBound(const K& key);
+    template <typename K>
+    _IfTransparent<K, ConstIterator> upperBound(const K& key) const;
+
+    // найти все элементы, у которых ключ равен key
+    // [pair.first, pair.second) - полуинтервал, содержащий все элементы с ключем key
+    std::pair<Iterator, Iterator> equalRange(const Key& key);
+    std::pair<ConstIterator, ConstIterator> equalRange(const Key& key) const;
+    template <typename K>
+    _IfTransparent<K, std::pair<Iterator, Iterator>> equalRange(const K& key);
+    template <typename K>
+    _IfTransparent<K, std::pair<ConstIterator, ConstIterator>> equalRange(const K& key) const;
+
+    Iterator begin();
+    Iterator end();
+
+    ConstIterator cbegin() const;
+    ConstIterator cend() const;
+
+    size_t size() const;
+
+    Compare keyComp() const;
+
+    // удалить все элементы
+    void clear();
+
+    // заменить содержимое элементами отсортированного по ключу диапазона [first, last)
+    template <typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+
+    void swap(BPlusTree& other) noexcept;
+
+private:
+    // позиция в листе, nullptr - позиция end()
+    struct Position
+    {
+        Leaf* leaf;
+        size_t index;
+    };
+
+    // число ключей массива меньших key (lower) или не больших key (upper)
+    template <typename K>
+    size_t _lowerIndex(const Leaf* leaf, const K& key) const;
+    template <typename K>
+    size_t _upperIndex(const Leaf* leaf, const K& key) const;
+    template <typename K>
+    size_t _lowerIndex(const Inner* inner, const K& key) const;
+    template <typename K>
+    size_t _upperIndex(const Inner* inner, const K& key) const;
+
+    template <typename K>
+    Position _lowerBound(const K& key) const;
+    template <typename K>
+    Position _upperBound(const K& key) const;
+    template <typename K>
+    Position _findPosition(const K& key) const;
+    // лист и место в нем для вставки после всех равных key
+    template <typename K>
+    Position _insertPosition(const K& key) const;
+    // перейти к следующему листу, если index указывает за конец листа
+    static Position _normalize(Position position);
+    // найденная позиция или end(), если ключ в позиции не равен key
+    template <typename K>
+    Position _matchPosition(Position position, const K& key) const;
+    // _lowerBound для группы ключей, visit(key, position) вызывается для ключей по порядку
+    template <typename ForwardIt, typename Visit>
+    void _lowerBoundBatch(ForwardIt first, ForwardIt last, Visit visit) const;
+    // запросить все строки кэша узла
+    template <typename NodeType>
+    static void _prefetch(const NodeType* node);
+
+    template <typename K>
+    void _eraseKey(const K& key);
+    template <typename KeyArg, typename... Args>
+    std::pair<Iterator, bool> _tryEmplace(KeyArg&& key, Args&&... args);
+
+    // вставить item в лист leaf на место index, при переполнении лист делится
+    Iterator _insertAt(Leaf* leaf, size_t index, _Item&& item);
+    // добавить в родителя left разделитель key и правого соседа right
+    void _insertIntoParent(NodeBase* left, Key&& key, NodeBase* right);
+    // разделить заполненный внутренний узел пополам
+    void _splitInner(Inner* node);
+    // удалить элемент из листа и восстановить заполненность узлов
+    void _eraseAt(Leaf* leaf, size_t index);
+    // обновить копию ключей листа, начиная с позиции from
+    static void _refreshKeys(Leaf* leaf, size_t from);
+    void _fixLeafUnderflow(Leaf* leaf);
+    void _fixInnerUnderflow(Inner* node);
+    // удалить ключ index и ребенка index + 1 внутреннего узла
+    void _eraseFromInner(Inner* node, size_t index);
+    static size_t _childIndex(const Inner* parent, const NodeBase* child);
+
+    void _deleteSubtree(NodeBase* node);
+    // копия node становится ребенком index узла parent или корнем, если parent пуст
+    void _cloneSubtree(const NodeBase* node, Inner* parent, size_t index, Leaf*& lastLeaf);
+    static const Key& _firstKey(const NodeBase* node);
+
+    // операции над массивами из count живых объектов в сырой памяти
+    template <typename T>
+    static void _insertSlot(T* array, size_t count, size_t index, T&& value);
+    template <typename T>
+    static void _eraseSlot(T* array, size_t count, size_t index);
+    template <typename T>
+    static void _moveSlots(T* from, size_t count, T* to);
+    template <typename T>
+    static void _destroySlots(T* array, size_t count);
+
+    size_t _size = 0;
+    NodeBase* _root = nullptr; //!< корневой узел дерева
+    Leaf* _first = nullptr;    //!< самый левый лист
+    Compare _compare;
+};
+
+//Nodes
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+BPlusTree<Key, Value, Compare, NodeBytes>::NodeBase::NodeBase(bool isLeaf)
+: isLeaf(isLeaf) {}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+BPlusTree<Key, Value, Compare, NodeBytes>::Leaf::Leaf()
+: NodeBase(true) {}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::_Item*
+BPlusTree<Key, Value, Compare, NodeBytes>::Leaf::items() {
+    return std::launder(reinterpret_cast<_Item*>(storage));
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+const typename BPlusTree<Key, Value, Compare, NodeBytes>::_Item*
+BPlusTree<Key, Value, Compare, NodeBytes>::Leaf::items() const {
+    return std::launder(reinterpret_cast<const _Item*>(storage));
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+BPlusTree<Key, Value, Compare, NodeBytes>::Inner::Inner()
+: NodeBase(false) {}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+Key* BPlusTree<Key, Value, Compare, NodeBytes>::Inner::keys() {
+    return std::launder(reinterpret_cast<Key*>(storage));
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+const Key* BPlusTree<Key, Value, Compare, NodeBytes>::Inner::keys() const {
+    return std::launder(reinterpret_cast<const Key*>(storage));
+}
+
+//BigFive
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+BPlusTree<Key, Value, Compare, NodeBytes>::BPlusTree(const Compare& compare)
+: _compare(compare) {}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename ForwardIt>
+BPlusTree<Key, Value, Compare, NodeBytes>::BPlusTree(ForwardIt first, ForwardIt last) {
+    assign(first, last);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+BPlusTree<Key, Value, Compare, NodeBytes>::BPlusTree(const BPlusTree& other)
+: _compare(other._compare) {
+    if (!other._root) {
+        return;
+    }
+    Leaf* lastLeaf = nullptr;
+    try {
+        _cloneSubtree(other._root, nullptr, 0, lastLeaf);
+    }
+    catch (...) {
+        clear();
+        throw;
+    }
+    _size = other._size;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+BPlusTree<Key, Value, Compare, NodeBytes>&
+BPlusTree<Key, Value, Compare, NodeBytes>::operator=(const BPlusTree& other) {
+    if (&other != this) {
+        BPlusTree copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+BPlusTree<Key, Value, Compare, NodeBytes>::BPlusTree(BPlusTree&& other) noexcept
+: _size(std::exchange(other._size, 0)),
+  _root(std::exchange(other._root, nullptr)),
+  _first(std::exchange(other._first, nullptr)),
+  _compare(other._compare) {}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+BPlusTree<Key, Value, Compare, NodeBytes>&
+BPlusTree<Key, Value, Compare, NodeBytes>::operator=(BPlusTree&& other) noexcept {
+    if (&other != this) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+BPlusTree<Key, Value, Compare, NodeBytes>::~BPlusTree() {
+    clear();
+}
+
+//Iterator
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+BPlusTree<Key, Value, Compare, NodeBytes>::Iterator::Iterator(Leaf* leaf, size_t index)
+: _leaf(leaf), _index(index) {}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+std::pair<Key, Value>& BPlusTree<Key, Value, Compare, NodeBytes>::Iterator::operator*() {
+    return _leaf->items()[_index];
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+const std::pair<Key, Value>&
+BPlusTree<Key, Value, Compare, NodeBytes>::Iterator::operator*() const {
+    return _leaf->items()[_index];
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+std::pair<Key, Value>* BPlusTree<Key, Value, Compare, NodeBytes>::Iterator::operator->() {
+    return _leaf->items() + _index;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+const std::pair<Key, Value>*
+BPlusTree<Key, Value, Compare, NodeBytes>::Iterator::operator->() const {
+    return _leaf->items() + _index;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::Iterator::operator++() {
+    if (++_index == _leaf->count) {
+        _leaf = _leaf->next;
+        _index = 0;
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::Iterator::operator++(int) {
+    Iterator bufIt = *this;
+    ++*this;
+    return bufIt;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::Iterator::operator--() {
+    if (_index == 0) {
+        _leaf = _leaf->prev;
+        _index = _leaf ? _leaf->count : 0;
+    }
+    if (_leaf) {
+        _index--;
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::Iterator::operator--(int) {
+    Iterator bufIt = *this;
+    --*this;
+    return bufIt;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+bool BPlusTree<Key, Value, Compare, NodeBytes>::Iterator::operator==(const Iterator& other) const {
+    return _leaf == other._leaf && _index == other._index;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+bool BPlusTree<Key, Value, Compare, NodeBytes>::Iterator::operator!=(const Iterator& other) const {
+    return !(*this == other);
+}
+
+//ConstIterator
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator::ConstIterator(const Leaf* leaf, size_t index)
+: _leaf(leaf), _index(index) {}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+const std::pair<Key, Value>&
+BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator::operator*() const {
+    return _leaf->items()[_index];
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+const std::pair<Key, Value>*
+BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator::operator->() const {
+    return _leaf->items() + _index;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator
+BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator::operator++() {
+    if (++_index == _leaf->count) {
+        _leaf = _leaf->next;
+        _index = 0;
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator
+BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator::operator++(int) {
+    ConstIterator bufIt = *this;
+    ++*this;
+    return bufIt;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator
+BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator::operator--() {
+    if (_index == 0) {
+        _leaf = _leaf->prev;
+        _index = _leaf ? _leaf->count : 0;
+    }
+    if (_leaf) {
+        _index--;
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator
+BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator::operator--(int) {
+    ConstIterator bufIt = *this;
+    --*this;
+    return bufIt;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+bool BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator::operator==(const ConstIterator& other) const {
+    return _leaf == other._leaf && _index == other._index;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+bool BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator::operator!=(const ConstIterator& other) const {
+    return !(*this == other);
+}
+
+//Methods
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::insert(const Key& key, const Value& value) {
+    return emplace(key, value);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::insert(Key&& key, Value&& value) {
+    return emplace(std::move(key), std::move(value));
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename... Args>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::emplace(Args&&... args) {
+    _Item item(std::forward<Args>(args)...);
+    Position position = _insertPosition(item.first);
+    return _insertAt(position.leaf, position.index, std::move(item));
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename... Args>
+std::pair<typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator, bool>
+BPlusTree<Key, Value, Compare, NodeBytes>::tryEmplace(const Key& key, Args&&... args) {
+    return _tryEmplace(key, std::forward<Args>(args)...);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename... Args>
+std::pair<typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator, bool>
+BPlusTree<Key, Value, Compare, NodeBytes>::tryEmplace(Key&& key, Args&&... args) {
+    return _tryEmplace(std::move(key), std::forward<Args>(args)...);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename KeyArg, typename... Args>
+std::pair<typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator, bool>
+BPlusTree<Key, Value, Compare, NodeBytes>::_tryEmplace(KeyArg&& key, Args&&... args) {
+    Position position = _insertPosition(key);
+    // равный ключ может быть только непосредственно перед местом вставки
+    if (position.leaf) {
+        Leaf* leaf = position.leaf;
+        size_t index = position.index;
+        if (index == 0 && leaf->prev) {
+            leaf = leaf->prev;
+            index = leaf->count;
+        }
+        if (index > 0 && !_compare(leaf->items()[index - 1].first, key)) {
+            return std::pair<Iterator, bool>(Iterator(leaf, index - 1), false);
+        }
+    }
+    _Item item(std::piecewise_construct,
+               std::forward_as_tuple(std::forward<KeyArg>(key)),
+               std::forward_as_tuple(std::forward<Args>(args)...));
+    return std::pair<Iterator, bool>(_insertAt(position.leaf, position.index, std::move(item)), true);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename V>
+void BPlusTree<Key, Value, Compare, NodeBytes>::assignValue(Iterator position, V&& value) {
+    position->second = std::forward<V>(value);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+void BPlusTree<Key, Value, Compare, NodeBytes>::erase(const Key& key) {
+    _eraseKey(key);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+auto BPlusTree<Key, Value, Compare, NodeBytes>::erase(const K& key) -> _IfTransparent<K, void> {
+    _eraseKey(key);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_eraseKey(const K& key) {
+    while (true) {
+        Position position = _findPosition(key);
+        if (!position.leaf) {
+            return;
+        }
+        _eraseAt(position.leaf, position.index);
+    }
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename ForwardIt>
+void BPlusTree<Key, Value, Compare, NodeBytes>::insertBatch(ForwardIt first, ForwardIt last) {
+    auto itemLess = [this](const _Item& left, const _Item& right) {
+        return _compare(left.first, right.first);
+    };
+    std::vector<_Item> batch(first, last);
+    // равные ключи пакета остаются в порядке пакета, как при цикле insert
+    if (!std::is_sorted(batch.begin(), batch.end(), itemLess)) {
+        std::stable_sort(batch.begin(), batch.end(), itemLess);
+    }
+    if (batch.size() * _rebuildRatio < _size) {
+        for (_Item& item : batch) {
+            Position position = _insertPosition(item.first);
+            _insertAt(position.leaf, position.index, std::move(item));
+        }
+        return;
+    }
+    // элементы дерева копируются, а не перемещаются: при исключении дерево не меняется
+    // при равных ключах старые элементы идут раньше новых
+    std::vector<_Item> merged;
+    merged.reserve(_size + batch.size());
+    auto item = batch.begin();
+    for (const Leaf* leaf = _first; leaf; leaf = leaf->next) {
+        for (size_t i = 0; i < leaf->count; i++) {
+            const _Item& current = leaf->items()[i];
+            while (item != batch.end() && itemLess(*item, current)) {
+                merged.push_back(std::move(*item++));
+            }
+            merged.push_back(current);
+        }
+    }
+    std::move(item, batch.end(), std::back_inserter(merged));
+    BPlusTree rebuilt(_compare);
+    rebuilt.assign(std::make_move_iterator(merged.begin()), std::make_move_iterator(merged.end()));
+    swap(rebuilt);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename ForwardIt>
+void BPlusTree<Key, Value, Compare, NodeBytes>::eraseBatch(ForwardIt first, ForwardIt last) {
+    static_assert(std::is_same<std::remove_cv_t<std::remove_reference_t<decltype(*first)>>, Key>::value,
+                  "eraseBatch expects a range of Key");
+    std::vector<const Key*> keys;
+    for (; first != last; ++first) {
+        keys.push_back(&*first);
+    }
+    std::sort(keys.begin(), keys.end(), [this](const Key* left, const Key* right) {
+        return _compare(*left, *right);
+    });
+    if (keys.size() * _rebuildRatio < _size) {
+        for (const Key* key : keys) {
+            _eraseKey(*key);
+        }
+        return;
+    }
+    // один проход по листьям и по отсортированным ключам, оставшиеся элементы копируются
+    std::vector<_Item> kept;
+    kept.reserve(_size);
+    size_t key = 0;
+    for (const Leaf* leaf = _first; leaf; leaf = leaf->next) {
+        for (size_t i = 0; i < leaf->count; i++) {
+            const _Item& current = leaf->items()[i];
+            while (key < keys.size() && _compare(*keys[key], current.first)) {
+                key++;
+            }
+            if (key == keys.size() || _compare(current.first, *keys[key])) {
+                kept.push_back(current);
+            }
+        }
+    }
+    if (kept.size() == _size) {
+        return;
+    }
+    BPlusTree rebuilt(_compare);
+    rebuilt.assign(std::make_move_iterator(kept.begin()), std::make_move_iterator(kept.end()));
+    swap(rebuilt);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator
+BPlusTree<Key, Value, Compare, NodeBytes>::find(const Key& key) const {
+    Position position = _findPosition(key);
+    return ConstIterator(position.leaf, position.index);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::find(const Key& key) {
+    Position position = _findPosition(key);
+    return Iterator(position.leaf, position.index);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+auto BPlusTree<Key, Value, Compare, NodeBytes>::find(const K& key) const
+-> _IfTransparent<K, ConstIterator> {
+    Position position = _findPosition(key);
+    return ConstIterator(position.leaf, position.index);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+auto BPlusTree<Key, Value, Compare, NodeBytes>::find(const K& key) -> _IfTransparent<K, Iterator> {
+    Position position = _findPosition(key);
+    return Iterator(position.leaf, position.index);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename ForwardIt, typename OutputIt>
+OutputIt BPlusTree<Key, Value, Compare, NodeBytes>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    _lowerBoundBatch(first, last, [this, &out](const auto& key, Position position) {
+        position = _matchPosition(position, key);
+        *out++ = ConstIterator(position.leaf, position.index);
+    });
+    return out;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename ForwardIt, typename OutputIt>
+OutputIt BPlusTree<Key, Value, Compare, NodeBytes>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) {
+    _lowerBoundBatch(first, last, [this, &out](const auto& key, Position position) {
+        position = _matchPosition(position, key);
+        *out++ = Iterator(position.leaf, position.index);
+    });
+    return out;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename ForwardIt, typename OutputIt>
+OutputIt BPlusTree<Key, Value, Compare, NodeBytes>::containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    _lowerBoundBatch(first, last, [this, &out](const auto& key, Position position) {
+        *out++ = _matchPosition(position, key).leaf != nullptr;
+    });
+    return out;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::lowerBound(const Key& key) {
+    Position position = _lowerBound(key);
+    return Iterator(position.leaf, position.index);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator
+BPlusTree<Key, Value, Compare, NodeBytes>::lowerBound(const Key& key) const {
+    Position position = _lowerBound(key);
+    return ConstIterator(position.leaf, position.index);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+auto BPlusTree<Key, Value, Compare, NodeBytes>::lowerBound(const K& key) -> _IfTransparent<K, Iterator> {
+    Position position = _lowerBound(key);
+    return Iterator(position.leaf, position.index);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+auto BPlusTree<Key, Value, Compare, NodeBytes>::lowerBound(const K& key) const
+-> _IfTransparent<K, ConstIterator> {
+    Position position = _lowerBound(key);
+    return ConstIterator(position.leaf, position.index);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::upperBound(const Key& key) {
+    Position position = _upperBound(key);
+    return Iterator(position.leaf, position.index);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator
+BPlusTree<Key, Value, Compare, NodeBytes>::upperBound(const Key& key) const {
+    Position position = _upperBound(key);
+    return ConstIterator(position.leaf, position.index);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+auto BPlusTree<Key, Value, Compare, NodeBytes>::upperBound(const K& key) -> _IfTransparent<K, Iterator> {
+    Position position = _upperBound(key);
+    return Iterator(position.leaf, position.index);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+auto BPlusTree<Key, Value, Compare, NodeBytes>::upperBound(const K& key) const
+-> _IfTransparent<K, ConstIterator> {
+    Position position = _upperBound(key);
+    return ConstIterator(position.leaf, position.index);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+std::pair<typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator,
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator>
+BPlusTree<Key, Value, Compare, NodeBytes>::equalRange(const Key& key) {
+    return std::pair<Iterator, Iterator>(lowerBound(key), upperBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+std::pair<typename BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator,
+typename BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator>
+BPlusTree<Key, Value, Compare, NodeBytes>::equalRange(const Key& key) const {
+    return std::pair<ConstIterator, ConstIterator>(lowerBound(key), upperBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+auto BPlusTree<Key, Value, Compare, NodeBytes>::equalRange(const K& key)
+-> _IfTransparent<K, std::pair<Iterator, Iterator>> {
+    return std::pair<Iterator, Iterator>(lowerBound(key), upperBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+auto BPlusTree<Key, Value, Compare, NodeBytes>::equalRange(const K& key) const
+-> _IfTransparent<K, std::pair<ConstIterator, ConstIterator>> {
+    return std::pair<ConstIterator, ConstIterator>(lowerBound(key), upperBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::begin() {
+    return Iterator(_first, 0);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::end() {
+    return Iterator(nullptr, 0);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator
+BPlusTree<Key, Value, Compare, NodeBytes>::cbegin() const {
+    return ConstIterator(_first, 0);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::ConstIterator
+BPlusTree<Key, Value, Compare, NodeBytes>::cend() const {
+    return ConstIterator(nullptr, 0);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+size_t BPlusTree<Key, Value, Compare, NodeBytes>::size() const {
+    return _size;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+Compare BPlusTree<Key, Value, Compare, NodeBytes>::keyComp() const {
+    return _compare;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+void BPlusTree<Key, Value, Compare, NodeBytes>::clear() {
+    if (_root) {
+        _deleteSubtree(_root);
+    }
+    _root = nullptr;
+    _first = nullptr;
+    _size = 0;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename ForwardIt>
+void BPlusTree<Key, Value, Compare, NodeBytes>::assign(ForwardIt first, ForwardIt last) {
+    clear();
+    size_t count = static_cast<size_t>(std::distance(first, last));
+    if (count == 0) {
+        return;
+    }
+    // листья заполняются равномерно, каждый не меньше чем наполовину
+    size_t leafCount = (count + _leafCapacity - 1) / _leafCapacity;
+    std::vector<NodeBase*> level;
+    std::vector<Inner*> inners; //!< созданные внутренние узлы, их меньше чем листьев
+    level.reserve(leafCount);
+    inners.reserve(leafCount);
+    try {
+        Leaf* previous = nullptr;
+        for (size_t i = 0; i < leafCount; i++) {
+            Leaf* leaf = new Leaf;
+            leaf->prev = previous;
+            if (previous) {
+                previous->next = leaf;
+            }
+            else {
+                _first = leaf;
+            }
+            previous = leaf;
+            level.push_back(leaf);
+            size_t itemCount = count / leafCount + (i < count % leafCount ? 1 : 0);
+            for (size_t j = 0; j < itemCount; j++, ++first) {
+                ::new (static_cast<void*>(leaf->items() + j)) _Item(*first);
+                leaf->count++;
+            }
+            _refreshKeys(leaf, 0);
+        }
+        // внутренние уровни строятся снизу вверх тем же равномерным разбиением
+        while (level.size() > 1) {
+            size_t childCount = level.size();
+            size_t innerCount = (childCount + _innerCapacity) / (_innerCapacity + 1);
+            size_t child = 0;
+            for (size_t i = 0; i < innerCount; i++) {
+                Inner* inner = new Inner;
+                inners.push_back(inner);
+                size_t children = childCount / innerCount + (i < childCount % innerCount ? 1 : 0);
+                for (size_t j = 0; j < children; j++, child++) {
+                    if (j > 0) {
+                        ::new (static_cast<void*>(inner->keys() + j - 1)) Key(_firstKey(level[child]));
+                        inner->count++;
+                    }
+                    inner->children[j] = level[child];
+                    level[child]->parent = inner;
+                }
+            }
+            level.assign(inners.end() - innerCount, inners.end());
+        }
+    }
+    catch (...) {
+        for (Leaf* leaf = _first; leaf;) {
+            Leaf* next = leaf->next;
+            _destroySlots(leaf->items(), leaf->count);
+            delete leaf;
+            leaf = next;
+        }
+        for (Inner* inner : inners) {
+            _destroySlots(inner->keys(), inner->count);
+            delete inner;
+        }
+        _first = nullptr;
+        throw;
+    }
+    _root = level.front();
+    _size = count;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+void BPlusTree<Key, Value, Compare, NodeBytes>::swap(BPlusTree& other) noexcept {
+    std::swap(_size, other._size);
+    std::swap(_root, other._root);
+    std::swap(_first, other._first);
+    std::swap(_compare, other._compare);
+}
+
+//Search
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+size_t BPlusTree<Key, Value, Compare, NodeBytes>::_lowerIndex(const Leaf* leaf, const K& key) const {
+    if constexpr (_mirrorsKeys) {
+        return KeySearch<Key, Compare>::lowerIndex(leaf->keys, leaf->count, key, _compare);
+    }
+    else {
+        size_t low = 0;
+        size_t high = leaf->count;
+        const _Item* items = leaf->items();
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (_compare(items[middle].first, key)) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+size_t BPlusTree<Key, Value, Compare, NodeBytes>::_upperIndex(const Leaf* leaf, const K& key) const {
+    if constexpr (_mirrorsKeys) {
+        return KeySearch<Key, Compare>::upperIndex(leaf->keys, leaf->count, key, _compare);
+    }
+    else {
+        size_t low = 0;
+        size_t high = leaf->count;
+        const _Item* items = leaf->items();
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (_compare(key, items[middle].first)) {
+                high = middle;
+            }
+            else {
+                low = middle + 1;
+            }
+        }
+        return low;
+    }
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+size_t BPlusTree<Key, Value, Compare, NodeBytes>::_lowerIndex(const Inner* inner, const K& key) const {
+    return KeySearch<Key, Compare>::lowerIndex(inner->keys(), inner->count, key, _compare);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+size_t BPlusTree<Key, Value, Compare, NodeBytes>::_upperIndex(const Inner* inner, const K& key) const {
+    return KeySearch<Key, Compare>::upperIndex(inner->keys(), inner->count, key, _compare);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Position
+BPlusTree<Key, Value, Compare, NodeBytes>::_lowerBound(const K& key) const {
+    // все ключи ребенка i не больше keys[i], все ключи ребенка i + 1 не меньше keys[i]:
+    // первый ключ не меньше key лежит в ребенке номер (число разделителей меньше key)
+    // или первым в следующем листе
+    if (!_root) {
+        return Position{nullptr, 0};
+    }
+    const NodeBase* node = _root;
+    while (!node->isLeaf) {
+        const Inner* inner = static_cast<const Inner*>(node);
+        node = inner->children[_lowerIndex(inner, key)];
+    }
+    Leaf* leaf = const_cast<Leaf*>(static_cast<const Leaf*>(node));
+    return _normalize(Position{leaf, _lowerIndex(leaf, key)});
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Position
+BPlusTree<Key, Value, Compare, NodeBytes>::_upperBound(const K& key) const {
+    return _normalize(_insertPosition(key));
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Position
+BPlusTree<Key, Value, Compare, NodeBytes>::_findPosition(const K& key) const {
+    return _matchPosition(_lowerBound(key), key);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Position
+BPlusTree<Key, Value, Compare, NodeBytes>::_matchPosition(Position position, const K& key) const {
+    if (position.leaf && _compare(key, position.leaf->items()[position.index].first)) {
+        return Position{nullptr, 0};
+    }
+    return position;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename ForwardIt, typename Visit>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_lowerBoundBatch(ForwardIt first, ForwardIt last, Visit visit) const {
+    using K = std::remove_cv_t<std::remove_reference_t<decltype(*first)>>;
+    static_assert(std::is_same<K, Key>::value || IsTransparentCompare<Compare, K>::value,
+                  "batch keys of another type require a transparent comparator");
+    const K* keys[_batchWidth];
+    const NodeBase* nodes[_batchWidth];
+    while (first != last) {
+        size_t count = 0;
+        for (; first != last && count < _batchWidth; ++first, ++count) {
+            keys[count] = &*first;
+            nodes[count] = _root;
+        }
+        if (!_root) {
+            for (size_t i = 0; i < count; i++) {
+                visit(*keys[i], Position{nullptr, 0});
+            }
+            continue;
+        }
+        // все листья на одной глубине, поэтому спуски идут по уровням синхронно:
+        // пока ищется ключ в узле одного спуска, узлы остальных уже загружаются
+        while (!nodes[0]->isLeaf) {
+            for (size_t i = 0; i < count; i++) {
+                const Inner* inner = static_cast<const Inner*>(nodes[i]);
+                const NodeBase* child = inner->children[_lowerIndex(inner, *keys[i])];
+                if (child->isLeaf) {
+                    _prefetch(static_cast<const Leaf*>(child));
+                }
+                else {
+                    _prefetch(static_cast<const Inner*>(child));
+                }
+                nodes[i] = child;
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            Leaf* leaf = const_cast<Leaf*>(static_cast<const Leaf*>(nodes[i]));
+            visit(*keys[i], _normalize(Position{leaf, _lowerIndex(leaf, *keys[i])}));
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename NodeType>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_prefetch(const NodeType* node) {
+#if defined(__GNUC__) || defined(__clang__)
+    const char* bytes = reinterpret_cast<const char*>(node);
+    for (size_t offset = 0; offset < sizeof(NodeType); offset += 64) {
+        __builtin_prefetch(bytes + offset);
+    }
+#else
+    (void)node;
+#endif
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename K>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Position
+BPlusTree<Key, Value, Compare, NodeBytes>::_insertPosition(const K& key) const {
+    if (!_root) {
+        return Position{nullptr, 0};
+    }
+    const NodeBase* node = _root;
+    while (!node->isLeaf) {
+        const Inner* inner = static_cast<const Inner*>(node);
+        node = inner->children[_upperIndex(inner, key)];
+    }
+    Leaf* leaf = const_cast<Leaf*>(static_cast<const Leaf*>(node));
+    return Position{leaf, _upperIndex(leaf, key)};
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Position
+BPlusTree<Key, Value, Compare, NodeBytes>::_normalize(Position position) {
+    if (position.leaf && position.index == position.leaf->count) {
+        return Position{position.leaf->next, 0};
+    }
+    return position;
+}
+
+//Modification
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+typename BPlusTree<Key, Value, Compare, NodeBytes>::Iterator
+BPlusTree<Key, Value, Compare, NodeBytes>::_insertAt(Leaf* leaf, size_t index, _Item&& item) {
+    if (!leaf) {
+        leaf = new Leaf;
+        _root = leaf;
+        _first = leaf;
+    }
+    if (leaf->count < _leafCapacity) {
+        _insertSlot(leaf->items(), leaf->count, index, std::move(item));
+        leaf->count++;
+        _refreshKeys(leaf, index);
+        _size++;
+        return Iterator(leaf, index);
+    }
+    // из capacity + 1 элементов левому листу достается leftCount
+    size_t leftCount = (_leafCapacity + 1) / 2;
+    Leaf* right = new Leaf;
+    size_t moveFrom = index < leftCount ? leftCount - 1 : leftCount;
+    _moveSlots(leaf->items() + moveFrom, leaf->count - moveFrom, right->items());
+    right->count = leaf->count - moveFrom;
+    leaf->count = moveFrom;
+    Iterator result = index < leftCount ? Iterator(leaf, index) : Iterator(right, index - leftCount);
+    if (index < leftCount) {
+        _insertSlot(leaf->items(), leaf->count, index, std::move(item));
+        leaf->count++;
+    }
+    else {
+        _insertSlot(right->items(), right->count, index - leftCount, std::move(item));
+        right->count++;
+    }
+    _refreshKeys(leaf, std::min(index, leaf->count));
+    _refreshKeys(right, 0);
+    _size++;
+    right->next = leaf->next;
+    right->prev = leaf;
+    if (leaf->next) {
+        leaf->next->prev = right;
+    }
+    leaf->next = right;
+    _insertIntoParent(leaf, Key(right->items()[0].first), right);
+    return result;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_insertIntoParent(NodeBase* left, Key&& key, NodeBase* right) {
+    if (!left->parent) {
+        Inner* root = new Inner;
+        ::new (static_cast<void*>(root->keys())) Key(std::move(key));
+        root->count = 1;
+        root->children[0] = left;
+        root->children[1] = right;
+        left->parent = root;
+        right->parent = root;
+        _root = root;
+        return;
+    }
+    if (left->parent->count == _innerCapacity) {
+        _splitInner(left->parent);
+    }
+    Inner* parent = left->parent;
+    size_t index = _childIndex(parent, left);
+    _insertSlot(parent->keys(), parent->count, index, std::move(key));
+    for (size_t i = parent->count + 1; i > index + 1; i--) {
+        parent->children[i] = parent->children[i - 1];
+    }
+    parent->children[index + 1] = right;
+    right->parent = parent;
+    parent->count++;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_splitInner(Inner* node) {
+    // средний ключ поднимается в родителя, правая половина уходит в новый узел
+    size_t middle = node->count / 2;
+    Inner* right = new Inner;
+    _moveSlots(node->keys() + middle + 1, node->count - middle - 1, right->keys());
+    right->count = node->count - middle - 1;
+    for (size_t i = 0; i <= right->count; i++) {
+        right->children[i] = node->children[middle + 1 + i];
+        right->children[i]->parent = right;
+    }
+    Key middleKey(std::move(node->keys()[middle]));
+    _destroySlots(node->keys() + middle, 1);
+    node->count = middle;
+    _insertIntoParent(node, std::move(middleKey), right);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_refreshKeys(Leaf* leaf, size_t from) {
+    if constexpr (_mirrorsKeys) {
+        for (size_t i = from; i < leaf->count; i++) {
+            leaf->keys[i] = leaf->items()[i].first;
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_eraseAt(Leaf* leaf, size_t index) {
+    _eraseSlot(leaf->items(), leaf->count, index);
+    leaf->count--;
+    _refreshKeys(leaf, index);
+    _size--;
+    if (leaf == _root) {
+        if (leaf->count == 0) {
+            delete leaf;
+            _root = nullptr;
+            _first = nullptr;
+        }
+        return;
+    }
+    if (leaf->count < _leafMin) {
+        _fixLeafUnderflow(leaf);
+    }
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_fixLeafUnderflow(Leaf* leaf) {
+    Inner* parent = leaf->parent;
+    size_t index = _childIndex(parent, leaf);
+    Leaf* left = index > 0 ? static_cast<Leaf*>(parent->children[index - 1]) : nullptr;
+    Leaf* right = index < parent->count ? static_cast<Leaf*>(parent->children[index + 1]) : nullptr;
+    if (left && left->count > _leafMin) {
+        _insertSlot(leaf->items(), leaf->count, 0, std::move(left->items()[left->count - 1]));
+        leaf->count++;
+        _destroySlots(left->items() + left->count - 1, 1);
+        left->count--;
+        _refreshKeys(leaf, 0);
+        parent->keys()[index - 1] = leaf->items()[0].first;
+        return;
+    }
+    if (right && right->count > _leafMin) {
+        ::new (static_cast<void*>(leaf->items() + leaf->count)) _Item(std::move(right->items()[0]));
+        leaf->count++;
+        _eraseSlot(right->items(), right->count, 0);
+        right->count--;
+        _refreshKeys(leaf, leaf->count - 1);
+        _refreshKeys(right, 0);
+        parent->keys()[index] = right->items()[0].first;
+        return;
+    }
+    // соседи заполнены минимально, лист сливается с одним из них
+    if (left) {
+        _moveSlots(leaf->items(), leaf->count, left->items() + left->count);
+        left->count += leaf->count;
+        _refreshKeys(left, left->count - leaf->count);
+        left->next = leaf->next;
+        if (leaf->next) {
+            leaf->next->prev = left;
+        }
+        delete leaf;
+        _eraseFromInner(parent, index - 1);
+    }
+    else {
+        _moveSlots(right->items(), right->count, leaf->items() + leaf->count);
+        leaf->count += right->count;
+        _refreshKeys(leaf, leaf->count - right->count);
+        leaf->next = right->next;
+        if (right->next) {
+            right->next->prev = leaf;
+        }
+        delete right;
+        _eraseFromInner(parent, index);
+    }
+    _fixInnerUnderflow(parent);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_fixInnerUnderflow(Inner* node) {
+    if (node == _root) {
+        if (node->count == 0) {
+            _root = node->children[0];
+            _root->parent = nullptr;
+            delete node;
+        }
+        return;
+    }
+    if (node->count >= _innerMin) {
+        return;
+    }
+    Inner* parent = node->parent;
+    size_t index = _childIndex(parent, node);
+    Inner* left = index > 0 ? static_cast<Inner*>(parent->children[index - 1]) : nullptr;
+    Inner* right = index < parent->count ? static_cast<Inner*>(parent->children[index + 1]) : nullptr;
+    if (left && left->count > _innerMin) {
+        // поворот вправо через разделитель родителя
+        _insertSlot(node->keys(), node->count, 0, std::move(parent->keys()[index - 1]));
+        for (size_t i = node->count + 1; i > 0; i--) {
+            node->children[i] = node->children[i - 1];
+        }
+        node->children[0] = left->children[left->count];
+        node->children[0]->parent = node;
+        node->count++;
+        parent->keys()[index - 1] = std::move(left->keys()[left->count - 1]);
+        _destroySlots(left->keys() + left->count - 1, 1);
+        left->count--;
+        return;
+    }
+    if (right && right->count > _innerMin) {
+        // поворот влево через разделитель родителя
+        ::new (static_cast<void*>(node->keys() + node->count)) Key(std::move(parent->keys()[index]));
+        node->children[node->count + 1] = right->children[0];
+        node->children[node->count + 1]->parent = node;
+        node->count++;
+        parent->keys()[index] = std::move(right->keys()[0]);
+        _eraseSlot(right->keys(), right->count, 0);
+        for (size_t i = 0; i < right->count; i++) {
+            right->children[i] = right->children[i + 1];
+        }
+        right->count--;
+        return;
+    }
+    // слияние: левый узел получает разделитель родителя и содержимое правого
+    Inner* target = left ? left : node;
+    Inner* source = left ? node : right;
+    size_t separator = left ? index - 1 : index;
+    ::new (static_cast<void*>(target->keys() + target->count)) Key(std::move(parent->keys()[separator]));
+    _moveSlots(source->keys(), source->count, target->keys() + target->count + 1);
+    for (size_t i = 0; i <= source->count; i++) {
+        target->children[target->count + 1 + i] = source->children[i];
+        source->children[i]->parent = target;
+    }
+    target->count += source->count + 1;
+    source->count = 0;
+    delete source;
+    _eraseFromInner(parent, separator);
+    _fixInnerUnderflow(parent);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_eraseFromInner(Inner* node, size_t index) {
+    _eraseSlot(node->keys(), node->count, index);
+    for (size_t i = index + 1; i < node->count; i++) {
+        node->children[i] = node->children[i + 1];
+    }
+    node->count--;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+size_t BPlusTree<Key, Value, Compare, NodeBytes>::_childIndex(const Inner* parent, const NodeBase* child) {
+    size_t index = 0;
+    while (parent->children[index] != child) {
+        index++;
+    }
+    return index;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_deleteSubtree(NodeBase* node) {
+    // глубина B+-дерева - единицы уровней, рекурсия безопасна
+    // пустые дети бывают только у недостроенной при исключении копии
+    if (!node) {
+        return;
+    }
+    if (node->isLeaf) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        _destroySlots(leaf->items(), leaf->count);
+        delete leaf;
+        return;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    for (size_t i = 0; i <= inner->count; i++) {
+        _deleteSubtree(inner->children[i]);
+    }
+    _destroySlots(inner->keys(), inner->count);
+    delete inner;
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_cloneSubtree(const NodeBase* node, Inner* parent,
+                                                              size_t index, Leaf*& lastLeaf) {
+    // узел подвешивается к дереву до заполнения, чтобы clear() нашел его при исключении
+    NodeBase* copy = node->isLeaf ? static_cast<NodeBase*>(new Leaf) : new Inner;
+    copy->parent = parent;
+    if (parent) {
+        parent->children[index] = copy;
+    }
+    else {
+        _root = copy;
+    }
+    if (node->isLeaf) {
+        const Leaf* source = static_cast<const Leaf*>(node);
+        Leaf* leaf = static_cast<Leaf*>(copy);
+        if (lastLeaf) {
+            lastLeaf->next = leaf;
+            leaf->prev = lastLeaf;
+        }
+        else {
+            _first = leaf;
+        }
+        lastLeaf = leaf;
+        for (size_t i = 0; i < source->count; i++) {
+            ::new (static_cast<void*>(leaf->items() + i)) _Item(source->items()[i]);
+            leaf->count++;
+        }
+        _refreshKeys(leaf, 0);
+        return;
+    }
+    const Inner* source = static_cast<const Inner*>(node);
+    Inner* inner = static_cast<Inner*>(copy);
+    for (size_t i = 0; i <= source->count; i++) {
+        inner->children[i] = nullptr;
+    }
+    for (size_t i = 0; i < source->count; i++) {
+        ::new (static_cast<void*>(inner->keys() + i)) Key(source->keys()[i]);
+        inner->count++;
+    }
+    for (size_t i = 0; i <= source->count; i++) {
+        _cloneSubtree(source->children[i], inner, i, lastLeaf);
+    }
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+const Key& BPlusTree<Key, Value, Compare, NodeBytes>::_firstKey(const NodeBase* node) {
+    while (!node->isLeaf) {
+        node = static_cast<const Inner*>(node)->children[0];
+    }
+    return static_cast<const Leaf*>(node)->items()[0].first;
+}
+
+//Slots
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename T>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_insertSlot(T* array, size_t count, size_t index, T&& value) {
+    if (index == count) {
+        ::new (static_cast<void*>(array + count)) T(std::move(value));
+        return;
+    }
+    ::new (static_cast<void*>(array + count)) T(std::move(array[count - 1]));
+    std::move_backward(array + index, array + count - 1, array + count);
+    array[index] = std::move(value);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename T>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_eraseSlot(T* array, size_t count, size_t index) {
+    std::move(array + index + 1, array + count, array + index);
+    array[count - 1].~T();
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename T>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_moveSlots(T* from, size_t count, T* to) {
+    std::uninitialized_move(from, from + count, to);
+    _destroySlots(from, count);
+}
+
+template <typename Key, typename Value, typename Compare, size_t NodeBytes>
+template <typename T>
+void BPlusTree<Key, Value, Compare, NodeBytes>::_destroySlots(T* array, size_t count) {
+    std::destroy(array, array + count);
+}
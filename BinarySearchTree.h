@@ -2,33 +2,238 @@
 
 #include <utility>
 #include <cstddef>
+#include <type_traits>
+#include <memory>
+#include <iterator>
+#include <functional>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+#include <optional>
+#include <limits>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <random>
+
+#include "MappedTree.h"
+#include "NodePool.h"
+#include "ThreadPool.h"
+
+/*!
+    Политики балансировки бинарного дерева поиска
+    Выбираются шаблонным параметром Balance
+*/
+//! Без балансировки, форма дерева зависит от порядка вставки
+struct NoBalance {};
+//! Красно-черное дерево, высота не больше 2 * log2(n + 1)
+struct RedBlackBalance {};
+//! АВЛ-дерево, высота не больше 1.44 * log2(n + 2)
+struct AvlBalance {};
+//! Декартово дерево (treap): узлы упорядочены по ключам и, как куча, по случайным
+//! приоритетам. Форма не зависит от порядка вставки, ожидаемая высота O(log n)
+//! при любом порядке ключей; вставка и удаление делают в среднем меньше двух поворотов
+struct TreapBalance {};
+
+/*!
+    Дополнительные данные в узлах дерева, выбираются параметром Augmentation
+    NodeData - база узла, countsSizes - хранит ли узел размер своего поддерева,
+    aggregates - хранит ли узел свертку значений своего поддерева
+*/
+//! Узлы без дополнительных данных
+struct NoAugmentation
+{
+    static constexpr bool countsSizes = false;
+    static constexpr bool aggregates = false;
+    struct NodeData {};
+};
+
+//! Размер поддерева в каждом узле: rank, select, countRange 
+//! и сдвиг итератора на n позиций за O(log n)
+struct SizeAugmentation
+{
+    static constexpr bool countsSizes = true;
+    static constexpr bool aggregates = false;
+    struct NodeData
+    {
+        size_t subtreeSize = 1;
+    };
+};
+
+//! Свертка значений поддерева моноидом Monoid в каждом узле: aggregate(low, high) за O(log n)
+//! Monoid - функтор с ассоциативной операцией над Monoid::value_type,
+//! нейтральным элементом Monoid::identity() и value_type, создаваемым из значения элемента
+//! Свертки обновляются вставкой, удалением и assignValue; значение, измененное
+//! через итератор, ссылку или forEach, в них не попадает
+template <typename Monoid>
+struct MonoidAugmentation
+{
+    static constexpr bool countsSizes = false;
+    static constexpr bool aggregates = true;
+    using MonoidType = Monoid;
+    struct NodeData
+    {
+        typename Monoid::value_type aggregate = Monoid::identity();
+    };
+};
+
+/*!
+    Моноиды для MonoidAugmentation
+*/
+//! Сумма
+template <typename T>
+struct SumMonoid
+{
+    using value_type = T;
+    static T identity() { return T(); }
+    T operator()(const T& left, const T& right) const { return left + right; }
+};
+
+//! Минимум
+template <typename T>
+struct MinMonoid
+{
+    using value_type = T;
+    static T identity() { return std::numeric_limits<T>::max(); }
+    T operator()(const T& left, const T& right) const { return right < left ? right : left; }
+};
+
+//! Максимум
+template <typename T>
+struct MaxMonoid
+{
+    using value_type = T;
+    static T identity() { return std::numeric_limits<T>::lowest(); }
+    T operator()(const T& left, const T& right) const { return left < right ? right : left; }
+};
+
+/*!
+    Политики статистики BinarySearchTree
+    NoStats - счетчиков нет, код учета не компилируется
+    CollectStats - поиски и вставки считают посещенные узлы и глубину спуска,
+    дерево считает созданные и уничтоженные узлы; снимок выдает stats().
+    Счетчики атомарные, поэтому константные поиски можно вести из нескольких потоков
+*/
+struct NoStats
+{
+    static constexpr bool enabled = false;
+};
+struct CollectStats
+{
+    static constexpr bool enabled = true;
+};
+
+//! Снимок счетчиков CollectStats
+struct TreeStats
+{
+    //! Корзины гистограмм глубин, в последнюю попадают все спуски глубже
+    static constexpr size_t depthBuckets = 64;
+
+    size_t finds = 0;           //!< поиски через find, contains и erase
+    size_t findVisits = 0;      //!< узлы, посещенные этими поисками
+    size_t inserts = 0;         //!< вставки со спуском от корня
+    size_t insertVisits = 0;
+    size_t maxDepth = 0;        //!< самый глубокий спуск поиска или вставки
+    size_t allocations = 0;     //!< созданные узлы
+    size_t frees = 0;           //!< уничтоженные узлы
+    //! число поисков и вставок, посетивших depth узлов
+    std::array<size_t, depthBuckets> findDepths{};
+    std::array<size_t, depthBuckets> insertDepths{};
+
+    // средняя глубина спуска; сравнений ключей у поиска на одно больше
+    double averageFindDepth() const { return finds ? double(findVisits) / double(finds) : 0.0; }
+    double averageInsertDepth() const { return inserts ? double(insertVisits) / double(inserts) : 0.0; }
+};
+
+//! Счетчики CollectStats - закрытая база BinarySearchTree, без статистики пустая и места не занимает
+template <bool Enabled>
+struct TreeStatsCounters {};
+
+template <>
+struct TreeStatsCounters<true>
+{
+    //! Число спусков каждой глубины
+    using DepthHistogram = std::array<std::atomic<size_t>, TreeStats::depthBuckets>;
+
+    struct Counters
+    {
+        std::atomic<size_t> finds{0};
+        std::atomic<size_t> findVisits{0};
+        std::atomic<size_t> inserts{0};
+        std::atomic<size_t> insertVisits{0};
+        std::atomic<size_t> maxDepth{0};
+        std::atomic<size_t> allocations{0};
+        std::atomic<size_t> frees{0};
+        DepthHistogram findDepths{};
+        DepthHistogram insertDepths{};
+    };
+
+    mutable Counters _stats;
+};
+
+/*!
+    Прозрачный компаратор (с типом Compare::is_transparent, как std::less<>)
+    позволяет искать по любому сравнимому с ключом типу K без создания Key
+*/
+template <typename Compare, typename K, typename = void>
+struct IsTransparentCompare : std::false_type {};
+
+template <typename Compare, typename K>
+struct IsTransparentCompare<Compare, K, std::void_t<typename Compare::is_transparent>> 
+: std::true_type {};
+
 /*!
     Имплементация бинарного дерева поиска
     Допускается дублирование ключей (аналог multimap)
+    Элементы с равными ключами хранятся в порядке вставки
 */
-template <typename Key, typename Value>
-class BinarySearchTree
+template <typename Key, 
+          typename Value, 
+          typename Compare = std::less<Key>, 
+          typename Balance = RedBlackBalance, 
+          typename Augmentation = NoAugmentation, 
+          typename Allocator = std::allocator<std::pair<Key, Value>>,
+          typename Stats = NoStats>
+class BinarySearchTree : private TreeStatsCounters<Stats::enabled>
 {
-    struct Node
+    using _NodeData = typename Augmentation::NodeData;
+    static constexpr bool _countsSizes = Augmentation::countsSizes;
+    static constexpr bool _aggregates = Augmentation::aggregates;
+
+    struct Node : _NodeData
     {
-        Node(Key key, 
-             Value value, 
-             Node* parent = nullptr, 
-             Node* left = nullptr, 
-             Node* right = nullptr);
+        //! пара ключ-значение создается на месте из args
+        template <typename... Args>
+        explicit Node(Node* parent, Args&&... args);
         Node* nextNode();
         Node* lastNode();
         std::pair<Key, Value> keyValuePair;
         Node* parent = nullptr;
         Node* left = nullptr;
         Node* right = nullptr;
+        //! цвет узла для RedBlackBalance, высота поддерева для AvlBalance
+        unsigned char balanceInfo = 0;
+        //! приоритет для TreapBalance, занимает выравнивание за balanceInfo
+        std::uint32_t priority = 0;
     };
 
+    // поиск по типу K, отличному от Key, доступен только с прозрачным компаратором
+    template <typename K, typename Result>
+    using _IfTransparent = std::enable_if_t<IsTransparentCompare<Compare, K>::value, Result>;
+
 public:
     //! Конструктор по умолчанию
     BinarySearchTree() = default;
+    //! Узлы размещаются в пуле, блоки которого выделяет allocator
+    explicit BinarySearchTree(const Allocator& allocator);
+    //! Ключи упорядочиваются компаратором compare
+    explicit BinarySearchTree(const Compare& compare, const Allocator& allocator = Allocator());
+    //! Построение сбалансированного дерева за O(n) из отсортированного по ключу 
+    //! диапазона пар [first, last), итераторы должны быть не слабее однонаправленных
+    template <typename ForwardIt>
+    BinarySearchTree(ForwardIt first, ForwardIt last, const Allocator& allocator = Allocator());
     
-    //! Копирование
+    //! Копирование, структура дерева повторяется без повторных вставок
     explicit BinarySearchTree(const BinarySearchTree& other);
     BinarySearchTree& operator=(const BinarySearchTree& other);
     //! Перемещение
@@ -60,10 +265,19 @@ public:
         Iterator operator--();
         Iterator operator--(int);
 
+        // сдвиг на n позиций за O(log n), только для SizeAugmentation
+        // итератор не должен быть равен end()
+        Iterator& operator+=(std::ptrdiff_t n);
+        Iterator& operator-=(std::ptrdiff_t n);
+        Iterator operator+(std::ptrdiff_t n) const;
+        Iterator operator-(std::ptrdiff_t n) const;
+
         bool operator==(const Iterator& other) const;
         bool operator!=(const Iterator& other) const;
 
     private:
+        friend class BinarySearchTree;
+
         Node* _node;
     };
 
@@ -85,33 +299,222 @@ public:
         ConstIterator operator--();
         ConstIterator operator--(int);
 
-        bool operator==(const Iterator& other) const;
-        bool operator!=(const Iterator& other) const;
+        // сдвиг на n позиций за O(log n), только для SizeAugmentation
+        // итератор не должен быть равен end()
+        ConstIterator& operator+=(std::ptrdiff_t n);
+        ConstIterator& operator-=(std::ptrdiff_t n);
+        ConstIterator operator+(std::ptrdiff_t n) const;
+        ConstIterator operator-(std::ptrdiff_t n) const;
+
+        bool operator==(const ConstIterator& other) const;
+        bool operator!=(const ConstIterator& other) const;
+
+    private:
+        const Node* _node;
+    };
+
+    /*!
+        Курсор для постраничного обхода
+
+        Помнит позицию между вызовами: очередная страница продолжает обход
+        с места остановки без спуска от корня, каждый элемент стоит амортизированно O(1).
+        seek вперед от текущей позиции поднимается только до общего предка,
+        поэтому близкий переход дешевле поиска от корня.
+        Как и итераторы, курсор действителен, пока его элемент не удален
+    */
+    class Cursor
+    {
+    public:
+        // курсор на первом элементе tree
+        explicit Cursor(const BinarySearchTree& tree);
+
+        // встать на первый элемент с ключем не меньше key
+        void seek(const Key& key);
+        // есть ли элемент под курсором
+        bool valid() const;
+        // элемент под курсором с переходом к следующему, nullptr в конце
+        const std::pair<Key, Value>* next();
+        // скопировать в buffer до n следующих элементов, вернуть их число
+        size_t nextBatch(std::pair<Key, Value>* buffer, size_t n);
 
     private:
+        const BinarySearchTree* _tree;
         const Node* _node;
     };
 
     // вставить элемент с ключем key и значением value
-    void insert(const Key& key, const Value& value);
+    // возвращает итератор на вставленный элемент
+    Iterator insert(const Key& key, const Value& value);
+    Iterator insert(Key&& key, Value&& value);
+
+    // вставить элемент, пара ключ-значение создается в узле из args
+    template <typename... Args>
+    Iterator emplace(Args&&... args);
+
+    // вставить элемент, только если элемента с ключем key еще нет,
+    // значение создается в узле из args, ключ и args не трогаются при неудаче
+    // второй элемент пары - была ли вставка
+    template <typename... Args>
+    std::pair<Iterator, bool> tryEmplace(const Key& key, Args&&... args);
+    template <typename... Args>
+    std::pair<Iterator, bool> tryEmplace(Key&& key, Args&&... args);
+
+    // вставка с подсказкой: элемент встает прямо перед hint (end() - в конец), если
+    // ключ не меньше предыдущего элемента и меньше ключа hint, так равные ключи
+    // остаются в порядке вставки. Тогда спуска от корня нет: два сравнения, проход
+    // к соседнему узлу и амортизированно O(1) поворотов. Наибольший узел хранится
+    // в дереве, поэтому добавление в конец с подсказкой end() без Augmentation
+    // у красно-черного и декартова дерева стоит амортизированно O(1); АВЛ
+    // и Augmentation по-прежнему проходят путь до корня. Неверная подсказка
+    // не ошибка: вставка идет обычным спуском
+    Iterator insert(Iterator hint, const Key& key, const Value& value);
+    Iterator insert(Iterator hint, Key&& key, Value&& value);
+    template <typename... Args>
+    std::pair<Iterator, bool> tryEmplace(Iterator hint, const Key& key, Args&&... args);
+    template <typename... Args>
+    std::pair<Iterator, bool> tryEmplace(Iterator hint, Key&& key, Args&&... args);
 
     // удалить все элементы с ключем key
     void erase(const Key& key);
+    template <typename K>
+    _IfTransparent<K, void> erase(const K& key);
+    // удалить элемент position без поиска, вернуть итератор на следующий
+    Iterator erase(Iterator position);
+
+    // заменить значение элемента position, свертки MonoidAugmentation
+    // пересчитываются на пути к корню за O(log n)
+    template <typename V>
+    void assignValue(Iterator position, V&& value);
+
+    // вставить все пары диапазона [first, last), результат как у цикла insert
+    // узлы пакета создаются подряд и сортируются; крупный пакет сливается с деревом
+    // за один проход и узлы перецепляются в сбалансированное дерево за O(n + m),
+    // небольшой вставляется по возрастанию ключей, соседние спуски идут по горячим узлам
+    // при исключении дерево не меняется
+    template <typename ForwardIt>
+    void insertBatch(ForwardIt first, ForwardIt last);
+    // удалить все элементы с ключами из диапазона [first, last), стратегия та же
+    template <typename ForwardIt>
+    void eraseBatch(ForwardIt first, ForwardIt last);
+
+    // разрезание и склейка сбалансированных деревьев без копирования узлов,
+    // недоступны для NoBalance; деревья после них совместно владеют блоками пулов
+    // перенести в greater элементы с ключами не меньше key за O(log n),
+    // прежнее содержимое greater удаляется; размеры частей находятся за O(1)
+    // с SizeAugmentation, иначе одновременным обходом обеих частей до конца меньшей
+    void split(const Key& key, BinarySearchTree& greater);
+    // присоединить элементы greater, ключи которых не меньше ключей этого дерева,
+    // за O(разности высот), greater становится пустым
+    void join(BinarySearchTree& greater);
+
+    // операции над множествами для деревьев без повторов ключей
+    // дерево режется split по ключу корня other, половины рекурсивно объединяются
+    // с поддеревьями other и склеиваются join: O(m log(n / m + 1)) для m <= n
+    // вместо O(m log n) у цикла find; крупные ветви рекурсии выполняются
+    // параллельно в ThreadPool::global(), компаратор не должен бросать исключений
+    // если одно из деревьев намного меньше, его элементы ищутся в другом по одному
+    // добавить элементы other с ключами, которых нет в дереве, для общих ключей
+    // остаются значения этого дерева
+    void unite(const BinarySearchTree& other);
+    // то же, узлы other переходят в дерево без копирования, other становится пустым
+    void unite(BinarySearchTree&& other);
+    // оставить только элементы с ключами из other
+    void intersect(const BinarySearchTree& other);
+    // удалить элементы с ключами из other
+    void difference(const BinarySearchTree& other);
+
+    // параллельные обходы всех элементов или элементов с ключами из [low, high)
+    // дерево делится по поддеревьям: по их размерам с SizeAugmentation, иначе по глубине;
+    // поддеревья обрабатываются в ThreadPool::global() одновременно, поэтому функции
+    // должны допускать вызов из нескольких потоков, а дерево не должно меняться
+    // вызвать function(pair) для каждого элемента, порядок вызовов не определен
+    template <typename Function>
+    void forEach(Function function);
+    template <typename Function>
+    void forEach(const Key& low, const Key& high, Function function);
+    // свернуть transform(pair) элементов ассоциативной функцией reduce в порядке ключей,
+    // init входит в свертку один раз первым
+    template <typename T, typename Reduce, typename Transform>
+    T transformReduce(T init, Reduce reduce, Transform transform) const;
+    template <typename T, typename Reduce, typename Transform>
+    T transformReduce(const Key& low, const Key& high, T init, Reduce reduce, Transform transform) const;
+    // свернуть значения элементов
+    template <typename T, typename Reduce>
+    T reduce(T init, Reduce reduce) const;
+    template <typename T, typename Reduce>
+    T reduce(const Key& low, const Key& high, T init, Reduce reduce) const;
 
     // найти первый элемент в дереве, равный ключу key
     ConstIterator find(const Key& key) const;
     Iterator find(const Key& key);
+    template <typename K>
+    _IfTransparent<K, ConstIterator> find(const K& key) const;
+    template <typename K>
+    _IfTransparent<K, Iterator> find(const K& key);
+
+    // найти элементы для всех ключей диапазона [first, last), результаты пишутся в out по порядку
+    // спуски группы ключей идут попеременно с предвыборкой следующих узлов,
+    // поэтому промахи кэша разных спусков перекрываются
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out);
+    // то же, в out пишется bool - есть ли элемент с таким ключем
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+
+    // первый элемент с ключем не меньше key, один спуск от корня
+    Iterator lowerBound(const Key& key);
+    ConstIterator lowerBound(const Key& key) const;
+    template <typename K>
+    _IfTransparent<K, Iterator> lowerBound(const K& key);
+    template <typename K>
+    _IfTransparent<K, ConstIterator> lowerBound(const K& key) const;
+
+    // первый элемент с ключем больше key, один спуск от корня
+    Iterator upperBound(const Key& key);
+    ConstIterator upperBound(const Key& key) const;
+    template <typename K>
+    _IfTransparent<K, Iterator> upperBound(const K& key);
+    template <typename K>
+    _IfTransparent<K, ConstIterator> upperBound(const K& key) const;
 
-    // найти все элементы, у которых ключ равен key
+    // порядковые статистики, доступны только с SizeAugmentation, все за O(log n)
+    // число элементов с ключем меньше key
+    size_t rank(const Key& key) const;
+    template <typename K>
+    _IfTransparent<K, size_t> rank(const K& key) const;
+    // k-й по порядку элемент (с нуля), end() при k >= size()
+    Iterator select(size_t k);
+    ConstIterator select(size_t k) const;
+    // число элементов с ключем из полуинтервала [low, high)
+    size_t countRange(const Key& low, const Key& high) const;
+    template <typename K>
+    _IfTransparent<K, size_t> countRange(const K& low, const K& high) const;
+
+    // свертки значений, доступны только с MonoidAugmentation
+    // свертка всех значений за O(1)
+    template <typename A = Augmentation>
+    typename A::MonoidType::value_type aggregate() const;
+    // свертка значений элементов с ключами из [low, high) в порядке ключей за O(log n)
+    template <typename A = Augmentation>
+    typename A::MonoidType::value_type aggregate(const Key& low, const Key& high) const;
+
+    // найти все элементы, у которых ключ равен key, за O(log n)
     // первый итератор пары - первый элемент в дереве, равный key
     // второй итератор пары - первый элемент в дереве больший, чем key
     // [pair.first, pair.second) - полуинтервал, содержащий все элементы с ключем key
     std::pair<Iterator, Iterator> equalRange(const Key& key);
     std::pair<ConstIterator, ConstIterator> equalRange(const Key& key) const;
+    template <typename K>
+    _IfTransparent<K, std::pair<Iterator, Iterator>> equalRange(const K& key);
+    template <typename K>
+    _IfTransparent<K, std::pair<ConstIterator, ConstIterator>> equalRange(const K& key) const;
 
-    // получить итератор на минимальное значение в дереве
+    // элемент с минимальным значением среди элементов с ключем key, cend() если их нет
+    // свертка диапазона равных ключей, большие диапазоны сворачиваются параллельно
     ConstIterator min(const Key& key) const;
-    // получить итератор на максимальное значение в дереве
+    // элемент с максимальным значением среди элементов с ключем key
     ConstIterator max(const Key& key) const;
 
     Iterator begin();
@@ -121,28 +524,285 @@ public:
     ConstIterator cend() const;
 
     size_t size() const;
+
+    Compare keyComp() const;
+
+    // высота - число узлов на самом длинном пути от корня, 0 у пустого дерева
+    // за O(1) для AvlBalance и обходом за O(n) для остальных деревьев
+    size_t height() const;
+
+    // снимок счетчиков, доступен только с CollectStats
+    TreeStats stats() const;
+    // обнулить счетчики
+    void resetStats();
+
+    // удалить все элементы, память пула возвращается аллокатору
+    void clear();
+
+    // заменить содержимое элементами отсортированного по ключу диапазона [first, last)
+    // дерево строится за O(n) и сразу сбалансировано
+    template <typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+
+    // записать элементы в файл path массивом пар в порядке ключей (формат MappedHeader),
+    // только для тривиально копируемых Key и Value; прежний файл заменяется целиком
+    void save(const std::string& path) const;
+    // открыть файл save только для чтения: find, equalRange и обход идут прямо
+    // по отображению файла в память, элементы не загружаются
+    // отображение использует POSIX mmap, вызывающий код подключает MappedFile.h
+    static MappedMap<Key, Value, Compare> openMapped(const std::string& path, const Compare& compare = Compare());
+
+    void swap(BinarySearchTree& other) noexcept;
 private:
+    static constexpr unsigned char _red = 0;
+    static constexpr unsigned char _black = 1;
+    //! Число одновременных спусков в findBatch
+    static constexpr size_t _batchWidth = 16;
+    //! Пакет от size() / _rebuildRatio элементов выгоднее слить с деревом, чем вставлять по одному
+    static constexpr size_t _rebuildRatio = 8;
+    //! Ветви операций над множествами выполняются параллельно, начиная с поддеревьев
+    //! такого ранга other: примерно тысяча узлов и больше
+    static constexpr unsigned char _parallelRank = std::is_same_v<Balance, AvlBalance> ? 14 : 10;
+    static constexpr bool _isTreap = std::is_same_v<Balance, TreapBalance>;
+    //! Поддерево меньше _parallelGrain элементов обходится одним потоком
+    static constexpr size_t _parallelGrain = 4096;
+    //! Множество в _algebraRatio раз меньше другого выгоднее обработать циклом поиска:
+    //! у split и join константа заметно больше, чем у одного спуска
+    static constexpr size_t _algebraRatio = 64;
+
+    using _DepthHistogram = typename TreeStatsCounters<true>::DepthHistogram;
+
+    //! Поддерево для split и join: корень и ранг - высота для АВЛ или черная высота
+    //! (число черных узлов на пути от корня до листа) для красно-черного дерева;
+    //! для декартова дерева ранг - оценка log2 размера, нужна только для _fork
+    struct _Subtree
+    {
+        Node* root = nullptr;
+        unsigned char rank = 0;
+    };
+    //! Результат _split: ключи меньше key, узел с ключем key, остальные
+    struct _SplitResult
+    {
+        _Subtree less;
+        Node* equal = nullptr;
+        _Subtree greater;
+    };
+    //! Удаленные операциями над множествами поддеревья, связанные через parent корней
+    struct _Garbage
+    {
+        Node* head = nullptr;
+        Node* tail = nullptr;
+    };
+
     void _shiftNodes(Node* node1, Node* node2);
-    Node* _findNode(const Key& key) const;
-    void _recursiveDelete(Node* node);
+    // первый узел с ключем, равным key, на каждом шаге спуска одно сравнение
+    template <typename K>
+    Node* _findNode(const K& key) const;
+    template <typename K>
+    Node* _lowerBound(const K& key) const;
+    // то же, visits - число посещенных узлов
+    template <typename K>
+    Node* _lowerBound(const K& key, size_t& visits) const;
+    template <typename K>
+    Node* _upperBound(const K& key) const;
+    // _lowerBound для группы ключей сразу, visit(key, node) вызывается для ключей по порядку
+    template <typename ForwardIt, typename Visit>
+    void _lowerBoundBatch(ForwardIt first, ForwardIt last, Visit visit) const;
+    static void _prefetch(const Node* node);
+    // первый узел с ключем key и первый узел с большим ключем
+    template <typename K>
+    std::pair<Node*, Node*> _equalRangeNodes(const K& key) const;
+    template <typename K>
+    void _eraseKey(const K& key);
+    void _eraseNode(Node* node);
+    // создать и уничтожить узел с учетом в статистике
+    template <typename... Args>
+    Node* _createNode(Node* parent, Args&&... args);
+    void _destroyNode(Node* node);
+    // учесть спуск поиска или вставки через visits узлов
+    void _recordFind(size_t visits) const;
+    void _recordInsert(size_t visits) const;
+    void _recordFrees(size_t count) const;
+    static void _recordDepth(std::atomic<size_t>& maxDepth, _DepthHistogram& histogram, size_t visits);
+    // найти место для созданного узла node и вставить его
+    Iterator _insertNode(Node* node);
+    // прикрепить узел node к parent слева или справа и восстановить баланс
+    void _linkNode(Node* node, Node* parent, bool toLeft);
+    template <typename KeyArg, typename... Args>
+    std::pair<Iterator, bool> _tryEmplace(KeyArg&& key, Args&&... args);
+    // место нового узла с ключем key прямо перед hint (nullptr - конец дерева):
+    // родитель и сторона, previous - элемент перед hint
+    // false, если key не лежит между previous и hint
+    bool _hintPosition(Node* hint, const Key& key, Node*& previous, Node*& parent, bool& toLeft) const;
+    // вставка с подсказкой, unique - как tryEmplace, иначе как insert
+    template <typename KeyArg, typename... Args>
+    std::pair<Iterator, bool> _emplaceHint(Node* hint, bool unique, KeyArg&& key, Args&&... args);
+    // удалить поддерево с корнем node без рекурсии и дополнительной памяти
+    // возвращает число удаленных узлов
+    size_t _deleteSubtree(Node* node);
+    // собрать дерево из count узлов, которые nextNode() выдает по возрастанию ключей
+    template <typename NextNode>
+    void _rebuild(NextNode nextNode, size_t count);
+    // построить идеально сбалансированное поддерево из count узлов,
+    // узлы на глубине redDepth красятся в красный, приоритеты убывают с глубиной
+    template <typename NextNode>
+    Node* _buildBalanced(NextNode& nextNode, size_t count, size_t depth, size_t redDepth);
+    // все узлы дерева по возрастанию ключей
+    std::vector<Node*> _inorderNodes() const;
+    // создать копию узла node с тем же цветом, высотой или приоритетом
+    Node* _cloneNode(const Node* node, Node* parent);
+
+    // повороты поддерева, node опускается на уровень вниз
+    // _root не меняется, поэтому повороты работают и в отрезанных поддеревьях
+    void _rotateLeft(Node* node);
+    void _rotateRight(Node* node);
+    // поставить replacement на место node у родителя node
+    static void _replaceChild(Node* node, Node* replacement);
+    // поднять _root до настоящего корня после поворотов
+    void _refreshRoot();
+    // найти _rightmost спуском по правому краю после замены корня
+    // повороты порядок узлов не меняют, поэтому _rightmost после них верен
+    void _resetRightmost();
+    // пересчитать служебные данные узла по его детям
+    void _updateNode(Node* node);
+    // восстановить баланс после вставки узла node
+    void _rebalanceAfterInsert(Node* node);
+    // красно-черное: устранить два красных узла подряд, поднимаясь от красного node
+    // до корня поддерева; true, если корень поддерева пришлось перекрасить в черный
+    bool _fixRedRed(Node* node);
+    // восстановить баланс после удаления, child - узел, занявший место удаленного,
+    // parent - его родитель (child может быть nullptr)
+    void _rebalanceAfterErase(Node* child, Node* parent, bool removedBlack);
+    // АВЛ: подняться от node к корню, обновляя высоты и выполняя повороты
+    void _avlRetrace(Node* node);
+    // декартово дерево: случайный приоритет нового узла
+    static std::uint32_t _randomPriority();
+    // декартово дерево: склейка по приоритетам, корень результата - узел
+    // с наибольшим приоритетом среди left, middle и right
+    Node* _treapJoin(Node* left, Node* middle, Node* right);
+
+    // пересчитать служебные данные от node до корня
+    void _updatePath(Node* node);
+
+    // все дерево как поддерево и обратная замена корня
+    _Subtree _wholeTree() const;
+    void _assignRoot(_Subtree tree);
+    // поддерево ребенка child корня tree
+    static _Subtree _childSubtree(_Subtree tree, Node* child);
+    // склеить left, узел middle и right, ключи которых идут по возрастанию
+    _Subtree _join(_Subtree left, Node* middle, _Subtree right);
+    // прицепить middle и низкое дерево low к краю высокого дерева tall
+    _Subtree _joinSide(_Subtree tall, Node* middle, _Subtree low, bool tallIsLeft);
+    // склеить без среднего узла
+    _Subtree _join2(_Subtree left, _Subtree right);
+    // отрезать последний по порядку узел
+    std::pair<_Subtree, Node*> _splitLast(_Subtree tree);
+    // разрезать tree по key; при takeEqual узел с ключем key возвращается отдельно,
+    // иначе попадает в greater
+    _SplitResult _split(_Subtree tree, const Key& key, bool takeEqual);
+    // число элементов дерева first при разбиении total элементов на first и second
+    static size_t _partSize(Node* first, Node* second, size_t total);
+
+    // рекурсия операций над множествами: mine - поддерево этого дерева,
+    // theirs - поддерево other, удаленные узлы собираются в garbage
+    _Subtree _uniteSubtrees(_Subtree mine, _Subtree theirs, _Garbage& garbage);
+    _Subtree _intersectSubtrees(_Subtree mine, _Subtree theirs, _Garbage& garbage);
+    _Subtree _differenceSubtrees(_Subtree mine, _Subtree theirs, _Garbage& garbage);
+    // выполнить left и right, параллельно, если ветвь достаточно велика
+    template <typename Left, typename Right>
+    static void _fork(_Subtree theirs, Left&& left, Right&& right);
+    static void _discard(_Garbage& garbage, Node* root);
+
+    // стоит ли отдать поддерево node на глубине depth отдельной задаче
+    bool _worthForking(const Node* node, size_t depth) const;
+    // свертка transform(node) по узлам поддерева в порядке ключей, nullopt для пустого
+    template <typename T, typename Reduce, typename Transform>
+    std::optional<T> _reduceSubtree(Node* node, size_t depth, const Reduce& reduce, const Transform& transform) const;
+    // то же для узлов, у которых aboveLow(node) и belowHigh(node);
+    // checkLow и checkHigh - нужно ли проверять границы внутри поддерева
+    template <typename T, typename Reduce, typename Transform, typename AboveLow, typename BelowHigh>
+    std::optional<T> _reduceRange(Node* node, size_t depth, bool checkLow, bool checkHigh,
+                                  const Reduce& reduce, const Transform& transform,
+                                  const AboveLow& aboveLow, const BelowHigh& belowHigh) const;
+    template <typename T, typename Reduce>
+    static std::optional<T> _combine(const Reduce& reduce, std::optional<T> left, std::optional<T> right);
+    static void _appendGarbage(_Garbage& garbage, _Garbage& other);
+    // уничтожить собранные узлы, возвращает их число
+    size_t _destroyGarbage(_Garbage& garbage);
+    template <typename K>
+    size_t _rank(const K& key) const;
+    static size_t _subtreeSize(const Node* node);
+    // свертка поддерева node, нейтральный элемент для пустого
+    template <typename A = Augmentation>
+    static typename A::MonoidType::value_type _aggregateOf(const Node* node);
+    static Node* _select(Node* root, size_t k);
+    // узел на n позиций дальше node, nullptr если это позиция end()
+    static Node* _advance(Node* node, std::ptrdiff_t n);
+
+    static bool _isRed(const Node* node);
+    static unsigned char _height(const Node* node);
+
+    using _NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+
     size_t _size = 0;
     Node* _root = nullptr; //!< корневой узел дерева
+    Node* _rightmost = nullptr; //!< узел с наибольшим ключом, с него начинается подсказка end()
+    Compare _compare;
+    NodePool<Node, _NodeAllocator> _pool; //!< хранилище узлов
 };
 
 
 /*!
     Имплементация словаря
     Не допускается дублирование ключей (аналог std::map)
+    Engine - дерево, в котором хранятся элементы: BinarySearchTree с любой
+    политикой балансировки (например, декартово дерево TreapBalance),
+    BPlusTree из BPlusTree.h или CompactTree из CompactTree.h с тем же компаратором
 */
-template <typename Key, typename Value>
+template <typename Key,
+          typename Value,
+          typename Compare = std::less<Key>,
+          typename Engine = BinarySearchTree<Key, Value, Compare>>
 class Map
 {
-    BinarySearchTree<Key, Value> _tree;
+    template <typename, typename, typename>
+    friend class Set;
+
+    Engine _tree;
+
+    template <typename K, typename Result>
+    using _IfTransparent = std::enable_if_t<IsTransparentCompare<Compare, K>::value, Result>;
+
+    // представляет диапазон пар как диапазон их ключей для findBatch
+    template <typename ForwardIt>
+    class _KeyIterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Key;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Key*;
+        using reference = const Key&;
+
+        explicit _KeyIterator(ForwardIt it);
+
+        reference operator*() const;
+        _KeyIterator& operator++();
+
+        bool operator==(const _KeyIterator& other) const;
+        bool operator!=(const _KeyIterator& other) const;
+
+    private:
+        ForwardIt _it;
+    };
 public:
-    using MapIterator = typename BinarySearchTree<Key, Value>::Iterator;
-    using ConstMapIterator = typename BinarySearchTree<Key, Value>::ConstIterator;
+    using MapIterator = typename Engine::Iterator;
+    using ConstMapIterator = typename Engine::ConstIterator;
 
     Map() = default;
+    //! Построение за O(n) из диапазона пар, отсортированного по ключу без повторов
+    template <typename ForwardIt>
+    Map(ForwardIt first, ForwardIt last);
     
     explicit Map(const Map& other);
     Map& operator=(const Map& other);
@@ -154,20 +814,121 @@ public:
 
     // вставить элемент с ключем key и значением value
     // если узел с ключем key уже представлен, то заменить его значение на value
-    void insert(const Key& key, const Value& value);
+    // второй элемент пары - был ли добавлен новый элемент
+    std::pair<MapIterator, bool> insert(const Key& key, const Value& value);
+    std::pair<MapIterator, bool> insert(Key&& key, Value&& value);
+
+    // то же, что insert, но значение передается любым типом, присваиваемым Value
+    template <typename V>
+    std::pair<MapIterator, bool> insertOrAssign(const Key& key, V&& value);
+    template <typename V>
+    std::pair<MapIterator, bool> insertOrAssign(Key&& key, V&& value);
+
+    // вставить элемент, только если ключа key еще нет, значение создается из args
+    // при неудаче key и args не перемещаются, существующее значение не меняется
+    template <typename... Args>
+    std::pair<MapIterator, bool> tryEmplace(const Key& key, Args&&... args);
+    template <typename... Args>
+    std::pair<MapIterator, bool> tryEmplace(Key&& key, Args&&... args);
+
+    // вставка с подсказкой BinarySearchTree: элемент встает перед hint без спуска
+    // от корня, если ключ туда подходит; значение существующего ключа заменяется
+    MapIterator insert(MapIterator hint, const Key& key, const Value& value);
+    MapIterator insert(MapIterator hint, Key&& key, Value&& value);
 
     // удалить элемент с ключем key
     void erase(const Key& key);
+    template <typename K>
+    _IfTransparent<K, void> erase(const K& key);
+    // удалить элемент position без поиска, вернуть итератор на следующий
+    MapIterator erase(MapIterator position);
+
+    // курсор BinarySearchTree для постраничного обхода, встает на первый элемент
+    template <typename E = Engine>
+    typename E::Cursor cursor() const;
+
+    // вставить пары диапазона [first, last), результат как у цикла insert:
+    // значения существующих ключей заменяются, из повторов пакета остается последний
+    // найденные ключи ищутся одним findBatch, новые передаются движку одним insertBatch
+    template <typename ForwardIt>
+    void insertBatch(ForwardIt first, ForwardIt last);
+    // удалить элементы с ключами из диапазона [first, last)
+    template <typename ForwardIt>
+    void eraseBatch(ForwardIt first, ForwardIt last);
+
+    // операции над множествами ключей через split и join сбалансированного
+    // BinarySearchTree, O(m log(n / m + 1)), крупные ветви параллельно
+    // добавить элементы other с новыми ключами, значения общих ключей не меняются
+    void unite(const Map& other);
+    // то же, элементы other переносятся без копирования
+    void unite(Map&& other);
+    // оставить элементы с ключами из other
+    void intersect(const Map& other);
+    // удалить элементы с ключами из other
+    void difference(const Map& other);
+
+    // параллельные обходы BinarySearchTree, функции вызываются из нескольких потоков
+    // вызвать function(pair) для всех элементов или для ключей из [low, high)
+    template <typename Function>
+    void forEach(Function function);
+    template <typename Function>
+    void forEach(const Key& low, const Key& high, Function function);
+    // свернуть transform(pair) ассоциативной функцией reduce в порядке ключей
+    template <typename T, typename Reduce, typename Transform>
+    T transformReduce(T init, Reduce reduce, Transform transform) const;
+    template <typename T, typename Reduce, typename Transform>
+    T transformReduce(const Key& low, const Key& high, T init, Reduce reduce, Transform transform) const;
+    // свернуть значения
+    template <typename T, typename Reduce>
+    T reduce(T init, Reduce reduce) const;
+    template <typename T, typename Reduce>
+    T reduce(const Key& low, const Key& high, T init, Reduce reduce) const;
+
+    // заменить содержимое диапазоном пар, отсортированным по ключу без повторов
+    template <typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
 
     // найти элемент, равный ключу key
+    // ключи других типов принимаются при прозрачном компараторе
     ConstMapIterator find(const Key& key) const;
     MapIterator find(const Key& key);
+    template <typename K>
+    _IfTransparent<K, ConstMapIterator> find(const K& key) const;
+    template <typename K>
+    _IfTransparent<K, MapIterator> find(const K& key);
+
+    // найти элементы для всех ключей [first, last) за один проход по дереву,
+    // результаты пишутся в out в порядке ключей
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out);
+    // в out пишется bool для каждого ключа
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+
+    // первый элемент с ключем не меньше key
+    ConstMapIterator lowerBound(const Key& key) const;
+    MapIterator lowerBound(const Key& key);
+    template <typename K>
+    _IfTransparent<K, ConstMapIterator> lowerBound(const K& key) const;
+    template <typename K>
+    _IfTransparent<K, MapIterator> lowerBound(const K& key);
+
+    // первый элемент с ключем больше key
+    ConstMapIterator upperBound(const Key& key) const;
+    MapIterator upperBound(const Key& key);
+    template <typename K>
+    _IfTransparent<K, ConstMapIterator> upperBound(const K& key) const;
+    template <typename K>
+    _IfTransparent<K, MapIterator> upperBound(const K& key);
 
     // доступ к элементу по ключу
     // если в момент обращения элемента не существует, создать его, 
     // ключ равен key, value равно дефолтному значению для типа Value
     const Value& operator[](const Key& key) const;
     Value& operator[](const Key& key);
+    Value& operator[](Key&& key);
 
     MapIterator begin();
     MapIterator end();
@@ -176,23 +937,68 @@ public:
     ConstMapIterator cend() const;
 
     size_t size() const;
+
+    Compare keyComp() const;
+
+    // записать элементы в файл path, как BinarySearchTree::save, с любым Engine
+    void save(const std::string& path) const;
+    // открыть файл save только для чтения без загрузки элементов, нужен MappedFile.h
+    static MappedMap<Key, Value, Compare> openMapped(const std::string& path, const Compare& compare = Compare());
+
+private:
+    // пары диапазона [first, last) уже упорядочены, без повторов и отсутствуют в словаре:
+    // передаются движку без сортировки и findBatch, для Set::insertBatch
+    template <typename ForwardIt>
+    void _insertAbsent(ForwardIt first, ForwardIt last);
 };
 
 
 /*!
     Имплементация множества
     Не допускается дублирование ключей (аналог std::set)
+    Engine - дерево, хранящее пары (value, value), как у Map
 */
-template <typename Value>
+template <typename Value,
+          typename Compare = std::less<Value>,
+          typename Engine = BinarySearchTree<Value, Value, Compare>>
 class Set
 {
-    Map<Value, Value> _map;
+    Map<Value, Value, Compare, Engine> _map;
+
+    template <typename K, typename Result>
+    using _IfTransparent = std::enable_if_t<IsTransparentCompare<Compare, K>::value, Result>;
+
+    // представляет диапазон значений как диапазон пар (value, value) для Map
+    template <typename ForwardIt>
+    class _PairIterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<Value, Value>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = std::pair<const Value&, const Value&>;
+
+        explicit _PairIterator(ForwardIt it);
+
+        reference operator*() const;
+        _PairIterator& operator++();
+
+        bool operator==(const _PairIterator& other) const;
+        bool operator!=(const _PairIterator& other) const;
+
+    private:
+        ForwardIt _it;
+    };
 
 public:
-    using SetIterator = typename Map<Value, Value>::MapIterator;
-    using ConstSetIterator = typename Map<Value, Value>::ConstMapIterator;
+    using SetIterator = typename Map<Value, Value, Compare, Engine>::MapIterator;
+    using ConstSetIterator = typename Map<Value, Value, Compare, Engine>::ConstMapIterator;
 
     Set() = default;
+    //! Построение за O(n) из отсортированного диапазона значений без повторов
+    template <typename ForwardIt>
+    Set(ForwardIt first, ForwardIt last);
 
     explicit Set(const Set& other);
     Set& operator=(const Set& other);
@@ -202,38 +1008,139 @@ public:
 
     ~Set() = default;
 
-    void insert(const Value& value);
+    // вставить значение, если его еще нет
+    // второй элемент пары - была ли вставка
+    std::pair<SetIterator, bool> insert(const Value& value);
+    std::pair<SetIterator, bool> insert(Value&& value);
+    // вставка с подсказкой, как у Map: значение встает перед hint без спуска от корня
+    SetIterator insert(SetIterator hint, const Value& value);
 
     void erase(const Value& value);
+    template <typename K>
+    _IfTransparent<K, void> erase(const K& value);
+    // удалить элемент position, вернуть итератор на следующий
+    SetIterator erase(SetIterator position);
+
+    // вставить значения диапазона [first, last), которых еще нет, как цикл insert
+    template <typename ForwardIt>
+    void insertBatch(ForwardIt first, ForwardIt last);
+    // удалить значения диапазона [first, last)
+    template <typename ForwardIt>
+    void eraseBatch(ForwardIt first, ForwardIt last);
+
+    // объединение, пересечение и разность с other, как у Map
+    void unite(const Set& other);
+    void unite(Set&& other);
+    void intersect(const Set& other);
+    void difference(const Set& other);
+
+    // параллельные обходы, как у Map: function(value) и transform(value)
+    template <typename Function>
+    void forEach(Function function) const;
+    template <typename Function>
+    void forEach(const Value& low, const Value& high, Function function) const;
+    template <typename T, typename Reduce, typename Transform>
+    T transformReduce(T init, Reduce reduce, Transform transform) const;
+    template <typename T, typename Reduce, typename Transform>
+    T transformReduce(const Value& low, const Value& high, T init, Reduce reduce, Transform transform) const;
+    template <typename T, typename Reduce>
+    T reduce(T init, Reduce reduce) const;
+    template <typename T, typename Reduce>
+    T reduce(const Value& low, const Value& high, T init, Reduce reduce) const;
+
+    // заменить содержимое отсортированным диапазоном значений без повторов
+    template <typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
 
     ConstSetIterator find(const Value& value) const;
     SetIterator find(const Value& key);
+    template <typename K>
+    _IfTransparent<K, ConstSetIterator> find(const K& value) const;
+    template <typename K>
+    _IfTransparent<K, SetIterator> find(const K& value);
+
+    // поиск группы значений за один проход, результаты пишутся в out по порядку
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out);
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+
+    // первый элемент не меньше value
+    ConstSetIterator lowerBound(const Value& value) const;
+    SetIterator lowerBound(const Value& value);
+    template <typename K>
+    _IfTransparent<K, ConstSetIterator> lowerBound(const K& value) const;
+    template <typename K>
+    _IfTransparent<K, SetIterator> lowerBound(const K& value);
+
+    // первый элемент больше value
+    ConstSetIterator upperBound(const Value& value) const;
+    SetIterator upperBound(const Value& value);
+    template <typename K>
+    _IfTransparent<K, ConstSetIterator> upperBound(const K& value) const;
+    template <typename K>
+    _IfTransparent<K, SetIterator> upperBound(const K& value);
+
+    SetIterator begin();
+    SetIterator end();
+
+    ConstSetIterator cbegin() const;
+    ConstSetIterator cend() const;
+
+    size_t size() const;
 
     bool contains(const Value& value) const;
+
+    // записать значения в файл path без пар, только для тривиально копируемых Value
+    void save(const std::string& path) const;
+    // открыть файл save только для чтения без загрузки значений, нужен MappedFile.h
+    static MappedSet<Value, Compare> openMapped(const std::string& path, const Compare& compare = Compare());
 };
 
 //BST
 
 //Node
-template <typename Key, typename Value>
-BinarySearchTree<Key, Value>::Node::Node
-(Key key, Value value, Node* parent, Node* left, Node* right) 
-:keyValuePair(key, value), parent(parent), left(left), right(right) {}
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename... Args>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node::Node(Node* parent, Args&&... args) 
+:keyValuePair(std::forward<Args>(args)...), parent(parent) {}
 
-template <typename Key, typename Value>
-void BinarySearchTree<Key, Value>::_recursiveDelete(Node* node) {
-    if (node->left) {
-        _recursiveDelete(node->left);
-    }
-    if (node->right) {
-        _recursiveDelete(node->right);
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+size_t BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_deleteSubtree(Node* node) {
+    // обход в обратном порядке по ссылкам на родителя:
+    // спускаемся до листа, удаляем его и поднимаемся к родителю
+    Node* stop = node ? node->parent : nullptr;
+    size_t count = 0;
+    while (node != stop) {
+        if (node->left) {
+            node = node->left;
+        }
+        else if (node->right) {
+            node = node->right;
+        }
+        else {
+            Node* parent = node->parent;
+            if (parent) {
+                if (parent->left == node) {
+                    parent->left = nullptr;
+                }
+                else {
+                    parent->right = nullptr;
+                }
+            }
+            _destroyNode(node);
+            count++;
+            node = parent;
+        }
     }
-    delete node;
+    return count;
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::Node* 
-BinarySearchTree<Key, Value>::Node::nextNode() {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node* 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node::nextNode() {
     auto node = this;
     if (!node) {
         return node;
@@ -253,9 +1160,9 @@ BinarySearchTree<Key, Value>::Node::nextNode() {
     return node;
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::Node* 
-BinarySearchTree<Key, Value>::Node::lastNode() {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node* 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node::lastNode() {
     auto node = this;
     if (!node) {
         return node;
@@ -276,529 +1183,3196 @@ BinarySearchTree<Key, Value>::Node::lastNode() {
 }
 
 //BigFive
-template <typename Key, typename Value>
-BinarySearchTree<Key, Value>::BinarySearchTree(const BinarySearchTree& other) {
-    for (auto&& [key, value] : other) {
-        insert(key, value);
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::BinarySearchTree(const Allocator& allocator)
+: _pool(_NodeAllocator(allocator)) {}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::BinarySearchTree(const Compare& compare, const Allocator& allocator)
+: _compare(compare), _pool(_NodeAllocator(allocator)) {}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename ForwardIt>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::BinarySearchTree
+(ForwardIt first, ForwardIt last, const Allocator& allocator) 
+: _pool(_NodeAllocator(allocator)) {
+    assign(first, last);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::BinarySearchTree(const BinarySearchTree& other) 
+: _compare(other._compare), _pool(other._pool.allocator()) {
+    if (!other._root) {
+        return;
+    }
+    // обход по ссылкам на родителя, копия строится синхронно с оригиналом
+    try {
+        _root = _cloneNode(other._root, nullptr);
+        const Node* source = other._root;
+        Node* copy = _root;
+        while (source) {
+            if (source->left && !copy->left) {
+                copy->left = _cloneNode(source->left, copy);
+                source = source->left;
+                copy = copy->left;
+            }
+            else if (source->right && !copy->right) {
+                copy->right = _cloneNode(source->right, copy);
+                source = source->right;
+                copy = copy->right;
+            }
+            else {
+                source = source->parent;
+                copy = copy->parent;
+            }
+        }
     }
+    catch (...) {
+        clear();
+        throw;
+    }
+    _size = other._size;
+    _resetRightmost();
 }
 
-template <typename Key, typename Value>
-BinarySearchTree<Key, Value>& 
-BinarySearchTree<Key, Value>::operator=(const BinarySearchTree& other) {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>& 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::operator=(const BinarySearchTree& other) {
     if (&other != this) {
-        _recursiveDelete(_root);
-        BinarySearchTree<Key, Value>* tmp = new BinarySearchTree<Key, Value>(other);
-        this = tmp;
+        BinarySearchTree copy(other);
+        swap(copy);
     }
     return *this;
 }
 
-template <typename Key, typename Value>
-BinarySearchTree<Key, Value>::BinarySearchTree(BinarySearchTree&& other) noexcept {
-    _root = std::move(other._root);
-    _size = std::move(other._size);
-}
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::BinarySearchTree(BinarySearchTree&& other) noexcept 
+: _size(std::exchange(other._size, 0)), 
+  _root(std::exchange(other._root, nullptr)), 
+  _rightmost(std::exchange(other._rightmost, nullptr)),
+  _compare(other._compare),
+  _pool(std::move(other._pool)) {}
 
-template <typename Key, typename Value>
-BinarySearchTree<Key, Value>&
-BinarySearchTree<Key, Value>::operator=(BinarySearchTree&& other) noexcept {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>&
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::operator=(BinarySearchTree&& other) noexcept {
     if (&other != this) {
-        _recursiveDelete(_root);
-        this = std::move(other);
+        clear();
+        swap(other);
     }
-    return this;
+    return *this;
 }
 
-template <typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()  {
-    _recursiveDelete(_root);
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::~BinarySearchTree()  {
+    clear();
 }
 
 
 //Iterator
-template <typename Key, typename Value>
-BinarySearchTree<Key, Value>::Iterator::Iterator(Node* node) 
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::Iterator(Node* node) 
 : _node(node) {}
 
-template <typename Key, typename Value>
-std::pair<Key, Value>& BinarySearchTree<Key, Value>::Iterator::operator*() {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+std::pair<Key, Value>& BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator*() {
     return _node->keyValuePair;
 }
 
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
 const std::pair<Key, Value>& 
-BinarySearchTree<Key, Value>::Iterator::operator*() const {
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator*() const {
     return _node->keyValuePair;
 }
 
-template <typename Key, typename Value>
-std::pair<Key, Value>* BinarySearchTree<Key, Value>::Iterator::operator->() {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+std::pair<Key, Value>* BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator->() {
     return &_node->keyValuePair;
 }
 
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
 const std::pair<Key, Value>*
-BinarySearchTree<Key, Value>::Iterator::operator->() const {
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator->() const {
     return &_node->keyValuePair;
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::Iterator
-BinarySearchTree<Key, Value>::Iterator::operator++() {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator++() {
     _node = _node->nextNode();
     return *this;
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::Iterator 
-BinarySearchTree<Key, Value>::Iterator::operator++(int) {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator++(int) {
     Iterator bufIt = *this;
     ++*this;
     return bufIt;
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::Iterator 
-BinarySearchTree<Key, Value>::Iterator::operator--() {   
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator--() {   
     _node = _node->lastNode();
     return *this;
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::Iterator 
-BinarySearchTree<Key, Value>::Iterator::operator--(int) {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator--(int) {
     Iterator bufIt = *this;
     --*this;
     return bufIt;
 }
 
-template <typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::Iterator::operator==(const Iterator& other) const {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator& 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator+=(std::ptrdiff_t n) {
+    _node = _advance(_node, n);
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator& 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator-=(std::ptrdiff_t n) {
+    return *this += -n;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator+(std::ptrdiff_t n) const {
+    Iterator result = *this;
+    return result += n;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator-(std::ptrdiff_t n) const {
+    Iterator result = *this;
+    return result -= n;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+bool BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator==(const Iterator& other) const {
     return _node == other._node;
 }
 
-template <typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::Iterator::operator!=(const Iterator& other) const {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+bool BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator::operator!=(const Iterator& other) const {
     return !(*this == other);
 }
 
 //ConstIterator
-template <typename Key, typename Value>
-BinarySearchTree<Key, Value>::ConstIterator::ConstIterator(const Node* node) 
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::ConstIterator(const Node* node) 
 : _node(node) {}
 
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
 const std::pair<Key, Value>& 
-BinarySearchTree<Key, Value>::ConstIterator::operator*() const {
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::operator*() const {
     return _node->keyValuePair;
 }
 
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
 const std::pair<Key, Value>* 
-BinarySearchTree<Key, Value>::ConstIterator::operator->() const {
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::operator->() const {
     return &_node->keyValuePair;
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::ConstIterator
-BinarySearchTree<Key, Value>::ConstIterator::operator++() {
-    _node = _node->nextNode();
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::operator++() {
+    _node = const_cast<Node*>(_node)->nextNode();
     return *this;
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::ConstIterator 
-BinarySearchTree<Key, Value>::ConstIterator::operator++(int) {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::operator++(int) {
     ConstIterator bufIt = *this;
     ++*this;
     return bufIt;
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::ConstIterator 
-BinarySearchTree<Key, Value>::ConstIterator::operator--() {
-    _node = _node->lastNode();
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::operator--() {
+    _node = const_cast<Node*>(_node)->lastNode();
     return *this;
 }
 
 
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::ConstIterator 
-BinarySearchTree<Key, Value>::ConstIterator::operator--(int) {
-    typename ConstIterator::Iterator bufIt = *this;
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::operator--(int) {
+    ConstIterator bufIt = *this;
     --*this;
     return bufIt;
 }
 
-template <typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::ConstIterator::operator==(const Iterator& other) const {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator& 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::operator+=(std::ptrdiff_t n) {
+    _node = _advance(const_cast<Node*>(_node), n);
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator& 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::operator-=(std::ptrdiff_t n) {
+    return *this += -n;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::operator+(std::ptrdiff_t n) const {
+    ConstIterator result = *this;
+    return result += n;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::operator-(std::ptrdiff_t n) const {
+    ConstIterator result = *this;
+    return result -= n;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+bool BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::operator==(const ConstIterator& other) const {
     return _node == other._node;
 }
 
-template <typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::ConstIterator::operator!=(const Iterator& other) const {
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+bool BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator::operator!=(const ConstIterator& other) const {
     return !(*this == other);
 }
 
-//Methods
-template <typename Key, typename Value>
-void BinarySearchTree<Key, Value>::insert(const Key& key, const Value& value) {
-    if (_size == 0) {
-        _root = new Node(key, value);
-    }
-    else {
-        Node* search = _root;
-        while (true) {
-            if (key >= search->keyValuePair.first) {
-                if (!search->right) {
-                    search->right = new Node(key, value, search);
-                    break;
-                }
-                else {
-                    search = search->right;
-                }
-            }
-            if (key < search->keyValuePair.first) {
-                if (!search->left) {
-                    search->left = new Node(key, value, search);
-                    break;
-                }
-                else {
-                    search = search->left;
-                }
-            }
-        }
+//Cursor
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Cursor::Cursor(const BinarySearchTree& tree) 
+: _tree(&tree), _node(tree._root) {
+    while (_node && _node->left) {
+        _node = _node->left;
     }
-    _size++;
 }
 
-template <typename Key, typename Value>
-void BinarySearchTree<Key, Value>::erase(const Key& key) {
-    Node* search = _findNode(key);
-    if (!search->left) {
-        _shiftNodes(search, search->right);
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Cursor::seek(const Key& key) {
+    const Compare& compare = _tree->_compare;
+    if (!_node || !compare(_node->keyValuePair.first, key)) {
+        // назад или из конца: обычный спуск от корня
+        _node = _tree->_lowerBound(key);
+        return;
     }
-    else if (!search->right) {
-        _shiftNodes(search, search->left);
+    // подъем, пока ближайший следующий за поддеревом node предок меньше key;
+    // все ключи поддерева до курсора меньше key, поэтому спуск ниже идет по всему поддереву
+    const Node* node = _node;
+    const Node* bound = nullptr;
+    while (node->parent) {
+        const Node* parent = node->parent;
+        if (parent->left == node && !compare(parent->keyValuePair.first, key)) {
+            bound = parent;
+            break;
+        }
+        node = parent;
     }
-    else {
-        Node* replace = search->nextNode();
-        if (replace->parent != search) {
-            _shiftNodes(replace, replace->right);
-            replace->right = search->right;
-            replace->right->parent = replace;
+    while (node) {
+        if (compare(node->keyValuePair.first, key)) {
+            node = node->right;
+        }
+        else {
+            bound = node;
+            node = node->left;
         }
-        _shiftNodes(search, replace);
-        replace->left = search->left;
-        replace->left->parent = replace;
     }
-    delete search;
-    _size--;
+    _node = bound;
 }
 
-template <typename Key, typename Value>
-void BinarySearchTree<Key, Value>::_shiftNodes(Node* node1, Node* node2) {
-    if (!node1->parent) {
-        _root = node2;
-    }
-    else if (node1->parent->left == node1) {
-        node1->parent->left = node2;
-    }
-    else {
-        node1->parent->right = node2;
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+bool BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Cursor::valid() const {
+    return _node != nullptr;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+const std::pair<Key, Value>* BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Cursor::next() {
+    if (!_node) {
+        return nullptr;
     }
-    if (node2) {
-        node2->parent = node1->parent;
+    const Node* current = _node;
+    _node = const_cast<Node*>(_node)->nextNode();
+    return &current->keyValuePair;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+size_t BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Cursor::nextBatch(std::pair<Key, Value>* buffer, size_t n) {
+    size_t count = 0;
+    for (; count < n && _node; count++) {
+        buffer[count] = _node->keyValuePair;
+        _node = const_cast<Node*>(_node)->nextNode();
     }
+    return count;
 }
 
+//Methods
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::insert(const Key& key, const Value& value) {
+    return _insertNode(_createNode(nullptr, key, value));
+}
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::ConstIterator 
-BinarySearchTree<Key, Value>::find(const Key& key) const {
-    return ConstIterator(_findNode(key));
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::insert(Key&& key, Value&& value) {
+    return _insertNode(_createNode(nullptr, std::move(key), std::move(value)));
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::Iterator 
-BinarySearchTree<Key, Value>::find(const Key& key) {
-    return Iterator(_findNode(key));
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename... Args>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::emplace(Args&&... args) {
+    return _insertNode(_createNode(nullptr, std::forward<Args>(args)...));
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::Node* 
-BinarySearchTree<Key, Value>::_findNode(const Key& key) const {
-    if (!_root) {
-        return nullptr;
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator, bool> 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::tryEmplace(const Key& key, Args&&... args) {
+    return _tryEmplace(key, std::forward<Args>(args)...);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator, bool> 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::tryEmplace(Key&& key, Args&&... args) {
+    return _tryEmplace(std::move(key), std::forward<Args>(args)...);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_insertNode(Node* node) {
+    const Key& key = node->keyValuePair.first;
+    Node* parent = nullptr;
+    Node* search = _root;
+    bool toLeft = false;
+    size_t visits = 0;
+    // равные ключи уходят вправо, чтобы сохранить порядок вставки
+    while (search) {
+        parent = search;
+        visits++;
+        toLeft = _compare(key, search->keyValuePair.first);
+        search = toLeft ? search->left : search->right;
+    }
+    _recordInsert(visits);
+    _linkNode(node, parent, toLeft);
+    return Iterator(node);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename KeyArg, typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator, bool> 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_tryEmplace(KeyArg&& key, Args&&... args) {
+    Node* parent = nullptr;
+    Node* search = _root;
+    Node* notGreater = nullptr; //!< последний узел с ключем не больше key
+    bool toLeft = false;
+    size_t visits = 0;
+    while (search) {
+        parent = search;
+        visits++;
+        toLeft = _compare(key, search->keyValuePair.first);
+        if (toLeft) {
+            search = search->left;
+        }
+        else {
+            notGreater = search;
+            search = search->right;
+        }
+    }
+    _recordInsert(visits);
+    if (notGreater && !_compare(notGreater->keyValuePair.first, key)) {
+        return std::pair<Iterator, bool>(Iterator(notGreater), false);
+    }
+    Node* node = _createNode(parent, 
+                              std::piecewise_construct, 
+                              std::forward_as_tuple(std::forward<KeyArg>(key)), 
+                              std::forward_as_tuple(std::forward<Args>(args)...));
+    _linkNode(node, parent, toLeft);
+    return std::pair<Iterator, bool>(Iterator(node), true);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::insert(Iterator hint, const Key& key, const Value& value) {
+    return _emplaceHint(hint._node, false, key, value).first;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::insert(Iterator hint, Key&& key, Value&& value) {
+    return _emplaceHint(hint._node, false, std::move(key), std::move(value)).first;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator, bool> 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::tryEmplace(Iterator hint, const Key& key, Args&&... args) {
+    return _emplaceHint(hint._node, true, key, std::forward<Args>(args)...);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator, bool> 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::tryEmplace(Iterator hint, Key&& key, Args&&... args) {
+    return _emplaceHint(hint._node, true, std::move(key), std::forward<Args>(args)...);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+bool BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_hintPosition
+(Node* hint, const Key& key, Node*& previous, Node*& parent, bool& toLeft) const {
+    if (hint && !_compare(key, hint->keyValuePair.first)) {
+        return false;
+    }
+    // предыдущий элемент - самый правый в левом поддереве hint, тогда у него нет
+    // правого ребенка, или ближайший предок, если левого поддерева нет;
+    // перед end() стоит наибольший узел, он хранится в _rightmost
+    if (!hint) {
+        previous = _rightmost;
+        parent = previous;
+        toLeft = false;
+    }
+    else if (hint->left) {
+        previous = hint->left;
+        while (previous->right) {
+            previous = previous->right;
+        }
+        parent = previous;
+        toLeft = false;
+    }
+    else {
+        previous = hint->lastNode();
+        parent = hint;
+        toLeft = true;
+    }
+    return !previous || !_compare(key, previous->keyValuePair.first);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename KeyArg, typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator, bool> 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_emplaceHint(Node* hint, bool unique, KeyArg&& key, Args&&... args) {
+    Node* previous = nullptr;
+    Node* parent = nullptr;
+    bool toLeft = false;
+    if (!_hintPosition(hint, key, previous, parent, toLeft)) {
+        if (unique) {
+            return _tryEmplace(std::forward<KeyArg>(key), std::forward<Args>(args)...);
+        }
+        Node* node = _createNode(nullptr, 
+                                 std::piecewise_construct, 
+                                 std::forward_as_tuple(std::forward<KeyArg>(key)), 
+                                 std::forward_as_tuple(std::forward<Args>(args)...));
+        return std::pair<Iterator, bool>(_insertNode(node), true);
+    }
+    // при unique равный ключ может быть только у previous: ключ hint больше key
+    if (unique && previous && !_compare(previous->keyValuePair.first, key)) {
+        return std::pair<Iterator, bool>(Iterator(previous), false);
+    }
+    Node* node = _createNode(parent, 
+                             std::piecewise_construct, 
+                             std::forward_as_tuple(std::forward<KeyArg>(key)), 
+                             std::forward_as_tuple(std::forward<Args>(args)...));
+    _linkNode(node, parent, toLeft);
+    return std::pair<Iterator, bool>(Iterator(node), true);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_linkNode(Node* node, Node* parent, bool toLeft) {
+    node->parent = parent;
+    if (!parent) {
+        _root = node;
+    }
+    else if (toLeft) {
+        parent->left = node;
+    }
+    else {
+        parent->right = node;
+    }
+    // новый узел становится наибольшим, только если встает справа от прежнего наибольшего
+    if (!parent || (parent == _rightmost && !toLeft)) {
+        _rightmost = node;
+    }
+    _size++;
+    _updatePath(node);
+    _rebalanceAfterInsert(node);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename V>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::assignValue(Iterator position, V&& value) {
+    position._node->keyValuePair.second = std::forward<V>(value);
+    _updatePath(position._node);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::erase(const Key& key) {
+    _eraseKey(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+auto BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::erase(const K& key) -> _IfTransparent<K, void> {
+    _eraseKey(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::erase(Iterator position) {
+    // узлы при удалении перецепляются, а не копируются, следующий узел остается на месте
+    Node* next = position._node->nextNode();
+    _eraseNode(position._node);
+    return Iterator(next);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_eraseKey(const K& key) {
+    while (Node* search = _findNode(key)) {
+        _eraseNode(search);
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_eraseNode(Node* search) {
+    // узлы перецепляются, а не копируются, поэтому предыдущий узел остается на месте
+    if (search == _rightmost) {
+        _rightmost = search->lastNode();
+    }
+    if constexpr (_isTreap) {
+        // узел опускается поворотами под ребенка с большим приоритетом,
+        // пока не останется один ребенок, который и занимает его место
+        while (search->left && search->right) {
+            if (search->left->priority > search->right->priority) {
+                _rotateRight(search);
+            }
+            else {
+                _rotateLeft(search);
+            }
+        }
+        _refreshRoot();
+        Node* parent = search->parent;
+        _shiftNodes(search, search->left ? search->left : search->right);
+        _destroyNode(search);
+        _size--;
+        _updatePath(parent);
+        return;
+    }
+    // child занимает место удаленного узла, childParent - его новый родитель
+    Node* child = nullptr;
+    Node* childParent = nullptr;
+    bool removedBlack = search->balanceInfo == _black;
+    if (!search->left) {
+        child = search->right;
+        childParent = search->parent;
+        _shiftNodes(search, search->right);
+    }
+    else if (!search->right) {
+        child = search->left;
+        childParent = search->parent;
+        _shiftNodes(search, search->left);
+    }
+    else {
+        Node* replace = search->nextNode();
+        removedBlack = replace->balanceInfo == _black;
+        child = replace->right;
+        if (replace->parent != search) {
+            childParent = replace->parent;
+            _shiftNodes(replace, replace->right);
+            replace->right = search->right;
+            replace->right->parent = replace;
+        }
+        else {
+            childParent = replace;
+        }
+        _shiftNodes(search, replace);
+        replace->left = search->left;
+        replace->left->parent = replace;
+        replace->balanceInfo = search->balanceInfo;
+    }
+    _destroyNode(search);
+    _size--;
+    _updatePath(childParent);
+    _rebalanceAfterErase(child, childParent, removedBlack);
+}
+
+//Balance
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+bool BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_isRed(const Node* node) {
+    return node && node->balanceInfo == _red;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+unsigned char BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_height(const Node* node) {
+    return node ? node->balanceInfo : 0;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_updateNode(Node* node) {
+    if constexpr (std::is_same_v<Balance, AvlBalance>) {
+        unsigned char left = _height(node->left);
+        unsigned char right = _height(node->right);
+        node->balanceInfo = (left > right ? left : right) + 1;
+    }
+    if constexpr (_countsSizes) {
+        node->subtreeSize = 1 + _subtreeSize(node->left) + _subtreeSize(node->right);
+    }
+    if constexpr (_aggregates) {
+        typename Augmentation::MonoidType monoid;
+        node->aggregate = monoid(monoid(_aggregateOf(node->left), node->keyValuePair.second), _aggregateOf(node->right));
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_updatePath(Node* node) {
+    if constexpr (_countsSizes || _aggregates) {
+        while (node) {
+            _updateNode(node);
+            node = node->parent;
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_rotateLeft(Node* node) {
+    Node* pivot = node->right;
+    node->right = pivot->left;
+    if (pivot->left) {
+        pivot->left->parent = node;
+    }
+    _replaceChild(node, pivot);
+    pivot->left = node;
+    node->parent = pivot;
+    _updateNode(node);
+    _updateNode(pivot);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_rotateRight(Node* node) {
+    Node* pivot = node->left;
+    node->left = pivot->right;
+    if (pivot->right) {
+        pivot->right->parent = node;
+    }
+    _replaceChild(node, pivot);
+    pivot->right = node;
+    node->parent = pivot;
+    _updateNode(node);
+    _updateNode(pivot);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_avlRetrace(Node* node) {
+    while (node) {
+        _updateNode(node);
+        int balance = int(_height(node->left)) - int(_height(node->right));
+        if (balance > 1) {
+            if (_height(node->left->left) < _height(node->left->right)) {
+                _rotateLeft(node->left);
+            }
+            _rotateRight(node);
+            node = node->parent;
+        }
+        else if (balance < -1) {
+            if (_height(node->right->right) < _height(node->right->left)) {
+                _rotateRight(node->right);
+            }
+            _rotateLeft(node);
+            node = node->parent;
+        }
+        node = node->parent;
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_rebalanceAfterInsert(Node* node) {
+    if constexpr (std::is_same_v<Balance, AvlBalance>) {
+        _avlRetrace(node);
+        _refreshRoot();
+    }
+    else if constexpr (std::is_same_v<Balance, RedBlackBalance>) {
+        node->balanceInfo = _red;
+        _fixRedRed(node);
+        _refreshRoot();
+        _root->balanceInfo = _black;
+    }
+    else if constexpr (_isTreap) {
+        // лист поднимается поворотами, пока его приоритет больше родительского
+        node->priority = _randomPriority();
+        while (node->parent && node->parent->priority < node->priority) {
+            if (node == node->parent->left) {
+                _rotateRight(node->parent);
+            }
+            else {
+                _rotateLeft(node->parent);
+            }
+        }
+        _refreshRoot();
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+std::uint32_t BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_randomPriority() {
+    // splitmix64 от счетчика потока, начальное значение которого случайно:
+    // приоритеты не выводятся из ключей и не повторяются между запусками
+    thread_local std::uint64_t state = (std::uint64_t(std::random_device()()) << 32) ^ std::random_device()();
+    std::uint64_t mixed = (state += 0x9e3779b97f4a7c15ULL);
+    mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+    return std::uint32_t((mixed ^ (mixed >> 31)) >> 32);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node*
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_treapJoin(Node* left, Node* middle, Node* right) {
+    // глубина рекурсии не больше суммы ожидаемых высот частей, O(log n)
+    if (left && left->priority > middle->priority && (!right || left->priority >= right->priority)) {
+        Node* joined = _treapJoin(left->right, middle, right);
+        left->right = joined;
+        joined->parent = left;
+        _updateNode(left);
+        return left;
+    }
+    if (right && right->priority > middle->priority) {
+        Node* joined = _treapJoin(left, middle, right->left);
+        right->left = joined;
+        joined->parent = right;
+        _updateNode(right);
+        return right;
+    }
+    middle->parent = nullptr;
+    middle->left = left;
+    middle->right = right;
+    if (left) {
+        left->parent = middle;
+    }
+    if (right) {
+        right->parent = middle;
+    }
+    _updateNode(middle);
+    return middle;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+bool BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_fixRedRed(Node* node) {
+    while (_isRed(node->parent)) {
+        Node* parent = node->parent;
+        Node* grand = parent->parent;
+        if (!grand) {
+            // красный корень поддерева: черная высота вырастает на один
+            parent->balanceInfo = _black;
+            return true;
+        }
+        if (parent == grand->left) {
+            Node* uncle = grand->right;
+            if (_isRed(uncle)) {
+                parent->balanceInfo = _black;
+                uncle->balanceInfo = _black;
+                grand->balanceInfo = _red;
+                node = grand;
+                continue;
+            }
+            if (node == parent->right) {
+                _rotateLeft(parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->balanceInfo = _black;
+            grand->balanceInfo = _red;
+            _rotateRight(grand);
+        }
+        else {
+            Node* uncle = grand->left;
+            if (_isRed(uncle)) {
+                parent->balanceInfo = _black;
+                uncle->balanceInfo = _black;
+                grand->balanceInfo = _red;
+                node = grand;
+                continue;
+            }
+            if (node == parent->left) {
+                _rotateRight(parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->balanceInfo = _black;
+            grand->balanceInfo = _red;
+            _rotateLeft(grand);
+        }
+    }
+    return false;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_rebalanceAfterErase
+(Node* child, Node* parent, bool removedBlack) {
+    if constexpr (std::is_same_v<Balance, AvlBalance>) {
+        _avlRetrace(parent);
+        _refreshRoot();
+    }
+    else if constexpr (std::is_same_v<Balance, RedBlackBalance>) {
+        if (!removedBlack) {
+            return;
+        }
+        // на пути через child не хватает одного черного узла, у корня parent == nullptr
+        while (parent && !_isRed(child)) {
+            if (child == parent->left) {
+                Node* sibling = parent->right;
+                if (_isRed(sibling)) {
+                    sibling->balanceInfo = _black;
+                    parent->balanceInfo = _red;
+                    _rotateLeft(parent);
+                    sibling = parent->right;
+                }
+                if (!_isRed(sibling->left) && !_isRed(sibling->right)) {
+                    sibling->balanceInfo = _red;
+                    child = parent;
+                    parent = child->parent;
+                    continue;
+                }
+                if (!_isRed(sibling->right)) {
+                    sibling->left->balanceInfo = _black;
+                    sibling->balanceInfo = _red;
+                    _rotateRight(sibling);
+                    sibling = parent->right;
+                }
+                sibling->balanceInfo = parent->balanceInfo;
+                parent->balanceInfo = _black;
+                sibling->right->balanceInfo = _black;
+                _rotateLeft(parent);
+                break;
+            }
+            else {
+                Node* sibling = parent->left;
+                if (_isRed(sibling)) {
+                    sibling->balanceInfo = _black;
+                    parent->balanceInfo = _red;
+                    _rotateRight(parent);
+                    sibling = parent->left;
+                }
+                if (!_isRed(sibling->left) && !_isRed(sibling->right)) {
+                    sibling->balanceInfo = _red;
+                    child = parent;
+                    parent = child->parent;
+                    continue;
+                }
+                if (!_isRed(sibling->left)) {
+                    sibling->right->balanceInfo = _black;
+                    sibling->balanceInfo = _red;
+                    _rotateLeft(sibling);
+                    sibling = parent->left;
+                }
+                sibling->balanceInfo = parent->balanceInfo;
+                parent->balanceInfo = _black;
+                sibling->left->balanceInfo = _black;
+                _rotateRight(parent);
+                break;
+            }
+        }
+        if (child) {
+            child->balanceInfo = _black;
+        }
+        _refreshRoot();
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_shiftNodes(Node* node1, Node* node2) {
+    if (!node1->parent) {
+        _root = node2;
+    }
+    else if (node1->parent->left == node1) {
+        node1->parent->left = node2;
+    }
+    else {
+        node1->parent->right = node2;
+    }
+    if (node2) {
+        node2->parent = node1->parent;
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_replaceChild(Node* node, Node* replacement) {
+    Node* parent = node->parent;
+    if (parent) {
+        if (parent->left == node) {
+            parent->left = replacement;
+        }
+        else {
+            parent->right = replacement;
+        }
+    }
+    if (replacement) {
+        replacement->parent = parent;
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_refreshRoot() {
+    if (_root) {
+        while (_root->parent) {
+            _root = _root->parent;
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_resetRightmost() {
+    _rightmost = _root;
+    while (_rightmost && _rightmost->right) {
+        _rightmost = _rightmost->right;
+    }
+}
+
+//SplitJoin
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_Subtree
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_wholeTree() const {
+    if constexpr (std::is_same_v<Balance, AvlBalance>) {
+        return {_root, _height(_root)};
+    }
+    else if constexpr (_isTreap) {
+        unsigned char rank = 0;
+        for (size_t size = _size; size; size >>= 1) {
+            rank++;
+        }
+        return {_root, rank};
+    }
+    else {
+        unsigned char rank = 0;
+        for (const Node* node = _root; node; node = node->left) {
+            rank += _isRed(node) ? 0 : 1;
+        }
+        return {_root, rank};
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_assignRoot(_Subtree tree) {
+    _root = tree.root;
+    if (_root) {
+        _root->parent = nullptr;
+        if constexpr (std::is_same_v<Balance, RedBlackBalance>) {
+            _root->balanceInfo = _black;
+        }
+    }
+    _resetRightmost();
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_Subtree
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_childSubtree(_Subtree tree, Node* child) {
+    if constexpr (std::is_same_v<Balance, AvlBalance>) {
+        return {child, _height(child)};
+    }
+    else if constexpr (_isTreap) {
+        return {child, static_cast<unsigned char>(tree.rank ? tree.rank - 1 : 0)};
+    }
+    else {
+        return {child, static_cast<unsigned char>(tree.rank - (_isRed(tree.root) ? 0 : 1))};
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_Subtree
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_join(_Subtree left, Node* middle, _Subtree right) {
+    // части приходят из разрезанных деревьев, ссылки их корней на родителя устарели
+    for (_Subtree* part : {&left, &right}) {
+        if (part->root) {
+            part->root->parent = nullptr;
+            // красно-черное: черные корни, чтобы middle можно было сделать красным
+            if constexpr (std::is_same_v<Balance, RedBlackBalance>) {
+                if (_isRed(part->root)) {
+                    part->root->balanceInfo = _black;
+                    part->rank++;
+                }
+            }
+        }
+    }
+    if constexpr (_isTreap) {
+        Node* root = _treapJoin(left.root, middle, right.root);
+        return {root, static_cast<unsigned char>(std::max(left.rank, right.rank) + 1)};
+    }
+    if constexpr (std::is_same_v<Balance, AvlBalance>) {
+        if (left.rank > right.rank + 1) {
+            return _joinSide(left, middle, right, true);
+        }
+        if (right.rank > left.rank + 1) {
+            return _joinSide(right, middle, left, false);
+        }
+    }
+    else {
+        if (left.rank > right.rank) {
+            return _joinSide(left, middle, right, true);
+        }
+        if (right.rank > left.rank) {
+            return _joinSide(right, middle, left, false);
+        }
+    }
+    // ранги близки: middle становится корнем
+    middle->parent = nullptr;
+    middle->left = left.root;
+    middle->right = right.root;
+    if (left.root) {
+        left.root->parent = middle;
+    }
+    if (right.root) {
+        right.root->parent = middle;
+    }
+    _updateNode(middle);
+    if constexpr (std::is_same_v<Balance, AvlBalance>) {
+        return {middle, _height(middle)};
+    }
+    else {
+        middle->balanceInfo = _black;
+        return {middle, static_cast<unsigned char>(left.rank + 1)};
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_Subtree
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_joinSide
+(_Subtree tall, Node* middle, _Subtree low, bool tallIsLeft) {
+    // спуск по краю tall, обращенному к low, до поддерева того же ранга, что и low
+    Node* parent = nullptr;
+    Node* spine = tall.root;
+    unsigned char rank = tall.rank;
+    while (true) {
+        if constexpr (std::is_same_v<Balance, AvlBalance>) {
+            if (_height(spine) <= low.rank + 1) {
+                break;
+            }
+        }
+        else {
+            if (!_isRed(spine) && rank == low.rank) {
+                break;
+            }
+            rank -= _isRed(spine) ? 0 : 1;
+        }
+        parent = spine;
+        spine = tallIsLeft ? spine->right : spine->left;
+    }
+    // middle занимает место spine, spine и low становятся его детьми
+    middle->parent = parent;
+    middle->left = tallIsLeft ? spine : low.root;
+    middle->right = tallIsLeft ? low.root : spine;
+    if (spine) {
+        spine->parent = middle;
+    }
+    if (low.root) {
+        low.root->parent = middle;
+    }
+    if (tallIsLeft) {
+        parent->right = middle;
+    }
+    else {
+        parent->left = middle;
+    }
+    _updateNode(middle);
+    bool grew = false;
+    if constexpr (std::is_same_v<Balance, AvlBalance>) {
+        _avlRetrace(parent);
+    }
+    else {
+        middle->balanceInfo = _red;
+        _updatePath(parent);
+        grew = _fixRedRed(middle);
+    }
+    Node* root = middle;
+    while (root->parent) {
+        root = root->parent;
+    }
+    if constexpr (std::is_same_v<Balance, AvlBalance>) {
+        return {root, _height(root)};
+    }
+    else {
+        return {root, static_cast<unsigned char>(tall.rank + (grew ? 1 : 0))};
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_Subtree
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_join2(_Subtree left, _Subtree right) {
+    if (!left.root) {
+        return right;
+    }
+    if (!right.root) {
+        return left;
+    }
+    std::pair<_Subtree, Node*> rest = _splitLast(left);
+    return _join(rest.first, rest.second, right);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_Subtree,
+          typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node*>
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_splitLast(_Subtree tree) {
+    Node* node = tree.root;
+    _Subtree left = _childSubtree(tree, node->left);
+    if (!node->right) {
+        return {left, node};
+    }
+    std::pair<_Subtree, Node*> rest = _splitLast(_childSubtree(tree, node->right));
+    return {_join(left, node, rest.first), rest.second};
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_SplitResult
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_split(_Subtree tree, const Key& key, bool takeEqual) {
+    // узлы пути поиска склеиваются с отрезанными от них поддеревьями,
+    // ранги растут вдоль пути, поэтому все склейки вместе стоят O(log n)
+    if (!tree.root) {
+        return {};
+    }
+    Node* node = tree.root;
+    _Subtree left = _childSubtree(tree, node->left);
+    _Subtree right = _childSubtree(tree, node->right);
+    if (_compare(node->keyValuePair.first, key)) {
+        _SplitResult result = _split(right, key, takeEqual);
+        result.less = _join(left, node, result.less);
+        return result;
+    }
+    if (takeEqual && !_compare(key, node->keyValuePair.first)) {
+        return {left, node, right};
+    }
+    _SplitResult result = _split(left, key, takeEqual);
+    result.greater = _join(result.greater, node, right);
+    return result;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+size_t BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_partSize(Node* first, Node* second, size_t total) {
+    for (Node** part : {&first, &second}) {
+        while (*part && (*part)->left) {
+            *part = (*part)->left;
+        }
+    }
+    size_t count = 0;
+    while (first && second) {
+        first = first->nextNode();
+        second = second->nextNode();
+        count++;
+    }
+    return first ? total - count : count;
+}
+
+//SetAlgebra
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_Subtree
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_uniteSubtrees
+(_Subtree mine, _Subtree theirs, _Garbage& garbage) {
+    if (!theirs.root) {
+        return mine;
+    }
+    if (!mine.root) {
+        return theirs;
+    }
+    Node* pivot = theirs.root;
+    _Subtree theirsLeft = _childSubtree(theirs, pivot->left);
+    _Subtree theirsRight = _childSubtree(theirs, pivot->right);
+    _SplitResult parts = _split(mine, pivot->keyValuePair.first, true);
+    if (parts.equal) {
+        // общий ключ: остается узел этого дерева
+        pivot->left = nullptr;
+        pivot->right = nullptr;
+        _discard(garbage, pivot);
+        pivot = parts.equal;
+    }
+    _Subtree left;
+    _Subtree right;
+    _Garbage rightGarbage;
+    _fork(theirs,
+          [&] { left = _uniteSubtrees(parts.less, theirsLeft, garbage); },
+          [&] { right = _uniteSubtrees(parts.greater, theirsRight, rightGarbage); });
+    _appendGarbage(garbage, rightGarbage);
+    return _join(left, pivot, right);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_Subtree
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_intersectSubtrees
+(_Subtree mine, _Subtree theirs, _Garbage& garbage) {
+    if (!mine.root) {
+        return mine;
+    }
+    if (!theirs.root) {
+        _discard(garbage, mine.root);
+        return {};
+    }
+    const Node* pivot = theirs.root;
+    _SplitResult parts = _split(mine, pivot->keyValuePair.first, true);
+    _Subtree left;
+    _Subtree right;
+    _Garbage rightGarbage;
+    _fork(theirs,
+          [&] { left = _intersectSubtrees(parts.less, _childSubtree(theirs, pivot->left), garbage); },
+          [&] { right = _intersectSubtrees(parts.greater, _childSubtree(theirs, pivot->right), rightGarbage); });
+    _appendGarbage(garbage, rightGarbage);
+    if (parts.equal) {
+        return _join(left, parts.equal, right);
+    }
+    return _join2(left, right);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_Subtree
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_differenceSubtrees
+(_Subtree mine, _Subtree theirs, _Garbage& garbage) {
+    if (!mine.root || !theirs.root) {
+        return mine;
+    }
+    const Node* pivot = theirs.root;
+    _SplitResult parts = _split(mine, pivot->keyValuePair.first, true);
+    _Subtree left;
+    _Subtree right;
+    _Garbage rightGarbage;
+    _fork(theirs,
+          [&] { left = _differenceSubtrees(parts.less, _childSubtree(theirs, pivot->left), garbage); },
+          [&] { right = _differenceSubtrees(parts.greater, _childSubtree(theirs, pivot->right), rightGarbage); });
+    _appendGarbage(garbage, rightGarbage);
+    if (parts.equal) {
+        parts.equal->left = nullptr;
+        parts.equal->right = nullptr;
+        _discard(garbage, parts.equal);
+    }
+    return _join2(left, right);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename Left, typename Right>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_fork(_Subtree theirs, Left&& left, Right&& right) {
+    if (theirs.rank >= _parallelRank) {
+        ThreadPool::global().invoke(left, right);
+    }
+    else {
+        left();
+        right();
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_discard(_Garbage& garbage, Node* root) {
+    root->parent = nullptr;
+    if (garbage.tail) {
+        garbage.tail->parent = root;
+    }
+    else {
+        garbage.head = root;
+    }
+    garbage.tail = root;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_appendGarbage(_Garbage& garbage, _Garbage& other) {
+    if (!other.head) {
+        return;
+    }
+    if (garbage.tail) {
+        garbage.tail->parent = other.head;
+    }
+    else {
+        garbage.head = other.head;
+    }
+    garbage.tail = other.tail;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+size_t BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_destroyGarbage(_Garbage& garbage) {
+    size_t count = 0;
+    Node* root = garbage.head;
+    while (root) {
+        Node* next = root->parent;
+        root->parent = nullptr;
+        count += _deleteSubtree(root);
+        root = next;
+    }
+    garbage = _Garbage();
+    return count;
+}
+
+//ParallelReduce
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+bool BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_worthForking(const Node* node, size_t depth) const {
+    if (ThreadPool::global().threadCount() == 0) {
+        return false;
+    }
+    // без размеров в узлах поддерево на глубине depth оценивается как у сбалансированного
+    size_t estimate = _countsSizes ? _subtreeSize(node) : (depth < 64 ? _size >> depth : 0);
+    return estimate >= _parallelGrain;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename T, typename Reduce, typename Transform>
+std::optional<T> BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_reduceSubtree
+(Node* node, size_t depth, const Reduce& reduce, const Transform& transform) const {
+    if (!node) {
+        return std::nullopt;
+    }
+    if (!_worthForking(node, depth)) {
+        // последовательный обход по ссылкам на родителя до последнего узла поддерева
+        Node* last = node;
+        while (last->right) {
+            last = last->right;
+        }
+        while (node->left) {
+            node = node->left;
+        }
+        T result = transform(node);
+        while (node != last) {
+            node = node->nextNode();
+            result = reduce(std::move(result), transform(node));
+        }
+        return result;
+    }
+    std::optional<T> left;
+    std::optional<T> right;
+    ThreadPool::global().invoke([&] { left = _reduceSubtree<T>(node->left, depth + 1, reduce, transform); },
+                                [&] { right = _reduceSubtree<T>(node->right, depth + 1, reduce, transform); });
+    return _combine(reduce, _combine(reduce, std::move(left), std::optional<T>(transform(node))), std::move(right));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename T, typename Reduce, typename Transform, typename AboveLow, typename BelowHigh>
+std::optional<T> BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_reduceRange
+(Node* node, size_t depth, bool checkLow, bool checkHigh, const Reduce& reduce, const Transform& transform,
+ const AboveLow& aboveLow, const BelowHigh& belowHigh) const {
+    // спуск до первого узла внутри диапазона, дальше диапазон делится им на две половины
+    while (node) {
+        if (checkLow && !aboveLow(node)) {
+            node = node->right;
+        }
+        else if (checkHigh && !belowHigh(node)) {
+            node = node->left;
+        }
+        else {
+            break;
+        }
+        depth++;
+    }
+    if (!node) {
+        return std::nullopt;
+    }
+    if (!checkLow && !checkHigh) {
+        return _reduceSubtree<T>(node, depth, reduce, transform);
+    }
+    std::optional<T> left;
+    std::optional<T> right;
+    auto reduceLeft = [&] {
+        left = _reduceRange<T>(node->left, depth + 1, checkLow, false, reduce, transform, aboveLow, belowHigh);
+    };
+    auto reduceRight = [&] {
+        right = _reduceRange<T>(node->right, depth + 1, false, checkHigh, reduce, transform, aboveLow, belowHigh);
+    };
+    if (_worthForking(node, depth)) {
+        ThreadPool::global().invoke(reduceLeft, reduceRight);
+    }
+    else {
+        reduceLeft();
+        reduceRight();
+    }
+    return _combine(reduce, _combine(reduce, std::move(left), std::optional<T>(transform(node))), std::move(right));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename T, typename Reduce>
+std::optional<T> BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_combine(const Reduce& reduce, std::optional<T> left, std::optional<T> right) {
+    if (!left) {
+        return right;
+    }
+    if (!right) {
+        return left;
+    }
+    return reduce(std::move(*left), std::move(*right));
+}
+
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::find(const Key& key) const {
+    return ConstIterator(_findNode(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::find(const Key& key) {
+    return Iterator(_findNode(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+auto BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::find(const K& key) const -> _IfTransparent<K, ConstIterator> {
+    return ConstIterator(_findNode(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+auto BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::find(const K& key) -> _IfTransparent<K, Iterator> {
+    return Iterator(_findNode(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename ForwardIt, typename OutputIt>
+OutputIt BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    _lowerBoundBatch(first, last, [this, &out](const auto& key, Node* candidate) {
+        *out++ = ConstIterator(candidate && !_compare(key, candidate->keyValuePair.first) ? candidate : nullptr);
+    });
+    return out;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename ForwardIt, typename OutputIt>
+OutputIt BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) {
+    _lowerBoundBatch(first, last, [this, &out](const auto& key, Node* candidate) {
+        *out++ = Iterator(candidate && !_compare(key, candidate->keyValuePair.first) ? candidate : nullptr);
+    });
+    return out;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename ForwardIt, typename OutputIt>
+OutputIt BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    _lowerBoundBatch(first, last, [this, &out](const auto& key, Node* candidate) {
+        *out++ = candidate && !_compare(key, candidate->keyValuePair.first);
+    });
+    return out;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node* 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_findNode(const K& key) const {
+    // равенство проверяется один раз после спуска
+    size_t visits = 0;
+    Node* candidate = _lowerBound(key, visits);
+    _recordFind(visits);
+    if (candidate && !_compare(key, candidate->keyValuePair.first)) {
+        return candidate;
+    }
+    return nullptr;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node* 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_lowerBound(const K& key) const {
+    // без CollectStats счетчик никуда не уходит и выбрасывается компилятором
+    size_t visits = 0;
+    return _lowerBound(key, visits);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node* 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_lowerBound(const K& key, size_t& visits) const {
+    Node* search = _root;
+    Node* candidate = nullptr;
+    while (search) {
+        visits++;
+        if (_compare(search->keyValuePair.first, key)) {
+            search = search->right;
+        }
+        else {
+            candidate = search;
+            search = search->left;
+        }
+    }
+    return candidate;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename ForwardIt, typename Visit>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_lowerBoundBatch(ForwardIt first, ForwardIt last, Visit visit) const {
+    using K = std::remove_cv_t<std::remove_reference_t<decltype(*first)>>;
+    static_assert(std::is_same<K, Key>::value || IsTransparentCompare<Compare, K>::value,
+                  "batch keys of another type require a transparent comparator");
+    const K* keys[_batchWidth];
+    Node* search[_batchWidth];
+    Node* candidates[_batchWidth];
+    while (first != last) {
+        size_t count = 0;
+        for (; first != last && count < _batchWidth; ++first, ++count) {
+            keys[count] = &*first;
+            search[count] = _root;
+            candidates[count] = nullptr;
+        }
+        // за один проход каждый спуск делает шаг и запрашивает следующий узел,
+        // к следующему проходу узел уже успевает прийти из памяти
+        bool active = _root != nullptr;
+        while (active) {
+            active = false;
+            for (size_t i = 0; i < count; i++) {
+                Node* node = search[i];
+                if (!node) {
+                    continue;
+                }
+                if (_compare(node->keyValuePair.first, *keys[i])) {
+                    node = node->right;
+                }
+                else {
+                    candidates[i] = node;
+                    node = node->left;
+                }
+                search[i] = node;
+                if (node) {
+                    _prefetch(node);
+                    active = true;
+                }
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            visit(*keys[i], candidates[i]);
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_prefetch(const Node* node) {
+#if defined(__GNUC__) || defined(__clang__)
+    // узел может занимать две строки кэша: ключ в начале, ссылки на детей в конце
+    __builtin_prefetch(node);
+    __builtin_prefetch(reinterpret_cast<const char*>(node) + sizeof(Node) - 1);
+#else
+    (void)node;
+#endif
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node* 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_upperBound(const K& key) const {
+    Node* search = _root;
+    Node* candidate = nullptr;
+    while (search) {
+        if (_compare(key, search->keyValuePair.first)) {
+            candidate = search;
+            search = search->left;
+        }
+        else {
+            search = search->right;
+        }
+    }
+    return candidate;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node*, typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node*> 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_equalRangeNodes(const K& key) const {
+    // при отсутствии ключа обе границы совпадают, диапазон пуст
+    return std::pair<Node*, Node*>(_lowerBound(key), _upperBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::lowerBound(const Key& key) {
+    return Iterator(_lowerBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::lowerBound(const Key& key) const {
+    return ConstIterator(_lowerBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+auto BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::lowerBound(const K& key) -> _IfTransparent<K, Iterator> {
+    return Iterator(_lowerBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+auto BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::lowerBound(const K& key) const -> _IfTransparent<K, ConstIterator> {
+    return ConstIterator(_lowerBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::upperBound(const Key& key) {
+    return Iterator(_upperBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::upperBound(const Key& key) const {
+    return ConstIterator(_upperBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+auto BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::upperBound(const K& key) -> _IfTransparent<K, Iterator> {
+    return Iterator(_upperBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+auto BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::upperBound(const K& key) const -> _IfTransparent<K, ConstIterator> {
+    return ConstIterator(_upperBound(key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+size_t BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::rank(const Key& key) const {
+    return _rank(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+auto BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::rank(const K& key) const -> _IfTransparent<K, size_t> {
+    return _rank(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::select(size_t k) {
+    static_assert(_countsSizes, "select requires SizeAugmentation");
+    return Iterator(_select(_root, k));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::select(size_t k) const {
+    static_assert(_countsSizes, "select requires SizeAugmentation");
+    return ConstIterator(_select(_root, k));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+size_t BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::countRange(const Key& low, const Key& high) const {
+    size_t lowRank = _rank(low);
+    size_t highRank = _rank(high);
+    return highRank > lowRank ? highRank - lowRank : 0;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+auto BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::countRange(const K& low, const K& high) const -> _IfTransparent<K, size_t> {
+    size_t lowRank = _rank(low);
+    size_t highRank = _rank(high);
+    return highRank > lowRank ? highRank - lowRank : 0;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+size_t BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_rank(const K& key) const {
+    static_assert(_countsSizes, "rank requires SizeAugmentation");
+    // спуск как в lowerBound, при переходе вправо левое поддерево и узел меньше key
+    size_t rank = 0;
+    Node* search = _root;
+    while (search) {
+        if (_compare(search->keyValuePair.first, key)) {
+            rank += _subtreeSize(search->left) + 1;
+            search = search->right;
+        }
+        else {
+            search = search->left;
+        }
+    }
+    return rank;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+size_t BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_subtreeSize(const Node* node) {
+    if constexpr (_countsSizes) {
+        return node ? node->subtreeSize : 0;
+    }
+    else {
+        return 0;
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename A>
+typename A::MonoidType::value_type BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_aggregateOf(const Node* node) {
+    return node ? node->aggregate : A::MonoidType::identity();
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename A>
+typename A::MonoidType::value_type BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::aggregate() const {
+    return _aggregateOf(_root);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename A>
+typename A::MonoidType::value_type BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::aggregate(const Key& low, const Key& high) const {
+    typename A::MonoidType monoid;
+    // спуск до первого узла внутри [low, high), ниже него диапазон - суффикс
+    // левого поддерева, сам узел и префикс правого поддерева
+    const Node* split = _root;
+    while (split) {
+        if (_compare(split->keyValuePair.first, low)) {
+            split = split->right;
+        }
+        else if (!_compare(split->keyValuePair.first, high)) {
+            split = split->left;
+        }
+        else {
+            break;
+        }
+    }
+    if (!split) {
+        return A::MonoidType::identity();
+    }
+    // суффикс: узлы не меньше low вместе с правыми поддеревьями, справа налево
+    auto suffix = A::MonoidType::identity();
+    for (const Node* node = split->left; node;) {
+        if (_compare(node->keyValuePair.first, low)) {
+            node = node->right;
+        }
+        else {
+            suffix = monoid(monoid(node->keyValuePair.second, _aggregateOf(node->right)), suffix);
+            node = node->left;
+        }
+    }
+    // префикс: узлы меньше high вместе с левыми поддеревьями, слева направо
+    auto prefix = A::MonoidType::identity();
+    for (const Node* node = split->right; node;) {
+        if (_compare(node->keyValuePair.first, high)) {
+            prefix = monoid(prefix, monoid(_aggregateOf(node->left), node->keyValuePair.second));
+            node = node->right;
+        }
+        else {
+            node = node->left;
+        }
+    }
+    return monoid(monoid(suffix, split->keyValuePair.second), prefix);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node* 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_select(Node* root, size_t k) {
+    Node* search = root;
+    while (search) {
+        size_t leftSize = _subtreeSize(search->left);
+        if (k < leftSize) {
+            search = search->left;
+        }
+        else if (k == leftSize) {
+            return search;
+        }
+        else {
+            k -= leftSize + 1;
+            search = search->right;
+        }
+    }
+    return nullptr;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node* 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_advance(Node* node, std::ptrdiff_t n) {
+    static_assert(_countsSizes, "iterator arithmetic requires SizeAugmentation");
+    // позиция node считается подъемом к корню, затем спуск к позиции + n
+    size_t index = _subtreeSize(node->left);
+    while (node->parent) {
+        if (node->parent->right == node) {
+            index += _subtreeSize(node->parent->left) + 1;
+        }
+        node = node->parent;
+    }
+    return _select(node, index + n);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator, 
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator> 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::equalRange(const Key& key) {
+    auto range = _equalRangeNodes(key);
+    return std::pair<Iterator, Iterator>(Iterator(range.first), Iterator(range.second));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+std::pair<typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator, 
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator> 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::equalRange(const Key& key) const {
+    auto range = _equalRangeNodes(key);
+    return std::pair<ConstIterator, ConstIterator>(ConstIterator(range.first), ConstIterator(range.second));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+auto BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::equalRange(const K& key) -> _IfTransparent<K, std::pair<Iterator, Iterator>> {
+    auto range = _equalRangeNodes(key);
+    return std::pair<Iterator, Iterator>(Iterator(range.first), Iterator(range.second));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename K>
+auto BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::equalRange(const K& key) const 
+-> _IfTransparent<K, std::pair<ConstIterator, ConstIterator>> {
+    auto range = _equalRangeNodes(key);
+    return std::pair<ConstIterator, ConstIterator>(ConstIterator(range.first), ConstIterator(range.second));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::min(const Key& key) const {
+    // при равных значениях остается первый по порядку элемент
+    auto reduce = [](const Node* left, const Node* right) {
+        return right->keyValuePair.second < left->keyValuePair.second ? right : left;
+    };
+    std::optional<const Node*> result = _reduceRange<const Node*>(
+        _root, 0, true, true, reduce, [](const Node* node) { return node; },
+        [this, &key](const Node* node) { return !_compare(node->keyValuePair.first, key); },
+        [this, &key](const Node* node) { return !_compare(key, node->keyValuePair.first); });
+    return ConstIterator(result ? *result : nullptr);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::max(const Key& key) const {
+    auto reduce = [](const Node* left, const Node* right) {
+        return left->keyValuePair.second < right->keyValuePair.second ? right : left;
+    };
+    std::optional<const Node*> result = _reduceRange<const Node*>(
+        _root, 0, true, true, reduce, [](const Node* node) { return node; },
+        [this, &key](const Node* node) { return !_compare(node->keyValuePair.first, key); },
+        [this, &key](const Node* node) { return !_compare(key, node->keyValuePair.first); });
+    return ConstIterator(result ? *result : nullptr);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::begin() {
+    Node* search = _root;
+    if (!search) {
+        return end();
+    }
+    while (search->left) {
+        search = search->left;
+    }
+    return Iterator(search);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Iterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::end() {
+    return Iterator(nullptr);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::cbegin() const {
+    Node* search = _root;
+    if (!search) {
+        return cend();
+    }
+    while (search->left) {
+        search = search->left;
+    }
+    return ConstIterator(search);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::ConstIterator 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::cend() const {
+    return ConstIterator(nullptr);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+size_t BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::size() const {
+    return _size;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+Compare BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::keyComp() const {
+    return _compare;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::clear() {
+    // для тривиально разрушаемых пар обход не нужен, достаточно вернуть блоки
+    if constexpr (!std::is_trivially_destructible_v<Node>) {
+        _deleteSubtree(_root);
+    }
+    else {
+        _recordFrees(_size);
+    }
+    _pool.release();
+    _root = nullptr;
+    _rightmost = nullptr;
+    _size = 0;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename ForwardIt>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::assign(ForwardIt first, ForwardIt last) {
+    clear();
+    size_t count = static_cast<size_t>(std::distance(first, last));
+    try {
+        _rebuild([this, &first]() {
+            Node* node = _createNode(nullptr, *first);
+            ++first;
+            return node;
+        }, count);
+    }
+    catch (...) {
+        _pool.release();
+        _root = nullptr;
+        _rightmost = nullptr;
+        _size = 0;
+        throw;
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename ForwardIt>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::insertBatch(ForwardIt first, ForwardIt last) {
+    auto nodeLess = [this](const Node* left, const Node* right) {
+        return _compare(left->keyValuePair.first, right->keyValuePair.first);
+    };
+    std::vector<Node*> batch;
+    try {
+        batch.reserve(static_cast<size_t>(std::distance(first, last)));
+        for (; first != last; ++first) {
+            batch.push_back(_createNode(nullptr, *first));
+        }
+        // равные ключи пакета остаются в порядке пакета, как при цикле insert
+        if (!std::is_sorted(batch.begin(), batch.end(), nodeLess)) {
+            std::stable_sort(batch.begin(), batch.end(), nodeLess);
+        }
+        if (batch.size() * _rebuildRatio >= _size) {
+            // слияние: при равных ключах старые узлы идут раньше новых
+            std::vector<Node*> existing = _inorderNodes();
+            std::vector<Node*> merged;
+            merged.reserve(existing.size() + batch.size());
+            std::merge(existing.begin(), existing.end(), batch.begin(), batch.end(),
+                       std::back_inserter(merged), nodeLess);
+            size_t index = 0;
+            _rebuild([&merged, &index]() { return merged[index++]; }, merged.size());
+            return;
+        }
+        for (size_t i = 0; i < batch.size(); i++) {
+            _insertNode(batch[i]);
+            // вставленные узлы уже принадлежат дереву
+            batch[i] = nullptr;
+        }
+    }
+    catch (...) {
+        for (Node* node : batch) {
+            if (node) {
+                _destroyNode(node);
+            }
+        }
+        throw;
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename ForwardIt>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::eraseBatch(ForwardIt first, ForwardIt last) {
+    static_assert(std::is_same<std::remove_cv_t<std::remove_reference_t<decltype(*first)>>, Key>::value,
+                  "eraseBatch expects a range of Key");
+    std::vector<const Key*> keys;
+    for (; first != last; ++first) {
+        keys.push_back(&*first);
+    }
+    std::sort(keys.begin(), keys.end(), [this](const Key* left, const Key* right) {
+        return _compare(*left, *right);
+    });
+    if (keys.size() * _rebuildRatio < _size) {
+        for (const Key* key : keys) {
+            _eraseKey(*key);
+        }
+        return;
+    }
+    // один проход по дереву и по отсортированным ключам, затем перестройка из оставшихся узлов
+    std::vector<Node*> existing = _inorderNodes();
+    std::vector<Node*> kept;
+    kept.reserve(existing.size());
+    size_t key = 0;
+    for (Node* node : existing) {
+        while (key < keys.size() && _compare(*keys[key], node->keyValuePair.first)) {
+            key++;
+        }
+        if (key == keys.size() || _compare(node->keyValuePair.first, *keys[key])) {
+            kept.push_back(node);
+        }
+    }
+    if (kept.size() == existing.size()) {
+        return;
+    }
+    size_t index = 0;
+    _rebuild([&kept, &index]() { return kept[index++]; }, kept.size());
+    key = 0;
+    for (Node* node : existing) {
+        if (key < kept.size() && kept[key] == node) {
+            key++;
+        }
+        else {
+            _destroyNode(node);
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::split(const Key& key, BinarySearchTree& greater) {
+    static_assert(!std::is_same_v<Balance, NoBalance>, "split requires a balanced tree");
+    if (&greater == this) {
+        return;
+    }
+    greater.clear();
+    _pool.share(greater._pool);
+    _SplitResult parts = _split(_wholeTree(), key, false);
+    _assignRoot(parts.less);
+    greater._assignRoot(parts.greater);
+    size_t total = _size;
+    if constexpr (_countsSizes) {
+        _size = _subtreeSize(_root);
+    }
+    else {
+        _size = _partSize(_root, greater._root, total);
+    }
+    greater._size = total - _size;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::join(BinarySearchTree& greater) {
+    static_assert(!std::is_same_v<Balance, NoBalance>, "join requires a balanced tree");
+    if (&greater == this || !greater._root) {
+        return;
+    }
+    _pool.adopt(greater._pool);
+    _assignRoot(_join2(_wholeTree(), greater._wholeTree()));
+    _size += greater._size;
+    greater._root = nullptr;
+    greater._rightmost = nullptr;
+    greater._size = 0;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::unite(const BinarySearchTree& other) {
+    if (&other == this) {
+        return;
+    }
+    if (other._size * _algebraRatio < _size) {
+        for (ConstIterator it = other.cbegin(); it != other.cend(); ++it) {
+            tryEmplace(it->first, it->second);
+        }
+        return;
+    }
+    BinarySearchTree copy(other);
+    unite(std::move(copy));
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::unite(BinarySearchTree&& other) {
+    static_assert(!std::is_same_v<Balance, NoBalance>, "unite requires a balanced tree");
+    if (&other == this) {
+        return;
+    }
+    if (other._size * _algebraRatio < _size) {
+        // при неудаче tryEmplace не трогает аргументы, остальное удалит clear
+        for (Node* node : other._inorderNodes()) {
+            tryEmplace(std::move(node->keyValuePair.first), std::move(node->keyValuePair.second));
+        }
+        other.clear();
+        return;
+    }
+    _pool.adopt(other._pool);
+    size_t total = _size + other._size;
+    _Subtree theirs = other._wholeTree();
+    other._root = nullptr;
+    other._rightmost = nullptr;
+    other._size = 0;
+    _Garbage garbage;
+    _assignRoot(_uniteSubtrees(_wholeTree(), theirs, garbage));
+    _size = total - _destroyGarbage(garbage);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::intersect(const BinarySearchTree& other) {
+    static_assert(!std::is_same_v<Balance, NoBalance>, "intersect requires a balanced tree");
+    if (&other == this) {
+        return;
+    }
+    if (_size * _algebraRatio < other._size) {
+        for (Node* node : _inorderNodes()) {
+            if (!other._findNode(node->keyValuePair.first)) {
+                _eraseNode(node);
+            }
+        }
+        return;
+    }
+    _Garbage garbage;
+    _assignRoot(_intersectSubtrees(_wholeTree(), other._wholeTree(), garbage));
+    _size -= _destroyGarbage(garbage);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::difference(const BinarySearchTree& other) {
+    static_assert(!std::is_same_v<Balance, NoBalance>, "difference requires a balanced tree");
+    if (&other == this) {
+        clear();
+        return;
+    }
+    if (other._size * _algebraRatio < _size) {
+        for (ConstIterator it = other.cbegin(); it != other.cend(); ++it) {
+            _eraseKey(it->first);
+        }
+        return;
+    }
+    _Garbage garbage;
+    _assignRoot(_differenceSubtrees(_wholeTree(), other._wholeTree(), garbage));
+    _size -= _destroyGarbage(garbage);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename Function>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::forEach(Function function) {
+    auto visit = [&function](Node* node) {
+        function(node->keyValuePair);
+        return true;
+    };
+    _reduceSubtree<bool>(_root, 0, [](bool, bool) { return true; }, visit);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename Function>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::forEach(const Key& low, const Key& high, Function function) {
+    auto visit = [&function](Node* node) {
+        function(node->keyValuePair);
+        return true;
+    };
+    _reduceRange<bool>(_root, 0, true, true, [](bool, bool) { return true; }, visit,
+                       [this, &low](const Node* node) { return !_compare(node->keyValuePair.first, low); },
+                       [this, &high](const Node* node) { return _compare(node->keyValuePair.first, high); });
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename T, typename Reduce, typename Transform>
+T BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::transformReduce(T init, Reduce reduce, Transform transform) const {
+    std::optional<T> result = _reduceSubtree<T>(_root, 0, reduce, [&transform](const Node* node) -> T {
+        return transform(node->keyValuePair);
+    });
+    return result ? reduce(std::move(init), std::move(*result)) : init;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename T, typename Reduce, typename Transform>
+T BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::transformReduce
+(const Key& low, const Key& high, T init, Reduce reduce, Transform transform) const {
+    std::optional<T> result = _reduceRange<T>(
+        _root, 0, true, true, reduce, [&transform](const Node* node) -> T { return transform(node->keyValuePair); },
+        [this, &low](const Node* node) { return !_compare(node->keyValuePair.first, low); },
+        [this, &high](const Node* node) { return _compare(node->keyValuePair.first, high); });
+    return result ? reduce(std::move(init), std::move(*result)) : init;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename T, typename Reduce>
+T BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::reduce(T init, Reduce reduce) const {
+    return transformReduce(std::move(init), reduce, [](const std::pair<Key, Value>& pair) -> const Value& {
+        return pair.second;
+    });
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename T, typename Reduce>
+T BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::reduce(const Key& low, const Key& high, T init, Reduce reduce) const {
+    return transformReduce(low, high, std::move(init), reduce, [](const std::pair<Key, Value>& pair) -> const Value& {
+        return pair.second;
+    });
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename NextNode>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_rebuild(NextNode nextNode, size_t count) {
+    _root = nullptr;
+    _rightmost = nullptr;
+    _size = 0;
+    if (count == 0) {
+        return;
+    }
+    // все уровни кроме последнего заполнены, последний (глубина floor(log2 n))
+    // красится в красный, тогда черная высота всех путей одинакова
+    size_t redDepth = 0;
+    while ((size_t(2) << redDepth) <= count) {
+        redDepth++;
+    }
+    _root = _buildBalanced(nextNode, count, 0, redDepth);
+    _root->parent = nullptr;
+    if constexpr (std::is_same_v<Balance, RedBlackBalance>) {
+        _root->balanceInfo = _black;
+    }
+    _size = count;
+    _resetRightmost();
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename NextNode>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node* 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_buildBalanced(NextNode& nextNode, size_t count, size_t depth, size_t redDepth) {
+    if (count == 0) {
+        return nullptr;
+    }
+    size_t leftCount = (count - 1) / 2;
+    Node* left = _buildBalanced(nextNode, leftCount, depth + 1, redDepth);
+    Node* node = nextNode();
+    node->left = left;
+    if (left) {
+        left->parent = node;
+    }
+    node->right = _buildBalanced(nextNode, count - 1 - leftCount, depth + 1, redDepth);
+    if (node->right) {
+        node->right->parent = node;
+    }
+    if constexpr (std::is_same_v<Balance, RedBlackBalance>) {
+        node->balanceInfo = depth == redDepth ? _red : _black;
+    }
+    else if constexpr (_isTreap) {
+        // куча по глубине: новые узлы со случайными приоритетами встают под готовый каркас
+        node->priority = std::numeric_limits<std::uint32_t>::max() - std::uint32_t(depth);
+    }
+    _updateNode(node);
+    return node;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+std::vector<typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node*> 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_inorderNodes() const {
+    std::vector<Node*> nodes;
+    nodes.reserve(_size);
+    Node* node = _root;
+    while (node && node->left) {
+        node = node->left;
+    }
+    for (; node; node = node->nextNode()) {
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node* 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_cloneNode(const Node* node, Node* parent) {
+    Node* copy = _createNode(parent, node->keyValuePair);
+    static_cast<_NodeData&>(*copy) = static_cast<const _NodeData&>(*node);
+    copy->balanceInfo = node->balanceInfo;
+    copy->priority = node->priority;
+    return copy;
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::swap(BinarySearchTree& other) noexcept {
+    std::swap(_size, other._size);
+    std::swap(_root, other._root);
+    std::swap(_rightmost, other._rightmost);
+    std::swap(_compare, other._compare);
+    _pool.swap(other._pool);
+}
+
+//Stats
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+size_t BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::height() const {
+    if constexpr (std::is_same_v<Balance, AvlBalance>) {
+        return _height(_root);
     }
-    Node* search = _root;
-    while (true) { 
-        if (key == search->keyValuePair.first) {
-            return search;
-        }
-        if (key < search->keyValuePair.first) {
-            if (!search->left) {
-                return nullptr;
+    else {
+        // обход в глубину по ссылкам на родителя без стека: вырожденное
+        // дерево без балансировки может быть глубиной в n узлов
+        size_t height = 0;
+        size_t depth = 1;
+        const Node* node = _root;
+        while (node) {
+            height = std::max(height, depth);
+            if (node->left) {
+                node = node->left;
+                depth++;
+                continue;
             }
-            search = search->left;
-        }
-        if (key > search->keyValuePair.first) {
-            if (!search->right) {
-                return nullptr;
+            if (node->right) {
+                node = node->right;
+                depth++;
+                continue;
             }
-            search = search->right;
+            // подняться до первого предка, правое поддерево которого еще не пройдено
+            const Node* parent = node->parent;
+            while (parent && (parent->right == node || !parent->right)) {
+                node = parent;
+                parent = node->parent;
+                depth--;
+            }
+            node = parent ? parent->right : nullptr;
         }
+        return height;
     }
 }
 
-template <typename Key, typename Value>
-std::pair<typename BinarySearchTree<Key, Value>::Iterator, 
-typename BinarySearchTree<Key, Value>::Iterator> 
-BinarySearchTree<Key, Value>::equalRange(const Key& key) {
-    Iterator begin = find(key);
-    Iterator end = begin;
-    while ((*end).first == (*begin).first) {
-        end++;
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+TreeStats BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::stats() const {
+    static_assert(Stats::enabled, "stats requires CollectStats");
+    const auto& counters = this->_stats;
+    TreeStats result;
+    result.finds = counters.finds.load(std::memory_order_relaxed);
+    result.findVisits = counters.findVisits.load(std::memory_order_relaxed);
+    result.inserts = counters.inserts.load(std::memory_order_relaxed);
+    result.insertVisits = counters.insertVisits.load(std::memory_order_relaxed);
+    result.maxDepth = counters.maxDepth.load(std::memory_order_relaxed);
+    result.allocations = counters.allocations.load(std::memory_order_relaxed);
+    result.frees = counters.frees.load(std::memory_order_relaxed);
+    for (size_t depth = 0; depth < TreeStats::depthBuckets; depth++) {
+        result.findDepths[depth] = counters.findDepths[depth].load(std::memory_order_relaxed);
+        result.insertDepths[depth] = counters.insertDepths[depth].load(std::memory_order_relaxed);
     }
-    return std::pair<Iterator, Iterator> (begin, end);
+    return result;
 }
 
-template <typename Key, typename Value>
-std::pair<typename BinarySearchTree<Key, Value>::ConstIterator, 
-typename BinarySearchTree<Key, Value>::ConstIterator> 
-BinarySearchTree<Key, Value>::equalRange(const Key& key) const {
-    ConstIterator begin = find(key);
-    ConstIterator end = begin;
-    while ((*end).first == (*begin).first) {
-        end++;
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::resetStats() {
+    static_assert(Stats::enabled, "resetStats requires CollectStats");
+    auto& counters = this->_stats;
+    for (auto* counter : {&counters.finds, &counters.findVisits, &counters.inserts, &counters.insertVisits,
+                          &counters.maxDepth, &counters.allocations, &counters.frees}) {
+        counter->store(0, std::memory_order_relaxed);
+    }
+    for (size_t depth = 0; depth < TreeStats::depthBuckets; depth++) {
+        counters.findDepths[depth].store(0, std::memory_order_relaxed);
+        counters.insertDepths[depth].store(0, std::memory_order_relaxed);
     }
-    return std::pair<ConstIterator, ConstIterator> (begin, end);
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::ConstIterator 
-BinarySearchTree<Key, Value>::min(const Key& key) const {
-    auto range = equalRange(key);
-    auto min = range.first;
-    for (auto it = range.first; it < range.second; it++) {
-        if ((*it).second < (*min).second) {
-            min = it;
-        }
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+template <typename... Args>
+typename BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::Node* 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_createNode(Node* parent, Args&&... args) {
+    Node* node = _pool.create(parent, std::forward<Args>(args)...);
+    if constexpr (Stats::enabled) {
+        this->_stats.allocations.fetch_add(1, std::memory_order_relaxed);
     }
-    return min;
+    return node;
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::ConstIterator 
-BinarySearchTree<Key, Value>::max(const Key& key) const {
-    auto range = equalRange(key);
-    auto max = range.first;
-    for (auto it = range.first; it < range.second; it++) {
-        if ((*it).second > (*max).second) {
-            max = it;
-        }
-    }
-    return max;
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_destroyNode(Node* node) {
+    _pool.destroy(node);
+    _recordFrees(1);
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::Iterator 
-BinarySearchTree<Key, Value>::begin() {
-    Node* search = _root;
-    while (search->left) {
-        search = search->left;
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_recordFind(size_t visits) const {
+    if constexpr (Stats::enabled) {
+        this->_stats.finds.fetch_add(1, std::memory_order_relaxed);
+        this->_stats.findVisits.fetch_add(visits, std::memory_order_relaxed);
+        _recordDepth(this->_stats.maxDepth, this->_stats.findDepths, visits);
     }
-    return Iterator(search);
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::Iterator 
-BinarySearchTree<Key, Value>::end() {
-    return Iterator(nullptr);
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_recordInsert(size_t visits) const {
+    if constexpr (Stats::enabled) {
+        this->_stats.inserts.fetch_add(1, std::memory_order_relaxed);
+        this->_stats.insertVisits.fetch_add(visits, std::memory_order_relaxed);
+        _recordDepth(this->_stats.maxDepth, this->_stats.insertDepths, visits);
+    }
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::ConstIterator 
-BinarySearchTree<Key, Value>::cbegin() const {
-    Node* search = _root;
-    while (search->left) {
-        search = search->left;
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_recordFrees(size_t count) const {
+    if constexpr (Stats::enabled) {
+        this->_stats.frees.fetch_add(count, std::memory_order_relaxed);
     }
-    return ConstIterator(search);
 }
 
-template <typename Key, typename Value>
-typename BinarySearchTree<Key, Value>::ConstIterator 
-BinarySearchTree<Key, Value>::cend() const {
-    return ConstIterator(nullptr);
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::_recordDepth(std::atomic<size_t>& maxDepth, _DepthHistogram& histogram, size_t visits) {
+    histogram[std::min(visits, TreeStats::depthBuckets - 1)].fetch_add(1, std::memory_order_relaxed);
+    // максимум меняется редко, обычно хватает одного чтения
+    size_t current = maxDepth.load(std::memory_order_relaxed);
+    while (visits > current && !maxDepth.compare_exchange_weak(current, visits, std::memory_order_relaxed)) {}
 }
 
-template <typename Key, typename Value>
-size_t BinarySearchTree<Key, Value>::size() const {
-    return _size;
+//Mapped
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+void BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::save(const std::string& path) const {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "save requires trivially copyable keys and values");
+    MappedWriter<std::pair<Key, Value>> writer(path, sizeof(Key), sizeof(Value));
+    // повторы ключей идут подряд, их отсутствие отмечается в заголовке
+    bool uniqueKeys = true;
+    const Key* previous = nullptr;
+    for (auto it = cbegin(); it != cend(); ++it) {
+        if (previous && !_compare(*previous, it->first)) {
+            uniqueKeys = false;
+        }
+        previous = &it->first;
+        writer.emplace(it->first, it->second);
+    }
+    writer.commit(uniqueKeys ? MappedHeader::uniqueKeys : 0);
+}
+
+template <typename Key, typename Value, typename Compare, typename Balance, typename Augmentation, typename Allocator, typename Stats>
+MappedMap<Key, Value, Compare> 
+BinarySearchTree<Key, Value, Compare, Balance, Augmentation, Allocator, Stats>::openMapped(const std::string& path, const Compare& compare) {
+    return MappedMap<Key, Value, Compare>(path, compare);
 }
 
 //MAP
 
 //BigFive
-template <typename Key, typename Value>
-Map<Key, Value>::Map(const Map& other) {
-    _tree = other._tree;
-}
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+Map<Key, Value, Compare, Engine>::Map(ForwardIt first, ForwardIt last) 
+: _tree(first, last) {}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+Map<Key, Value, Compare, Engine>::Map(const Map& other) 
+: _tree(other._tree) {}
 
-template <typename Key, typename Value>
-Map<Key, Value>& Map<Key, Value>::operator=(const Map& other) {
+template <typename Key, typename Value, typename Compare, typename Engine>
+Map<Key, Value, Compare, Engine>& Map<Key, Value, Compare, Engine>::operator=(const Map& other) {
     if (&other != this) {
-        delete _tree;
         _tree = other._tree;
     }
-    return this;
+    return *this;
 }
 
-template <typename Key, typename Value>
-Map<Key, Value>::Map(Map&& other) noexcept {
-    _tree = std::move(other._tree);
-}
+template <typename Key, typename Value, typename Compare, typename Engine>
+Map<Key, Value, Compare, Engine>::Map(Map&& other) noexcept 
+: _tree(std::move(other._tree)) {}
 
-template <typename Key, typename Value>
-Map<Key, Value>& Map<Key, Value>::operator=(Map&& other) noexcept {
+template <typename Key, typename Value, typename Compare, typename Engine>
+Map<Key, Value, Compare, Engine>& Map<Key, Value, Compare, Engine>::operator=(Map&& other) noexcept {
     if (&other != this) {
-        delete _tree;
-        this = std::move(other);
+        _tree = std::move(other._tree);
     }
-    return this;
+    return *this;
 }
 
 //Methods
-template <typename Key, typename Value>
-void Map<Key, Value>::insert(const Key& key, const Value& value) {   
-    MapIterator it = find(key);
-    if (*it) {
-        (*it).second = value;
+template <typename Key, typename Value, typename Compare, typename Engine>
+std::pair<typename Map<Key, Value, Compare, Engine>::MapIterator, bool> 
+Map<Key, Value, Compare, Engine>::insert(const Key& key, const Value& value) {   
+    return insertOrAssign(key, value);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+std::pair<typename Map<Key, Value, Compare, Engine>::MapIterator, bool> 
+Map<Key, Value, Compare, Engine>::insert(Key&& key, Value&& value) {   
+    return insertOrAssign(std::move(key), std::move(value));
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename V>
+std::pair<typename Map<Key, Value, Compare, Engine>::MapIterator, bool> 
+Map<Key, Value, Compare, Engine>::insertOrAssign(const Key& key, V&& value) {
+    auto result = _tree.tryEmplace(key, std::forward<V>(value));
+    if (!result.second) {
+        _tree.assignValue(result.first, std::forward<V>(value));
     }
-    else {
-        _tree.insert(key, value);
+    return result;
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename V>
+std::pair<typename Map<Key, Value, Compare, Engine>::MapIterator, bool> 
+Map<Key, Value, Compare, Engine>::insertOrAssign(Key&& key, V&& value) {
+    auto result = _tree.tryEmplace(std::move(key), std::forward<V>(value));
+    if (!result.second) {
+        _tree.assignValue(result.first, std::forward<V>(value));
+    }
+    return result;
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename... Args>
+std::pair<typename Map<Key, Value, Compare, Engine>::MapIterator, bool> 
+Map<Key, Value, Compare, Engine>::tryEmplace(const Key& key, Args&&... args) {
+    return _tree.tryEmplace(key, std::forward<Args>(args)...);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename... Args>
+std::pair<typename Map<Key, Value, Compare, Engine>::MapIterator, bool> 
+Map<Key, Value, Compare, Engine>::tryEmplace(Key&& key, Args&&... args) {
+    return _tree.tryEmplace(std::move(key), std::forward<Args>(args)...);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::MapIterator 
+Map<Key, Value, Compare, Engine>::insert(MapIterator hint, const Key& key, const Value& value) {
+    auto result = _tree.tryEmplace(hint, key, value);
+    if (!result.second) {
+        _tree.assignValue(result.first, value);
+    }
+    return result.first;
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::MapIterator 
+Map<Key, Value, Compare, Engine>::insert(MapIterator hint, Key&& key, Value&& value) {
+    auto result = _tree.tryEmplace(hint, std::move(key), std::move(value));
+    if (!result.second) {
+        _tree.assignValue(result.first, std::move(value));
     }
+    return result.first;
 }
 
-template <typename Key, typename Value>
-void Map<Key, Value>::erase(const Key& key) {
+template <typename Key, typename Value, typename Compare, typename Engine>
+void Map<Key, Value, Compare, Engine>::erase(const Key& key) {
     _tree.erase(key);
 }
 
-template <typename Key, typename Value>
-typename Map<Key, Value>::ConstMapIterator 
-Map<Key, Value>::find(const Key& key) const { 
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::MapIterator Map<Key, Value, Compare, Engine>::erase(MapIterator position) {
+    return _tree.erase(position);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename E>
+typename E::Cursor Map<Key, Value, Compare, Engine>::cursor() const {
+    return typename E::Cursor(_tree);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Map<Key, Value, Compare, Engine>::erase(const K& key) -> _IfTransparent<K, void> {
+    _tree.erase(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+void Map<Key, Value, Compare, Engine>::insertBatch(ForwardIt first, ForwardIt last) {
+    Compare compare = _tree.keyComp();
+    auto itemLess = [&compare](const std::pair<Key, Value>& left, const std::pair<Key, Value>& right) {
+        return compare(left.first, right.first);
+    };
+    std::vector<std::pair<Key, Value>> items(first, last);
+    if (!std::is_sorted(items.begin(), items.end(), itemLess)) {
+        std::stable_sort(items.begin(), items.end(), itemLess);
+    }
+    size_t unique = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (unique > 0 && !compare(items[unique - 1].first, items[i].first)) {
+            items[unique - 1] = std::move(items[i]);
+        }
+        else {
+            if (unique != i) {
+                items[unique] = std::move(items[i]);
+            }
+            unique++;
+        }
+    }
+    items.resize(unique);
+
+    std::vector<MapIterator> found;
+    found.reserve(items.size());
+    _tree.findBatch(_KeyIterator<typename std::vector<std::pair<Key, Value>>::iterator>(items.begin()),
+                    _KeyIterator<typename std::vector<std::pair<Key, Value>>::iterator>(items.end()),
+                    std::back_inserter(found));
+    // новые пары сдвигаются в начало и вставляются движком одним пакетом
+    size_t fresh = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (found[i] != _tree.end()) {
+            _tree.assignValue(found[i], std::move(items[i].second));
+        }
+        else {
+            if (fresh != i) {
+                items[fresh] = std::move(items[i]);
+            }
+            fresh++;
+        }
+    }
+    _tree.insertBatch(std::make_move_iterator(items.begin()), std::make_move_iterator(items.begin() + fresh));
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+void Map<Key, Value, Compare, Engine>::_insertAbsent(ForwardIt first, ForwardIt last) {
+    _tree.insertBatch(first, last);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+void Map<Key, Value, Compare, Engine>::eraseBatch(ForwardIt first, ForwardIt last) {
+    _tree.eraseBatch(first, last);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+void Map<Key, Value, Compare, Engine>::unite(const Map& other) {
+    _tree.unite(other._tree);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+void Map<Key, Value, Compare, Engine>::unite(Map&& other) {
+    _tree.unite(std::move(other._tree));
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+void Map<Key, Value, Compare, Engine>::intersect(const Map& other) {
+    _tree.intersect(other._tree);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+void Map<Key, Value, Compare, Engine>::difference(const Map& other) {
+    _tree.difference(other._tree);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename Function>
+void Map<Key, Value, Compare, Engine>::forEach(Function function) {
+    _tree.forEach(function);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename Function>
+void Map<Key, Value, Compare, Engine>::forEach(const Key& low, const Key& high, Function function) {
+    _tree.forEach(low, high, function);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename T, typename Reduce, typename Transform>
+T Map<Key, Value, Compare, Engine>::transformReduce(T init, Reduce reduce, Transform transform) const {
+    return _tree.transformReduce(std::move(init), reduce, transform);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename T, typename Reduce, typename Transform>
+T Map<Key, Value, Compare, Engine>::transformReduce(const Key& low, const Key& high, T init, Reduce reduce, Transform transform) const {
+    return _tree.transformReduce(low, high, std::move(init), reduce, transform);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename T, typename Reduce>
+T Map<Key, Value, Compare, Engine>::reduce(T init, Reduce reduce) const {
+    return _tree.reduce(std::move(init), reduce);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename T, typename Reduce>
+T Map<Key, Value, Compare, Engine>::reduce(const Key& low, const Key& high, T init, Reduce reduce) const {
+    return _tree.reduce(low, high, std::move(init), reduce);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+void Map<Key, Value, Compare, Engine>::assign(ForwardIt first, ForwardIt last) {
+    _tree.assign(first, last);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::ConstMapIterator 
+Map<Key, Value, Compare, Engine>::find(const Key& key) const { 
+    return _tree.find(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::MapIterator Map<Key, Value, Compare, Engine>::find(const Key& key) {
+    return _tree.find(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Map<Key, Value, Compare, Engine>::find(const K& key) const -> _IfTransparent<K, ConstMapIterator> {
     return _tree.find(key);
 }
 
-template <typename Key, typename Value>
-typename Map<Key, Value>::MapIterator Map<Key, Value>::find(const Key& key) {
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Map<Key, Value, Compare, Engine>::find(const K& key) -> _IfTransparent<K, MapIterator> {
     return _tree.find(key);
 }
 
-template <typename Key, typename Value>
-const Value& Map<Key, Value>::operator[](const Key& key) const {
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt, typename OutputIt>
+OutputIt Map<Key, Value, Compare, Engine>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return _tree.findBatch(first, last, out);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt, typename OutputIt>
+OutputIt Map<Key, Value, Compare, Engine>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) {
+    return _tree.findBatch(first, last, out);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt, typename OutputIt>
+OutputIt Map<Key, Value, Compare, Engine>::containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return _tree.containsBatch(first, last, out);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::ConstMapIterator 
+Map<Key, Value, Compare, Engine>::lowerBound(const Key& key) const {
+    return _tree.lowerBound(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::MapIterator Map<Key, Value, Compare, Engine>::lowerBound(const Key& key) {
+    return _tree.lowerBound(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Map<Key, Value, Compare, Engine>::lowerBound(const K& key) const -> _IfTransparent<K, ConstMapIterator> {
+    return _tree.lowerBound(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Map<Key, Value, Compare, Engine>::lowerBound(const K& key) -> _IfTransparent<K, MapIterator> {
+    return _tree.lowerBound(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::ConstMapIterator 
+Map<Key, Value, Compare, Engine>::upperBound(const Key& key) const {
+    return _tree.upperBound(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::MapIterator Map<Key, Value, Compare, Engine>::upperBound(const Key& key) {
+    return _tree.upperBound(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Map<Key, Value, Compare, Engine>::upperBound(const K& key) const -> _IfTransparent<K, ConstMapIterator> {
+    return _tree.upperBound(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Map<Key, Value, Compare, Engine>::upperBound(const K& key) -> _IfTransparent<K, MapIterator> {
+    return _tree.upperBound(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+const Value& Map<Key, Value, Compare, Engine>::operator[](const Key& key) const {
     return (*find(key)).second;
 }
 
-template <typename Key, typename Value>
-Value& Map<Key, Value>::operator[](const Key& key) {
-    try {
-        return ((*find(key)).second);
-    }
-    catch (...) {
-        insert(key, Value());
-        return ((*find(key)).second);
-    }
+template <typename Key, typename Value, typename Compare, typename Engine>
+Value& Map<Key, Value, Compare, Engine>::operator[](const Key& key) {
+    return tryEmplace(key).first->second;
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+Value& Map<Key, Value, Compare, Engine>::operator[](Key&& key) {
+    return tryEmplace(std::move(key)).first->second;
 }
 
-template <typename Key, typename Value>
-typename Map<Key, Value>::MapIterator Map<Key, Value>::begin() {
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::MapIterator Map<Key, Value, Compare, Engine>::begin() {
     return _tree.begin();
 }
 
-template <typename Key, typename Value>
-typename Map<Key, Value>::MapIterator Map<Key, Value>::end() {
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::MapIterator Map<Key, Value, Compare, Engine>::end() {
     return _tree.end();
 }
 
-template <typename Key, typename Value>
-typename Map<Key, Value>::ConstMapIterator Map<Key, Value>::cbegin() const {
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::ConstMapIterator Map<Key, Value, Compare, Engine>::cbegin() const {
     return _tree.cbegin();
 }
 
-template <typename Key, typename Value>
-typename Map<Key, Value>::ConstMapIterator Map<Key, Value>::cend() const {
+template <typename Key, typename Value, typename Compare, typename Engine>
+typename Map<Key, Value, Compare, Engine>::ConstMapIterator Map<Key, Value, Compare, Engine>::cend() const {
     return _tree.cend();
 }
 
-template <typename Key, typename Value>
-size_t Map<Key, Value>::size() const {
+template <typename Key, typename Value, typename Compare, typename Engine>
+size_t Map<Key, Value, Compare, Engine>::size() const {
     return _tree.size();
 }
 
+template <typename Key, typename Value, typename Compare, typename Engine>
+Compare Map<Key, Value, Compare, Engine>::keyComp() const {
+    return _tree.keyComp();
+}
+
+//Mapped
+template <typename Key, typename Value, typename Compare, typename Engine>
+void Map<Key, Value, Compare, Engine>::save(const std::string& path) const {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "save requires trivially copyable keys and values");
+    MappedWriter<std::pair<Key, Value>> writer(path, sizeof(Key), sizeof(Value));
+    for (auto it = _tree.cbegin(); it != _tree.cend(); ++it) {
+        writer.emplace(it->first, it->second);
+    }
+    writer.commit(MappedHeader::uniqueKeys);
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+MappedMap<Key, Value, Compare> Map<Key, Value, Compare, Engine>::openMapped(const std::string& path, const Compare& compare) {
+    return MappedMap<Key, Value, Compare>(path, compare);
+}
+
+//KeyIterator
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+Map<Key, Value, Compare, Engine>::_KeyIterator<ForwardIt>::_KeyIterator(ForwardIt it) 
+: _it(it) {}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+typename Map<Key, Value, Compare, Engine>::template _KeyIterator<ForwardIt>::reference 
+Map<Key, Value, Compare, Engine>::_KeyIterator<ForwardIt>::operator*() const {
+    return (*_it).first;
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+typename Map<Key, Value, Compare, Engine>::template _KeyIterator<ForwardIt>& 
+Map<Key, Value, Compare, Engine>::_KeyIterator<ForwardIt>::operator++() {
+    ++_it;
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+bool Map<Key, Value, Compare, Engine>::_KeyIterator<ForwardIt>::operator==(const _KeyIterator& other) const {
+    return _it == other._it;
+}
+
+template <typename Key, typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+bool Map<Key, Value, Compare, Engine>::_KeyIterator<ForwardIt>::operator!=(const _KeyIterator& other) const {
+    return !(*this == other);
+}
+
 //SET
 
 //BigFive
-template <typename Value>
-Set<Value>::Set(const Set& other) {
-    _map = other._map;
-}
+template <typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+Set<Value, Compare, Engine>::Set(ForwardIt first, ForwardIt last) 
+: _map(_PairIterator<ForwardIt>(first), _PairIterator<ForwardIt>(last)) {}
+
+template <typename Value, typename Compare, typename Engine>
+Set<Value, Compare, Engine>::Set(const Set& other) 
+: _map(other._map) {}
 
-template <typename Value>
-Set<Value>& Set<Value>::operator=(const Set& other) {
+template <typename Value, typename Compare, typename Engine>
+Set<Value, Compare, Engine>& Set<Value, Compare, Engine>::operator=(const Set& other) {
     if (&other != this) {
-        delete _map;
         _map = other._map;
     }
-    return this;
+    return *this;
 }
 
-template <typename Value>
-Set<Value>::Set(Set&& other) noexcept {
-    _map = std::move(other._map);
-}
+template <typename Value, typename Compare, typename Engine>
+Set<Value, Compare, Engine>::Set(Set&& other) noexcept 
+: _map(std::move(other._map)) {}
 
-template <typename Value>
-Set<Value>& Set<Value>::operator=(Set&& other) noexcept {
+template <typename Value, typename Compare, typename Engine>
+Set<Value, Compare, Engine>& Set<Value, Compare, Engine>::operator=(Set&& other) noexcept {
     if (&other != this) {
-        delete _map;
-        this = std::move(other);
+        _map = std::move(other._map);
     }
-    return this;
+    return *this;
 }
 
 //Methods
-template <typename Value>
-void Set<Value>::insert(const Value& value) {
-    _map.insert(value, value);
+template <typename Value, typename Compare, typename Engine>
+std::pair<typename Set<Value, Compare, Engine>::SetIterator, bool> 
+Set<Value, Compare, Engine>::insert(const Value& value) {
+    return _map.tryEmplace(value, value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+std::pair<typename Set<Value, Compare, Engine>::SetIterator, bool> 
+Set<Value, Compare, Engine>::insert(Value&& value) {
+    // ключ копируется раньше, чем значение перемещается в узел
+    return _map.tryEmplace(static_cast<const Value&>(value), std::move(value));
+}
+
+template <typename Value, typename Compare, typename Engine>
+typename Set<Value, Compare, Engine>::SetIterator Set<Value, Compare, Engine>::insert(SetIterator hint, const Value& value) {
+    return _map.insert(hint, value, value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+void Set<Value, Compare, Engine>::erase(const Value& value) {
+    _map.erase(value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+typename Set<Value, Compare, Engine>::SetIterator Set<Value, Compare, Engine>::erase(SetIterator position) {
+    return _map.erase(position);
 }
 
-template <typename Value>
-void Set<Value>::erase(const Value& value) {
+template <typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Set<Value, Compare, Engine>::erase(const K& value) -> _IfTransparent<K, void> {
     _map.erase(value);
 }
 
-template <typename Value>
-typename Set<Value>::ConstSetIterator Set<Value>::find(const Value& value) const {
+template <typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+void Set<Value, Compare, Engine>::insertBatch(ForwardIt first, ForwardIt last) {
+    Compare compare = _map.keyComp();
+    std::vector<Value> values(first, last);
+    // из равных значений пакета остается первое, существующие значения не заменяются,
+    // поэтому после containsBatch новые значения уходят движку без второго поиска
+    std::stable_sort(values.begin(), values.end(), compare);
+    values.erase(std::unique(values.begin(), values.end(), [&compare](const Value& left, const Value& right) {
+        return !compare(left, right);
+    }), values.end());
+    std::vector<char> present(values.size());
+    _map.containsBatch(values.begin(), values.end(), present.begin());
+    size_t fresh = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        if (!present[i]) {
+            if (fresh != i) {
+                values[fresh] = std::move(values[i]);
+            }
+            fresh++;
+        }
+    }
+    using It = typename std::vector<Value>::iterator;
+    _map._insertAbsent(_PairIterator<It>(values.begin()), _PairIterator<It>(values.begin() + fresh));
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+void Set<Value, Compare, Engine>::eraseBatch(ForwardIt first, ForwardIt last) {
+    _map.eraseBatch(first, last);
+}
+
+template <typename Value, typename Compare, typename Engine>
+void Set<Value, Compare, Engine>::unite(const Set& other) {
+    _map.unite(other._map);
+}
+
+template <typename Value, typename Compare, typename Engine>
+void Set<Value, Compare, Engine>::unite(Set&& other) {
+    _map.unite(std::move(other._map));
+}
+
+template <typename Value, typename Compare, typename Engine>
+void Set<Value, Compare, Engine>::intersect(const Set& other) {
+    _map.intersect(other._map);
+}
+
+template <typename Value, typename Compare, typename Engine>
+void Set<Value, Compare, Engine>::difference(const Set& other) {
+    _map.difference(other._map);
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename Function>
+void Set<Value, Compare, Engine>::forEach(Function function) const {
+    _map.transformReduce(true, [](bool, bool) { return true; }, [&function](const std::pair<Value, Value>& pair) {
+        function(pair.first);
+        return true;
+    });
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename Function>
+void Set<Value, Compare, Engine>::forEach(const Value& low, const Value& high, Function function) const {
+    _map.transformReduce(low, high, true, [](bool, bool) { return true; },
+                         [&function](const std::pair<Value, Value>& pair) {
+                             function(pair.first);
+                             return true;
+                         });
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename T, typename Reduce, typename Transform>
+T Set<Value, Compare, Engine>::transformReduce(T init, Reduce reduce, Transform transform) const {
+    return _map.transformReduce(std::move(init), reduce, [&transform](const std::pair<Value, Value>& pair) {
+        return transform(pair.first);
+    });
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename T, typename Reduce, typename Transform>
+T Set<Value, Compare, Engine>::transformReduce(const Value& low, const Value& high, T init, Reduce reduce, Transform transform) const {
+    return _map.transformReduce(low, high, std::move(init), reduce, [&transform](const std::pair<Value, Value>& pair) {
+        return transform(pair.first);
+    });
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename T, typename Reduce>
+T Set<Value, Compare, Engine>::reduce(T init, Reduce reduce) const {
+    return _map.reduce(std::move(init), reduce);
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename T, typename Reduce>
+T Set<Value, Compare, Engine>::reduce(const Value& low, const Value& high, T init, Reduce reduce) const {
+    return _map.reduce(low, high, std::move(init), reduce);
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+void Set<Value, Compare, Engine>::assign(ForwardIt first, ForwardIt last) {
+    _map.assign(_PairIterator<ForwardIt>(first), _PairIterator<ForwardIt>(last));
+}
+
+template <typename Value, typename Compare, typename Engine>
+typename Set<Value, Compare, Engine>::ConstSetIterator Set<Value, Compare, Engine>::find(const Value& value) const {
     return _map.find(value);
 }
 
-template <typename Value>
-typename Set<Value>::SetIterator Set<Value>::find(const Value& key) {
+template <typename Value, typename Compare, typename Engine>
+typename Set<Value, Compare, Engine>::SetIterator Set<Value, Compare, Engine>::find(const Value& key) {
     return _map.find(key);
 }
 
-template <typename Value>
-bool Set<Value>::contains(const Value& value) const {
-    try {
-        find(value);
-        return true;
-    }
-    catch (...) {
-        return false;
+template <typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Set<Value, Compare, Engine>::find(const K& value) const -> _IfTransparent<K, ConstSetIterator> {
+    return _map.find(value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Set<Value, Compare, Engine>::find(const K& value) -> _IfTransparent<K, SetIterator> {
+    return _map.find(value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename ForwardIt, typename OutputIt>
+OutputIt Set<Value, Compare, Engine>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return _map.findBatch(first, last, out);
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename ForwardIt, typename OutputIt>
+OutputIt Set<Value, Compare, Engine>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) {
+    return _map.findBatch(first, last, out);
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename ForwardIt, typename OutputIt>
+OutputIt Set<Value, Compare, Engine>::containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return _map.containsBatch(first, last, out);
+}
+
+template <typename Value, typename Compare, typename Engine>
+typename Set<Value, Compare, Engine>::ConstSetIterator Set<Value, Compare, Engine>::lowerBound(const Value& value) const {
+    return _map.lowerBound(value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+typename Set<Value, Compare, Engine>::SetIterator Set<Value, Compare, Engine>::lowerBound(const Value& value) {
+    return _map.lowerBound(value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Set<Value, Compare, Engine>::lowerBound(const K& value) const -> _IfTransparent<K, ConstSetIterator> {
+    return _map.lowerBound(value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Set<Value, Compare, Engine>::lowerBound(const K& value) -> _IfTransparent<K, SetIterator> {
+    return _map.lowerBound(value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+typename Set<Value, Compare, Engine>::ConstSetIterator Set<Value, Compare, Engine>::upperBound(const Value& value) const {
+    return _map.upperBound(value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+typename Set<Value, Compare, Engine>::SetIterator Set<Value, Compare, Engine>::upperBound(const Value& value) {
+    return _map.upperBound(value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Set<Value, Compare, Engine>::upperBound(const K& value) const -> _IfTransparent<K, ConstSetIterator> {
+    return _map.upperBound(value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename K>
+auto Set<Value, Compare, Engine>::upperBound(const K& value) -> _IfTransparent<K, SetIterator> {
+    return _map.upperBound(value);
+}
+
+template <typename Value, typename Compare, typename Engine>
+typename Set<Value, Compare, Engine>::SetIterator Set<Value, Compare, Engine>::begin() {
+    return _map.begin();
+}
+
+template <typename Value, typename Compare, typename Engine>
+typename Set<Value, Compare, Engine>::SetIterator Set<Value, Compare, Engine>::end() {
+    return _map.end();
+}
+
+template <typename Value, typename Compare, typename Engine>
+typename Set<Value, Compare, Engine>::ConstSetIterator Set<Value, Compare, Engine>::cbegin() const {
+    return _map.cbegin();
+}
+
+template <typename Value, typename Compare, typename Engine>
+typename Set<Value, Compare, Engine>::ConstSetIterator Set<Value, Compare, Engine>::cend() const {
+    return _map.cend();
+}
+
+template <typename Value, typename Compare, typename Engine>
+size_t Set<Value, Compare, Engine>::size() const {
+    return _map.size();
+}
+
+template <typename Value, typename Compare, typename Engine>
+bool Set<Value, Compare, Engine>::contains(const Value& value) const {
+    return _map.find(value) != _map.cend();
+}
+
+//Mapped
+template <typename Value, typename Compare, typename Engine>
+void Set<Value, Compare, Engine>::save(const std::string& path) const {
+    static_assert(std::is_trivially_copyable_v<Value>, "save requires trivially copyable values");
+    MappedWriter<Value> writer(path, sizeof(Value), 0);
+    for (auto it = _map.cbegin(); it != _map.cend(); ++it) {
+        writer.emplace(it->first);
     }
+    writer.commit(MappedHeader::uniqueKeys | MappedHeader::valuesOnly);
+}
+
+template <typename Value, typename Compare, typename Engine>
+MappedSet<Value, Compare> Set<Value, Compare, Engine>::openMapped(const std::string& path, const Compare& compare) {
+    return MappedSet<Value, Compare>(path, compare);
+}
+
+//PairIterator
+template <typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+Set<Value, Compare, Engine>::_PairIterator<ForwardIt>::_PairIterator(ForwardIt it) 
+: _it(it) {}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+typename Set<Value, Compare, Engine>::template _PairIterator<ForwardIt>::reference 
+Set<Value, Compare, Engine>::_PairIterator<ForwardIt>::operator*() const {
+    return reference(*_it, *_it);
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+typename Set<Value, Compare, Engine>::template _PairIterator<ForwardIt>& 
+Set<Value, Compare, Engine>::_PairIterator<ForwardIt>::operator++() {
+    ++_it;
+    return *this;
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+bool Set<Value, Compare, Engine>::_PairIterator<ForwardIt>::operator==(const _PairIterator& other) const {
+    return _it == other._it;
+}
+
+template <typename Value, typename Compare, typename Engine>
+template <typename ForwardIt>
+bool Set<Value, Compare, Engine>::_PairIterator<ForwardIt>::operator!=(const _PairIterator& other) const {
+    return !(*this == other);
 }
@@ -0,0 +1,1274 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "BinarySearchTree.h"
+
+/*!
+    Компактное красно-черное дерево
+    Допускается дублирование ключей (аналог multimap)
+    Элементы с равными ключами хранятся в порядке вставки
+
+    Узлы лежат в общем массиве из блоков растущего размера и ссылаются друг
+    на друга 32-битными индексами вместо указателей. Ссылки на родителя нет,
+    цвет узла хранится в старшем бите индекса правого ребенка, поэтому узел
+    занимает sizeof(pair<Key, Value>) + 8 байт против пары и трех указателей
+    с цветом у BinarySearchTree. Итератор хранит путь от корня до узла.
+    Интерфейс совпадает с BinarySearchTree, поэтому дерево может служить
+    движком Map и Set.
+    Вставка и удаление перестраивают пути, итераторы становятся недействительными.
+    В дереве не больше 2^31 - 1 элементов.
+*/
+template <typename Key,
+          typename Value,
+          typename Compare = std::less<Key>>
+class CompactTree
+{
+    using _Item = std::pair<Key, Value>;
+    using Index = std::uint32_t;
+
+    //! Отсутствующий узел
+    static constexpr Index _nil = 0x7fffffff;
+    //! Бит цвета в индексе правого ребенка: 1 - красный
+    static constexpr Index _redBit = 0x80000000;
+    //! Высота красно-черного дерева из 2^31 узлов не больше 62, удаление добавляет один уровень
+    static constexpr size_t _maxDepth = 64;
+    //! Блоки узлов растут от 2^_firstChunkBits до 2^_lastChunkBits ячеек
+    static constexpr size_t _firstChunkBits = 6;
+    static constexpr size_t _lastChunkBits = 16;
+    static constexpr size_t _growingChunks = _lastChunkBits - _firstChunkBits + 1;
+    static constexpr size_t _growingSlots = (size_t(1) << (_lastChunkBits + 1)) - (size_t(1) << _firstChunkBits);
+    //! Пакет от size() / _rebuildRatio элементов выгоднее слить с деревом, чем вставлять по одному
+    static constexpr size_t _rebuildRatio = 32;
+
+    struct Node
+    {
+        template <typename... Args>
+        explicit Node(Args&&... args);
+
+        _Item keyValuePair;
+        Index left = _nil;
+        Index right = _redBit | _nil; //!< новый узел красный
+    };
+
+    //! Ячейка массива: живой узел или ссылка на следующую свободную ячейку
+    struct Slot
+    {
+        alignas(Node) alignas(Index) unsigned char storage[sizeof(Node)];
+    };
+
+    //! Узлы от корня до текущего, спуски запоминают его вместо ссылок на родителя
+    struct Path
+    {
+        Index nodes[_maxDepth];
+        size_t depth = 0;
+    };
+
+    template <bool IsConst>
+    class _Iterator;
+
+    template <typename K, typename Result>
+    using _IfTransparent = std::enable_if_t<IsTransparentCompare<Compare, K>::value, Result>;
+
+public:
+    //! Конструктор по умолчанию
+    CompactTree() = default;
+    //! Ключи упорядочиваются компаратором compare
+    explicit CompactTree(const Compare& compare);
+    //! Построение за O(n) из отсортированного по ключу диапазона пар [first, last)
+    template <typename ForwardIt>
+    CompactTree(ForwardIt first, ForwardIt last);
+
+    //! Копирование за O(n), узлы копии лежат подряд в порядке ключей
+    explicit CompactTree(const CompactTree& other);
+    CompactTree& operator=(const CompactTree& other);
+    //! Перемещение
+    explicit CompactTree(CompactTree&& other) noexcept;
+    CompactTree& operator=(CompactTree&& other) noexcept;
+
+    //! Деструктор
+    ~CompactTree();
+
+    using Iterator = _Iterator<false>;
+    using ConstIterator = _Iterator<true>;
+
+    // вставить элемент с ключем key и значением value
+    // возвращает итератор на вставленный элемент
+    Iterator insert(const Key& key, const Value& value);
+    Iterator insert(Key&& key, Value&& value);
+
+    // вставить элемент, пара ключ-значение создается из args
+    template <typename... Args>
+    Iterator emplace(Args&&... args);
+
+    // вставить элемент, только если элемента с ключем key еще нет
+    // второй элемент пары - была ли вставка
+    template <typename... Args>
+    std::pair<Iterator, bool> tryEmplace(const Key& key, Args&&... args);
+    template <typename... Args>
+    std::pair<Iterator, bool> tryEmplace(Key&& key, Args&&... args);
+
+    // заменить значение элемента position
+    template <typename V>
+    void assignValue(Iterator position, V&& value);
+
+    // удалить все элементы с ключем key
+    void erase(const Key& key);
+    template <typename K>
+    _IfTransparent<K, void> erase(const K& key);
+
+    // вставить все пары диапазона [first, last), результат как у цикла insert
+    // крупный пакет сливается с содержимым дерева, и дерево строится заново за O(n + m)
+    template <typename ForwardIt>
+    void insertBatch(ForwardIt first, ForwardIt last);
+    // удалить все элементы с ключами из диапазона [first, last), стратегия та же
+    template <typename ForwardIt>
+    void eraseBatch(ForwardIt first, ForwardIt last);
+
+    // найти первый элемент в дереве, равный ключу key
+    ConstIterator find(const Key& key) const;
+    Iterator find(const Key& key);
+    template <typename K>
+    _IfTransparent<K, ConstIterator> find(const K& key) const;
+    template <typename K>
+    _IfTransparent<K, Iterator> find(const K& key);
+
+    // найти первые элементы для всех ключей [first, last), результаты пишутся в out по порядку
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out);
+    // то же, в out пишется bool - есть ли элемент с таким ключем
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+
+    // первый элемент с ключем не меньше key
+    Iterator lowerBound(const Key& key);
+    ConstIterator lowerBound(const Key& key) const;
+    template <typename K>
+    _IfTransparent<K, Iterator> lowerBound(const K& key);
+    template <typename K>
+    _IfTransparent<K, ConstIterator> lowerBound(const K& key) const;
+
+    // первый элемент с ключем больше key
+    Iterator upperBound(const Key& key);
+    ConstIterator upperBound(const Key& key) const;
+    template <typename K>
+    _IfTransparent<K, Iterator> upperBound(const K& key);
+    template <typename K>
+    _IfTransparent<K, ConstIterator> upperBound(const K& key) const;
+
+    // найти все элементы, у которых ключ равен key
+    // [pair.first, pair.second) - полуинтервал, содержащий все элементы с ключем key
+    std::pair<Iterator, Iterator> equalRange(const Key& key);
+    std::pair<ConstIterator, ConstIterator> equalRange(const Key& key) const;
+
+    Iterator begin();
+    Iterator end();
+
+    ConstIterator cbegin() const;
+    ConstIterator cend() const;
+
+    size_t size() const;
+
+    Compare keyComp() const;
+
+    // удалить все элементы и вернуть память
+    void clear();
+
+    // заменить содержимое элементами отсортированного по ключу диапазона [first, last)
+    template <typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+
+    void swap(CompactTree& other) noexcept;
+
+private:
+    Node& _node(Index index);
+    const Node& _node(Index index) const;
+
+    Index _left(Index node) const;
+    Index _right(Index node) const;
+    void _setLeft(Index node, Index child);
+    void _setRight(Index node, Index child);
+    bool _isRed(Index node) const;
+    void _setRed(Index node, bool red);
+
+    // путь к первому элементу с ключем не меньше key (lower) или больше key (upper)
+    // пустой путь - позиция end()
+    template <typename K>
+    void _lowerBound(const K& key, Path& path) const;
+    template <typename K>
+    void _upperBound(const K& key, Path& path) const;
+    template <typename K>
+    void _findPath(const K& key, Path& path) const;
+    // спуск к месту вставки после всех равных key, path заканчивается будущим родителем
+    // возвращает глубину последнего узла с ключем не больше key, 0 - таких нет
+    template <typename K>
+    size_t _insertPath(const K& key, Path& path) const;
+    // путь к последнему элементу с ключем не больше key
+    template <typename K>
+    void _lastNotGreater(const K& key, Path& path) const;
+    // дописать к пути самый левый (toLeft) или самый правый узел поддерева node
+    void _descend(Index node, bool toLeft, Path& path) const;
+
+    template <typename K>
+    void _eraseKey(const K& key);
+    template <typename KeyArg, typename... Args>
+    std::pair<Iterator, bool> _tryEmplace(KeyArg&& key, Args&&... args);
+
+    // подвесить новый узел к концу пути, восстановить свойства дерева
+    // и вернуть итератор на него
+    Iterator _insertAt(Path& path, Index node);
+    // удалить последний узел пути
+    void _eraseAt(Path& path);
+    // восстановить черную высоту, x - ребенок path.nodes[depth - 1] на стороне xIsLeft
+    void _fixDoubleBlack(Index x, bool xIsLeft, Path& path);
+    // поворот поддерева node, возвращает его новый корень
+    Index _rotate(Index node, bool toLeft);
+    // заменить ребенка old узла parent на child, при parent == _nil заменяется корень
+    void _replaceChild(Index parent, Index old, Index child);
+
+    // разместить узел в свободной ячейке
+    template <typename... Args>
+    Index _create(Args&&... args);
+    // уничтожить узел и вернуть ячейку в список свободных
+    void _destroy(Index node);
+    // новая ячейка из свободного списка или из блоков
+    Index _allocateSlot();
+    void _freeSlot(Index slot);
+    Slot& _slot(Index index) const;
+    static size_t _chunkSlots(size_t chunk);
+    static size_t _log2(size_t value);
+
+    void _destroySubtree(Index node);
+    Index _buildBalanced(size_t first, size_t count, size_t depth, size_t redDepth);
+
+    std::vector<std::unique_ptr<Slot[]>> _chunks; //!< блоки ячеек узлов
+    size_t _capacity = 0; //!< ячеек во всех блоках
+    size_t _used = 0;     //!< ячеек, выданных хотя бы раз
+    Index _freeHead = _nil;
+    size_t _size = 0;
+    Index _root = _nil;
+    Compare _compare;
+};
+
+/*!
+    Итератор компактного дерева
+
+    Хранит путь от корня до текущего узла, пустой путь - позиция end()
+*/
+template <typename Key, typename Value, typename Compare>
+template <bool IsConst>
+class CompactTree<Key, Value, Compare>::_Iterator
+{
+    using _Tree = std::conditional_t<IsConst, const CompactTree, CompactTree>;
+
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = std::pair<Key, Value>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+    using reference = std::conditional_t<IsConst, const value_type&, value_type&>;
+
+    _Iterator(_Tree* tree, const Path& path);
+    //! Итератор преобразуется в константный
+    template <bool OtherConst, typename = std::enable_if_t<IsConst && !OtherConst>>
+    _Iterator(const _Iterator<OtherConst>& other);
+
+    reference operator*() const;
+    pointer operator->() const;
+
+    _Iterator& operator++();
+    _Iterator operator++(int);
+
+    _Iterator& operator--();
+    _Iterator operator--(int);
+
+    bool operator==(const _Iterator& other) const;
+    bool operator!=(const _Iterator& other) const;
+
+private:
+    friend class CompactTree;
+    friend class _Iterator<!IsConst>;
+
+    _Tree* _tree;
+    Path _path;
+};
+
+//Node
+template <typename Key, typename Value, typename Compare>
+template <typename... Args>
+CompactTree<Key, Value, Compare>::Node::Node(Args&&... args)
+: keyValuePair(std::forward<Args>(args)...) {}
+
+//BigFive
+template <typename Key, typename Value, typename Compare>
+CompactTree<Key, Value, Compare>::CompactTree(const Compare& compare)
+: _compare(compare) {}
+
+template <typename Key, typename Value, typename Compare>
+template <typename ForwardIt>
+CompactTree<Key, Value, Compare>::CompactTree(ForwardIt first, ForwardIt last) {
+    assign(first, last);
+}
+
+template <typename Key, typename Value, typename Compare>
+CompactTree<Key, Value, Compare>::CompactTree(const CompactTree& other)
+: _compare(other._compare) {
+    assign(other.cbegin(), other.cend());
+}
+
+template <typename Key, typename Value, typename Compare>
+CompactTree<Key, Value, Compare>&
+CompactTree<Key, Value, Compare>::operator=(const CompactTree& other) {
+    if (&other != this) {
+        CompactTree copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+CompactTree<Key, Value, Compare>::CompactTree(CompactTree&& other) noexcept
+: _chunks(std::move(other._chunks)),
+  _capacity(std::exchange(other._capacity, 0)),
+  _used(std::exchange(other._used, 0)),
+  _freeHead(std::exchange(other._freeHead, _nil)),
+  _size(std::exchange(other._size, 0)),
+  _root(std::exchange(other._root, _nil)),
+  _compare(other._compare) {
+    other._chunks.clear();
+}
+
+template <typename Key, typename Value, typename Compare>
+CompactTree<Key, Value, Compare>&
+CompactTree<Key, Value, Compare>::operator=(CompactTree&& other) noexcept {
+    if (&other != this) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+CompactTree<Key, Value, Compare>::~CompactTree() {
+    clear();
+}
+
+//Iterator
+template <typename Key, typename Value, typename Compare>
+template <bool IsConst>
+CompactTree<Key, Value, Compare>::_Iterator<IsConst>::_Iterator(_Tree* tree, const Path& path)
+: _tree(tree), _path(path) {}
+
+template <typename Key, typename Value, typename Compare>
+template <bool IsConst>
+template <bool OtherConst, typename>
+CompactTree<Key, Value, Compare>::_Iterator<IsConst>::_Iterator(const _Iterator<OtherConst>& other)
+: _tree(other._tree), _path(other._path) {}
+
+template <typename Key, typename Value, typename Compare>
+template <bool IsConst>
+typename CompactTree<Key, Value, Compare>::template _Iterator<IsConst>::reference
+CompactTree<Key, Value, Compare>::_Iterator<IsConst>::operator*() const {
+    return _tree->_node(_path.nodes[_path.depth - 1]).keyValuePair;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <bool IsConst>
+typename CompactTree<Key, Value, Compare>::template _Iterator<IsConst>::pointer
+CompactTree<Key, Value, Compare>::_Iterator<IsConst>::operator->() const {
+    return &**this;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <bool IsConst>
+typename CompactTree<Key, Value, Compare>::template _Iterator<IsConst>&
+CompactTree<Key, Value, Compare>::_Iterator<IsConst>::operator++() {
+    Index node = _path.nodes[_path.depth - 1];
+    Index right = _tree->_right(node);
+    if (right != _nil) {
+        _tree->_descend(right, true, _path);
+        return *this;
+    }
+    // подняться из правых поддеревьев, следующий - первый предок, в левом поддереве которого мы были
+    Index child;
+    do {
+        child = _path.nodes[--_path.depth];
+    } while (_path.depth > 0 && _tree->_right(_path.nodes[_path.depth - 1]) == child);
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <bool IsConst>
+typename CompactTree<Key, Value, Compare>::template _Iterator<IsConst>
+CompactTree<Key, Value, Compare>::_Iterator<IsConst>::operator++(int) {
+    _Iterator bufIt = *this;
+    ++*this;
+    return bufIt;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <bool IsConst>
+typename CompactTree<Key, Value, Compare>::template _Iterator<IsConst>&
+CompactTree<Key, Value, Compare>::_Iterator<IsConst>::operator--() {
+    if (_path.depth == 0) {
+        if (_tree->_root != _nil) {
+            _tree->_descend(_tree->_root, false, _path);
+        }
+        return *this;
+    }
+    Index node = _path.nodes[_path.depth - 1];
+    Index left = _tree->_left(node);
+    if (left != _nil) {
+        _tree->_descend(left, false, _path);
+        return *this;
+    }
+    Index child;
+    do {
+        child = _path.nodes[--_path.depth];
+    } while (_path.depth > 0 && _tree->_left(_path.nodes[_path.depth - 1]) == child);
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <bool IsConst>
+typename CompactTree<Key, Value, Compare>::template _Iterator<IsConst>
+CompactTree<Key, Value, Compare>::_Iterator<IsConst>::operator--(int) {
+    _Iterator bufIt = *this;
+    --*this;
+    return bufIt;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <bool IsConst>
+bool CompactTree<Key, Value, Compare>::_Iterator<IsConst>::operator==(const _Iterator& other) const {
+    if (_path.depth == 0 || other._path.depth == 0) {
+        return _path.depth == other._path.depth;
+    }
+    return _path.nodes[_path.depth - 1] == other._path.nodes[other._path.depth - 1];
+}
+
+template <typename Key, typename Value, typename Compare>
+template <bool IsConst>
+bool CompactTree<Key, Value, Compare>::_Iterator<IsConst>::operator!=(const _Iterator& other) const {
+    return !(*this == other);
+}
+
+//Methods
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Iterator
+CompactTree<Key, Value, Compare>::insert(const Key& key, const Value& value) {
+    return emplace(key, value);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Iterator
+CompactTree<Key, Value, Compare>::insert(Key&& key, Value&& value) {
+    return emplace(std::move(key), std::move(value));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename... Args>
+typename CompactTree<Key, Value, Compare>::Iterator
+CompactTree<Key, Value, Compare>::emplace(Args&&... args) {
+    Index node = _create(std::forward<Args>(args)...);
+    Path path;
+    _insertPath(_node(node).keyValuePair.first, path);
+    return _insertAt(path, node);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename... Args>
+std::pair<typename CompactTree<Key, Value, Compare>::Iterator, bool>
+CompactTree<Key, Value, Compare>::tryEmplace(const Key& key, Args&&... args) {
+    return _tryEmplace(key, std::forward<Args>(args)...);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename... Args>
+std::pair<typename CompactTree<Key, Value, Compare>::Iterator, bool>
+CompactTree<Key, Value, Compare>::tryEmplace(Key&& key, Args&&... args) {
+    return _tryEmplace(std::move(key), std::forward<Args>(args)...);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename KeyArg, typename... Args>
+std::pair<typename CompactTree<Key, Value, Compare>::Iterator, bool>
+CompactTree<Key, Value, Compare>::_tryEmplace(KeyArg&& key, Args&&... args) {
+    Path path;
+    size_t notGreater = _insertPath(key, path);
+    // равный ключ может быть только у последнего узла с ключем не больше key
+    if (notGreater > 0 && !_compare(_node(path.nodes[notGreater - 1]).keyValuePair.first, key)) {
+        path.depth = notGreater;
+        return std::pair<Iterator, bool>(Iterator(this, path), false);
+    }
+    Index node = _create(std::piecewise_construct,
+                         std::forward_as_tuple(std::forward<KeyArg>(key)),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
+    return std::pair<Iterator, bool>(_insertAt(path, node), true);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename V>
+void CompactTree<Key, Value, Compare>::assignValue(Iterator position, V&& value) {
+    position->second = std::forward<V>(value);
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::erase(const Key& key) {
+    _eraseKey(key);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto CompactTree<Key, Value, Compare>::erase(const K& key) -> _IfTransparent<K, void> {
+    _eraseKey(key);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+void CompactTree<Key, Value, Compare>::_eraseKey(const K& key) {
+    Path path;
+    while (true) {
+        _findPath(key, path);
+        if (path.depth == 0) {
+            return;
+        }
+        _eraseAt(path);
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename ForwardIt>
+void CompactTree<Key, Value, Compare>::insertBatch(ForwardIt first, ForwardIt last) {
+    auto itemLess = [this](const _Item& left, const _Item& right) {
+        return _compare(left.first, right.first);
+    };
+    std::vector<_Item> batch(first, last);
+    // равные ключи пакета остаются в порядке пакета, как при цикле insert
+    if (!std::is_sorted(batch.begin(), batch.end(), itemLess)) {
+        std::stable_sort(batch.begin(), batch.end(), itemLess);
+    }
+    if (batch.size() * _rebuildRatio < _size) {
+        for (_Item& item : batch) {
+            emplace(std::move(item));
+        }
+        return;
+    }
+    // элементы дерева копируются, а не перемещаются: при исключении дерево не меняется
+    // при равных ключах старые элементы идут раньше новых
+    std::vector<_Item> merged;
+    merged.reserve(_size + batch.size());
+    auto item = batch.begin();
+    for (ConstIterator current = cbegin(); current != cend(); ++current) {
+        while (item != batch.end() && itemLess(*item, *current)) {
+            merged.push_back(std::move(*item++));
+        }
+        merged.push_back(*current);
+    }
+    std::move(item, batch.end(), std::back_inserter(merged));
+    CompactTree rebuilt(_compare);
+    rebuilt.assign(std::make_move_iterator(merged.begin()), std::make_move_iterator(merged.end()));
+    swap(rebuilt);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename ForwardIt>
+void CompactTree<Key, Value, Compare>::eraseBatch(ForwardIt first, ForwardIt last) {
+    static_assert(std::is_same<std::remove_cv_t<std::remove_reference_t<decltype(*first)>>, Key>::value,
+                  "eraseBatch expects a range of Key");
+    std::vector<const Key*> keys;
+    for (; first != last; ++first) {
+        keys.push_back(&*first);
+    }
+    std::sort(keys.begin(), keys.end(), [this](const Key* left, const Key* right) {
+        return _compare(*left, *right);
+    });
+    if (keys.size() * _rebuildRatio < _size) {
+        for (const Key* key : keys) {
+            _eraseKey(*key);
+        }
+        return;
+    }
+    // один проход по дереву и по отсортированным ключам, оставшиеся элементы копируются
+    std::vector<_Item> kept;
+    kept.reserve(_size);
+    size_t key = 0;
+    for (ConstIterator current = cbegin(); current != cend(); ++current) {
+        while (key < keys.size() && _compare(*keys[key], current->first)) {
+            key++;
+        }
+        if (key == keys.size() || _compare(current->first, *keys[key])) {
+            kept.push_back(*current);
+        }
+    }
+    if (kept.size() == _size) {
+        return;
+    }
+    CompactTree rebuilt(_compare);
+    rebuilt.assign(std::make_move_iterator(kept.begin()), std::make_move_iterator(kept.end()));
+    swap(rebuilt);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::ConstIterator
+CompactTree<Key, Value, Compare>::find(const Key& key) const {
+    Path path;
+    _findPath(key, path);
+    return ConstIterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Iterator
+CompactTree<Key, Value, Compare>::find(const Key& key) {
+    Path path;
+    _findPath(key, path);
+    return Iterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto CompactTree<Key, Value, Compare>::find(const K& key) const -> _IfTransparent<K, ConstIterator> {
+    Path path;
+    _findPath(key, path);
+    return ConstIterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto CompactTree<Key, Value, Compare>::find(const K& key) -> _IfTransparent<K, Iterator> {
+    Path path;
+    _findPath(key, path);
+    return Iterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename ForwardIt, typename OutputIt>
+OutputIt CompactTree<Key, Value, Compare>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    for (; first != last; ++first) {
+        *out++ = find(*first);
+    }
+    return out;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename ForwardIt, typename OutputIt>
+OutputIt CompactTree<Key, Value, Compare>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) {
+    for (; first != last; ++first) {
+        *out++ = find(*first);
+    }
+    return out;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename ForwardIt, typename OutputIt>
+OutputIt CompactTree<Key, Value, Compare>::containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    Path path;
+    for (; first != last; ++first) {
+        _findPath(*first, path);
+        *out++ = path.depth > 0;
+    }
+    return out;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Iterator
+CompactTree<Key, Value, Compare>::lowerBound(const Key& key) {
+    Path path;
+    _lowerBound(key, path);
+    return Iterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::ConstIterator
+CompactTree<Key, Value, Compare>::lowerBound(const Key& key) const {
+    Path path;
+    _lowerBound(key, path);
+    return ConstIterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto CompactTree<Key, Value, Compare>::lowerBound(const K& key) -> _IfTransparent<K, Iterator> {
+    Path path;
+    _lowerBound(key, path);
+    return Iterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto CompactTree<Key, Value, Compare>::lowerBound(const K& key) const -> _IfTransparent<K, ConstIterator> {
+    Path path;
+    _lowerBound(key, path);
+    return ConstIterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Iterator
+CompactTree<Key, Value, Compare>::upperBound(const Key& key) {
+    Path path;
+    _upperBound(key, path);
+    return Iterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::ConstIterator
+CompactTree<Key, Value, Compare>::upperBound(const Key& key) const {
+    Path path;
+    _upperBound(key, path);
+    return ConstIterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto CompactTree<Key, Value, Compare>::upperBound(const K& key) -> _IfTransparent<K, Iterator> {
+    Path path;
+    _upperBound(key, path);
+    return Iterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto CompactTree<Key, Value, Compare>::upperBound(const K& key) const -> _IfTransparent<K, ConstIterator> {
+    Path path;
+    _upperBound(key, path);
+    return ConstIterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+std::pair<typename CompactTree<Key, Value, Compare>::Iterator,
+typename CompactTree<Key, Value, Compare>::Iterator>
+CompactTree<Key, Value, Compare>::equalRange(const Key& key) {
+    return std::pair<Iterator, Iterator>(lowerBound(key), upperBound(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+std::pair<typename CompactTree<Key, Value, Compare>::ConstIterator,
+typename CompactTree<Key, Value, Compare>::ConstIterator>
+CompactTree<Key, Value, Compare>::equalRange(const Key& key) const {
+    return std::pair<ConstIterator, ConstIterator>(lowerBound(key), upperBound(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Iterator
+CompactTree<Key, Value, Compare>::begin() {
+    Path path;
+    if (_root != _nil) {
+        _descend(_root, true, path);
+    }
+    return Iterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Iterator
+CompactTree<Key, Value, Compare>::end() {
+    return Iterator(this, Path());
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::ConstIterator
+CompactTree<Key, Value, Compare>::cbegin() const {
+    Path path;
+    if (_root != _nil) {
+        _descend(_root, true, path);
+    }
+    return ConstIterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::ConstIterator
+CompactTree<Key, Value, Compare>::cend() const {
+    return ConstIterator(this, Path());
+}
+
+template <typename Key, typename Value, typename Compare>
+size_t CompactTree<Key, Value, Compare>::size() const {
+    return _size;
+}
+
+template <typename Key, typename Value, typename Compare>
+Compare CompactTree<Key, Value, Compare>::keyComp() const {
+    return _compare;
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::clear() {
+    if constexpr (!std::is_trivially_destructible<_Item>::value) {
+        _destroySubtree(_root);
+    }
+    _chunks.clear();
+    _capacity = 0;
+    _used = 0;
+    _freeHead = _nil;
+    _size = 0;
+    _root = _nil;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename ForwardIt>
+void CompactTree<Key, Value, Compare>::assign(ForwardIt first, ForwardIt last) {
+    clear();
+    size_t count = static_cast<size_t>(std::distance(first, last));
+    if (count == 0) {
+        return;
+    }
+    if (count >= _nil) {
+        throw std::length_error("CompactTree is full");
+    }
+    // элементы занимают ячейки 0..count-1 в порядке ключей
+    size_t created = 0;
+    try {
+        for (; first != last; ++first, ++created) {
+            _create(*first);
+        }
+    }
+    catch (...) {
+        for (size_t i = 0; i < created; i++) {
+            _node(Index(i)).~Node();
+        }
+        clear();
+        throw;
+    }
+    // все уровни кроме последнего заполнены, последний (глубина floor(log2 n))
+    // красится в красный, тогда черная высота всех путей одинакова
+    size_t redDepth = 0;
+    while ((size_t(2) << redDepth) <= count) {
+        redDepth++;
+    }
+    _root = _buildBalanced(0, count, 0, redDepth);
+    _setRed(_root, false);
+    _size = count;
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::swap(CompactTree& other) noexcept {
+    std::swap(_chunks, other._chunks);
+    std::swap(_capacity, other._capacity);
+    std::swap(_used, other._used);
+    std::swap(_freeHead, other._freeHead);
+    std::swap(_size, other._size);
+    std::swap(_root, other._root);
+    std::swap(_compare, other._compare);
+}
+
+//Links
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Node&
+CompactTree<Key, Value, Compare>::_node(Index index) {
+    return *std::launder(reinterpret_cast<Node*>(_slot(index).storage));
+}
+
+template <typename Key, typename Value, typename Compare>
+const typename CompactTree<Key, Value, Compare>::Node&
+CompactTree<Key, Value, Compare>::_node(Index index) const {
+    return *std::launder(reinterpret_cast<const Node*>(_slot(index).storage));
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Index
+CompactTree<Key, Value, Compare>::_left(Index node) const {
+    return _node(node).left;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Index
+CompactTree<Key, Value, Compare>::_right(Index node) const {
+    return _node(node).right & ~_redBit;
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::_setLeft(Index node, Index child) {
+    _node(node).left = child;
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::_setRight(Index node, Index child) {
+    Index& right = _node(node).right;
+    right = (right & _redBit) | child;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool CompactTree<Key, Value, Compare>::_isRed(Index node) const {
+    return node != _nil && (_node(node).right & _redBit);
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::_setRed(Index node, bool red) {
+    Index& right = _node(node).right;
+    right = red ? (right | _redBit) : (right & ~_redBit);
+}
+
+//Search
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+void CompactTree<Key, Value, Compare>::_lowerBound(const K& key, Path& path) const {
+    // предки найденного узла - начало пути спуска, путь обрезается до него
+    size_t found = 0;
+    path.depth = 0;
+    for (Index node = _root; node != _nil;) {
+        path.nodes[path.depth++] = node;
+        if (_compare(_node(node).keyValuePair.first, key)) {
+            node = _right(node);
+        }
+        else {
+            found = path.depth;
+            node = _left(node);
+        }
+    }
+    path.depth = found;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+void CompactTree<Key, Value, Compare>::_upperBound(const K& key, Path& path) const {
+    size_t found = 0;
+    path.depth = 0;
+    for (Index node = _root; node != _nil;) {
+        path.nodes[path.depth++] = node;
+        if (_compare(key, _node(node).keyValuePair.first)) {
+            found = path.depth;
+            node = _left(node);
+        }
+        else {
+            node = _right(node);
+        }
+    }
+    path.depth = found;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+void CompactTree<Key, Value, Compare>::_findPath(const K& key, Path& path) const {
+    _lowerBound(key, path);
+    if (path.depth > 0 && _compare(key, _node(path.nodes[path.depth - 1]).keyValuePair.first)) {
+        path.depth = 0;
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+size_t CompactTree<Key, Value, Compare>::_insertPath(const K& key, Path& path) const {
+    size_t notGreater = 0;
+    path.depth = 0;
+    for (Index node = _root; node != _nil;) {
+        path.nodes[path.depth++] = node;
+        if (_compare(key, _node(node).keyValuePair.first)) {
+            node = _left(node);
+        }
+        else {
+            notGreater = path.depth;
+            node = _right(node);
+        }
+    }
+    return notGreater;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+void CompactTree<Key, Value, Compare>::_lastNotGreater(const K& key, Path& path) const {
+    path.depth = _insertPath(key, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::_descend(Index node, bool toLeft, Path& path) const {
+    while (node != _nil) {
+        path.nodes[path.depth++] = node;
+        node = toLeft ? _left(node) : _right(node);
+    }
+}
+
+//Modification
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Iterator
+CompactTree<Key, Value, Compare>::_insertAt(Path& path, Index node) {
+    if (path.depth == 0) {
+        _root = node;
+    }
+    else {
+        Index parent = path.nodes[path.depth - 1];
+        if (_compare(_node(node).keyValuePair.first, _node(parent).keyValuePair.first)) {
+            _setLeft(parent, node);
+        }
+        else {
+            _setRight(parent, node);
+        }
+    }
+    path.nodes[path.depth++] = node;
+    _size++;
+
+    // перекраска сохраняет путь к новому узлу, после поворота он ищется заново
+    bool rotated = false;
+    size_t depth = path.depth - 1; //!< позиция текущего узла x в пути
+    while (depth >= 2 && _isRed(path.nodes[depth - 1])) {
+        Index x = path.nodes[depth];
+        Index parent = path.nodes[depth - 1];
+        Index grand = path.nodes[depth - 2];
+        Index grandParent = depth >= 3 ? path.nodes[depth - 3] : _nil;
+        bool parentIsLeft = _left(grand) == parent;
+        Index uncle = parentIsLeft ? _right(grand) : _left(grand);
+        if (_isRed(uncle)) {
+            _setRed(parent, false);
+            _setRed(uncle, false);
+            _setRed(grand, true);
+            depth -= 2;
+            continue;
+        }
+        // x по другую сторону от parent, чем parent от grand: сначала выпрямить
+        if ((parentIsLeft ? _right(parent) : _left(parent)) == x) {
+            Index top = _rotate(parent, parentIsLeft);
+            if (parentIsLeft) {
+                _setLeft(grand, top);
+            }
+            else {
+                _setRight(grand, top);
+            }
+            parent = top;
+        }
+        Index top = _rotate(grand, !parentIsLeft);
+        _replaceChild(grandParent, grand, top);
+        _setRed(parent, false);
+        _setRed(grand, true);
+        rotated = true;
+        break;
+    }
+    _setRed(_root, false);
+    if (rotated) {
+        // новый узел - последний среди равных ключей
+        _lastNotGreater(_node(node).keyValuePair.first, path);
+    }
+    return Iterator(this, path);
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::_eraseAt(Path& path) {
+    size_t zDepth = path.depth - 1;
+    Index z = path.nodes[zDepth];
+    Index zParent = zDepth > 0 ? path.nodes[zDepth - 1] : _nil;
+    Index x;
+    bool xIsLeft;
+    bool removedRed;
+    if (_left(z) == _nil || _right(z) == _nil) {
+        x = _left(z) != _nil ? _left(z) : _right(z);
+        xIsLeft = zParent != _nil && _left(zParent) == z;
+        removedRed = _isRed(z);
+        _replaceChild(zParent, z, x);
+        path.depth = zDepth;
+    }
+    else {
+        // на место z встает следующий за ним узел y без левого ребенка
+        _descend(_right(z), true, path);
+        size_t yDepth = path.depth - 1;
+        Index y = path.nodes[yDepth];
+        x = _right(y);
+        removedRed = _isRed(y);
+        if (yDepth == zDepth + 1) {
+            xIsLeft = false;
+        }
+        else {
+            _setLeft(path.nodes[yDepth - 1], x);
+            _setRight(y, _right(z));
+            xIsLeft = true;
+        }
+        _setLeft(y, _left(z));
+        _setRed(y, _isRed(z));
+        _replaceChild(zParent, z, y);
+        path.nodes[zDepth] = y;
+        path.depth = yDepth;
+    }
+    _destroy(z);
+    _size--;
+    if (!removedRed) {
+        _fixDoubleBlack(x, xIsLeft, path);
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::_fixDoubleBlack(Index x, bool xIsLeft, Path& path) {
+    while (path.depth > 0 && !_isRed(x)) {
+        Index parent = path.nodes[path.depth - 1];
+        Index grand = path.depth > 1 ? path.nodes[path.depth - 2] : _nil;
+        Index sibling = xIsLeft ? _right(parent) : _left(parent);
+        if (_isRed(sibling)) {
+            // красный брат поднимается над parent, путь удлиняется на один узел
+            _setRed(sibling, false);
+            _setRed(parent, true);
+            _replaceChild(grand, parent, _rotate(parent, xIsLeft));
+            path.nodes[path.depth - 1] = sibling;
+            path.nodes[path.depth++] = parent;
+            sibling = xIsLeft ? _right(parent) : _left(parent);
+            grand = path.nodes[path.depth - 2];
+        }
+        Index near = xIsLeft ? _left(sibling) : _right(sibling);
+        Index far = xIsLeft ? _right(sibling) : _left(sibling);
+        if (!_isRed(near) && !_isRed(far)) {
+            _setRed(sibling, true);
+            x = parent;
+            path.depth--;
+            xIsLeft = path.depth > 0 && _left(path.nodes[path.depth - 1]) == x;
+            continue;
+        }
+        if (!_isRed(far)) {
+            _setRed(near, false);
+            _setRed(sibling, true);
+            sibling = _rotate(sibling, !xIsLeft);
+            if (xIsLeft) {
+                _setRight(parent, sibling);
+            }
+            else {
+                _setLeft(parent, sibling);
+            }
+            far = xIsLeft ? _right(sibling) : _left(sibling);
+        }
+        _setRed(sibling, _isRed(parent));
+        _setRed(parent, false);
+        _setRed(far, false);
+        _replaceChild(grand, parent, _rotate(parent, xIsLeft));
+        return;
+    }
+    if (x != _nil) {
+        _setRed(x, false);
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Index
+CompactTree<Key, Value, Compare>::_rotate(Index node, bool toLeft) {
+    if (toLeft) {
+        Index top = _right(node);
+        _setRight(node, _left(top));
+        _setLeft(top, node);
+        return top;
+    }
+    Index top = _left(node);
+    _setLeft(node, _right(top));
+    _setRight(top, node);
+    return top;
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::_replaceChild(Index parent, Index old, Index child) {
+    if (parent == _nil) {
+        _root = child;
+    }
+    else if (_left(parent) == old) {
+        _setLeft(parent, child);
+    }
+    else {
+        _setRight(parent, child);
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::_destroySubtree(Index node) {
+    // глубина рекурсии ограничена высотой дерева
+    if (node == _nil) {
+        return;
+    }
+    _destroySubtree(_left(node));
+    _destroySubtree(_right(node));
+    _node(node).~Node();
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Index
+CompactTree<Key, Value, Compare>::_buildBalanced(size_t first, size_t count, size_t depth, size_t redDepth) {
+    if (count == 0) {
+        return _nil;
+    }
+    size_t leftCount = (count - 1) / 2;
+    Index node = Index(first + leftCount);
+    _setLeft(node, _buildBalanced(first, leftCount, depth + 1, redDepth));
+    _setRight(node, _buildBalanced(first + leftCount + 1, count - 1 - leftCount, depth + 1, redDepth));
+    _setRed(node, depth == redDepth);
+    return node;
+}
+
+//Slots
+template <typename Key, typename Value, typename Compare>
+template <typename... Args>
+typename CompactTree<Key, Value, Compare>::Index
+CompactTree<Key, Value, Compare>::_create(Args&&... args) {
+    Index slot = _allocateSlot();
+    try {
+        ::new (static_cast<void*>(_slot(slot).storage)) Node(std::forward<Args>(args)...);
+    }
+    catch (...) {
+        _freeSlot(slot);
+        throw;
+    }
+    return slot;
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::_destroy(Index node) {
+    _node(node).~Node();
+    _freeSlot(node);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Index
+CompactTree<Key, Value, Compare>::_allocateSlot() {
+    if (_freeHead != _nil) {
+        Index slot = _freeHead;
+        _freeHead = *std::launder(reinterpret_cast<Index*>(_slot(slot).storage));
+        return slot;
+    }
+    if (_used >= _nil) {
+        throw std::length_error("CompactTree is full");
+    }
+    if (_used == _capacity) {
+        size_t slots = _chunkSlots(_chunks.size());
+        std::unique_ptr<Slot[]> chunk(new Slot[slots]);
+        _chunks.push_back(std::move(chunk));
+        _capacity += slots;
+    }
+    return Index(_used++);
+}
+
+template <typename Key, typename Value, typename Compare>
+void CompactTree<Key, Value, Compare>::_freeSlot(Index slot) {
+    ::new (static_cast<void*>(_slot(slot).storage)) Index(_freeHead);
+    _freeHead = slot;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename CompactTree<Key, Value, Compare>::Slot&
+CompactTree<Key, Value, Compare>::_slot(Index index) const {
+    // блок k < _growingChunks начинается с ячейки 2^first * (2^k - 1), дальше блоки одного размера
+    if (index < _growingSlots) {
+        size_t chunk = _log2((index >> _firstChunkBits) + 1);
+        return _chunks[chunk][index - ((size_t(1) << (chunk + _firstChunkBits)) - (size_t(1) << _firstChunkBits))];
+    }
+    size_t rest = index - _growingSlots;
+    return _chunks[_growingChunks + (rest >> _lastChunkBits)][rest & ((size_t(1) << _lastChunkBits) - 1)];
+}
+
+template <typename Key, typename Value, typename Compare>
+size_t CompactTree<Key, Value, Compare>::_chunkSlots(size_t chunk) {
+    return size_t(1) << (std::min(chunk, _growingChunks - 1) + _firstChunkBits);
+}
+
+template <typename Key, typename Value, typename Compare>
+size_t CompactTree<Key, Value, Compare>::_log2(size_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return size_t(31 - __builtin_clz(static_cast<unsigned>(value)));
+#else
+    size_t result = 0;
+    while (value >>= 1) {
+        result++;
+    }
+    return result;
+#endif
+}
@@ -0,0 +1,639 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "EpochReclaimer.h"
+
+/*!
+    Спин-блокировка размером в один байт для блокировки отдельных узлов
+*/
+class SpinLock
+{
+public:
+    void lock();
+    void unlock();
+
+private:
+    std::atomic<bool> _locked{false};
+};
+
+/*!
+    Потокобезопасный словарь на ленивом списке с пропусками
+    Не допускается дублирование ключей (аналог std::map)
+
+    Поиск не берет блокировок: ключи узлов неизменны, а удаленные узлы
+    освобождаются через EpochReclaimer, когда их уже никто не читает.
+    Вставка и удаление блокируют только предшественников изменяемого
+    узла и проверяют, что те не изменились с момента поиска, иначе
+    повторяют поиск. Удаление сначала помечает узел (логическое удаление),
+    затем исключает его со всех уровней.
+
+    Значения меняют insert и update под блокировкой узла, find и forEach
+    читают их без блокировок:
+    - тривиально копируемое значение лежит в узле атомарными словами рядом
+      со счетчиком версий, запись делает счетчик нечетным на время записи слов.
+      Читатель копирует слова и повторяет чтение, если версия была нечетной
+      или изменилась, поэтому может подождать незавершенную запись одного
+      узла и lock-free не является, хотя блокировок и не берет
+    - остальные значения неизменны и лежат отдельными объектами: запись
+      создает новый объект, подменяет указатель и передает старый
+      в EpochReclaimer, чтение только загружает указатель и lock-free
+    contains, обход ключей и поиск узла lock-free при любом Value.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class ConcurrentMap
+{
+    static constexpr bool _inlineValue = std::is_trivially_copyable<Value>::value;
+    static constexpr size_t _valueWords = (sizeof(Value) + sizeof(std::uintptr_t) - 1) / sizeof(std::uintptr_t);
+
+    //! Тривиально копируемое значение, записывается под счетчиком версий
+    struct _InlineValue
+    {
+        std::atomic<uint32_t> version{0}; //!< нечетен, пока слова записываются
+        std::atomic<std::uintptr_t> words[_valueWords];
+    };
+    //! Неизменный объект значения, заменяется целиком
+    struct _BoxedValue
+    {
+        std::atomic<Value*> pointer{nullptr};
+    };
+
+    struct Node
+    {
+        explicit Node(int height);
+        const Key& key();
+        std::atomic<Node*>* next(); //!< указатели на следующие узлы, по одному на уровень
+
+        SpinLock lock;
+        std::atomic<bool> marked{false};      //!< узел логически удален
+        std::atomic<bool> fullyLinked{false}; //!< узел связан на всех своих уровнях
+        int height;
+        std::conditional_t<_inlineValue, _InlineValue, _BoxedValue> value; //!< у головы не заполняется
+        alignas(Key) unsigned char storage[sizeof(Key)];                    //!< ключ, у головы не заполняется
+    };
+
+    static constexpr int _maxHeight = 20;
+    static constexpr size_t _nextOffset =
+        (sizeof(Node) + alignof(std::atomic<Node*>) - 1) / alignof(std::atomic<Node*>) * alignof(std::atomic<Node*>);
+
+public:
+    ConcurrentMap();
+    explicit ConcurrentMap(const Compare& compare);
+
+    ConcurrentMap(const ConcurrentMap& other) = delete;
+    ConcurrentMap& operator=(const ConcurrentMap& other) = delete;
+
+    //! Деструктор, другие потоки к этому моменту не должны обращаться к словарю
+    ~ConcurrentMap();
+
+    // вставить элемент с ключем key и значением value
+    // если ключ уже представлен, заменить его значение на value
+    // возвращает, был ли добавлен новый элемент
+    bool insert(const Key& key, const Value& value);
+
+    // вставить элемент, только если ключа key еще нет, значение создается из args
+    template <typename... Args>
+    bool tryEmplace(const Key& key, Args&&... args);
+
+    // удалить элемент с ключем key, возвращает, был ли он удален этим вызовом
+    bool erase(const Key& key);
+
+    // скопировать значение элемента с ключем key в value без блокировок
+    // возвращает, найден ли элемент
+    bool find(const Key& key, Value& value) const;
+
+    bool contains(const Key& key) const;
+
+    // вызвать function(Value&) для копии значения элемента с ключем key под его блокировкой
+    // и опубликовать копию, читатели видят старое или новое значение целиком
+    // если function бросает исключение, значение не меняется
+    // возвращает, найден ли элемент
+    template <typename Function>
+    bool update(const Key& key, Function function);
+
+    // обойти элементы по возрастанию ключей, function(const Key&, const Value&)
+    // значения читаются как в find, function вызывается без блокировок и может
+    // менять словарь, в том числе текущий элемент
+    // элементы, добавленные или удаленные во время обхода, могут быть не видны
+    template <typename Function>
+    void forEach(Function function) const;
+
+    size_t size() const;
+
+private:
+    // предшественники и последователи key на всех уровнях
+    // возвращает верхний уровень, на котором найден ключ key, или -1
+    int _findNode(const Key& key, Node** preds, Node** succs) const;
+    // связанный и не удаленный узел с ключем key или nullptr
+    Node* _findLive(const Key& key) const;
+    // найти или вставить узел, второй элемент пары - была ли вставка
+    template <typename... Args>
+    std::pair<Node*, bool> _tryEmplace(const Key& key, Args&&... args);
+    static void _unlockPreds(Node** preds, int highestLocked);
+
+    // вызвать function(const Value&) для целой копии значения node, без блокировок
+    template <typename Function>
+    static void _readValue(Node* node, Function function);
+    // заменить значение node, вызывается под блокировкой узла
+    template <typename V>
+    static void _writeValue(Node* node, V&& value);
+    static void _storeWords(Node* node, const Value& value);
+
+    static Node* _allocateNode(int height);
+    template <typename... Args>
+    static Node* _createNode(int height, const Key& key, Args&&... args);
+    static void _destroyNode(Node* node, bool hasItem);
+    static void _retiredDeleter(void* node);
+    static void _retiredValueDeleter(void* value);
+    static int _randomHeight();
+
+    Node* _head;
+    std::atomic<size_t> _size{0};
+    Compare _compare;
+};
+
+/*!
+    Потокобезопасное множество
+    Не допускается дублирование ключей (аналог std::set)
+*/
+template <typename Value, typename Compare = std::less<Value>>
+class ConcurrentSet
+{
+    ConcurrentMap<Value, Value, Compare> _map;
+public:
+    ConcurrentSet() = default;
+
+    // вставить значение, если его еще нет, возвращает, была ли вставка
+    bool insert(const Value& value);
+
+    // удалить значение, возвращает, было ли оно удалено этим вызовом
+    bool erase(const Value& value);
+
+    bool contains(const Value& value) const;
+
+    // обойти значения по возрастанию, function(const Value&)
+    template <typename Function>
+    void forEach(Function function) const;
+
+    size_t size() const;
+};
+
+//SpinLock
+inline void SpinLock::lock() {
+    while (_locked.exchange(true, std::memory_order_acquire)) {
+        while (_locked.load(std::memory_order_relaxed)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+inline void SpinLock::unlock() {
+    _locked.store(false, std::memory_order_release);
+}
+
+//CONCURRENT MAP
+
+//Node
+template <typename Key, typename Value, typename Compare>
+ConcurrentMap<Key, Value, Compare>::Node::Node(int height)
+: height(height) {
+    for (int level = 0; level < height; level++) {
+        ::new (static_cast<void*>(next() + level)) std::atomic<Node*>(nullptr);
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+const Key& ConcurrentMap<Key, Value, Compare>::Node::key() {
+    return *std::launder(reinterpret_cast<Key*>(storage));
+}
+
+template <typename Key, typename Value, typename Compare>
+std::atomic<typename ConcurrentMap<Key, Value, Compare>::Node*>*
+ConcurrentMap<Key, Value, Compare>::Node::next() {
+    return reinterpret_cast<std::atomic<Node*>*>(reinterpret_cast<unsigned char*>(this) + _nextOffset);
+}
+
+//BigFive
+template <typename Key, typename Value, typename Compare>
+ConcurrentMap<Key, Value, Compare>::ConcurrentMap()
+: ConcurrentMap(Compare()) {}
+
+template <typename Key, typename Value, typename Compare>
+ConcurrentMap<Key, Value, Compare>::ConcurrentMap(const Compare& compare)
+: _head(_allocateNode(_maxHeight)), _compare(compare) {}
+
+template <typename Key, typename Value, typename Compare>
+ConcurrentMap<Key, Value, Compare>::~ConcurrentMap() {
+    Node* node = _head->next()[0].load();
+    while (node) {
+        Node* next = node->next()[0].load();
+        _destroyNode(node, true);
+        node = next;
+    }
+    _destroyNode(_head, false);
+}
+
+//Methods
+template <typename Key, typename Value, typename Compare>
+bool ConcurrentMap<Key, Value, Compare>::insert(const Key& key, const Value& value) {
+    EpochReclaimer::Guard guard;
+    while (true) {
+        std::pair<Node*, bool> result = _tryEmplace(key, value);
+        if (result.second) {
+            return true;
+        }
+        std::lock_guard<SpinLock> lock(result.first->lock);
+        // узел удалили между поиском и блокировкой - вставка повторяется
+        if (!result.first->marked.load()) {
+            _writeValue(result.first, value);
+            return false;
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename... Args>
+bool ConcurrentMap<Key, Value, Compare>::tryEmplace(const Key& key, Args&&... args) {
+    EpochReclaimer::Guard guard;
+    return _tryEmplace(key, std::forward<Args>(args)...).second;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool ConcurrentMap<Key, Value, Compare>::erase(const Key& key) {
+    EpochReclaimer::Guard guard;
+    Node* preds[_maxHeight];
+    Node* succs[_maxHeight];
+    Node* victim = nullptr;
+    while (true) {
+        int found = _findNode(key, preds, succs);
+        if (!victim) {
+            if (found == -1) {
+                return false;
+            }
+            Node* candidate = succs[found];
+            // вставка еще не завершена или узел уже удаляется
+            if (!candidate->fullyLinked.load() || candidate->height - 1 != found || candidate->marked.load()) {
+                return false;
+            }
+            candidate->lock.lock();
+            if (candidate->marked.load()) {
+                candidate->lock.unlock();
+                return false;
+            }
+            candidate->marked.store(true);
+            victim = candidate;
+        }
+        int highestLocked = -1;
+        bool valid = true;
+        for (int level = 0; valid && level < victim->height; level++) {
+            if (level == 0 || preds[level] != preds[level - 1]) {
+                preds[level]->lock.lock();
+            }
+            highestLocked = level;
+            valid = !preds[level]->marked.load() && preds[level]->next()[level].load() == victim;
+        }
+        if (!valid) {
+            _unlockPreds(preds, highestLocked);
+            continue;
+        }
+        for (int level = victim->height - 1; level >= 0; level--) {
+            preds[level]->next()[level].store(victim->next()[level].load(), std::memory_order_release);
+        }
+        victim->lock.unlock();
+        _unlockPreds(preds, highestLocked);
+        _size.fetch_sub(1, std::memory_order_relaxed);
+        EpochReclaimer::retire(victim, &_retiredDeleter);
+        return true;
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+bool ConcurrentMap<Key, Value, Compare>::find(const Key& key, Value& value) const {
+    EpochReclaimer::Guard guard;
+    Node* node = _findLive(key);
+    if (!node) {
+        return false;
+    }
+    _readValue(node, [&value](const Value& current) { value = current; });
+    return true;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool ConcurrentMap<Key, Value, Compare>::contains(const Key& key) const {
+    EpochReclaimer::Guard guard;
+    return _findLive(key) != nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Function>
+bool ConcurrentMap<Key, Value, Compare>::update(const Key& key, Function function) {
+    EpochReclaimer::Guard guard;
+    Node* node = _findLive(key);
+    if (!node) {
+        return false;
+    }
+    std::lock_guard<SpinLock> lock(node->lock);
+    if (node->marked.load()) {
+        return false;
+    }
+    // под блокировкой узла других записей нет, чтение не повторяется
+    _readValue(node, [node, &function](const Value& current) {
+        Value copy(current);
+        function(copy);
+        _writeValue(node, std::move(copy));
+    });
+    return true;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Function>
+void ConcurrentMap<Key, Value, Compare>::forEach(Function function) const {
+    EpochReclaimer::Guard guard;
+    for (Node* node = _head->next()[0].load(std::memory_order_acquire); node;
+         node = node->next()[0].load(std::memory_order_acquire)) {
+        if (!node->fullyLinked.load(std::memory_order_acquire)) {
+            continue;
+        }
+        // function получает копию и вызывается без блокировок, поэтому может менять словарь
+        if (!node->marked.load()) {
+            _readValue(node, [node, &function](const Value& value) { function(node->key(), value); });
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+size_t ConcurrentMap<Key, Value, Compare>::size() const {
+    return _size.load(std::memory_order_relaxed);
+}
+
+template <typename Key, typename Value, typename Compare>
+int ConcurrentMap<Key, Value, Compare>::_findNode(const Key& key, Node** preds, Node** succs) const {
+    int found = -1;
+    Node* pred = _head;
+    for (int level = _maxHeight - 1; level >= 0; level--) {
+        Node* curr = pred->next()[level].load(std::memory_order_acquire);
+        while (curr && _compare(curr->key(), key)) {
+            pred = curr;
+            curr = pred->next()[level].load(std::memory_order_acquire);
+        }
+        if (found == -1 && curr && !_compare(key, curr->key())) {
+            found = level;
+        }
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+    return found;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename ConcurrentMap<Key, Value, Compare>::Node*
+ConcurrentMap<Key, Value, Compare>::_findLive(const Key& key) const {
+    Node* pred = _head;
+    for (int level = _maxHeight - 1; level >= 0; level--) {
+        Node* curr = pred->next()[level].load(std::memory_order_acquire);
+        while (curr && _compare(curr->key(), key)) {
+            pred = curr;
+            curr = pred->next()[level].load(std::memory_order_acquire);
+        }
+        if (curr && !_compare(key, curr->key())) {
+            return curr->fullyLinked.load(std::memory_order_acquire) && !curr->marked.load() ? curr : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename... Args>
+std::pair<typename ConcurrentMap<Key, Value, Compare>::Node*, bool>
+ConcurrentMap<Key, Value, Compare>::_tryEmplace(const Key& key, Args&&... args) {
+    Node* preds[_maxHeight];
+    Node* succs[_maxHeight];
+    int height = _randomHeight();
+    while (true) {
+        int found = _findNode(key, preds, succs);
+        if (found != -1) {
+            Node* node = succs[found];
+            if (!node->marked.load()) {
+                while (!node->fullyLinked.load()) {
+                    std::this_thread::yield();
+                }
+                return std::pair<Node*, bool>(node, false);
+            }
+            // узел удаляется, повторить поиск после его исключения
+            continue;
+        }
+        // блокировки берутся снизу вверх, то есть по убыванию ключей
+        int highestLocked = -1;
+        bool valid = true;
+        for (int level = 0; valid && level < height; level++) {
+            if (level == 0 || preds[level] != preds[level - 1]) {
+                preds[level]->lock.lock();
+            }
+            highestLocked = level;
+            Node* succ = succs[level];
+            valid = !preds[level]->marked.load() && (!succ || !succ->marked.load())
+                    && preds[level]->next()[level].load() == succ;
+        }
+        if (!valid) {
+            _unlockPreds(preds, highestLocked);
+            continue;
+        }
+        Node* node;
+        try {
+            node = _createNode(height, key, std::forward<Args>(args)...);
+        }
+        catch (...) {
+            _unlockPreds(preds, highestLocked);
+            throw;
+        }
+        for (int level = 0; level < height; level++) {
+            node->next()[level].store(succs[level], std::memory_order_relaxed);
+        }
+        for (int level = 0; level < height; level++) {
+            preds[level]->next()[level].store(node, std::memory_order_release);
+        }
+        node->fullyLinked.store(true, std::memory_order_release);
+        _unlockPreds(preds, highestLocked);
+        _size.fetch_add(1, std::memory_order_relaxed);
+        return std::pair<Node*, bool>(node, true);
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+void ConcurrentMap<Key, Value, Compare>::_unlockPreds(Node** preds, int highestLocked) {
+    for (int level = 0; level <= highestLocked; level++) {
+        if (level == 0 || preds[level] != preds[level - 1]) {
+            preds[level]->lock.unlock();
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Function>
+void ConcurrentMap<Key, Value, Compare>::_readValue(Node* node, Function function) {
+    if constexpr (_inlineValue) {
+        alignas(Value) alignas(std::uintptr_t) std::uintptr_t words[_valueWords];
+        while (true) {
+            uint32_t version = node->value.version.load(std::memory_order_acquire);
+            if (version & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = 0; i < _valueWords; i++) {
+                words[i] = node->value.words[i].load(std::memory_order_relaxed);
+            }
+            // слова прочитаны раньше повторной проверки версии
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (node->value.version.load(std::memory_order_relaxed) == version) {
+                break;
+            }
+        }
+        function(*std::launder(reinterpret_cast<const Value*>(words)));
+    }
+    else {
+        // старый объект освобождается не раньше, чем закроется Guard читателя
+        function(*node->value.pointer.load(std::memory_order_acquire));
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename V>
+void ConcurrentMap<Key, Value, Compare>::_writeValue(Node* node, V&& value) {
+    if constexpr (_inlineValue) {
+        // копия создается до смены версии, исключение не оставляет версию нечетной
+        Value fresh(std::forward<V>(value));
+        uint32_t version = node->value.version.load(std::memory_order_relaxed);
+        node->value.version.store(version + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _storeWords(node, fresh);
+        node->value.version.store(version + 2, std::memory_order_release);
+    }
+    else {
+        Value* old = node->value.pointer.exchange(new Value(std::forward<V>(value)), std::memory_order_acq_rel);
+        EpochReclaimer::retire(old, &_retiredValueDeleter);
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+void ConcurrentMap<Key, Value, Compare>::_storeWords(Node* node, const Value& value) {
+    if constexpr (_inlineValue) {
+        std::uintptr_t words[_valueWords] = {};
+        std::memcpy(words, &value, sizeof(Value));
+        for (size_t i = 0; i < _valueWords; i++) {
+            node->value.words[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+typename ConcurrentMap<Key, Value, Compare>::Node*
+ConcurrentMap<Key, Value, Compare>::_allocateNode(int height) {
+    // массив указателей уровней размещается сразу за узлом
+    size_t bytes = _nextOffset + size_t(height) * sizeof(std::atomic<Node*>);
+    void* memory = ::operator new(bytes, std::align_val_t(alignof(Node)));
+    return ::new (memory) Node(height);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename... Args>
+typename ConcurrentMap<Key, Value, Compare>::Node*
+ConcurrentMap<Key, Value, Compare>::_createNode(int height, const Key& key, Args&&... args) {
+    Node* node = _allocateNode(height);
+    try {
+        ::new (static_cast<void*>(node->storage)) Key(key);
+    }
+    catch (...) {
+        _destroyNode(node, false);
+        throw;
+    }
+    try {
+        // узел еще не опубликован, версия не нужна
+        if constexpr (_inlineValue) {
+            Value value(std::forward<Args>(args)...);
+            _storeWords(node, value);
+        }
+        else {
+            node->value.pointer.store(new Value(std::forward<Args>(args)...), std::memory_order_relaxed);
+        }
+    }
+    catch (...) {
+        node->key().~Key();
+        _destroyNode(node, false);
+        throw;
+    }
+    return node;
+}
+
+template <typename Key, typename Value, typename Compare>
+void ConcurrentMap<Key, Value, Compare>::_destroyNode(Node* node, bool hasItem) {
+    if (hasItem) {
+        node->key().~Key();
+        if constexpr (!_inlineValue) {
+            delete node->value.pointer.load(std::memory_order_relaxed);
+        }
+    }
+    node->~Node();
+    ::operator delete(static_cast<void*>(node), std::align_val_t(alignof(Node)));
+}
+
+template <typename Key, typename Value, typename Compare>
+void ConcurrentMap<Key, Value, Compare>::_retiredDeleter(void* node) {
+    _destroyNode(static_cast<Node*>(node), true);
+}
+
+template <typename Key, typename Value, typename Compare>
+void ConcurrentMap<Key, Value, Compare>::_retiredValueDeleter(void* value) {
+    delete static_cast<Value*>(value);
+}
+
+template <typename Key, typename Value, typename Compare>
+int ConcurrentMap<Key, Value, Compare>::_randomHeight() {
+    // xorshift у каждого потока свой, уровень растет с вероятностью 1/4
+    thread_local uint64_t state = 0x9E3779B97F4A7C15ull ^ reinterpret_cast<uintptr_t>(&state);
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    uint64_t bits = state;
+    int height = 1;
+    while ((bits & 3) == 0 && height < _maxHeight) {
+        height++;
+        bits >>= 2;
+    }
+    return height;
+}
+
+//CONCURRENT SET
+template <typename Value, typename Compare>
+bool ConcurrentSet<Value, Compare>::insert(const Value& value) {
+    return _map.tryEmplace(value, value);
+}
+
+template <typename Value, typename Compare>
+bool ConcurrentSet<Value, Compare>::erase(const Value& value) {
+    return _map.erase(value);
+}
+
+template <typename Value, typename Compare>
+bool ConcurrentSet<Value, Compare>::contains(const Value& value) const {
+    return _map.contains(value);
+}
+
+template <typename Value, typename Compare>
+template <typename Function>
+void ConcurrentSet<Value, Compare>::forEach(Function function) const {
+    _map.forEach([&function](const Value& value, const Value&) { function(value); });
+}
+
+template <typename Value, typename Compare>
+size_t ConcurrentSet<Value, Compare>::size() const {
+    return _map.size();
+}
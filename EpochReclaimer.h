@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*!
+    Отложенное освобождение памяти по эпохам
+
+    Потоки читают общие структуры внутри критических секций (Guard),
+    не захватывая блокировок. Исключенный из структуры объект передается
+    в retire и освобождается только после того, как глобальная эпоха
+    продвинется дважды: к этому моменту ни один поток не может держать
+    на него указатель. Эпоха продвигается, когда все потоки внутри
+    критических секций вошли в них в текущей эпохе.
+
+    Каждый поток получает свою запись при первом обращении,
+    после завершения потока запись переиспользуется другими потоками.
+*/
+class EpochReclaimer
+{
+public:
+    /*!
+        Критическая секция чтения, допускает вложенность
+    */
+    class Guard
+    {
+    public:
+        Guard();
+        ~Guard();
+
+        Guard(const Guard& other) = delete;
+        Guard& operator=(const Guard& other) = delete;
+    };
+
+    // передать объект на удаление функцией deleter, когда его не смогут видеть другие потоки
+    // объект к этому моменту уже должен быть недостижим из структуры
+    static void retire(void* object, void (*deleter)(void*));
+
+    // попытаться продвинуть эпоху и освободить объекты текущего потока
+    static void collect();
+
+private:
+    struct Retired
+    {
+        void* object;
+        void (*deleter)(void*);
+        uint64_t epoch;
+    };
+
+    struct Record
+    {
+        std::atomic<uint64_t> activeEpoch{0}; //!< эпоха входа в секцию, 0 - вне секции
+        std::atomic<bool> owned{true};
+        size_t depth = 0;
+        std::vector<Retired> retired;
+        Record* next = nullptr;
+    };
+
+    //! Закрепляет запись за потоком на время его жизни
+    struct Owner
+    {
+        Owner();
+        ~Owner();
+        Record* record;
+    };
+
+    static Record* _record();
+    static void _tryAdvance();
+
+    static constexpr size_t _collectThreshold = 64;
+
+    static inline std::atomic<uint64_t> _epoch{1};
+    static inline std::atomic<Record*> _records{nullptr}; //!< записи не удаляются
+};
+
+//Guard
+inline EpochReclaimer::Guard::Guard() {
+    Record* record = _record();
+    if (record->depth++ == 0) {
+        record->activeEpoch.store(_epoch.load());
+        // последующие чтения структуры не могут обогнать объявление эпохи
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+inline EpochReclaimer::Guard::~Guard() {
+    Record* record = _record();
+    if (--record->depth == 0) {
+        record->activeEpoch.store(0, std::memory_order_release);
+    }
+}
+
+//Owner
+inline EpochReclaimer::Owner::Owner() {
+    for (Record* candidate = _records.load(); candidate; candidate = candidate->next) {
+        bool expected = false;
+        if (candidate->owned.compare_exchange_strong(expected, true)) {
+            record = candidate;
+            return;
+        }
+    }
+    record = new Record;
+    Record* head = _records.load();
+    do {
+        record->next = head;
+    } while (!_records.compare_exchange_weak(head, record));
+}
+
+inline EpochReclaimer::Owner::~Owner() {
+    // неосвобожденные объекты останутся в записи и будут освобождены следующим владельцем
+    record->owned.store(false, std::memory_order_release);
+}
+
+//Methods
+inline void EpochReclaimer::retire(void* object, void (*deleter)(void*)) {
+    Record* record = _record();
+    record->retired.push_back(Retired{object, deleter, _epoch.load()});
+    if (record->retired.size() >= _collectThreshold) {
+        collect();
+    }
+}
+
+inline void EpochReclaimer::collect() {
+    _tryAdvance();
+    Record* record = _record();
+    uint64_t epoch = _epoch.load();
+    size_t kept = 0;
+    for (size_t i = 0; i < record->retired.size(); i++) {
+        Retired& retired = record->retired[i];
+        if (retired.epoch + 2 <= epoch) {
+            retired.deleter(retired.object);
+        }
+        else {
+            record->retired[kept++] = retired;
+        }
+    }
+    record->retired.resize(kept);
+}
+
+inline EpochReclaimer::Record* EpochReclaimer::_record() {
+    thread_local Owner owner;
+    return owner.record;
+}
+
+inline void EpochReclaimer::_tryAdvance() {
+    uint64_t epoch = _epoch.load();
+    for (Record* record = _records.load(); record; record = record->next) {
+        uint64_t active = record->activeEpoch.load();
+        if (active != 0 && active != epoch) {
+            return;
+        }
+    }
+    _epoch.compare_exchange_strong(epoch, epoch + 1);
+}
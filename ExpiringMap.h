@@ -0,0 +1,310 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+#include "BinarySearchTree.h"
+
+/*!
+    Словарь для кэша с ограниченным сроком жизни элементов
+    Не допускается дублирование ключей (аналог std::map)
+
+    Кроме словаря ключей поддерживается второй индекс по моменту истечения,
+    поэтому просроченные элементы всегда лежат в его начале. Каждая операция
+    удаляет не больше evictionBudget самых старых просроченных элементов,
+    tick() делает то же самое отдельно, например по таймеру. Полного обхода
+    нет ни в одной операции, стоимость вытеснения ограничена O(budget * log n).
+    Просроченный, но еще не удаленный элемент не виден через find и contains.
+
+    При capacity > 0 поддерживается третий индекс по времени последнего обращения:
+    вставка нового ключа в заполненный словарь сначала удаляет просроченные,
+    а если места все равно нет - один давно не использованный элемент (LRU)
+    Clock - часы со статическим now(), как у std::chrono
+*/
+template <typename Key,
+          typename Value,
+          typename Compare = std::less<Key>,
+          typename Clock = std::chrono::steady_clock>
+class ExpiringMap
+{
+public:
+    using Duration = typename Clock::duration;
+    using TimePoint = typename Clock::time_point;
+
+private:
+    struct _Entry
+    {
+        Value value;
+        TimePoint expiry;
+        std::uint64_t order;   //!< порядковый номер вставки, различает равные моменты истечения
+        std::uint64_t access;  //!< номер последнего обращения, только при capacity > 0
+    };
+    using _ExpiryKey = std::pair<TimePoint, std::uint64_t>;
+
+public:
+    //! defaultTtl - срок жизни элементов, вставленных без явного срока
+    //! capacity - наибольшее число элементов, 0 - без ограничения
+    //! evictionBudget - сколько просроченных элементов удаляет одна операция
+    explicit ExpiringMap(Duration defaultTtl, size_t capacity = 0, size_t evictionBudget = 4);
+
+    explicit ExpiringMap(const ExpiringMap& other) = default;
+    ExpiringMap& operator=(const ExpiringMap& other) = default;
+
+    explicit ExpiringMap(ExpiringMap&& other) noexcept = default;
+    ExpiringMap& operator=(ExpiringMap&& other) noexcept = default;
+
+    ~ExpiringMap() = default;
+
+    // вставить элемент со сроком жизни ttl (по умолчанию defaultTtl)
+    // если ключ уже есть, заменить значение и отсчитать срок заново
+    // возвращает, был ли добавлен новый элемент (замена просроченного тоже считается)
+    bool insert(const Key& key, const Value& value);
+    bool insert(const Key& key, const Value& value, Duration ttl);
+
+    // значение живого элемента с ключем key или nullptr; при capacity > 0
+    // элемент становится последним использованным. Указатель действителен
+    // до следующей изменяющей операции
+    Value* find(const Key& key);
+    // есть ли живой элемент, без побочных эффектов
+    bool contains(const Key& key) const;
+
+    // продлить срок жизни элемента на ttl от текущего момента
+    // возвращает false, если живого элемента нет
+    bool touch(const Key& key, Duration ttl);
+
+    // удалить элемент, возвращает, был ли он жив
+    bool erase(const Key& key);
+
+    // удалить не больше budget просроченных элементов, возвращает их число
+    size_t tick();
+    size_t tick(size_t budget);
+
+    // число хранимых элементов, включая просроченные, которые еще не удалены
+    size_t size() const;
+
+    void clear();
+
+private:
+    // удалить до budget элементов, истекших к моменту now
+    size_t _evictExpired(TimePoint now, size_t budget);
+    // удалить элемент, к которому дольше всех не обращались
+    void _evictLeastRecent();
+    // удалить элемент key со всеми записями индексов; key не должен ссылаться в индексы
+    void _remove(const Key& key, const _Entry& entry);
+    // сделать элемент последним использованным
+    void _touchRecency(const Key& key, _Entry& entry);
+
+    Map<Key, _Entry, Compare> _entries;
+    Map<_ExpiryKey, Key> _expiry;         //!< ключи в порядке истечения
+    Map<std::uint64_t, Key> _recency;     //!< ключи в порядке обращений, только при capacity > 0
+    Duration _defaultTtl;
+    size_t _capacity;
+    size_t _evictionBudget;
+    std::uint64_t _sequence = 0;          //!< источник номеров вставок и обращений
+};
+
+//BigFive
+template <typename Key, typename Value, typename Compare, typename Clock>
+ExpiringMap<Key, Value, Compare, Clock>::ExpiringMap(Duration defaultTtl, size_t capacity, size_t evictionBudget)
+: _defaultTtl(defaultTtl), _capacity(capacity), _evictionBudget(evictionBudget) {}
+
+//Methods
+template <typename Key, typename Value, typename Compare, typename Clock>
+bool ExpiringMap<Key, Value, Compare, Clock>::insert(const Key& key, const Value& value) {
+    return insert(key, value, _defaultTtl);
+}
+
+template <typename Key, typename Value, typename Compare, typename Clock>
+bool ExpiringMap<Key, Value, Compare, Clock>::insert(const Key& key, const Value& value, Duration ttl) {
+    TimePoint now = Clock::now();
+    _evictExpired(now, _evictionBudget);
+
+    auto found = _entries.find(key);
+    if (found != _entries.end()) {
+        // новый срок - новая позиция в индексе истечения
+        // значение присваивается первым: если присваивание бросает, индексы не тронуты
+        _Entry& entry = found->second;
+        bool expired = entry.expiry <= now;
+        entry.value = value;
+        _ExpiryKey slot(now + ttl, _sequence++);
+        _expiry.insert(slot, key);
+        _expiry.erase(_ExpiryKey(entry.expiry, entry.order));
+        entry.expiry = slot.first;
+        entry.order = slot.second;
+        if (_capacity) {
+            _touchRecency(key, entry);
+        }
+        return expired;
+    }
+
+    if (_capacity && _entries.size() >= _capacity) {
+        _evictLeastRecent();
+    }
+    std::uint64_t order = _sequence++;
+    _ExpiryKey slot(now + ttl, order);
+    _entries.tryEmplace(key, _Entry{value, slot.first, order, order});
+    // при исключении в индексах уже вставленные записи откатываются
+    try {
+        _expiry.insert(slot, key);
+        try {
+            if (_capacity) {
+                _recency.insert(order, key);
+            }
+        }
+        catch (...) {
+            _expiry.erase(slot);
+            throw;
+        }
+    }
+    catch (...) {
+        _entries.erase(key);
+        throw;
+    }
+    return true;
+}
+
+template <typename Key, typename Value, typename Compare, typename Clock>
+Value* ExpiringMap<Key, Value, Compare, Clock>::find(const Key& key) {
+    TimePoint now = Clock::now();
+    _evictExpired(now, _evictionBudget);
+
+    auto found = _entries.find(key);
+    if (found == _entries.end()) {
+        return nullptr;
+    }
+    _Entry& entry = found->second;
+    if (entry.expiry <= now) {
+        // найденный просроченный элемент удаляется сразу, не дожидаясь очереди
+        Key expired = found->first;
+        _remove(expired, entry);
+        return nullptr;
+    }
+    if (_capacity) {
+        _touchRecency(found->first, entry);
+    }
+    return &entry.value;
+}
+
+template <typename Key, typename Value, typename Compare, typename Clock>
+bool ExpiringMap<Key, Value, Compare, Clock>::contains(const Key& key) const {
+    auto found = _entries.find(key);
+    return found != _entries.cend() && found->second.expiry > Clock::now();
+}
+
+template <typename Key, typename Value, typename Compare, typename Clock>
+bool ExpiringMap<Key, Value, Compare, Clock>::touch(const Key& key, Duration ttl) {
+    TimePoint now = Clock::now();
+    _evictExpired(now, _evictionBudget);
+
+    auto found = _entries.find(key);
+    if (found == _entries.end() || found->second.expiry <= now) {
+        return false;
+    }
+    _Entry& entry = found->second;
+    _ExpiryKey slot(now + ttl, _sequence++);
+    _expiry.insert(slot, key);
+    _expiry.erase(_ExpiryKey(entry.expiry, entry.order));
+    entry.expiry = slot.first;
+    entry.order = slot.second;
+    if (_capacity) {
+        _touchRecency(key, entry);
+    }
+    return true;
+}
+
+template <typename Key, typename Value, typename Compare, typename Clock>
+bool ExpiringMap<Key, Value, Compare, Clock>::erase(const Key& key) {
+    TimePoint now = Clock::now();
+    _evictExpired(now, _evictionBudget);
+
+    auto found = _entries.find(key);
+    if (found == _entries.end()) {
+        return false;
+    }
+    bool alive = found->second.expiry > now;
+    _remove(key, found->second);
+    return alive;
+}
+
+template <typename Key, typename Value, typename Compare, typename Clock>
+size_t ExpiringMap<Key, Value, Compare, Clock>::tick() {
+    return tick(_evictionBudget);
+}
+
+template <typename Key, typename Value, typename Compare, typename Clock>
+size_t ExpiringMap<Key, Value, Compare, Clock>::tick(size_t budget) {
+    return _evictExpired(Clock::now(), budget);
+}
+
+template <typename Key, typename Value, typename Compare, typename Clock>
+size_t ExpiringMap<Key, Value, Compare, Clock>::size() const {
+    return _entries.size();
+}
+
+template <typename Key, typename Value, typename Compare, typename Clock>
+void ExpiringMap<Key, Value, Compare, Clock>::clear() {
+    _entries = Map<Key, _Entry, Compare>();
+    _expiry = Map<_ExpiryKey, Key>();
+    _recency = Map<std::uint64_t, Key>();
+}
+
+//Eviction
+template <typename Key, typename Value, typename Compare, typename Clock>
+size_t ExpiringMap<Key, Value, Compare, Clock>::_evictExpired(TimePoint now, size_t budget) {
+    size_t evicted = 0;
+    while (evicted < budget && _expiry.size() != 0) {
+        auto oldest = _expiry.begin();
+        if (oldest->first.first > now) {
+            break;
+        }
+        // ключ копируется: запись индекса удаляется вместе с элементом
+        Key key = oldest->second;
+        auto found = _entries.find(key);
+        if (found == _entries.end() || _ExpiryKey(found->second.expiry, found->second.order) != oldest->first) {
+            // запись без элемента не должна появляться, но и не должна ломать вытеснение
+            _expiry.erase(oldest);
+            continue;
+        }
+        _remove(key, found->second);
+        evicted++;
+    }
+    return evicted;
+}
+
+template <typename Key, typename Value, typename Compare, typename Clock>
+void ExpiringMap<Key, Value, Compare, Clock>::_evictLeastRecent() {
+    // сначала просроченные: их удаление не выбрасывает живые элементы
+    if (_evictExpired(Clock::now(), 1) != 0 || _recency.size() == 0) {
+        return;
+    }
+    while (_recency.size() != 0) {
+        auto oldest = _recency.begin();
+        Key key = oldest->second;
+        auto found = _entries.find(key);
+        if (found != _entries.end() && found->second.access == oldest->first) {
+            _remove(key, found->second);
+            return;
+        }
+        _recency.erase(oldest);
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Clock>
+void ExpiringMap<Key, Value, Compare, Clock>::_remove(const Key& key, const _Entry& entry) {
+    _expiry.erase(_ExpiryKey(entry.expiry, entry.order));
+    if (_capacity) {
+        _recency.erase(std::uint64_t(entry.access));
+    }
+    _entries.erase(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Clock>
+void ExpiringMap<Key, Value, Compare, Clock>::_touchRecency(const Key& key, _Entry& entry) {
+    std::uint64_t access = _sequence++;
+    _recency.insert(access, key);
+    _recency.erase(std::uint64_t(entry.access));
+    entry.access = access;
+}
@@ -0,0 +1,1307 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "BinarySearchTree.h"
+#include "ThreadPool.h"
+
+/*!
+    Политики поиска в FlatMap
+    SortedLayout - бинарный поиск без ветвлений прямо по отсортированному массиву пар
+    EytzingerLayout - дополнительная копия ключей в порядке Эйтцингера (дерево поиска,
+    записанное по уровням): первые уровни поиска лежат рядом, узлы на четыре уровня
+    ниже запрашиваются заранее. Стоит sizeof(Key) + 4 байта на элемент, и каждая
+    вставка или удаление одного элемента перестраивает копию целиком за O(n)
+    с копированием всех ключей, поэтому заполнять такой словарь нужно
+    построением из диапазона, assign, insertBatch или unite - одна перестройка на пакет
+*/
+struct SortedLayout {};
+struct EytzingerLayout {};
+
+/*!
+    Словарь на отсортированном массиве для таблиц, которые строятся один раз
+    и дальше в основном читаются
+    Не допускается дублирование ключей (аналог std::map)
+    Интерфейс совпадает с Map, итераторы - указатели на пары массива,
+    обход идет простым инкрементом указателя. Вставка и удаление одного
+    элемента сдвигают массив за O(n) и делают итераторы недействительными,
+    пакетные операции и операции над множествами - один проход слиянием
+    С EytzingerLayout вставка и удаление одного элемента еще и строят заново
+    копию ключей за O(n): для загрузки многих элементов - insertBatch или unite
+*/
+template <typename Key,
+          typename Value,
+          typename Compare = std::less<Key>,
+          typename Layout = SortedLayout>
+class FlatMap
+{
+    template <typename, typename, typename>
+    friend class FlatSet;
+
+    using _Item = std::pair<Key, Value>;
+
+    static constexpr bool _eytzingerLayout = std::is_same<Layout, EytzingerLayout>::value;
+    //! Узлы на столько позиций Эйтцингера дальше текущего лежат на четыре уровня ниже
+    static constexpr size_t _prefetchStride = 16;
+    //! Диапазоны меньше этого обходятся одним потоком
+    static constexpr size_t _parallelGrain = 4096;
+
+    template <typename K, typename Result>
+    using _IfTransparent = std::enable_if_t<IsTransparentCompare<Compare, K>::value, Result>;
+
+public:
+    using MapIterator = _Item*;
+    using ConstMapIterator = const _Item*;
+
+    FlatMap() = default;
+    //! Ключи упорядочиваются компаратором compare
+    explicit FlatMap(const Compare& compare);
+    //! Построение за O(n) из диапазона пар, отсортированного по ключу без повторов
+    template <typename ForwardIt>
+    FlatMap(ForwardIt first, ForwardIt last);
+    //! Построение за O(n) обходом словаря на дереве
+    template <typename Engine>
+    explicit FlatMap(const Map<Key, Value, Compare, Engine>& map);
+
+    explicit FlatMap(const FlatMap& other) = default;
+    FlatMap& operator=(const FlatMap& other) = default;
+
+    explicit FlatMap(FlatMap&& other) noexcept = default;
+    FlatMap& operator=(FlatMap&& other) noexcept = default;
+
+    ~FlatMap() = default;
+
+    // вставить элемент с ключем key и значением value
+    // если элемент с ключем key уже есть, заменить его значение на value
+    // второй элемент пары - был ли добавлен новый элемент
+    std::pair<MapIterator, bool> insert(const Key& key, const Value& value);
+    std::pair<MapIterator, bool> insert(Key&& key, Value&& value);
+
+    // то же, что insert, но значение передается любым типом, присваиваемым Value
+    template <typename V>
+    std::pair<MapIterator, bool> insertOrAssign(const Key& key, V&& value);
+    template <typename V>
+    std::pair<MapIterator, bool> insertOrAssign(Key&& key, V&& value);
+
+    // вставить элемент, только если ключа key еще нет, значение создается из args
+    template <typename... Args>
+    std::pair<MapIterator, bool> tryEmplace(const Key& key, Args&&... args);
+    template <typename... Args>
+    std::pair<MapIterator, bool> tryEmplace(Key&& key, Args&&... args);
+
+    // удалить элемент с ключем key
+    void erase(const Key& key);
+    template <typename K>
+    _IfTransparent<K, void> erase(const K& key);
+
+    // вставить пары диапазона [first, last), результат как у цикла insert:
+    // значения существующих ключей заменяются, из повторов пакета остается последний
+    // пакет сортируется и сливается с массивом за O(n + m log m)
+    template <typename ForwardIt>
+    void insertBatch(ForwardIt first, ForwardIt last);
+    // удалить элементы с ключами из диапазона [first, last) за O(n + m log m)
+    template <typename ForwardIt>
+    void eraseBatch(ForwardIt first, ForwardIt last);
+
+    // операции над множествами ключей слиянием массивов за O(n + m)
+    // добавить элементы other с новыми ключами, значения общих ключей не меняются
+    void unite(const FlatMap& other);
+    void unite(FlatMap&& other);
+    // оставить элементы с ключами из other
+    void intersect(const FlatMap& other);
+    // удалить элементы с ключами из other
+    void difference(const FlatMap& other);
+
+    // параллельные обходы частей массива, функции вызываются из нескольких потоков
+    // вызвать function(pair) для всех элементов или для ключей из [low, high)
+    template <typename Function>
+    void forEach(Function function);
+    template <typename Function>
+    void forEach(const Key& low, const Key& high, Function function);
+    // свернуть transform(pair) ассоциативной функцией reduce в порядке ключей
+    template <typename T, typename Reduce, typename Transform>
+    T transformReduce(T init, Reduce reduce, Transform transform) const;
+    template <typename T, typename Reduce, typename Transform>
+    T transformReduce(const Key& low, const Key& high, T init, Reduce reduce, Transform transform) const;
+    // свернуть значения
+    template <typename T, typename Reduce>
+    T reduce(T init, Reduce reduce) const;
+    template <typename T, typename Reduce>
+    T reduce(const Key& low, const Key& high, T init, Reduce reduce) const;
+
+    // заменить содержимое диапазоном пар, отсортированным по ключу без повторов
+    template <typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+
+    // найти элемент, равный ключу key
+    ConstMapIterator find(const Key& key) const;
+    MapIterator find(const Key& key);
+    template <typename K>
+    _IfTransparent<K, ConstMapIterator> find(const K& key) const;
+    template <typename K>
+    _IfTransparent<K, MapIterator> find(const K& key);
+
+    // найти элементы для всех ключей [first, last), результаты пишутся в out по порядку
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out);
+    // в out пишется bool для каждого ключа
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+
+    // первый элемент с ключем не меньше key
+    ConstMapIterator lowerBound(const Key& key) const;
+    MapIterator lowerBound(const Key& key);
+    template <typename K>
+    _IfTransparent<K, ConstMapIterator> lowerBound(const K& key) const;
+    template <typename K>
+    _IfTransparent<K, MapIterator> lowerBound(const K& key);
+
+    // первый элемент с ключем больше key
+    ConstMapIterator upperBound(const Key& key) const;
+    MapIterator upperBound(const Key& key);
+    template <typename K>
+    _IfTransparent<K, ConstMapIterator> upperBound(const K& key) const;
+    template <typename K>
+    _IfTransparent<K, MapIterator> upperBound(const K& key);
+
+    // доступ к элементу по ключу
+    // если элемента не существует, создать его со значением по умолчанию
+    const Value& operator[](const Key& key) const;
+    Value& operator[](const Key& key);
+    Value& operator[](Key&& key);
+
+    MapIterator begin();
+    MapIterator end();
+
+    ConstMapIterator cbegin() const;
+    ConstMapIterator cend() const;
+
+    size_t size() const;
+
+    Compare keyComp() const;
+
+private:
+    // индекс первого элемента, ключ которого не удовлетворяет before
+    // before(key) истинно для начала массива и ложно для его конца
+    template <typename Before>
+    size_t _partitionPoint(Before before) const;
+    template <typename K>
+    size_t _lowerIndex(const K& key) const;
+    template <typename K>
+    size_t _upperIndex(const K& key) const;
+    // индекс элемента с ключем key или size()
+    template <typename K>
+    size_t _findIndex(const K& key) const;
+
+    template <typename KeyArg, typename... Args>
+    std::pair<MapIterator, bool> _tryEmplace(KeyArg&& key, Args&&... args);
+    template <typename KeyArg, typename V>
+    std::pair<MapIterator, bool> _insertOrAssign(KeyArg&& key, V&& value);
+    template <typename K>
+    void _eraseKey(const K& key);
+    // удалить элементы, для которых erased(pair) истинно, erased вызывается по порядку массива
+    template <typename Erased>
+    void _eraseIf(Erased erased);
+    // слить с массивом пары [first, last), упорядоченные по ключу без повторов,
+    // новые пары берутся из *first: копируются, а через move_iterator перемещаются
+    // при равных ключах остается пара из [first, last), если replace, иначе пара массива
+    template <typename InputIt>
+    void _uniteSorted(InputIt first, InputIt last, bool replace);
+    // пройти то же слияние, вызывая emit(pair) для пар результата по порядку
+    template <typename InputIt, typename Emit>
+    void _mergeSorted(InputIt first, InputIt last, bool replace, Emit emit);
+
+    //! Копия ключей в порядке Эйтцингера и индексы этих ключей в _items
+    struct _Index
+    {
+        std::vector<Key> eytzinger;
+        std::vector<std::uint32_t> ranks;
+    };
+
+    // построить копию ключей для будущего массива из count элементов, keyAt(i) - ключ i-го из них
+    // строится до изменения _items: исключение (в том числе length_error при count >= UINT32_MAX)
+    // оставляет словарь прежним; у SortedLayout ничего не строит
+    template <typename KeyAt>
+    _Index _makeIndex(size_t count, KeyAt keyAt) const;
+    void _setIndex(_Index& index) noexcept;
+    // перестроить копию ключей по текущему массиву, только при построении словаря
+    void _reindex();
+    // позиции в порядке Эйтцингера начиная с k получают индексы массива по порядку
+    static void _fillRanks(std::vector<std::uint32_t>& ranks, size_t k, std::uint32_t& rank);
+    static size_t _trailingOnes(size_t value);
+
+    template <typename Function>
+    void _forEachIndices(size_t first, size_t last, Function& function);
+    template <typename T, typename Reduce, typename Transform>
+    std::optional<T> _reduceIndices(size_t first, size_t last, const Reduce& reduce, const Transform& transform) const;
+
+    std::vector<_Item> _items;          //!< пары в порядке ключей
+    std::vector<Key> _eytzinger;        //!< ключи в порядке Эйтцингера, только у EytzingerLayout
+    std::vector<std::uint32_t> _ranks;  //!< индекс в _items для каждой позиции _eytzinger
+    Compare _compare;
+};
+
+
+/*!
+    Множество на отсортированном массиве
+    Не допускается дублирование ключей (аналог std::set)
+    Интерфейс совпадает с Set, элементы хранятся парами (value, value), как у Set
+*/
+template <typename Value,
+          typename Compare = std::less<Value>,
+          typename Layout = SortedLayout>
+class FlatSet
+{
+    FlatMap<Value, Value, Compare, Layout> _map;
+
+    template <typename K, typename Result>
+    using _IfTransparent = std::enable_if_t<IsTransparentCompare<Compare, K>::value, Result>;
+
+    // представляет диапазон значений как диапазон пар (value, value) для FlatMap
+    template <typename ForwardIt>
+    class _PairIterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<Value, Value>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = std::pair<const Value&, const Value&>;
+
+        explicit _PairIterator(ForwardIt it);
+
+        reference operator*() const;
+        _PairIterator& operator++();
+
+        bool operator==(const _PairIterator& other) const;
+        bool operator!=(const _PairIterator& other) const;
+
+    private:
+        ForwardIt _it;
+    };
+
+public:
+    using SetIterator = typename FlatMap<Value, Value, Compare, Layout>::MapIterator;
+    using ConstSetIterator = typename FlatMap<Value, Value, Compare, Layout>::ConstMapIterator;
+
+    FlatSet() = default;
+    //! Построение за O(n) из отсортированного диапазона значений без повторов
+    template <typename ForwardIt>
+    FlatSet(ForwardIt first, ForwardIt last);
+    //! Построение за O(n) обходом множества на дереве
+    template <typename Engine>
+    explicit FlatSet(const Set<Value, Compare, Engine>& set);
+
+    explicit FlatSet(const FlatSet& other) = default;
+    FlatSet& operator=(const FlatSet& other) = default;
+
+    explicit FlatSet(FlatSet&& other) noexcept = default;
+    FlatSet& operator=(FlatSet&& other) noexcept = default;
+
+    ~FlatSet() = default;
+
+    // вставить значение, если его еще нет
+    // второй элемент пары - была ли вставка
+    std::pair<SetIterator, bool> insert(const Value& value);
+    std::pair<SetIterator, bool> insert(Value&& value);
+
+    void erase(const Value& value);
+    template <typename K>
+    _IfTransparent<K, void> erase(const K& value);
+
+    // вставить значения диапазона [first, last), которых еще нет, как цикл insert
+    template <typename ForwardIt>
+    void insertBatch(ForwardIt first, ForwardIt last);
+    // удалить значения диапазона [first, last)
+    template <typename ForwardIt>
+    void eraseBatch(ForwardIt first, ForwardIt last);
+
+    // объединение, пересечение и разность с other, как у FlatMap
+    void unite(const FlatSet& other);
+    void unite(FlatSet&& other);
+    void intersect(const FlatSet& other);
+    void difference(const FlatSet& other);
+
+    // параллельные обходы, как у FlatMap: function(value) и transform(value)
+    template <typename Function>
+    void forEach(Function function) const;
+    template <typename Function>
+    void forEach(const Value& low, const Value& high, Function function) const;
+    template <typename T, typename Reduce, typename Transform>
+    T transformReduce(T init, Reduce reduce, Transform transform) const;
+    template <typename T, typename Reduce, typename Transform>
+    T transformReduce(const Value& low, const Value& high, T init, Reduce reduce, Transform transform) const;
+    template <typename T, typename Reduce>
+    T reduce(T init, Reduce reduce) const;
+    template <typename T, typename Reduce>
+    T reduce(const Value& low, const Value& high, T init, Reduce reduce) const;
+
+    // заменить содержимое отсортированным диапазоном значений без повторов
+    template <typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+
+    ConstSetIterator find(const Value& value) const;
+    SetIterator find(const Value& value);
+    template <typename K>
+    _IfTransparent<K, ConstSetIterator> find(const K& value) const;
+    template <typename K>
+    _IfTransparent<K, SetIterator> find(const K& value);
+
+    // поиск группы значений, результаты пишутся в out по порядку
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt findBatch(ForwardIt first, ForwardIt last, OutputIt out);
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const;
+
+    // первый элемент не меньше value
+    ConstSetIterator lowerBound(const Value& value) const;
+    SetIterator lowerBound(const Value& value);
+    template <typename K>
+    _IfTransparent<K, ConstSetIterator> lowerBound(const K& value) const;
+    template <typename K>
+    _IfTransparent<K, SetIterator> lowerBound(const K& value);
+
+    // первый элемент больше value
+    ConstSetIterator upperBound(const Value& value) const;
+    SetIterator upperBound(const Value& value);
+    template <typename K>
+    _IfTransparent<K, ConstSetIterator> upperBound(const K& value) const;
+    template <typename K>
+    _IfTransparent<K, SetIterator> upperBound(const K& value);
+
+    SetIterator begin();
+    SetIterator end();
+
+    ConstSetIterator cbegin() const;
+    ConstSetIterator cend() const;
+
+    size_t size() const;
+
+    bool contains(const Value& value) const;
+};
+
+//FLATMAP
+
+//BigFive
+template <typename Key, typename Value, typename Compare, typename Layout>
+FlatMap<Key, Value, Compare, Layout>::FlatMap(const Compare& compare)
+: _compare(compare) {}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+FlatMap<Key, Value, Compare, Layout>::FlatMap(ForwardIt first, ForwardIt last)
+: _items(first, last) {
+    _reindex();
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename Engine>
+FlatMap<Key, Value, Compare, Layout>::FlatMap(const Map<Key, Value, Compare, Engine>& map)
+: _compare(map.keyComp()) {
+    _items.reserve(map.size());
+    for (auto it = map.cbegin(); it != map.cend(); ++it) {
+        _items.push_back(*it);
+    }
+    _reindex();
+}
+
+//Methods
+template <typename Key, typename Value, typename Compare, typename Layout>
+std::pair<typename FlatMap<Key, Value, Compare, Layout>::MapIterator, bool>
+FlatMap<Key, Value, Compare, Layout>::insert(const Key& key, const Value& value) {
+    return _insertOrAssign(key, value);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+std::pair<typename FlatMap<Key, Value, Compare, Layout>::MapIterator, bool>
+FlatMap<Key, Value, Compare, Layout>::insert(Key&& key, Value&& value) {
+    return _insertOrAssign(std::move(key), std::move(value));
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename V>
+std::pair<typename FlatMap<Key, Value, Compare, Layout>::MapIterator, bool>
+FlatMap<Key, Value, Compare, Layout>::insertOrAssign(const Key& key, V&& value) {
+    return _insertOrAssign(key, std::forward<V>(value));
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename V>
+std::pair<typename FlatMap<Key, Value, Compare, Layout>::MapIterator, bool>
+FlatMap<Key, Value, Compare, Layout>::insertOrAssign(Key&& key, V&& value) {
+    return _insertOrAssign(std::move(key), std::forward<V>(value));
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename KeyArg, typename V>
+std::pair<typename FlatMap<Key, Value, Compare, Layout>::MapIterator, bool>
+FlatMap<Key, Value, Compare, Layout>::_insertOrAssign(KeyArg&& key, V&& value) {
+    size_t index = _lowerIndex(key);
+    if (index < _items.size() && !_compare(key, _items[index].first)) {
+        _items[index].second = std::forward<V>(value);
+        return std::pair<MapIterator, bool>(_items.data() + index, false);
+    }
+    _Index eytzinger = _makeIndex(_items.size() + 1, [this, index, &key](size_t i) -> const Key& {
+        return i < index ? _items[i].first : i == index ? key : _items[i - 1].first;
+    });
+    _items.emplace(_items.begin() + index, std::forward<KeyArg>(key), std::forward<V>(value));
+    _setIndex(eytzinger);
+    return std::pair<MapIterator, bool>(_items.data() + index, true);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename... Args>
+std::pair<typename FlatMap<Key, Value, Compare, Layout>::MapIterator, bool>
+FlatMap<Key, Value, Compare, Layout>::tryEmplace(const Key& key, Args&&... args) {
+    return _tryEmplace(key, std::forward<Args>(args)...);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename... Args>
+std::pair<typename FlatMap<Key, Value, Compare, Layout>::MapIterator, bool>
+FlatMap<Key, Value, Compare, Layout>::tryEmplace(Key&& key, Args&&... args) {
+    return _tryEmplace(std::move(key), std::forward<Args>(args)...);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename KeyArg, typename... Args>
+std::pair<typename FlatMap<Key, Value, Compare, Layout>::MapIterator, bool>
+FlatMap<Key, Value, Compare, Layout>::_tryEmplace(KeyArg&& key, Args&&... args) {
+    size_t index = _lowerIndex(key);
+    if (index < _items.size() && !_compare(key, _items[index].first)) {
+        return std::pair<MapIterator, bool>(_items.data() + index, false);
+    }
+    _Index eytzinger = _makeIndex(_items.size() + 1, [this, index, &key](size_t i) -> const Key& {
+        return i < index ? _items[i].first : i == index ? key : _items[i - 1].first;
+    });
+    _items.emplace(_items.begin() + index,
+                   std::piecewise_construct,
+                   std::forward_as_tuple(std::forward<KeyArg>(key)),
+                   std::forward_as_tuple(std::forward<Args>(args)...));
+    _setIndex(eytzinger);
+    return std::pair<MapIterator, bool>(_items.data() + index, true);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+void FlatMap<Key, Value, Compare, Layout>::erase(const Key& key) {
+    _eraseKey(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatMap<Key, Value, Compare, Layout>::erase(const K& key) -> _IfTransparent<K, void> {
+    _eraseKey(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename K>
+void FlatMap<Key, Value, Compare, Layout>::_eraseKey(const K& key) {
+    size_t index = _findIndex(key);
+    if (index == _items.size()) {
+        return;
+    }
+    _Index eytzinger = _makeIndex(_items.size() - 1, [this, index](size_t i) -> const Key& {
+        return _items[i < index ? i : i + 1].first;
+    });
+    _items.erase(_items.begin() + index);
+    _setIndex(eytzinger);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+void FlatMap<Key, Value, Compare, Layout>::insertBatch(ForwardIt first, ForwardIt last) {
+    auto itemLess = [this](const _Item& left, const _Item& right) {
+        return _compare(left.first, right.first);
+    };
+    std::vector<_Item> batch(first, last);
+    if (!std::is_sorted(batch.begin(), batch.end(), itemLess)) {
+        std::stable_sort(batch.begin(), batch.end(), itemLess);
+    }
+    // из равных ключей пакета остается последний, новое значение заменяет старое
+    auto kept = batch.begin();
+    for (auto item = batch.begin(); item != batch.end(); ++item) {
+        if (std::next(item) != batch.end() && !itemLess(*item, *std::next(item))) {
+            continue;
+        }
+        if (kept != item) {
+            *kept = std::move(*item);
+        }
+        ++kept;
+    }
+    batch.erase(kept, batch.end());
+    _uniteSorted(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()), true);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+void FlatMap<Key, Value, Compare, Layout>::eraseBatch(ForwardIt first, ForwardIt last) {
+    std::vector<Key> keys(first, last);
+    std::sort(keys.begin(), keys.end(), _compare);
+    auto key = keys.begin();
+    _eraseIf([this, &key, &keys](const _Item& item) {
+        while (key != keys.end() && _compare(*key, item.first)) {
+            ++key;
+        }
+        return key != keys.end() && !_compare(item.first, *key);
+    });
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+void FlatMap<Key, Value, Compare, Layout>::unite(const FlatMap& other) {
+    _uniteSorted(other._items.begin(), other._items.end(), false);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+void FlatMap<Key, Value, Compare, Layout>::unite(FlatMap&& other) {
+    _uniteSorted(std::make_move_iterator(other._items.begin()), std::make_move_iterator(other._items.end()), false);
+    other._items.clear();
+    other._reindex();
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename InputIt>
+void FlatMap<Key, Value, Compare, Layout>::_uniteSorted(InputIt first, InputIt last, bool replace) {
+    std::vector<_Item> merged;
+    merged.reserve(_items.size() + static_cast<size_t>(std::distance(first, last)));
+    _Index eytzinger;
+    if constexpr (_eytzingerLayout) {
+        // пробное слияние по адресам ключей: копия ключей готова до того, как пары массива перемещены
+        std::vector<const Key*> keys;
+        keys.reserve(merged.capacity());
+        _mergeSorted(first, last, replace, [&keys](auto&& item) { keys.push_back(&item.first); });
+        eytzinger = _makeIndex(keys.size(), [&keys](size_t i) -> const Key& { return *keys[i]; });
+    }
+    _mergeSorted(first, last, replace, [&merged](auto&& item) {
+        merged.emplace_back(std::forward<decltype(item)>(item));
+    });
+    _items.swap(merged);
+    _setIndex(eytzinger);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename InputIt, typename Emit>
+void FlatMap<Key, Value, Compare, Layout>::_mergeSorted(InputIt first, InputIt last, bool replace, Emit emit) {
+    auto current = _items.begin();
+    for (; first != last; ++first) {
+        auto&& item = *first;
+        while (current != _items.end() && _compare(current->first, item.first)) {
+            emit(std::move(*current++));
+        }
+        if (current == _items.end() || _compare(item.first, current->first)) {
+            emit(std::forward<decltype(item)>(item));
+        }
+        else if (replace) {
+            ++current;
+            emit(std::forward<decltype(item)>(item));
+        }
+    }
+    for (; current != _items.end(); ++current) {
+        emit(std::move(*current));
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+void FlatMap<Key, Value, Compare, Layout>::intersect(const FlatMap& other) {
+    auto key = other._items.begin();
+    _eraseIf([this, &key, &other](const _Item& item) {
+        while (key != other._items.end() && _compare(key->first, item.first)) {
+            ++key;
+        }
+        return key == other._items.end() || _compare(item.first, key->first);
+    });
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+void FlatMap<Key, Value, Compare, Layout>::difference(const FlatMap& other) {
+    auto key = other._items.begin();
+    _eraseIf([this, &key, &other](const _Item& item) {
+        while (key != other._items.end() && _compare(key->first, item.first)) {
+            ++key;
+        }
+        return key != other._items.end() && !_compare(item.first, key->first);
+    });
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename Erased>
+void FlatMap<Key, Value, Compare, Layout>::_eraseIf(Erased erased) {
+    if constexpr (_eytzingerLayout) {
+        // сначала индексы оставшихся элементов и копия их ключей, затем сдвиг массива
+        std::vector<size_t> kept;
+        kept.reserve(_items.size());
+        for (size_t i = 0; i < _items.size(); i++) {
+            if (!erased(_items[i])) {
+                kept.push_back(i);
+            }
+        }
+        if (kept.size() == _items.size()) {
+            return;
+        }
+        _Index eytzinger = _makeIndex(kept.size(), [this, &kept](size_t i) -> const Key& {
+            return _items[kept[i]].first;
+        });
+        for (size_t i = 0; i < kept.size(); i++) {
+            if (kept[i] != i) {
+                _items[i] = std::move(_items[kept[i]]);
+            }
+        }
+        _items.erase(_items.begin() + kept.size(), _items.end());
+        _setIndex(eytzinger);
+    }
+    else {
+        // сдвиг оставшихся элементов к началу одним проходом
+        _items.erase(std::remove_if(_items.begin(), _items.end(), erased), _items.end());
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename Function>
+void FlatMap<Key, Value, Compare, Layout>::forEach(Function function) {
+    _forEachIndices(0, _items.size(), function);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename Function>
+void FlatMap<Key, Value, Compare, Layout>::forEach(const Key& low, const Key& high, Function function) {
+    size_t first = _lowerIndex(low);
+    size_t last = _lowerIndex(high);
+    if (first < last) {
+        _forEachIndices(first, last, function);
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename T, typename Reduce, typename Transform>
+T FlatMap<Key, Value, Compare, Layout>::transformReduce(T init, Reduce reduce, Transform transform) const {
+    std::optional<T> result = _reduceIndices<T>(0, _items.size(), reduce, transform);
+    return result ? reduce(std::move(init), std::move(*result)) : init;
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename T, typename Reduce, typename Transform>
+T FlatMap<Key, Value, Compare, Layout>::transformReduce
+(const Key& low, const Key& high, T init, Reduce reduce, Transform transform) const {
+    size_t first = _lowerIndex(low);
+    size_t last = std::max(first, _lowerIndex(high));
+    std::optional<T> result = _reduceIndices<T>(first, last, reduce, transform);
+    return result ? reduce(std::move(init), std::move(*result)) : init;
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename T, typename Reduce>
+T FlatMap<Key, Value, Compare, Layout>::reduce(T init, Reduce reduce) const {
+    return transformReduce(std::move(init), reduce, [](const std::pair<Key, Value>& pair) -> const Value& {
+        return pair.second;
+    });
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename T, typename Reduce>
+T FlatMap<Key, Value, Compare, Layout>::reduce(const Key& low, const Key& high, T init, Reduce reduce) const {
+    return transformReduce(low, high, std::move(init), reduce, [](const std::pair<Key, Value>& pair) -> const Value& {
+        return pair.second;
+    });
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+void FlatMap<Key, Value, Compare, Layout>::assign(ForwardIt first, ForwardIt last) {
+    std::vector<_Item> items(first, last);
+    _Index eytzinger = _makeIndex(items.size(), [&items](size_t i) -> const Key& { return items[i].first; });
+    _items.swap(items);
+    _setIndex(eytzinger);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+typename FlatMap<Key, Value, Compare, Layout>::ConstMapIterator
+FlatMap<Key, Value, Compare, Layout>::find(const Key& key) const {
+    return _items.data() + _findIndex(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+typename FlatMap<Key, Value, Compare, Layout>::MapIterator
+FlatMap<Key, Value, Compare, Layout>::find(const Key& key) {
+    return _items.data() + _findIndex(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatMap<Key, Value, Compare, Layout>::find(const K& key) const -> _IfTransparent<K, ConstMapIterator> {
+    return _items.data() + _findIndex(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatMap<Key, Value, Compare, Layout>::find(const K& key) -> _IfTransparent<K, MapIterator> {
+    return _items.data() + _findIndex(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename ForwardIt, typename OutputIt>
+OutputIt FlatMap<Key, Value, Compare, Layout>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    for (; first != last; ++first) {
+        *out++ = find(*first);
+    }
+    return out;
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename ForwardIt, typename OutputIt>
+OutputIt FlatMap<Key, Value, Compare, Layout>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) {
+    for (; first != last; ++first) {
+        *out++ = find(*first);
+    }
+    return out;
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename ForwardIt, typename OutputIt>
+OutputIt FlatMap<Key, Value, Compare, Layout>::containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    for (; first != last; ++first) {
+        *out++ = _findIndex(*first) != _items.size();
+    }
+    return out;
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+typename FlatMap<Key, Value, Compare, Layout>::ConstMapIterator
+FlatMap<Key, Value, Compare, Layout>::lowerBound(const Key& key) const {
+    return _items.data() + _lowerIndex(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+typename FlatMap<Key, Value, Compare, Layout>::MapIterator
+FlatMap<Key, Value, Compare, Layout>::lowerBound(const Key& key) {
+    return _items.data() + _lowerIndex(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatMap<Key, Value, Compare, Layout>::lowerBound(const K& key) const -> _IfTransparent<K, ConstMapIterator> {
+    return _items.data() + _lowerIndex(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatMap<Key, Value, Compare, Layout>::lowerBound(const K& key) -> _IfTransparent<K, MapIterator> {
+    return _items.data() + _lowerIndex(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+typename FlatMap<Key, Value, Compare, Layout>::ConstMapIterator
+FlatMap<Key, Value, Compare, Layout>::upperBound(const Key& key) const {
+    return _items.data() + _upperIndex(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+typename FlatMap<Key, Value, Compare, Layout>::MapIterator
+FlatMap<Key, Value, Compare, Layout>::upperBound(const Key& key) {
+    return _items.data() + _upperIndex(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatMap<Key, Value, Compare, Layout>::upperBound(const K& key) const -> _IfTransparent<K, ConstMapIterator> {
+    return _items.data() + _upperIndex(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatMap<Key, Value, Compare, Layout>::upperBound(const K& key) -> _IfTransparent<K, MapIterator> {
+    return _items.data() + _upperIndex(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+const Value& FlatMap<Key, Value, Compare, Layout>::operator[](const Key& key) const {
+    return find(key)->second;
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+Value& FlatMap<Key, Value, Compare, Layout>::operator[](const Key& key) {
+    return tryEmplace(key).first->second;
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+Value& FlatMap<Key, Value, Compare, Layout>::operator[](Key&& key) {
+    return tryEmplace(std::move(key)).first->second;
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+typename FlatMap<Key, Value, Compare, Layout>::MapIterator FlatMap<Key, Value, Compare, Layout>::begin() {
+    return _items.data();
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+typename FlatMap<Key, Value, Compare, Layout>::MapIterator FlatMap<Key, Value, Compare, Layout>::end() {
+    return _items.data() + _items.size();
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+typename FlatMap<Key, Value, Compare, Layout>::ConstMapIterator FlatMap<Key, Value, Compare, Layout>::cbegin() const {
+    return _items.data();
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+typename FlatMap<Key, Value, Compare, Layout>::ConstMapIterator FlatMap<Key, Value, Compare, Layout>::cend() const {
+    return _items.data() + _items.size();
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+size_t FlatMap<Key, Value, Compare, Layout>::size() const {
+    return _items.size();
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+Compare FlatMap<Key, Value, Compare, Layout>::keyComp() const {
+    return _compare;
+}
+
+//Search
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename Before>
+size_t FlatMap<Key, Value, Compare, Layout>::_partitionPoint(Before before) const {
+    size_t count = _items.size();
+    if constexpr (_eytzingerLayout) {
+        // спуск по неявному дереву: дети позиции k - позиции 2k и 2k + 1 (с единицы)
+        size_t k = 1;
+        while (k <= count) {
+#if defined(__GNUC__) || defined(__clang__)
+            // адрес за концом массива не читается: промах prefetch не дает ошибки
+            __builtin_prefetch(reinterpret_cast<const void*>(reinterpret_cast<std::uintptr_t>(_eytzinger.data())
+                                                             + (k * _prefetchStride - 1) * sizeof(Key)));
+#endif
+            k = 2 * k + (before(_eytzinger[k - 1]) ? 1 : 0);
+        }
+        // последний поворот налево был в искомой позиции: отбросить повороты направо после него
+        k >>= _trailingOnes(k) + 1;
+        return k == 0 ? count : _ranks[k - 1];
+    }
+    else {
+        // на каждом шаге половина отбрасывается условным присваиванием без ветвления
+        if (count == 0) {
+            return 0;
+        }
+        const _Item* base = _items.data();
+        while (count > 1) {
+            size_t half = count / 2;
+            base = before(base[half - 1].first) ? base + half : base;
+            count -= half;
+        }
+        return size_t(base - _items.data()) + (before(base->first) ? 1 : 0);
+    }
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename K>
+size_t FlatMap<Key, Value, Compare, Layout>::_lowerIndex(const K& key) const {
+    return _partitionPoint([this, &key](const Key& current) { return _compare(current, key); });
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename K>
+size_t FlatMap<Key, Value, Compare, Layout>::_upperIndex(const K& key) const {
+    return _partitionPoint([this, &key](const Key& current) { return !_compare(key, current); });
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename K>
+size_t FlatMap<Key, Value, Compare, Layout>::_findIndex(const K& key) const {
+    size_t index = _lowerIndex(key);
+    return index < _items.size() && !_compare(key, _items[index].first) ? index : _items.size();
+}
+
+//Layout
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename KeyAt>
+typename FlatMap<Key, Value, Compare, Layout>::_Index
+FlatMap<Key, Value, Compare, Layout>::_makeIndex(size_t count, KeyAt keyAt) const {
+    _Index index;
+    if constexpr (_eytzingerLayout) {
+        if (count >= UINT32_MAX) {
+            throw std::length_error("FlatMap with EytzingerLayout is full");
+        }
+        index.ranks.resize(count);
+        std::uint32_t rank = 0;
+        _fillRanks(index.ranks, 1, rank);
+        index.eytzinger.reserve(count);
+        for (std::uint32_t i : index.ranks) {
+            index.eytzinger.push_back(keyAt(i));
+        }
+    }
+    return index;
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+void FlatMap<Key, Value, Compare, Layout>::_setIndex(_Index& index) noexcept {
+    _eytzinger.swap(index.eytzinger);
+    _ranks.swap(index.ranks);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+void FlatMap<Key, Value, Compare, Layout>::_reindex() {
+    _Index index = _makeIndex(_items.size(), [this](size_t i) -> const Key& { return _items[i].first; });
+    _setIndex(index);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+void FlatMap<Key, Value, Compare, Layout>::_fillRanks(std::vector<std::uint32_t>& ranks, size_t k, std::uint32_t& rank) {
+    // глубина рекурсии - высота неявного дерева, log2(n)
+    if (k > ranks.size()) {
+        return;
+    }
+    _fillRanks(ranks, 2 * k, rank);
+    ranks[k - 1] = rank++;
+    _fillRanks(ranks, 2 * k + 1, rank);
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+size_t FlatMap<Key, Value, Compare, Layout>::_trailingOnes(size_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return size_t(__builtin_ctzll(~static_cast<unsigned long long>(value)));
+#else
+    size_t result = 0;
+    while (value & 1) {
+        value >>= 1;
+        result++;
+    }
+    return result;
+#endif
+}
+
+//ParallelReduce
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename Function>
+void FlatMap<Key, Value, Compare, Layout>::_forEachIndices(size_t first, size_t last, Function& function) {
+    ThreadPool& pool = ThreadPool::global();
+    if (last - first <= _parallelGrain || pool.threadCount() == 0) {
+        for (size_t i = first; i < last; i++) {
+            function(_items[i]);
+        }
+        return;
+    }
+    size_t middle = first + (last - first) / 2;
+    pool.invoke([this, first, middle, &function] { _forEachIndices(first, middle, function); },
+                [this, middle, last, &function] { _forEachIndices(middle, last, function); });
+}
+
+template <typename Key, typename Value, typename Compare, typename Layout>
+template <typename T, typename Reduce, typename Transform>
+std::optional<T> FlatMap<Key, Value, Compare, Layout>::_reduceIndices
+(size_t first, size_t last, const Reduce& reduce, const Transform& transform) const {
+    if (first == last) {
+        return std::nullopt;
+    }
+    ThreadPool& pool = ThreadPool::global();
+    if (last - first <= _parallelGrain || pool.threadCount() == 0) {
+        T result = transform(_items[first]);
+        for (size_t i = first + 1; i < last; i++) {
+            result = reduce(std::move(result), transform(_items[i]));
+        }
+        return result;
+    }
+    size_t middle = first + (last - first) / 2;
+    std::optional<T> left;
+    std::optional<T> right;
+    pool.invoke([&] { left = _reduceIndices<T>(first, middle, reduce, transform); },
+                [&] { right = _reduceIndices<T>(middle, last, reduce, transform); });
+    return reduce(std::move(*left), std::move(*right));
+}
+
+//FLATSET
+
+//BigFive
+template <typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+FlatSet<Value, Compare, Layout>::FlatSet(ForwardIt first, ForwardIt last)
+: _map(_PairIterator<ForwardIt>(first), _PairIterator<ForwardIt>(last)) {}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename Engine>
+FlatSet<Value, Compare, Layout>::FlatSet(const Set<Value, Compare, Engine>& set) {
+    std::vector<std::pair<Value, Value>> items;
+    items.reserve(set.size());
+    for (auto it = set.cbegin(); it != set.cend(); ++it) {
+        items.push_back(*it);
+    }
+    _map.assign(std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()));
+}
+
+//Methods
+template <typename Value, typename Compare, typename Layout>
+std::pair<typename FlatSet<Value, Compare, Layout>::SetIterator, bool>
+FlatSet<Value, Compare, Layout>::insert(const Value& value) {
+    return _map.tryEmplace(value, value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+std::pair<typename FlatSet<Value, Compare, Layout>::SetIterator, bool>
+FlatSet<Value, Compare, Layout>::insert(Value&& value) {
+    // ключ копируется раньше, чем значение перемещается в массив
+    return _map.tryEmplace(static_cast<const Value&>(value), std::move(value));
+}
+
+template <typename Value, typename Compare, typename Layout>
+void FlatSet<Value, Compare, Layout>::erase(const Value& value) {
+    _map.erase(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatSet<Value, Compare, Layout>::erase(const K& value) -> _IfTransparent<K, void> {
+    _map.erase(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+void FlatSet<Value, Compare, Layout>::insertBatch(ForwardIt first, ForwardIt last) {
+    Compare compare = _map.keyComp();
+    std::vector<Value> values(first, last);
+    // из равных значений пакета остается первое, существующие значения не заменяются
+    std::stable_sort(values.begin(), values.end(), compare);
+    values.erase(std::unique(values.begin(), values.end(), [&compare](const Value& left, const Value& right) {
+        return !compare(left, right);
+    }), values.end());
+    using It = typename std::vector<Value>::iterator;
+    _map._uniteSorted(_PairIterator<It>(values.begin()), _PairIterator<It>(values.end()), false);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+void FlatSet<Value, Compare, Layout>::eraseBatch(ForwardIt first, ForwardIt last) {
+    _map.eraseBatch(first, last);
+}
+
+template <typename Value, typename Compare, typename Layout>
+void FlatSet<Value, Compare, Layout>::unite(const FlatSet& other) {
+    _map.unite(other._map);
+}
+
+template <typename Value, typename Compare, typename Layout>
+void FlatSet<Value, Compare, Layout>::unite(FlatSet&& other) {
+    _map.unite(std::move(other._map));
+}
+
+template <typename Value, typename Compare, typename Layout>
+void FlatSet<Value, Compare, Layout>::intersect(const FlatSet& other) {
+    _map.intersect(other._map);
+}
+
+template <typename Value, typename Compare, typename Layout>
+void FlatSet<Value, Compare, Layout>::difference(const FlatSet& other) {
+    _map.difference(other._map);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename Function>
+void FlatSet<Value, Compare, Layout>::forEach(Function function) const {
+    _map.transformReduce(true, [](bool, bool) { return true; }, [&function](const std::pair<Value, Value>& pair) {
+        function(pair.first);
+        return true;
+    });
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename Function>
+void FlatSet<Value, Compare, Layout>::forEach(const Value& low, const Value& high, Function function) const {
+    _map.transformReduce(low, high, true, [](bool, bool) { return true; },
+                         [&function](const std::pair<Value, Value>& pair) {
+                             function(pair.first);
+                             return true;
+                         });
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename T, typename Reduce, typename Transform>
+T FlatSet<Value, Compare, Layout>::transformReduce(T init, Reduce reduce, Transform transform) const {
+    return _map.transformReduce(std::move(init), reduce, [&transform](const std::pair<Value, Value>& pair) {
+        return transform(pair.first);
+    });
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename T, typename Reduce, typename Transform>
+T FlatSet<Value, Compare, Layout>::transformReduce
+(const Value& low, const Value& high, T init, Reduce reduce, Transform transform) const {
+    return _map.transformReduce(low, high, std::move(init), reduce, [&transform](const std::pair<Value, Value>& pair) {
+        return transform(pair.first);
+    });
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename T, typename Reduce>
+T FlatSet<Value, Compare, Layout>::reduce(T init, Reduce reduce) const {
+    return _map.reduce(std::move(init), reduce);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename T, typename Reduce>
+T FlatSet<Value, Compare, Layout>::reduce(const Value& low, const Value& high, T init, Reduce reduce) const {
+    return _map.reduce(low, high, std::move(init), reduce);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+void FlatSet<Value, Compare, Layout>::assign(ForwardIt first, ForwardIt last) {
+    _map.assign(_PairIterator<ForwardIt>(first), _PairIterator<ForwardIt>(last));
+}
+
+template <typename Value, typename Compare, typename Layout>
+typename FlatSet<Value, Compare, Layout>::ConstSetIterator FlatSet<Value, Compare, Layout>::find(const Value& value) const {
+    return _map.find(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+typename FlatSet<Value, Compare, Layout>::SetIterator FlatSet<Value, Compare, Layout>::find(const Value& value) {
+    return _map.find(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatSet<Value, Compare, Layout>::find(const K& value) const -> _IfTransparent<K, ConstSetIterator> {
+    return _map.find(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatSet<Value, Compare, Layout>::find(const K& value) -> _IfTransparent<K, SetIterator> {
+    return _map.find(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename ForwardIt, typename OutputIt>
+OutputIt FlatSet<Value, Compare, Layout>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return _map.findBatch(first, last, out);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename ForwardIt, typename OutputIt>
+OutputIt FlatSet<Value, Compare, Layout>::findBatch(ForwardIt first, ForwardIt last, OutputIt out) {
+    return _map.findBatch(first, last, out);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename ForwardIt, typename OutputIt>
+OutputIt FlatSet<Value, Compare, Layout>::containsBatch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return _map.containsBatch(first, last, out);
+}
+
+template <typename Value, typename Compare, typename Layout>
+typename FlatSet<Value, Compare, Layout>::ConstSetIterator FlatSet<Value, Compare, Layout>::lowerBound(const Value& value) const {
+    return _map.lowerBound(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+typename FlatSet<Value, Compare, Layout>::SetIterator FlatSet<Value, Compare, Layout>::lowerBound(const Value& value) {
+    return _map.lowerBound(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatSet<Value, Compare, Layout>::lowerBound(const K& value) const -> _IfTransparent<K, ConstSetIterator> {
+    return _map.lowerBound(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatSet<Value, Compare, Layout>::lowerBound(const K& value) -> _IfTransparent<K, SetIterator> {
+    return _map.lowerBound(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+typename FlatSet<Value, Compare, Layout>::ConstSetIterator FlatSet<Value, Compare, Layout>::upperBound(const Value& value) const {
+    return _map.upperBound(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+typename FlatSet<Value, Compare, Layout>::SetIterator FlatSet<Value, Compare, Layout>::upperBound(const Value& value) {
+    return _map.upperBound(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatSet<Value, Compare, Layout>::upperBound(const K& value) const -> _IfTransparent<K, ConstSetIterator> {
+    return _map.upperBound(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename K>
+auto FlatSet<Value, Compare, Layout>::upperBound(const K& value) -> _IfTransparent<K, SetIterator> {
+    return _map.upperBound(value);
+}
+
+template <typename Value, typename Compare, typename Layout>
+typename FlatSet<Value, Compare, Layout>::SetIterator FlatSet<Value, Compare, Layout>::begin() {
+    return _map.begin();
+}
+
+template <typename Value, typename Compare, typename Layout>
+typename FlatSet<Value, Compare, Layout>::SetIterator FlatSet<Value, Compare, Layout>::end() {
+    return _map.end();
+}
+
+template <typename Value, typename Compare, typename Layout>
+typename FlatSet<Value, Compare, Layout>::ConstSetIterator FlatSet<Value, Compare, Layout>::cbegin() const {
+    return _map.cbegin();
+}
+
+template <typename Value, typename Compare, typename Layout>
+typename FlatSet<Value, Compare, Layout>::ConstSetIterator FlatSet<Value, Compare, Layout>::cend() const {
+    return _map.cend();
+}
+
+template <typename Value, typename Compare, typename Layout>
+size_t FlatSet<Value, Compare, Layout>::size() const {
+    return _map.size();
+}
+
+template <typename Value, typename Compare, typename Layout>
+bool FlatSet<Value, Compare, Layout>::contains(const Value& value) const {
+    return _map.find(value) != _map.cend();
+}
+
+//PairIterator
+template <typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+FlatSet<Value, Compare, Layout>::_PairIterator<ForwardIt>::_PairIterator(ForwardIt it)
+: _it(it) {}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+typename FlatSet<Value, Compare, Layout>::template _PairIterator<ForwardIt>::reference
+FlatSet<Value, Compare, Layout>::_PairIterator<ForwardIt>::operator*() const {
+    return reference(*_it, *_it);
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+typename FlatSet<Value, Compare, Layout>::template _PairIterator<ForwardIt>&
+FlatSet<Value, Compare, Layout>::_PairIterator<ForwardIt>::operator++() {
+    ++_it;
+    return *this;
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+bool FlatSet<Value, Compare, Layout>::_PairIterator<ForwardIt>::operator==(const _PairIterator& other) const {
+    return _it == other._it;
+}
+
+template <typename Value, typename Compare, typename Layout>
+template <typename ForwardIt>
+bool FlatSet<Value, Compare, Layout>::_PairIterator<ForwardIt>::operator!=(const _PairIterator& other) const {
+    return !(*this == other);
+}
@@ -0,0 +1,419 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MappedTree.h"
+
+/*!
+    Файл, отображенный в память только для чтения
+
+    Страницы подгружаются системой при первом обращении,
+    поэтому открытие не зависит от размера файла
+*/
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    ~MappedFile();
+
+    // проверить заголовок и вернуть записи, count - их число
+    // valuesOnly - ожидается файл Set, а не пары
+    template <typename Record>
+    const Record* records(bool valuesOnly, size_t keySize, size_t valueSize, size_t& count) const;
+
+    // флаги заголовка
+    std::uint32_t flags() const;
+
+private:
+    [[noreturn]] void _invalid(const char* reason) const;
+
+    std::string _path;
+    void* _data = nullptr;
+    size_t _size = 0;
+};
+
+/*!
+    Словарь только для чтения поверх файла, записанного save у Map или BinarySearchTree
+
+    Пары читаются прямо из отображения без разбора и копирования, открытие занимает
+    время одного mmap; итераторы - указатели на пары в отображении. Файл
+    BinarySearchTree может содержать повторы ключей, они лежат подряд и
+    находятся equalRange, find возвращает первый из них
+*/
+template <typename Key, typename Value, typename Compare>
+class MappedMap
+{
+    using _Item = std::pair<Key, Value>;
+
+public:
+    using ConstMapIterator = const _Item*;
+
+    explicit MappedMap(const std::string& path, const Compare& compare = Compare());
+
+    MappedMap(const MappedMap& other) = delete;
+    MappedMap& operator=(const MappedMap& other) = delete;
+
+    //! Перемещение, итераторы остаются действительными
+    MappedMap(MappedMap&& other) noexcept = default;
+    MappedMap& operator=(MappedMap&& other) noexcept = default;
+
+    ~MappedMap() = default;
+
+    // первый элемент с ключем key, cend() если его нет
+    ConstMapIterator find(const Key& key) const;
+    bool contains(const Key& key) const;
+
+    // полуинтервал всех элементов с ключем key
+    std::pair<ConstMapIterator, ConstMapIterator> equalRange(const Key& key) const;
+
+    // первый элемент с ключем не меньше key
+    ConstMapIterator lowerBound(const Key& key) const;
+    // первый элемент с ключем больше key
+    ConstMapIterator upperBound(const Key& key) const;
+
+    ConstMapIterator begin() const;
+    ConstMapIterator end() const;
+
+    ConstMapIterator cbegin() const;
+    ConstMapIterator cend() const;
+
+    size_t size() const;
+
+    // нет ли в файле повторов ключей
+    bool uniqueKeys() const;
+
+    Compare keyComp() const;
+
+private:
+    // число первых пар, для которых before(key) истинно, бинарный поиск без ветвлений
+    template <typename Before>
+    size_t _partitionPoint(Before before) const;
+
+    MappedFile _file;
+    const _Item* _items = nullptr;
+    size_t _size = 0;
+    Compare _compare;
+};
+
+/*!
+    Множество только для чтения поверх файла, записанного save у Set
+    Значения хранятся без пар, итераторы - указатели на значения в отображении
+*/
+template <typename Value, typename Compare>
+class MappedSet
+{
+public:
+    using ConstSetIterator = const Value*;
+
+    explicit MappedSet(const std::string& path, const Compare& compare = Compare());
+
+    MappedSet(const MappedSet& other) = delete;
+    MappedSet& operator=(const MappedSet& other) = delete;
+
+    MappedSet(MappedSet&& other) noexcept = default;
+    MappedSet& operator=(MappedSet&& other) noexcept = default;
+
+    ~MappedSet() = default;
+
+    ConstSetIterator find(const Value& value) const;
+    bool contains(const Value& value) const;
+
+    std::pair<ConstSetIterator, ConstSetIterator> equalRange(const Value& value) const;
+
+    // первый элемент не меньше value
+    ConstSetIterator lowerBound(const Value& value) const;
+    // первый элемент больше value
+    ConstSetIterator upperBound(const Value& value) const;
+
+    ConstSetIterator begin() const;
+    ConstSetIterator end() const;
+
+    ConstSetIterator cbegin() const;
+    ConstSetIterator cend() const;
+
+    size_t size() const;
+
+private:
+    template <typename Before>
+    size_t _partitionPoint(Before before) const;
+
+    MappedFile _file;
+    const Value* _values = nullptr;
+    size_t _size = 0;
+    Compare _compare;
+};
+
+//MAPPEDFILE
+
+inline MappedFile::MappedFile(const std::string& path)
+: _path(path) {
+    int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+    }
+    struct stat status;
+    if (::fstat(descriptor, &status) != 0) {
+        int error = errno;
+        ::close(descriptor);
+        throw std::system_error(error, std::generic_category(), "cannot open " + path);
+    }
+    _size = size_t(status.st_size);
+    if (_size < MappedHeader::dataOffset) {
+        ::close(descriptor);
+        _invalid("file is too short");
+    }
+    _data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // отображение держит файл открытым само
+    ::close(descriptor);
+    if (_data == MAP_FAILED) {
+        _data = nullptr;
+        throw std::system_error(errno, std::generic_category(), "cannot map " + path);
+    }
+}
+
+inline MappedFile::MappedFile(MappedFile&& other) noexcept
+: _path(std::move(other._path)), _data(other._data), _size(other._size) {
+    other._data = nullptr;
+    other._size = 0;
+}
+
+inline MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        if (_data) {
+            ::munmap(_data, _size);
+        }
+        _path = std::move(other._path);
+        _data = other._data;
+        _size = other._size;
+        other._data = nullptr;
+        other._size = 0;
+    }
+    return *this;
+}
+
+inline MappedFile::~MappedFile() {
+    if (_data) {
+        ::munmap(_data, _size);
+    }
+}
+
+template <typename Record>
+const Record* MappedFile::records(bool valuesOnly, size_t keySize, size_t valueSize, size_t& count) const {
+    const auto* bytes = static_cast<const unsigned char*>(_data);
+    MappedHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+
+    if (std::memcmp(header.magic, MappedHeader::signature, sizeof(header.magic)) != 0) {
+        _invalid("not a tree file");
+    }
+    if (header.version != MappedHeader::currentVersion) {
+        _invalid("unsupported format version");
+    }
+    if (header.byteOrder != MappedHeader::nativeByteOrder) {
+        _invalid("file was written with a different byte order");
+    }
+    if (((header.flags & MappedHeader::valuesOnly) != 0) != valuesOnly) {
+        _invalid(valuesOnly ? "file holds key-value pairs, not a set" : "file holds a set, not key-value pairs");
+    }
+    if (header.keySize != keySize || header.valueSize != valueSize
+        || header.recordSize != sizeof(Record) || header.recordAlign != alignof(Record)) {
+        _invalid("record layout does not match the requested types");
+    }
+    if (header.count > (_size - MappedHeader::dataOffset) / sizeof(Record)
+        || MappedHeader::dataOffset + header.count * sizeof(Record) != _size) {
+        _invalid("file size does not match the record count");
+    }
+    count = size_t(header.count);
+    return reinterpret_cast<const Record*>(bytes + MappedHeader::dataOffset);
+}
+
+inline std::uint32_t MappedFile::flags() const {
+    std::uint32_t flags;
+    std::memcpy(&flags, static_cast<const unsigned char*>(_data) + offsetof(MappedHeader, flags), sizeof(flags));
+    return flags;
+}
+
+inline void MappedFile::_invalid(const char* reason) const {
+    throw std::runtime_error("cannot open " + _path + ": " + reason);
+}
+
+//MAPPEDMAP
+
+template <typename Key, typename Value, typename Compare>
+MappedMap<Key, Value, Compare>::MappedMap(const std::string& path, const Compare& compare)
+: _file(path), _compare(compare) {
+    _items = _file.records<_Item>(false, sizeof(Key), sizeof(Value), _size);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto MappedMap<Key, Value, Compare>::find(const Key& key) const -> ConstMapIterator {
+    ConstMapIterator it = lowerBound(key);
+    return it != cend() && !_compare(key, it->first) ? it : cend();
+}
+
+template <typename Key, typename Value, typename Compare>
+bool MappedMap<Key, Value, Compare>::contains(const Key& key) const {
+    return find(key) != cend();
+}
+
+template <typename Key, typename Value, typename Compare>
+auto MappedMap<Key, Value, Compare>::equalRange(const Key& key) const
+-> std::pair<ConstMapIterator, ConstMapIterator> {
+    return {lowerBound(key), upperBound(key)};
+}
+
+template <typename Key, typename Value, typename Compare>
+auto MappedMap<Key, Value, Compare>::lowerBound(const Key& key) const -> ConstMapIterator {
+    return _items + _partitionPoint([this, &key](const Key& current) { return _compare(current, key); });
+}
+
+template <typename Key, typename Value, typename Compare>
+auto MappedMap<Key, Value, Compare>::upperBound(const Key& key) const -> ConstMapIterator {
+    return _items + _partitionPoint([this, &key](const Key& current) { return !_compare(key, current); });
+}
+
+template <typename Key, typename Value, typename Compare>
+auto MappedMap<Key, Value, Compare>::begin() const -> ConstMapIterator {
+    return _items;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto MappedMap<Key, Value, Compare>::end() const -> ConstMapIterator {
+    return _items + _size;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto MappedMap<Key, Value, Compare>::cbegin() const -> ConstMapIterator {
+    return _items;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto MappedMap<Key, Value, Compare>::cend() const -> ConstMapIterator {
+    return _items + _size;
+}
+
+template <typename Key, typename Value, typename Compare>
+size_t MappedMap<Key, Value, Compare>::size() const {
+    return _size;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool MappedMap<Key, Value, Compare>::uniqueKeys() const {
+    return (_file.flags() & MappedHeader::uniqueKeys) != 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+Compare MappedMap<Key, Value, Compare>::keyComp() const {
+    return _compare;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Before>
+size_t MappedMap<Key, Value, Compare>::_partitionPoint(Before before) const {
+    size_t count = _size;
+    if (count == 0) {
+        return 0;
+    }
+    const _Item* base = _items;
+    while (count > 1) {
+        size_t half = count / 2;
+        base = before(base[half - 1].first) ? base + half : base;
+        count -= half;
+    }
+    return size_t(base - _items) + (before(base->first) ? 1 : 0);
+}
+
+//MAPPEDSET
+
+template <typename Value, typename Compare>
+MappedSet<Value, Compare>::MappedSet(const std::string& path, const Compare& compare)
+: _file(path), _compare(compare) {
+    _values = _file.records<Value>(true, sizeof(Value), 0, _size);
+}
+
+template <typename Value, typename Compare>
+auto MappedSet<Value, Compare>::find(const Value& value) const -> ConstSetIterator {
+    ConstSetIterator it = lowerBound(value);
+    return it != cend() && !_compare(value, *it) ? it : cend();
+}
+
+template <typename Value, typename Compare>
+bool MappedSet<Value, Compare>::contains(const Value& value) const {
+    return find(value) != cend();
+}
+
+template <typename Value, typename Compare>
+auto MappedSet<Value, Compare>::equalRange(const Value& value) const
+-> std::pair<ConstSetIterator, ConstSetIterator> {
+    return {lowerBound(value), upperBound(value)};
+}
+
+template <typename Value, typename Compare>
+auto MappedSet<Value, Compare>::lowerBound(const Value& value) const -> ConstSetIterator {
+    return _values + _partitionPoint([this, &value](const Value& current) { return _compare(current, value); });
+}
+
+template <typename Value, typename Compare>
+auto MappedSet<Value, Compare>::upperBound(const Value& value) const -> ConstSetIterator {
+    return _values + _partitionPoint([this, &value](const Value& current) { return !_compare(value, current); });
+}
+
+template <typename Value, typename Compare>
+auto MappedSet<Value, Compare>::begin() const -> ConstSetIterator {
+    return _values;
+}
+
+template <typename Value, typename Compare>
+auto MappedSet<Value, Compare>::end() const -> ConstSetIterator {
+    return _values + _size;
+}
+
+template <typename Value, typename Compare>
+auto MappedSet<Value, Compare>::cbegin() const -> ConstSetIterator {
+    return _values;
+}
+
+template <typename Value, typename Compare>
+auto MappedSet<Value, Compare>::cend() const -> ConstSetIterator {
+    return _values + _size;
+}
+
+template <typename Value, typename Compare>
+size_t MappedSet<Value, Compare>::size() const {
+    return _size;
+}
+
+template <typename Value, typename Compare>
+template <typename Before>
+size_t MappedSet<Value, Compare>::_partitionPoint(Before before) const {
+    size_t count = _size;
+    if (count == 0) {
+        return 0;
+    }
+    const Value* base = _values;
+    while (count > 1) {
+        size_t half = count / 2;
+        base = before(base[half - 1]) ? base + half : base;
+        count -= half;
+    }
+    return size_t(base - _values) + (before(*base) ? 1 : 0);
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define BST_POSIX_FSYNC 1
+#endif
+
+/*!
+    Заголовок файла, который пишут save у BinarySearchTree, Map и Set
+
+    За заголовком с отступа dataOffset идут count записей в порядке ключей:
+    std::pair<Key, Value> у BinarySearchTree и Map, Value у Set. Записи - побайтовые
+    образы тривиально копируемых типов без указателей, место записи обнуляется
+    перед копированием, чтобы в файл не попадал мусор из буфера.
+    При открытии проверяются версия, порядок байтов, размеры и выравнивание записей;
+    сами типы и компаратор не записываются - файл открывается с теми же
+    параметрами шаблона, с которыми сохранялся
+*/
+struct MappedHeader
+{
+    static constexpr char signature[8] = {'B', 'S', 'T', 'T', 'R', 'E', 'E', '\0'};
+    static constexpr std::uint32_t currentVersion = 1;
+    static constexpr std::uint32_t nativeByteOrder = 0x01020304;
+    //! Начало записей, выравнивание записей не может быть больше
+    static constexpr size_t dataOffset = 64;
+
+    //! Флаги
+    static constexpr std::uint32_t uniqueKeys = 1;  //!< ключи без повторов
+    static constexpr std::uint32_t valuesOnly = 2;  //!< записи - значения Set, а не пары
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint32_t flags;
+    std::uint32_t keySize;
+    std::uint32_t valueSize;    //!< 0 у Set
+    std::uint32_t recordSize;
+    std::uint32_t recordAlign;
+    std::uint32_t reserved;
+    std::uint64_t count;
+};
+
+static_assert(sizeof(MappedHeader) <= MappedHeader::dataOffset, "MappedHeader must fit before the records");
+
+/*!
+    Запись файла save
+
+    Записи копируются в буфер и сбрасываются на диск блоками, файл пишется
+    под временным именем path.tmp и заменяет path переименованием в commit,
+    поэтому прерванное сохранение не портит прежний файл
+*/
+template <typename Record>
+class MappedWriter
+{
+    //! Ячейка буфера, обнуляется перед созданием записи, чтобы байты выравнивания были нулями
+    struct Slot
+    {
+        alignas(Record) unsigned char storage[sizeof(Record)];
+    };
+
+    static_assert(alignof(Record) <= MappedHeader::dataOffset, "record alignment is too large");
+    static constexpr size_t _bufferSlots = (size_t(1) << 16) / sizeof(Record) + 1;
+
+public:
+    // keySize и valueSize попадают в заголовок для проверки при открытии
+    MappedWriter(const std::string& path, size_t keySize, size_t valueSize);
+
+    MappedWriter(const MappedWriter& other) = delete;
+    MappedWriter& operator=(const MappedWriter& other) = delete;
+
+    // незавершенный файл удаляется
+    ~MappedWriter();
+
+    // дописать запись, созданную из args
+    template <typename... Args>
+    void emplace(Args&&... args);
+
+    // записать заголовок с флагами flags и заменить файл path
+    void commit(std::uint32_t flags);
+
+private:
+    void _flush();
+    [[noreturn]] void _fail(const char* action);
+
+    std::string _path;
+    std::string _temporaryPath;
+    std::FILE* _file = nullptr;
+    std::vector<Slot> _buffer;
+    size_t _used = 0;           //!< занятые ячейки буфера
+    std::uint64_t _count = 0;
+    std::uint32_t _keySize;
+    std::uint32_t _valueSize;
+};
+
+/*!
+    Только для чтения файлы save открывают MappedMap и MappedSet из MappedFile.h:
+    отображение в память требует POSIX, поэтому подключается только там,
+    где вызывается openMapped
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class MappedMap;
+template <typename Value, typename Compare = std::less<Value>>
+class MappedSet;
+
+//MAPPEDWRITER
+
+template <typename Record>
+MappedWriter<Record>::MappedWriter(const std::string& path, size_t keySize, size_t valueSize)
+: _path(path), _temporaryPath(path + ".tmp"), _buffer(_bufferSlots),
+  _keySize(std::uint32_t(keySize)), _valueSize(std::uint32_t(valueSize)) {
+    _file = std::fopen(_temporaryPath.c_str(), "wb");
+    if (!_file) {
+        _fail("create");
+    }
+    // место под заголовок, он пишется в commit, когда известно число записей
+    unsigned char placeholder[MappedHeader::dataOffset] = {};
+    if (std::fwrite(placeholder, sizeof(placeholder), 1, _file) != 1) {
+        int error = errno;
+        std::fclose(_file);
+        std::remove(_temporaryPath.c_str());
+        errno = error;
+        _fail("write");
+    }
+}
+
+template <typename Record>
+MappedWriter<Record>::~MappedWriter() {
+    if (_file) {
+        std::fclose(_file);
+        std::remove(_temporaryPath.c_str());
+    }
+}
+
+template <typename Record>
+template <typename... Args>
+void MappedWriter<Record>::emplace(Args&&... args) {
+    if (_used == _buffer.size()) {
+        _flush();
+    }
+    Slot& slot = _buffer[_used];
+    std::memset(slot.storage, 0, sizeof(Record));
+    new (slot.storage) Record(std::forward<Args>(args)...);
+    _used++;
+    _count++;
+}
+
+template <typename Record>
+void MappedWriter<Record>::commit(std::uint32_t flags) {
+    _flush();
+
+    MappedHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MappedHeader::signature, sizeof(header.magic));
+    header.version = MappedHeader::currentVersion;
+    header.byteOrder = MappedHeader::nativeByteOrder;
+    header.flags = flags;
+    header.keySize = _keySize;
+    header.valueSize = _valueSize;
+    header.recordSize = std::uint32_t(sizeof(Record));
+    header.recordAlign = std::uint32_t(alignof(Record));
+    header.count = _count;
+
+    if (std::fseek(_file, 0, SEEK_SET) != 0 || std::fwrite(&header, sizeof(header), 1, _file) != 1
+        || std::fflush(_file) != 0) {
+        _fail("write");
+    }
+#ifdef BST_POSIX_FSYNC
+    // данные на диске раньше, чем переименование сделает файл видимым
+    if (::fsync(::fileno(_file)) != 0) {
+        _fail("write");
+    }
+#endif
+    std::FILE* file = _file;
+    _file = nullptr;
+    if (std::fclose(file) != 0) {
+        std::remove(_temporaryPath.c_str());
+        _fail("write");
+    }
+#ifndef BST_POSIX_FSYNC
+    // rename вне POSIX не заменяет существующий файл
+    std::remove(_path.c_str());
+#endif
+    if (std::rename(_temporaryPath.c_str(), _path.c_str()) != 0) {
+        int error = errno;
+        std::remove(_temporaryPath.c_str());
+        errno = error;
+        _fail("replace");
+    }
+}
+
+template <typename Record>
+void MappedWriter<Record>::_flush() {
+    if (_used != 0 && std::fwrite(_buffer.data(), sizeof(Slot), _used, _file) != _used) {
+        _fail("write");
+    }
+    _used = 0;
+}
+
+template <typename Record>
+void MappedWriter<Record>::_fail(const char* action) {
+    throw std::system_error(errno, std::generic_category(), std::string("cannot ") + action + " " + _path);
+}
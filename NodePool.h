@@ -0,0 +1,262 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+/*!
+    Пул объектов одного типа
+
+    Память запрашивается у Allocator блоками растущего размера,
+    объекты размещаются в блоках подряд. Освобожденные объекты
+    попадают в список свободных ячеек и переиспользуются следующими
+    вызовами create. Все блоки возвращаются аллокатору за O(число блоков)
+    в release или деструкторе, деструкторы живых объектов при этом
+    не вызываются - это обязанность владельца пула.
+
+    share и adopt передают объекты между пулами без копирования:
+    блоки переходят в совместное владение и возвращаются аллокатору,
+    когда их отпустит последний пул.
+*/
+template <typename T, typename Allocator = std::allocator<T>>
+class NodePool
+{
+    union Slot
+    {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    //! Заголовок блока, хранится в первых ячейках самого блока
+    struct BlockHeader
+    {
+        Slot* nextBlock;
+        size_t capacity;
+    };
+
+    using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+    using SlotTraits = std::allocator_traits<SlotAllocator>;
+
+    //! Список блоков под совместным владением нескольких пулов
+    struct SharedBlocks
+    {
+        SharedBlocks(Slot* blockList, const SlotAllocator& blockAllocator);
+        ~SharedBlocks();
+
+        Slot* blocks;
+        SlotAllocator allocator;
+    };
+
+    static constexpr size_t _headerSlots = (sizeof(BlockHeader) + sizeof(Slot) - 1) / sizeof(Slot);
+    static constexpr size_t _minBlockSlots = 32;
+    static constexpr size_t _maxBlockSlots = 8192;
+
+public:
+    explicit NodePool(const Allocator& allocator = Allocator());
+
+    NodePool(const NodePool& other) = delete;
+    NodePool& operator=(const NodePool& other) = delete;
+
+    NodePool(NodePool&& other) noexcept;
+    NodePool& operator=(NodePool&& other) noexcept;
+
+    ~NodePool();
+
+    // разместить объект, аргументы передаются конструктору T
+    template <typename... Args>
+    T* create(Args&&... args);
+
+    // уничтожить объект и вернуть его ячейку в список свободных
+    void destroy(T* object);
+
+    // вернуть все блоки аллокатору, не вызывая деструкторы объектов
+    void release();
+
+    void swap(NodePool& other) noexcept;
+
+    // разделить все блоки с other: объекты этого пула можно уничтожать
+    // через любой из двух пулов, пока оба не вызовут release
+    // аллокаторы пулов должны быть равны
+    void share(NodePool& other);
+    // забрать все блоки other, other становится пустым
+    // свободные ячейки other не переиспользуются до release
+    void adopt(NodePool& other);
+
+    Allocator allocator() const;
+
+private:
+    Slot* _allocateSlot();
+    void _addBlock();
+    // перевести собственные блоки в совместное владение
+    void _shareOwnBlocks();
+    // убрать повторы после объединения списков совместных блоков
+    void _uniqueShared();
+    static void _deallocateBlocks(SlotAllocator& allocator, Slot* blocks);
+
+    SlotAllocator _allocator;
+    Slot* _blocks = nullptr;    //!< односвязный список блоков
+    Slot* _freeList = nullptr;  //!< освобожденные ячейки
+    Slot* _cursor = nullptr;    //!< первая незанятая ячейка текущего блока
+    Slot* _blockEnd = nullptr;
+    size_t _nextBlockSlots = _minBlockSlots;
+    std::vector<std::shared_ptr<SharedBlocks>> _shared; //!< блоки, разделенные с другими пулами
+};
+
+template <typename T, typename Allocator>
+NodePool<T, Allocator>::SharedBlocks::SharedBlocks(Slot* blockList, const SlotAllocator& blockAllocator)
+: blocks(blockList), allocator(blockAllocator) {}
+
+template <typename T, typename Allocator>
+NodePool<T, Allocator>::SharedBlocks::~SharedBlocks() {
+    _deallocateBlocks(allocator, blocks);
+}
+
+template <typename T, typename Allocator>
+NodePool<T, Allocator>::NodePool(const Allocator& allocator)
+: _allocator(allocator) {}
+
+template <typename T, typename Allocator>
+NodePool<T, Allocator>::NodePool(NodePool&& other) noexcept
+: _allocator(other._allocator),
+  _blocks(std::exchange(other._blocks, nullptr)),
+  _freeList(std::exchange(other._freeList, nullptr)),
+  _cursor(std::exchange(other._cursor, nullptr)),
+  _blockEnd(std::exchange(other._blockEnd, nullptr)),
+  _nextBlockSlots(std::exchange(other._nextBlockSlots, _minBlockSlots)),
+  _shared(std::move(other._shared)) {}
+
+template <typename T, typename Allocator>
+NodePool<T, Allocator>& NodePool<T, Allocator>::operator=(NodePool&& other) noexcept {
+    if (&other != this) {
+        release();
+        swap(other);
+    }
+    return *this;
+}
+
+template <typename T, typename Allocator>
+NodePool<T, Allocator>::~NodePool() {
+    release();
+}
+
+template <typename T, typename Allocator>
+template <typename... Args>
+T* NodePool<T, Allocator>::create(Args&&... args) {
+    Slot* slot = _allocateSlot();
+    try {
+        return ::new (static_cast<void*>(slot->storage)) T(std::forward<Args>(args)...);
+    }
+    catch (...) {
+        slot->next = _freeList;
+        _freeList = slot;
+        throw;
+    }
+}
+
+template <typename T, typename Allocator>
+void NodePool<T, Allocator>::destroy(T* object) {
+    object->~T();
+    Slot* slot = reinterpret_cast<Slot*>(object);
+    slot->next = _freeList;
+    _freeList = slot;
+}
+
+template <typename T, typename Allocator>
+void NodePool<T, Allocator>::release() {
+    _deallocateBlocks(_allocator, _blocks);
+    _blocks = nullptr;
+    _shared.clear();
+    _freeList = nullptr;
+    _cursor = nullptr;
+    _blockEnd = nullptr;
+    _nextBlockSlots = _minBlockSlots;
+}
+
+template <typename T, typename Allocator>
+void NodePool<T, Allocator>::swap(NodePool& other) noexcept {
+    using std::swap;
+    swap(_allocator, other._allocator);
+    swap(_blocks, other._blocks);
+    swap(_freeList, other._freeList);
+    swap(_cursor, other._cursor);
+    swap(_blockEnd, other._blockEnd);
+    swap(_nextBlockSlots, other._nextBlockSlots);
+    swap(_shared, other._shared);
+}
+
+template <typename T, typename Allocator>
+void NodePool<T, Allocator>::share(NodePool& other) {
+    _shareOwnBlocks();
+    other._shared.insert(other._shared.end(), _shared.begin(), _shared.end());
+    other._uniqueShared();
+}
+
+template <typename T, typename Allocator>
+void NodePool<T, Allocator>::adopt(NodePool& other) {
+    if (&other == this) {
+        return;
+    }
+    other._shareOwnBlocks();
+    _shared.insert(_shared.end(), other._shared.begin(), other._shared.end());
+    _uniqueShared();
+    other.release();
+}
+
+template <typename T, typename Allocator>
+Allocator NodePool<T, Allocator>::allocator() const {
+    return Allocator(_allocator);
+}
+
+template <typename T, typename Allocator>
+typename NodePool<T, Allocator>::Slot* NodePool<T, Allocator>::_allocateSlot() {
+    if (_freeList) {
+        Slot* slot = _freeList;
+        _freeList = slot->next;
+        return slot;
+    }
+    if (_cursor == _blockEnd) {
+        _addBlock();
+    }
+    return _cursor++;
+}
+
+template <typename T, typename Allocator>
+void NodePool<T, Allocator>::_addBlock() {
+    size_t capacity = _headerSlots + _nextBlockSlots;
+    Slot* block = SlotTraits::allocate(_allocator, capacity);
+    ::new (static_cast<void*>(block)) BlockHeader{_blocks, capacity};
+    _blocks = block;
+    _cursor = block + _headerSlots;
+    _blockEnd = block + capacity;
+    if (_nextBlockSlots < _maxBlockSlots) {
+        _nextBlockSlots *= 2;
+    }
+}
+
+template <typename T, typename Allocator>
+void NodePool<T, Allocator>::_shareOwnBlocks() {
+    // текущий блок остается под _cursor и продолжает заполняться
+    if (_blocks) {
+        _shared.push_back(std::make_shared<SharedBlocks>(_blocks, _allocator));
+        _blocks = nullptr;
+    }
+}
+
+template <typename T, typename Allocator>
+void NodePool<T, Allocator>::_uniqueShared() {
+    std::sort(_shared.begin(), _shared.end());
+    _shared.erase(std::unique(_shared.begin(), _shared.end()), _shared.end());
+}
+
+template <typename T, typename Allocator>
+void NodePool<T, Allocator>::_deallocateBlocks(SlotAllocator& allocator, Slot* blocks) {
+    while (blocks) {
+        BlockHeader* header = reinterpret_cast<BlockHeader*>(blocks);
+        Slot* next = header->nextBlock;
+        SlotTraits::deallocate(allocator, blocks, header->capacity);
+        blocks = next;
+    }
+}
@@ -0,0 +1,634 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <tuple>
+#include <utility>
+
+#include "EpochReclaimer.h"
+
+/*!
+    Персистентное АВЛ-дерево со снимками
+    Допускается дублирование ключей (аналог multimap)
+
+    Узлы после публикации не меняются. Изменение копирует только узлы
+    на пути от корня к месту изменения, остальные поддеревья разделяются
+    между версиями и освобождаются по счетчику ссылок, когда их не держит
+    ни одна версия. Новая версия публикуется атомарной заменой корня,
+    поэтому читатель видит либо старое, либо новое дерево целиком.
+
+    snapshot() за O(1) возвращает неизменяемую версию, которая остается
+    корректной, пока писатели продолжают работу. Читатели не блокируются,
+    писатели сериализуются внутренним мьютексом.
+    Ключи и значения копируются в узлы пути при каждом изменении.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class PersistentTree
+{
+    using _Item = std::pair<Key, Value>;
+
+    struct Node
+    {
+        template <typename... Args>
+        Node(Node* left, Node* right, Args&&... args);
+
+        const _Item keyValuePair;
+        Node* const left;  //!< ссылки на детей принадлежат узлу
+        Node* const right;
+        const unsigned char height;
+        const size_t size; //!< число узлов поддерева
+        mutable std::atomic<size_t> references{1};
+    };
+
+    //! Высота АВЛ-дерева не больше 1.44 * log2(n + 2), для любого size_t это меньше 96
+    static constexpr size_t _maxHeight = 96;
+
+public:
+    /*!
+        Итератор только для чтения, обходит версию по возрастанию ключей
+        Хранит путь от корня, поэтому узлам не нужны ссылки на родителей
+    */
+    class ConstIterator
+    {
+    public:
+        ConstIterator() = default;
+
+        const std::pair<Key, Value>& operator*() const;
+
+        const std::pair<Key, Value>* operator->() const;
+
+        ConstIterator operator++();
+        ConstIterator operator++(int);
+
+        bool operator==(const ConstIterator& other) const;
+        bool operator!=(const ConstIterator& other) const;
+
+    private:
+        friend class PersistentTree;
+        // добавить node и всю левую ветку под ним
+        void _pushLeftBranch(const Node* node);
+
+        const Node* _path[_maxHeight]; //!< узлы, которые еще предстоит посетить, текущий - последний
+        size_t _depth = 0;
+    };
+
+    /*!
+        Неизменяемая версия дерева
+        Держит ссылку на корень, копирование и присваивание за O(1)
+    */
+    class Snapshot
+    {
+    public:
+        Snapshot() = default;
+
+        Snapshot(const Snapshot& other);
+        Snapshot& operator=(const Snapshot& other);
+
+        Snapshot(Snapshot&& other) noexcept;
+        Snapshot& operator=(Snapshot&& other) noexcept;
+
+        ~Snapshot();
+
+        // первый элемент, равный ключу key
+        ConstIterator find(const Key& key) const;
+        // первый элемент с ключем не меньше key
+        ConstIterator lowerBound(const Key& key) const;
+        // первый элемент с ключем больше key
+        ConstIterator upperBound(const Key& key) const;
+
+        ConstIterator cbegin() const;
+        ConstIterator cend() const;
+
+        size_t size() const;
+
+    private:
+        friend class PersistentTree;
+        Snapshot(const Node* root, const Compare& compare);
+
+        const Node* _root = nullptr;
+        Compare _compare;
+    };
+
+    PersistentTree() = default;
+    explicit PersistentTree(const Compare& compare);
+
+    //! Копия разделяет все узлы с оригиналом, O(1)
+    explicit PersistentTree(const PersistentTree& other);
+    PersistentTree& operator=(const PersistentTree& other);
+
+    ~PersistentTree();
+
+    // вставить элемент после всех элементов с равным ключем
+    void insert(const Key& key, const Value& value);
+
+    // заменить значение первого элемента с ключем key или вставить новый элемент
+    // возвращает, был ли добавлен новый элемент
+    bool insertOrAssign(const Key& key, const Value& value);
+
+    // удалить все элементы с ключем key
+    void erase(const Key& key);
+
+    // заменить содержимое отсортированным по ключу диапазоном пар [first, last) за O(n)
+    // читатели видят старое содержимое до момента публикации нового
+    template <typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+
+    void clear();
+
+    // текущая версия дерева, O(1), можно вызывать из любого потока
+    Snapshot snapshot() const;
+
+    size_t size() const;
+
+private:
+    static Node* _retain(const Node* node);
+    static void _release(const Node* node);
+    static void _releaseDeferred(void* node);
+    static unsigned char _height(const Node* node);
+    static size_t _size(const Node* node);
+
+    //! Ссылка во владении до передачи в _create, при исключении освобождается
+    struct _Reference
+    {
+        Node* node;
+        ~_Reference() { _release(node); }
+        Node* take() { return std::exchange(node, nullptr); }
+    };
+
+    // все функции ниже принимают ссылки на детей во владение
+    // и возвращают новую ссылку на построенное поддерево; при исключении
+    // ссылки освобождаются, поэтому аргументы не должны сами бросать:
+    // поддеревья строятся отдельными операторами до вызова
+    // пара узла создается из source уже под защитой _create
+    template <typename Source>
+    static Node* _create(const Source& source, Node* left, Node* right);
+    static Node* _balance(const _Item& keyValuePair, Node* left, Node* right);
+
+    // входной узел только читается, путь до изменения копируется
+    Node* _insert(const Node* node, const _Item& keyValuePair) const;
+    Node* _assign(const Node* node, const _Item& keyValuePair) const;
+    Node* _erase(const Node* node, const Key& key, bool& erased) const;
+    bool _contains(const Node* node, const Key& key) const;
+    static Node* _eraseMin(const Node* node, const Node*& min);
+    template <typename ForwardIt>
+    static Node* _build(ForwardIt& first, size_t count);
+
+    // заменить корень и отложить освобождение старого до выхода читателей из секций
+    void _publish(Node* root);
+
+    std::atomic<Node*> _root{nullptr};
+    mutable std::mutex _writeMutex;
+    Compare _compare;
+};
+
+//Node
+template <typename Key, typename Value, typename Compare>
+template <typename... Args>
+PersistentTree<Key, Value, Compare>::Node::Node(Node* left, Node* right, Args&&... args)
+: keyValuePair(std::forward<Args>(args)...),
+  left(left),
+  right(right),
+  height(static_cast<unsigned char>(1 + std::max(_height(left), _height(right)))),
+  size(1 + _size(left) + _size(right)) {}
+
+//ConstIterator
+template <typename Key, typename Value, typename Compare>
+const std::pair<Key, Value>& PersistentTree<Key, Value, Compare>::ConstIterator::operator*() const {
+    return _path[_depth - 1]->keyValuePair;
+}
+
+template <typename Key, typename Value, typename Compare>
+const std::pair<Key, Value>* PersistentTree<Key, Value, Compare>::ConstIterator::operator->() const {
+    return &_path[_depth - 1]->keyValuePair;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::ConstIterator
+PersistentTree<Key, Value, Compare>::ConstIterator::operator++() {
+    const Node* node = _path[--_depth];
+    _pushLeftBranch(node->right);
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::ConstIterator
+PersistentTree<Key, Value, Compare>::ConstIterator::operator++(int) {
+    ConstIterator bufIt = *this;
+    ++*this;
+    return bufIt;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool PersistentTree<Key, Value, Compare>::ConstIterator::operator==(const ConstIterator& other) const {
+    if (_depth == 0 || other._depth == 0) {
+        return _depth == other._depth;
+    }
+    return _path[_depth - 1] == other._path[other._depth - 1];
+}
+
+template <typename Key, typename Value, typename Compare>
+bool PersistentTree<Key, Value, Compare>::ConstIterator::operator!=(const ConstIterator& other) const {
+    return !(*this == other);
+}
+
+template <typename Key, typename Value, typename Compare>
+void PersistentTree<Key, Value, Compare>::ConstIterator::_pushLeftBranch(const Node* node) {
+    for (; node; node = node->left) {
+        _path[_depth++] = node;
+    }
+}
+
+//Snapshot
+template <typename Key, typename Value, typename Compare>
+PersistentTree<Key, Value, Compare>::Snapshot::Snapshot(const Node* root, const Compare& compare)
+: _root(root), _compare(compare) {}
+
+template <typename Key, typename Value, typename Compare>
+PersistentTree<Key, Value, Compare>::Snapshot::Snapshot(const Snapshot& other)
+: _root(_retain(other._root)), _compare(other._compare) {}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::Snapshot&
+PersistentTree<Key, Value, Compare>::Snapshot::operator=(const Snapshot& other) {
+    if (&other != this) {
+        const Node* root = _retain(other._root);
+        _release(_root);
+        _root = root;
+        _compare = other._compare;
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentTree<Key, Value, Compare>::Snapshot::Snapshot(Snapshot&& other) noexcept
+: _root(std::exchange(other._root, nullptr)), _compare(other._compare) {}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::Snapshot&
+PersistentTree<Key, Value, Compare>::Snapshot::operator=(Snapshot&& other) noexcept {
+    if (&other != this) {
+        _release(_root);
+        _root = std::exchange(other._root, nullptr);
+        _compare = other._compare;
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentTree<Key, Value, Compare>::Snapshot::~Snapshot() {
+    _release(_root);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::ConstIterator
+PersistentTree<Key, Value, Compare>::Snapshot::find(const Key& key) const {
+    ConstIterator it = lowerBound(key);
+    if (it._depth != 0 && _compare(key, it->first)) {
+        return cend();
+    }
+    return it;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::ConstIterator
+PersistentTree<Key, Value, Compare>::Snapshot::lowerBound(const Key& key) const {
+    // путь хранит только узлы, в которых спуск ушел влево: они идут после текущего
+    ConstIterator it;
+    for (const Node* node = _root; node;) {
+        if (_compare(node->keyValuePair.first, key)) {
+            node = node->right;
+        }
+        else {
+            it._path[it._depth++] = node;
+            node = node->left;
+        }
+    }
+    return it;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::ConstIterator
+PersistentTree<Key, Value, Compare>::Snapshot::upperBound(const Key& key) const {
+    ConstIterator it;
+    for (const Node* node = _root; node;) {
+        if (_compare(key, node->keyValuePair.first)) {
+            it._path[it._depth++] = node;
+            node = node->left;
+        }
+        else {
+            node = node->right;
+        }
+    }
+    return it;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::ConstIterator
+PersistentTree<Key, Value, Compare>::Snapshot::cbegin() const {
+    ConstIterator it;
+    it._pushLeftBranch(_root);
+    return it;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::ConstIterator
+PersistentTree<Key, Value, Compare>::Snapshot::cend() const {
+    return ConstIterator();
+}
+
+template <typename Key, typename Value, typename Compare>
+size_t PersistentTree<Key, Value, Compare>::Snapshot::size() const {
+    return _size(_root);
+}
+
+//BigFive
+template <typename Key, typename Value, typename Compare>
+PersistentTree<Key, Value, Compare>::PersistentTree(const Compare& compare)
+: _compare(compare) {}
+
+template <typename Key, typename Value, typename Compare>
+PersistentTree<Key, Value, Compare>::PersistentTree(const PersistentTree& other)
+: _compare(other._compare) {
+    Snapshot current = other.snapshot();
+    _root.store(_retain(current._root));
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentTree<Key, Value, Compare>& PersistentTree<Key, Value, Compare>::operator=(const PersistentTree& other) {
+    if (&other != this) {
+        Snapshot current = other.snapshot();
+        std::lock_guard<std::mutex> lock(_writeMutex);
+        _compare = other._compare;
+        _publish(_retain(current._root));
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentTree<Key, Value, Compare>::~PersistentTree() {
+    // снимки держат свои ссылки, освобождается только ссылка самого дерева
+    _release(_root.load());
+}
+
+//Methods
+template <typename Key, typename Value, typename Compare>
+void PersistentTree<Key, Value, Compare>::insert(const Key& key, const Value& value) {
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    _publish(_insert(_root.load(), _Item(key, value)));
+}
+
+template <typename Key, typename Value, typename Compare>
+bool PersistentTree<Key, Value, Compare>::insertOrAssign(const Key& key, const Value& value) {
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    _Item keyValuePair(key, value);
+    Node* root = _assign(_root.load(), keyValuePair);
+    bool inserted = !root;
+    if (inserted) {
+        root = _insert(_root.load(), keyValuePair);
+    }
+    _publish(root);
+    return inserted;
+}
+
+template <typename Key, typename Value, typename Compare>
+void PersistentTree<Key, Value, Compare>::erase(const Key& key) {
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    // все равные элементы удаляются из локальной версии, которую читатели не видят,
+    // и публикуются одной заменой корня; промежуточные версии освобождаются сразу
+    _Reference root{_retain(_root.load())};
+    bool erased = false;
+    while (_contains(root.node, key)) {
+        Node* next = _erase(root.node, key, erased);
+        _release(root.node);
+        root.node = next;
+    }
+    if (erased) {
+        _publish(root.take());
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename ForwardIt>
+void PersistentTree<Key, Value, Compare>::assign(ForwardIt first, ForwardIt last) {
+    size_t count = static_cast<size_t>(std::distance(first, last));
+    Node* root = _build(first, count);
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    _publish(root);
+}
+
+template <typename Key, typename Value, typename Compare>
+void PersistentTree<Key, Value, Compare>::clear() {
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    _publish(nullptr);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::Snapshot
+PersistentTree<Key, Value, Compare>::snapshot() const {
+    // старый корень освобождается писателем только после выхода всех из секций,
+    // поэтому между чтением корня и увеличением счетчика он жив
+    EpochReclaimer::Guard guard;
+    return Snapshot(_retain(_root.load(std::memory_order_acquire)), _compare);
+}
+
+template <typename Key, typename Value, typename Compare>
+size_t PersistentTree<Key, Value, Compare>::size() const {
+    return snapshot().size();
+}
+
+//References
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::Node*
+PersistentTree<Key, Value, Compare>::_retain(const Node* node) {
+    if (node) {
+        node->references.fetch_add(1, std::memory_order_relaxed);
+    }
+    return const_cast<Node*>(node);
+}
+
+template <typename Key, typename Value, typename Compare>
+void PersistentTree<Key, Value, Compare>::_release(const Node* node) {
+    // глубина рекурсии ограничена высотой дерева
+    if (node && node->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        _release(node->left);
+        _release(node->right);
+        delete node;
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+void PersistentTree<Key, Value, Compare>::_releaseDeferred(void* node) {
+    _release(static_cast<const Node*>(node));
+}
+
+template <typename Key, typename Value, typename Compare>
+unsigned char PersistentTree<Key, Value, Compare>::_height(const Node* node) {
+    return node ? node->height : 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+size_t PersistentTree<Key, Value, Compare>::_size(const Node* node) {
+    return node ? node->size : 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+void PersistentTree<Key, Value, Compare>::_publish(Node* root) {
+    Node* old = _root.exchange(root, std::memory_order_acq_rel);
+    if (old) {
+        EpochReclaimer::retire(old, &_releaseDeferred);
+    }
+    EpochReclaimer::collect();
+}
+
+//PathCopying
+template <typename Key, typename Value, typename Compare>
+template <typename Source>
+typename PersistentTree<Key, Value, Compare>::Node*
+PersistentTree<Key, Value, Compare>::_create(const Source& source, Node* left, Node* right) {
+    try {
+        return new Node(left, right, source);
+    }
+    catch (...) {
+        _release(left);
+        _release(right);
+        throw;
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::Node*
+PersistentTree<Key, Value, Compare>::_balance(const _Item& keyValuePair, Node* left, Node* right) {
+    // повороты строят новые узлы, старые только читаются
+    // прежний корень поворота отпускается деструктором после построения замены
+    _Reference ownedLeft{left};
+    _Reference ownedRight{right};
+    if (_height(left) > _height(right) + 1) {
+        if (_height(left->left) >= _height(left->right)) {
+            Node* lower = _create(keyValuePair, _retain(left->right), ownedRight.take());
+            return _create(left->keyValuePair, _retain(left->left), lower);
+        }
+        const Node* middle = left->right;
+        _Reference lower{_create(keyValuePair, _retain(middle->right), ownedRight.take())};
+        Node* upper = _create(left->keyValuePair, _retain(left->left), _retain(middle->left));
+        return _create(middle->keyValuePair, upper, lower.take());
+    }
+    if (_height(right) > _height(left) + 1) {
+        if (_height(right->right) >= _height(right->left)) {
+            Node* lower = _create(keyValuePair, ownedLeft.take(), _retain(right->left));
+            return _create(right->keyValuePair, lower, _retain(right->right));
+        }
+        const Node* middle = right->left;
+        _Reference lower{_create(keyValuePair, ownedLeft.take(), _retain(middle->left))};
+        Node* upper = _create(right->keyValuePair, _retain(middle->right), _retain(right->right));
+        return _create(middle->keyValuePair, lower.take(), upper);
+    }
+    return _create(keyValuePair, ownedLeft.take(), ownedRight.take());
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::Node*
+PersistentTree<Key, Value, Compare>::_insert(const Node* node, const _Item& keyValuePair) const {
+    if (!node) {
+        return _create(keyValuePair, nullptr, nullptr);
+    }
+    if (_compare(keyValuePair.first, node->keyValuePair.first)) {
+        Node* left = _insert(node->left, keyValuePair);
+        return _balance(node->keyValuePair, left, _retain(node->right));
+    }
+    Node* right = _insert(node->right, keyValuePair);
+    return _balance(node->keyValuePair, _retain(node->left), right);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::Node*
+PersistentTree<Key, Value, Compare>::_assign(const Node* node, const _Item& keyValuePair) const {
+    // nullptr - ключ не найден, иначе копия пути с новым значением первого равного элемента
+    if (!node) {
+        return nullptr;
+    }
+    if (_compare(node->keyValuePair.first, keyValuePair.first)) {
+        Node* right = _assign(node->right, keyValuePair);
+        return right ? _create(node->keyValuePair, _retain(node->left), right) : nullptr;
+    }
+    Node* left = _assign(node->left, keyValuePair);
+    if (left) {
+        return _create(node->keyValuePair, left, _retain(node->right));
+    }
+    if (_compare(keyValuePair.first, node->keyValuePair.first)) {
+        return nullptr;
+    }
+    return _create(keyValuePair, _retain(node->left), _retain(node->right));
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::Node*
+PersistentTree<Key, Value, Compare>::_erase(const Node* node, const Key& key, bool& erased) const {
+    if (!node) {
+        return nullptr;
+    }
+    if (_compare(key, node->keyValuePair.first)) {
+        Node* left = _erase(node->left, key, erased);
+        return _balance(node->keyValuePair, left, _retain(node->right));
+    }
+    if (_compare(node->keyValuePair.first, key)) {
+        Node* right = _erase(node->right, key, erased);
+        return _balance(node->keyValuePair, _retain(node->left), right);
+    }
+    erased = true;
+    if (!node->left) {
+        return _retain(node->right);
+    }
+    if (!node->right) {
+        return _retain(node->left);
+    }
+    // место узла занимает минимум правого поддерева
+    const Node* min = nullptr;
+    Node* right = _eraseMin(node->right, min);
+    return _balance(min->keyValuePair, _retain(node->left), right);
+}
+
+template <typename Key, typename Value, typename Compare>
+bool PersistentTree<Key, Value, Compare>::_contains(const Node* node, const Key& key) const {
+    while (node) {
+        if (_compare(key, node->keyValuePair.first)) {
+            node = node->left;
+        }
+        else if (_compare(node->keyValuePair.first, key)) {
+            node = node->right;
+        }
+        else {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentTree<Key, Value, Compare>::Node*
+PersistentTree<Key, Value, Compare>::_eraseMin(const Node* node, const Node*& min) {
+    if (!node->left) {
+        min = node;
+        return _retain(node->right);
+    }
+    Node* left = _eraseMin(node->left, min);
+    return _balance(node->keyValuePair, left, _retain(node->right));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename ForwardIt>
+typename PersistentTree<Key, Value, Compare>::Node*
+PersistentTree<Key, Value, Compare>::_build(ForwardIt& first, size_t count) {
+    // середина диапазона становится корнем, высоты поддеревьев отличаются не больше чем на 1
+    if (count == 0) {
+        return nullptr;
+    }
+    _Reference left{_build(first, count / 2)};
+    ForwardIt middle = first;
+    ++first;
+    Node* right = _build(first, count - count / 2 - 1);
+    return _create(*middle, left.take(), right);
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define BST_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+/*!
+    Векторные ядра поиска в отсортированном массиве арифметических ключей
+
+    Ключи размером 4 и 8 байт сравниваются блоками по 128 бит (SSE2)
+    или 256 бит (AVX2), набор инструкций выбирается один раз при первом
+    вызове по возможностям процессора. На других платформах и без
+    поддержки векторных инструкций используется скалярный двоичный поиск.
+*/
+class SimdSearch
+{
+public:
+    enum Level
+    {
+        Scalar,
+        Sse2,
+        Avx2
+    };
+
+    // набор инструкций, выбранный для текущего процессора
+    static Level level();
+
+    //! Поддерживается ли тип ключа векторными ядрами
+    template <typename T>
+    static constexpr bool supports = std::is_arithmetic<T>::value
+                                     && !std::is_same<T, bool>::value
+                                     && !std::is_same<T, long double>::value
+                                     && (sizeof(T) == 4 || sizeof(T) == 8);
+
+    // число элементов отсортированного массива keys[0, count), меньших key
+    template <typename T>
+    static size_t countLess(const T* keys, size_t count, T key);
+    // число элементов отсортированного массива keys[0, count), больших key
+    template <typename T>
+    static size_t countGreater(const T* keys, size_t count, T key);
+
+private:
+    static Level _detect();
+
+    template <bool Less, typename T>
+    static size_t _count(const T* keys, size_t count, T key);
+    template <bool Less, typename T>
+    static size_t _scalar(const T* keys, size_t count, T key);
+#ifdef BST_SIMD_X86
+    template <bool Less, typename T>
+    __attribute__((target("sse2"))) static size_t _sse2(const T* keys, size_t count, T key);
+    template <bool Less, typename T>
+    __attribute__((target("avx2"))) static size_t _avx2(const T* keys, size_t count, T key);
+#endif
+};
+
+/*!
+    Поиск места ключа в массиве ключей узла дерева
+
+    Векторные ядра SimdSearch используются для арифметических ключей
+    с компаратором std::less, для остальных - двоичный поиск с Compare
+*/
+template <typename Key, typename Compare>
+class KeySearch
+{
+public:
+    //! Сравниваются ли ключи блоками
+    static constexpr bool vectorized = SimdSearch::supports<Key>
+                                       && (std::is_same<Compare, std::less<Key>>::value
+                                           || std::is_same<Compare, std::less<>>::value);
+
+    // число ключей массива, меньших key
+    template <typename K>
+    static size_t lowerIndex(const Key* keys, size_t count, const K& key, const Compare& compare);
+    // число ключей массива, не больших key
+    template <typename K>
+    static size_t upperIndex(const Key* keys, size_t count, const K& key, const Compare& compare);
+
+private:
+    //! Длинные массивы сужаются двоичным поиском до блока такой длины
+    static constexpr size_t _linearLimit = 64;
+};
+
+//SimdSearch
+inline SimdSearch::Level SimdSearch::level() {
+    static const Level detected = _detect();
+    return detected;
+}
+
+inline SimdSearch::Level SimdSearch::_detect() {
+#ifdef BST_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return Sse2;
+    }
+#endif
+    return Scalar;
+}
+
+template <typename T>
+size_t SimdSearch::countLess(const T* keys, size_t count, T key) {
+    return _count<true>(keys, count, key);
+}
+
+template <typename T>
+size_t SimdSearch::countGreater(const T* keys, size_t count, T key) {
+    return _count<false>(keys, count, key);
+}
+
+template <bool Less, typename T>
+size_t SimdSearch::_count(const T* keys, size_t count, T key) {
+    static_assert(supports<T>, "SimdSearch: unsupported key type");
+#ifdef BST_SIMD_X86
+    switch (level()) {
+    case Avx2:
+        return _avx2<Less>(keys, count, key);
+    case Sse2:
+        // в SSE2 нет сравнения 64-битных целых
+        if (std::is_floating_point<T>::value || sizeof(T) == 4) {
+            return _sse2<Less>(keys, count, key);
+        }
+        break;
+    case Scalar:
+        break;
+    }
+#endif
+    return _scalar<Less>(keys, count, key);
+}
+
+template <bool Less, typename T>
+size_t SimdSearch::_scalar(const T* keys, size_t count, T key) {
+    // массив отсортирован: ответ - граница между "меньше" и "не меньше" (или "больше")
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (Less ? keys[middle] < key : !(key < keys[middle])) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return Less ? low : count - low;
+}
+
+#ifdef BST_SIMD_X86
+template <bool Less, typename T>
+__attribute__((target("sse2")))
+size_t SimdSearch::_sse2(const T* keys, size_t count, T key) {
+    constexpr size_t width = 16 / sizeof(T);
+    size_t result = 0;
+    size_t i = 0;
+    for (; i + width <= count; i += width) {
+        int mask;
+        if constexpr (std::is_same<T, float>::value) {
+            __m128 block = _mm_loadu_ps(keys + i);
+            __m128 pivot = _mm_set1_ps(key);
+            mask = _mm_movemask_ps(Less ? _mm_cmplt_ps(block, pivot) : _mm_cmpgt_ps(block, pivot));
+        }
+        else if constexpr (std::is_same<T, double>::value) {
+            __m128d block = _mm_loadu_pd(keys + i);
+            __m128d pivot = _mm_set1_pd(key);
+            mask = _mm_movemask_pd(Less ? _mm_cmplt_pd(block, pivot) : _mm_cmpgt_pd(block, pivot));
+        }
+        else if constexpr (sizeof(T) == 4) {
+            // беззнаковые ключи сравниваются знаково после инверсии старшего бита
+            const __m128i flip = _mm_set1_epi32(std::is_signed<T>::value ? 0 : int(0x80000000u));
+            __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), flip);
+            __m128i pivot = _mm_xor_si128(_mm_set1_epi32(int(key)), flip);
+            __m128i compared = Less ? _mm_cmplt_epi32(block, pivot) : _mm_cmpgt_epi32(block, pivot);
+            mask = _mm_movemask_ps(_mm_castsi128_ps(compared));
+        }
+        else {
+            return _scalar<Less>(keys, count, key);
+        }
+        result += size_t(__builtin_popcount(unsigned(mask)));
+    }
+    for (; i < count; i++) {
+        result += Less ? keys[i] < key : key < keys[i];
+    }
+    return result;
+}
+
+template <bool Less, typename T>
+__attribute__((target("avx2")))
+size_t SimdSearch::_avx2(const T* keys, size_t count, T key) {
+    constexpr size_t width = 32 / sizeof(T);
+    size_t result = 0;
+    size_t i = 0;
+    for (; i + width <= count; i += width) {
+        int mask;
+        if constexpr (std::is_same<T, float>::value) {
+            __m256 block = _mm256_loadu_ps(keys + i);
+            __m256 pivot = _mm256_set1_ps(key);
+            mask = _mm256_movemask_ps(_mm256_cmp_ps(block, pivot, Less ? _CMP_LT_OQ : _CMP_GT_OQ));
+        }
+        else if constexpr (std::is_same<T, double>::value) {
+            __m256d block = _mm256_loadu_pd(keys + i);
+            __m256d pivot = _mm256_set1_pd(key);
+            mask = _mm256_movemask_pd(_mm256_cmp_pd(block, pivot, Less ? _CMP_LT_OQ : _CMP_GT_OQ));
+        }
+        else if constexpr (sizeof(T) == 4) {
+            const __m256i flip = _mm256_set1_epi32(std::is_signed<T>::value ? 0 : int(0x80000000u));
+            __m256i block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), flip);
+            __m256i pivot = _mm256_xor_si256(_mm256_set1_epi32(int(key)), flip);
+            __m256i compared = Less ? _mm256_cmpgt_epi32(pivot, block) : _mm256_cmpgt_epi32(block, pivot);
+            mask = _mm256_movemask_ps(_mm256_castsi256_ps(compared));
+        }
+        else {
+            const __m256i flip = _mm256_set1_epi64x(std::is_signed<T>::value ? 0 : (long long)(1ull << 63));
+            __m256i block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), flip);
+            __m256i pivot = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), flip);
+            __m256i compared = Less ? _mm256_cmpgt_epi64(pivot, block) : _mm256_cmpgt_epi64(block, pivot);
+            mask = _mm256_movemask_pd(_mm256_castsi256_pd(compared));
+        }
+        result += size_t(__builtin_popcount(unsigned(mask)));
+    }
+    for (; i < count; i++) {
+        result += Less ? keys[i] < key : key < keys[i];
+    }
+    return result;
+}
+#endif
+
+//KeySearch
+template <typename Key, typename Compare>
+template <typename K>
+size_t KeySearch<Key, Compare>::lowerIndex(const Key* keys, size_t count, const K& key, const Compare& compare) {
+    size_t low = 0;
+    size_t high = count;
+    if constexpr (vectorized && std::is_same<K, Key>::value) {
+        while (high - low > _linearLimit) {
+            size_t middle = (low + high) / 2;
+            if (keys[middle] < key) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+        return low + SimdSearch::countLess(keys + low, high - low, key);
+    }
+    else {
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (compare(keys[middle], key)) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+}
+
+template <typename Key, typename Compare>
+template <typename K>
+size_t KeySearch<Key, Compare>::upperIndex(const Key* keys, size_t count, const K& key, const Compare& compare) {
+    size_t low = 0;
+    size_t high = count;
+    if constexpr (vectorized && std::is_same<K, Key>::value) {
+        while (high - low > _linearLimit) {
+            size_t middle = (low + high) / 2;
+            if (key < keys[middle]) {
+                high = middle;
+            }
+            else {
+                low = middle + 1;
+            }
+        }
+        return high - SimdSearch::countGreater(keys + low, high - low, key);
+    }
+    else {
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (compare(key, keys[middle])) {
+                high = middle;
+            }
+            else {
+                low = middle + 1;
+            }
+        }
+        return low;
+    }
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*!
+    Пул потоков с перехватом работы для рекурсивного параллелизма вида fork-join
+
+    invoke(left, right) ставит right в конец очереди текущего потока, выполняет
+    left и затем забирает right обратно, если его еще не перехватил другой поток.
+    Свободные потоки забирают задачи из начала чужих очередей - это самые
+    ранние и потому самые крупные ветви рекурсии. Пока чужой поток выполняет
+    right, текущий выполняет задачи из своей и чужих очередей, поэтому
+    вложенные invoke не блокируют потоки пула. Потоки вне пула используют
+    одну общую очередь.
+*/
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t threadCount);
+
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+
+    ~ThreadPool();
+
+    // общий пул: число ядер минус один поток, вызывающий поток работает вместе с ним
+    static ThreadPool& global();
+
+    size_t threadCount() const;
+
+    // выполнить left() и right(), возможно параллельно, и дождаться обоих
+    // исключение из left или right передается вызывающему
+    template <typename Left, typename Right>
+    void invoke(Left&& left, Right&& right);
+
+private:
+    //! Отложенная половина invoke, живет на стеке вызывающего потока
+    struct Task
+    {
+        void (*run)(void*);
+        void* context;
+        std::atomic<bool> done{false};
+        std::exception_ptr exception;
+    };
+
+    //! Очередь задач потока: владелец работает с концом, другие потоки забирают из начала
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task*> tasks;
+    };
+
+    // очередь текущего потока: своя у потоков пула, общая у остальных
+    size_t _queueIndex() const;
+    void _push(Task* task);
+    // убрать задачу из очереди, если ее еще никто не начал выполнять
+    bool _take(Task* task);
+    // задача из конца своей очереди или из начала чужой, nullptr если задач нет
+    Task* _pop(size_t index);
+    // выполнять другие задачи, пока task не будет выполнена
+    void _wait(Task* task);
+    static void _execute(Task* task);
+    void _workerLoop(size_t index);
+
+    std::vector<std::unique_ptr<Queue>> _queues; //!< по очереди на поток пула и общая последней
+    std::vector<std::thread> _threads;
+    std::atomic<size_t> _queued{0}; //!< задач во всех очередях
+    std::mutex _sleepMutex;
+    std::condition_variable _wakeUp;
+    bool _stopping = false;
+
+    static inline thread_local const ThreadPool* _currentPool = nullptr;
+    static inline thread_local size_t _currentIndex = 0;
+};
+
+inline ThreadPool::ThreadPool(size_t threadCount) {
+    for (size_t i = 0; i <= threadCount; i++) {
+        _queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < threadCount; i++) {
+        _threads.emplace_back([this, i] { _workerLoop(i); });
+    }
+}
+
+inline ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stopping = true;
+    }
+    _wakeUp.notify_all();
+    for (std::thread& thread : _threads) {
+        thread.join();
+    }
+}
+
+inline ThreadPool& ThreadPool::global() {
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+inline size_t ThreadPool::threadCount() const {
+    return _threads.size();
+}
+
+template <typename Left, typename Right>
+void ThreadPool::invoke(Left&& left, Right&& right) {
+    if (_threads.empty()) {
+        left();
+        right();
+        return;
+    }
+    using RightType = std::remove_reference_t<Right>;
+    Task task;
+    task.run = [](void* context) { (*static_cast<RightType*>(context))(); };
+    task.context = const_cast<void*>(static_cast<const void*>(std::addressof(right)));
+    _push(&task);
+    try {
+        left();
+    }
+    catch (...) {
+        // right ссылается на стек этого вызова, его нужно дождаться и при исключении
+        if (!_take(&task)) {
+            _wait(&task);
+        }
+        throw;
+    }
+    if (_take(&task)) {
+        right();
+        return;
+    }
+    _wait(&task);
+    if (task.exception) {
+        std::rethrow_exception(task.exception);
+    }
+}
+
+inline size_t ThreadPool::_queueIndex() const {
+    return _currentPool == this ? _currentIndex : _threads.size();
+}
+
+inline void ThreadPool::_push(Task* task) {
+    // счетчик растет раньше, чем задача видна другим потокам, и не уходит ниже нуля
+    _queued.fetch_add(1);
+    Queue& queue = *_queues[_queueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+    }
+    {
+        // спящий поток проверяет _queued под этим мьютексом, уведомление не потеряется
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+    }
+    _wakeUp.notify_one();
+}
+
+inline bool ThreadPool::_take(Task* task) {
+    Queue& queue = *_queues[_queueIndex()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    // обычно задача последняя: все задачи, поставленные позже, уже забраны их владельцами
+    auto found = std::find(queue.tasks.rbegin(), queue.tasks.rend(), task);
+    if (found == queue.tasks.rend()) {
+        return false;
+    }
+    queue.tasks.erase(std::next(found).base());
+    _queued.fetch_sub(1);
+    return true;
+}
+
+inline ThreadPool::Task* ThreadPool::_pop(size_t index) {
+    if (_queued.load() == 0) {
+        return nullptr;
+    }
+    {
+        Queue& own = *_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            Task* task = own.tasks.back();
+            own.tasks.pop_back();
+            _queued.fetch_sub(1);
+            return task;
+        }
+    }
+    for (size_t step = 1; step < _queues.size(); step++) {
+        Queue& victim = *_queues[(index + step) % _queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            Task* task = victim.tasks.front();
+            victim.tasks.pop_front();
+            _queued.fetch_sub(1);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+inline void ThreadPool::_wait(Task* task) {
+    size_t index = _queueIndex();
+    while (!task->done.load(std::memory_order_acquire)) {
+        Task* other = _pop(index);
+        if (other) {
+            _execute(other);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+inline void ThreadPool::_execute(Task* task) {
+    try {
+        task->run(task->context);
+    }
+    catch (...) {
+        task->exception = std::current_exception();
+    }
+    task->done.store(true, std::memory_order_release);
+}
+
+inline void ThreadPool::_workerLoop(size_t index) {
+    _currentPool = this;
+    _currentIndex = index;
+    while (true) {
+        Task* task = _pop(index);
+        if (task) {
+            _execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _wakeUp.wait(lock, [this] { return _stopping || _queued.load() > 0; });
+        if (_stopping && _queued.load() == 0) {
+            return;
+        }
+    }
+}
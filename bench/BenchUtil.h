@@ -0,0 +1,14 @@
+#pragma once
+
+#include <chrono>
+
+/*!
+    Общее для замеров в bench/: часы и время, прошедшее с начала замера
+*/
+
+using Clock = std::chrono::steady_clock;
+
+// секунды от start до текущего момента
+inline double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
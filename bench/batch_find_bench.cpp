@@ -0,0 +1,64 @@
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "../BPlusTree.h"
+#include "BenchUtil.h"
+
+/*
+    Пакетный поиск против цикла одиночных find
+    На деревьях, не помещающихся в кэш, каждый одиночный поиск ждет
+    загрузки узлов по очереди, findBatch перекрывает эти ожидания
+
+    Сборка: g++ -std=c++17 -O2 bench/batch_find_bench.cpp -o batch_find_bench
+    Запуск: ./batch_find_bench [число элементов, по умолчанию 4000000]
+*/
+
+template <typename Tree>
+void measure(const char* name, const std::vector<int>& keys, const std::vector<int>& queries) {
+    Tree tree;
+    for (int key : keys) {
+        tree.tryEmplace(key, key);
+    }
+    const Tree& constTree = tree;
+
+    auto start = Clock::now();
+    size_t found = 0;
+    for (int key : queries) {
+        found += constTree.find(key) != constTree.cend();
+    }
+    double singleTime = secondsSince(start);
+
+    std::vector<char> contains(queries.size());
+    start = Clock::now();
+    constTree.containsBatch(queries.begin(), queries.end(), contains.begin());
+    double batchTime = secondsSince(start);
+    size_t batchFound = 0;
+    for (char value : contains) {
+        batchFound += value;
+    }
+
+    std::cout << name << ": find " << singleTime << " s, containsBatch " << batchTime << " s"
+              << (found == batchFound ? "" : " MISMATCH") << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+
+    std::mt19937 random(42);
+    std::vector<int> keys(count);
+    for (int& key : keys) {
+        key = int(random() % (4 * count));
+    }
+    std::vector<int> queries(count);
+    for (int& query : queries) {
+        query = int(random() % (4 * count));
+    }
+
+    measure<BinarySearchTree<int, int>>("BinarySearchTree", keys, queries);
+    measure<BinarySearchTree<int, int, std::less<int>, AvlBalance>>("BinarySearchTree, AVL", keys, queries);
+    measure<BPlusTree<int, int>>("BPlusTree", keys, queries);
+    return 0;
+}
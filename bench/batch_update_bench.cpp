@@ -0,0 +1,74 @@
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "../BPlusTree.h"
+#include "BenchUtil.h"
+
+/*
+    Пакетные insertBatch/eraseBatch против цикла insert/erase
+    В словарь из N элементов применяются пакеты обновлений разного размера:
+    сначала вставка пакета случайных пар, затем удаление тех же ключей
+
+    Сборка: g++ -std=c++17 -O2 bench/batch_update_bench.cpp -o batch_update_bench
+    Запуск: ./batch_update_bench [размер словаря, по умолчанию 1000000]
+*/
+
+template <typename Container>
+void fill(Container& container, size_t count) {
+    std::vector<std::pair<int, int>> items(count);
+    for (size_t i = 0; i < count; i++) {
+        items[i] = std::pair<int, int>(int(2 * i), int(i));
+    }
+    container.assign(items.begin(), items.end());
+}
+
+template <typename Container>
+void measure(const char* name, size_t count, size_t batchSize) {
+    std::mt19937 random(static_cast<unsigned>(batchSize));
+    std::vector<std::pair<int, int>> batch(batchSize);
+    std::vector<int> keys(batchSize);
+    for (size_t i = 0; i < batchSize; i++) {
+        keys[i] = int(random() % (4 * count));
+        batch[i] = std::pair<int, int>(keys[i], int(i));
+    }
+
+    Container looped;
+    fill(looped, count);
+    auto start = Clock::now();
+    for (const std::pair<int, int>& item : batch) {
+        looped.insert(item.first, item.second);
+    }
+    double loopInsert = secondsSince(start);
+    start = Clock::now();
+    for (int key : keys) {
+        looped.erase(key);
+    }
+    double loopErase = secondsSince(start);
+
+    Container batched;
+    fill(batched, count);
+    start = Clock::now();
+    batched.insertBatch(batch.begin(), batch.end());
+    double batchInsert = secondsSince(start);
+    start = Clock::now();
+    batched.eraseBatch(keys.begin(), keys.end());
+    double batchErase = secondsSince(start);
+
+    std::cout << name << ", batch " << batchSize << ": insert loop " << loopInsert << " s, insertBatch " << batchInsert
+              << " s; erase loop " << loopErase << " s, eraseBatch " << batchErase << " s"
+              << (looped.size() == batched.size() ? "" : " MISMATCH") << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    for (size_t batchSize : {1000, 10000, 30000, 60000, 100000, 1000000}) {
+        measure<Map<int, int>>("Map", count, batchSize);
+        measure<Map<int, int, std::less<int>, BPlusTree<int, int>>>("Map on BPlusTree", count, batchSize);
+    }
+    return 0;
+}
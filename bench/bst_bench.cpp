@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "BenchUtil.h"
+
+/*
+    Набор замеров для отслеживания регрессий BinarySearchTree, Map и Set
+    Операции insert, find, erase, equalRange, обход, копирование и удаление дерева
+    на отсортированных, случайных, ципфовских ключах и ключах с частыми повторами
+    сравниваются с std::multimap, std::map и std::set. Каждый замер повторяется,
+    пока суммарное время операции не превысит --min-time; подготовка (построение
+    дерева для erase, удаление после insert) в замер не входит
+
+    Результаты пишутся в JSON в формате Google Benchmark (context и benchmarks),
+    real_time и cpu_time - на одну итерацию из n операций, ns_per_item - на операцию
+
+    Сборка: cmake -S . -B build && cmake --build build --target bst_bench
+    или g++ -std=c++17 -O2 -pthread bench/bst_bench.cpp -o bst_bench
+    Запуск: ./bst_bench [--min-size=1000] [--max-size=1000000] [--min-time=0.2]
+                        [--filter=подстрока имени] [--out=файл.json]
+    Размеры идут степенями десяти от --min-size до --max-size, не больше 100000000
+*/
+
+using Key = std::int64_t;
+//! Результаты операций накапливаются здесь, чтобы компилятор их не выбросил
+static volatile std::uint64_t sink = 0;
+
+// Распределения ключей
+
+//! Генератор Ципфа с параметром theta < 1 за O(1) на ключ (Gray et al., SIGMOD 1994)
+class ZipfGenerator
+{
+public:
+    ZipfGenerator(std::uint64_t count, double theta)
+    : _count(count), _theta(theta) {
+        for (std::uint64_t i = 1; i <= count; i++) {
+            _zetaN += 1.0 / std::pow(double(i), theta);
+        }
+        double zeta2 = 1.0 + std::pow(0.5, theta);
+        _alpha = 1.0 / (1.0 - theta);
+        _eta = (1.0 - std::pow(2.0 / double(count), 1.0 - theta)) / (1.0 - zeta2 / _zetaN);
+    }
+
+    // ранг от 0 (самый частый) до count - 1
+    template <typename Random>
+    std::uint64_t operator()(Random& random) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+        double uz = u * _zetaN;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, _theta)) {
+            return 1;
+        }
+        std::uint64_t rank = std::uint64_t(double(_count) * std::pow(_eta * u - _eta + 1.0, _alpha));
+        return rank < _count ? rank : _count - 1;
+    }
+
+private:
+    std::uint64_t _count;
+    double _theta;
+    double _zetaN = 0.0;
+    double _alpha;
+    double _eta;
+};
+
+//! Ключи для вставки и запросы для поиска
+struct Workload
+{
+    std::vector<Key> keys;
+    std::vector<Key> queries;
+};
+
+static const char* const distributions[] = {"sorted", "random", "zipfian", "duplicates"};
+
+static Workload makeWorkload(const std::string& distribution, size_t count) {
+    Workload workload;
+    workload.keys.resize(count);
+    workload.queries.resize(count);
+    std::mt19937_64 random(42);
+    if (distribution == "sorted") {
+        // вставка и поиск по возрастанию
+        for (size_t i = 0; i < count; i++) {
+            workload.keys[i] = Key(i);
+        }
+        workload.queries = workload.keys;
+    }
+    else if (distribution == "random") {
+        // почти все ключи разные, запросы - те же ключи в другом порядке
+        for (Key& key : workload.keys) {
+            key = Key(random());
+        }
+        workload.queries = workload.keys;
+        std::shuffle(workload.queries.begin(), workload.queries.end(), random);
+    }
+    else if (distribution == "zipfian") {
+        // частые ранги разбрасываются по всему диапазону умножением на нечетную константу
+        ZipfGenerator zipf(count, 0.99);
+        for (Key& key : workload.keys) {
+            key = Key(zipf(random) * 0x9E3779B97F4A7C15ull);
+        }
+        for (Key& key : workload.queries) {
+            key = Key(zipf(random) * 0x9E3779B97F4A7C15ull);
+        }
+    }
+    else {
+        // в среднем 64 повтора каждого ключа
+        std::uniform_int_distribution<Key> uniform(0, Key(count / 64));
+        for (Key& key : workload.keys) {
+            key = uniform(random);
+        }
+        for (Key& key : workload.queries) {
+            key = uniform(random);
+        }
+    }
+    return workload;
+}
+
+// Единый интерфейс контейнеров
+
+using Tree = BinarySearchTree<Key, Key>;
+using TreeMap = Map<Key, Key>;
+using TreeSet = Set<Key>;
+
+static void insertKey(Tree& tree, Key key) { tree.insert(key, key); }
+static void insertKey(TreeMap& map, Key key) { map.insert(key, key); }
+static void insertKey(TreeSet& set, Key key) { set.insert(key); }
+static void insertKey(std::multimap<Key, Key>& map, Key key) { map.emplace(key, key); }
+static void insertKey(std::map<Key, Key>& map, Key key) { map.insert_or_assign(key, key); }
+static void insertKey(std::set<Key>& set, Key key) { set.insert(key); }
+
+template <typename Container>
+bool containsKey(const Container& container, Key key) {
+    return container.find(key) != container.cend();
+}
+
+static size_t countEqual(const Tree& tree, Key key) {
+    auto range = tree.equalRange(key);
+    size_t count = 0;
+    for (; range.first != range.second; ++range.first) {
+        count++;
+    }
+    return count;
+}
+
+template <typename Container>
+size_t countEqual(const Container& container, Key key) {
+    auto first = container.lowerBound(key);
+    auto last = container.upperBound(key);
+    size_t count = 0;
+    for (; first != last; ++first) {
+        count++;
+    }
+    return count;
+}
+
+template <typename Key_, typename Value_>
+size_t countEqual(const std::multimap<Key_, Value_>& map, Key key) {
+    auto range = map.equal_range(key);
+    return size_t(std::distance(range.first, range.second));
+}
+
+template <typename Key_, typename Value_>
+size_t countEqual(const std::map<Key_, Value_>& map, Key key) {
+    return map.count(key);
+}
+
+static size_t countEqual(const std::set<Key>& set, Key key) {
+    return set.count(key);
+}
+
+template <typename Item>
+Key itemKey(const Item& item) {
+    if constexpr (std::is_same_v<Item, Key>) {
+        return item;
+    }
+    else {
+        return item.first;
+    }
+}
+
+template <typename Container>
+std::unique_ptr<Container> build(const std::vector<Key>& keys) {
+    auto container = std::make_unique<Container>();
+    for (Key key : keys) {
+        insertKey(*container, key);
+    }
+    return container;
+}
+
+// Запуск замеров
+
+struct Options
+{
+    size_t minSize = 1000;
+    size_t maxSize = 1000000;
+    double minTime = 0.2;
+    std::string filter;
+    std::string out;
+};
+
+class Runner
+{
+public:
+    explicit Runner(const Options& options)
+    : _options(options) {}
+
+    // повторять body(state) для state = setup() до --min-time суммарного времени body,
+    // state разрушается вне замера; items - число операций в одной итерации
+    template <typename Setup, typename Body>
+    void run(const std::string& name, size_t items, Setup setup, Body body);
+
+    bool matches(const std::string& name) const {
+        return name.find(_options.filter) != std::string::npos;
+    }
+
+    void writeJson(std::ostream& out) const;
+
+private:
+    struct Result
+    {
+        std::string name;
+        size_t iterations;
+        double realTime;  //!< нс на итерацию
+        double cpuTime;
+        size_t items;
+    };
+
+    Options _options;
+    std::vector<Result> _results;
+};
+
+template <typename Setup, typename Body>
+void Runner::run(const std::string& name, size_t items, Setup setup, Body body) {
+    if (!matches(name)) {
+        return;
+    }
+    double real = 0.0;
+    double cpu = 0.0;
+    size_t iterations = 0;
+    do {
+        auto state = setup();
+        auto realStart = Clock::now();
+        std::clock_t cpuStart = std::clock();
+        body(state);
+        cpu += double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        real += secondsSince(realStart);
+        iterations++;
+    } while (real < _options.minTime);
+
+    Result result{name, iterations, real * 1e9 / double(iterations), cpu * 1e9 / double(iterations), items};
+    std::cerr << name << ": " << result.realTime / double(items) << " ns per item, "
+              << iterations << " iterations" << std::endl;
+    _results.push_back(result);
+}
+
+void Runner::writeJson(std::ostream& out) const {
+    char date[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+
+    out << "{\n  \"context\": {\n"
+        << "    \"date\": \"" << date << "\",\n"
+        << "    \"executable\": \"bst_bench\",\n"
+        << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+#ifdef NDEBUG
+        << "    \"library_build_type\": \"release\",\n"
+#else
+        << "    \"library_build_type\": \"debug\",\n"
+#endif
+        << "    \"min_time\": " << _options.minTime << "\n"
+        << "  },\n  \"benchmarks\": [";
+    for (size_t i = 0; i < _results.size(); i++) {
+        const Result& result = _results[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\n"
+            << "      \"name\": \"" << result.name << "\",\n"
+            << "      \"run_name\": \"" << result.name << "\",\n"
+            << "      \"run_type\": \"iteration\",\n"
+            << "      \"iterations\": " << result.iterations << ",\n"
+            << "      \"real_time\": " << result.realTime << ",\n"
+            << "      \"cpu_time\": " << result.cpuTime << ",\n"
+            << "      \"time_unit\": \"ns\",\n"
+            << "      \"items_per_second\": " << double(result.items) * 1e9 / result.realTime << ",\n"
+            << "      \"ns_per_item\": " << result.realTime / double(result.items) << "\n"
+            << "    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+// все операции для одного контейнера и набора ключей
+template <typename Container>
+void runContainer(Runner& runner, const std::string& suffix, const Workload& workload) {
+    const std::vector<Key>& keys = workload.keys;
+    const std::vector<Key>& queries = workload.queries;
+    size_t count = keys.size();
+    // построенный контейнер нужен только для чтения, его строит первая подходящая операция
+    std::unique_ptr<Container> built;
+    auto shared = [&]() {
+        if (!built) {
+            built = build<Container>(keys);
+        }
+        return static_cast<const Container*>(built.get());
+    };
+    auto empty = []() { return std::make_unique<Container>(); };
+
+    runner.run("insert/" + suffix, count, empty, [&](std::unique_ptr<Container>& container) {
+        for (Key key : keys) {
+            insertKey(*container, key);
+        }
+        sink = sink + container->size();
+    });
+    runner.run("find/" + suffix, count, shared, [&](const Container* container) {
+        size_t found = 0;
+        for (Key key : queries) {
+            found += containsKey(*container, key);
+        }
+        sink = sink + found;
+    });
+    runner.run("equalRange/" + suffix, count, shared, [&](const Container* container) {
+        size_t found = 0;
+        for (Key key : queries) {
+            found += countEqual(*container, key);
+        }
+        sink = sink + found;
+    });
+    runner.run("iterate/" + suffix, count, shared, [&](const Container* container) {
+        Key sum = 0;
+        for (auto it = container->cbegin(); it != container->cend(); ++it) {
+            sum += itemKey(*it);
+        }
+        sink = sink + std::uint64_t(sum);
+    });
+    runner.run("copy/" + suffix, count, [&]() { shared(); return std::unique_ptr<Container>(); },
+               [&](std::unique_ptr<Container>& copy) {
+        copy = std::make_unique<Container>(*built);
+        sink = sink + copy->size();
+    });
+    runner.run("erase/" + suffix, count, [&]() { return build<Container>(keys); },
+               [&](std::unique_ptr<Container>& container) {
+        for (Key key : keys) {
+            container->erase(key);
+        }
+        sink = sink + container->size();
+    });
+    runner.run("teardown/" + suffix, count, [&]() { return build<Container>(keys); },
+               [&](std::unique_ptr<Container>& container) {
+        container.reset();
+    });
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        auto value = [&argument](const char* prefix) -> const char* {
+            size_t length = std::strlen(prefix);
+            return argument.compare(0, length, prefix) == 0 ? argument.c_str() + length : nullptr;
+        };
+        if (const char* v = value("--min-size=")) {
+            options.minSize = std::strtoull(v, nullptr, 10);
+        }
+        else if (const char* v = value("--max-size=")) {
+            options.maxSize = std::strtoull(v, nullptr, 10);
+        }
+        else if (const char* v = value("--min-time=")) {
+            options.minTime = std::strtod(v, nullptr);
+        }
+        else if (const char* v = value("--filter=")) {
+            options.filter = v;
+        }
+        else if (const char* v = value("--out=")) {
+            options.out = v;
+        }
+        else {
+            std::cerr << "usage: " << argv[0] << " [--min-size=N] [--max-size=N] [--min-time=seconds]"
+                      << " [--filter=substring] [--out=file.json]" << std::endl;
+            return 1;
+        }
+    }
+
+    Runner runner(options);
+    for (size_t size = 1000; size <= options.maxSize && size <= 100000000; size *= 10) {
+        if (size < options.minSize) {
+            continue;
+        }
+        for (const char* distribution : distributions) {
+            std::string suffix = std::string(distribution) + "/";
+            std::string tail = "/" + std::to_string(size);
+            // ключи генерируются, только если какой-то замер для них выбран
+            bool needed = false;
+            for (const char* container : {"BinarySearchTree", "std::multimap", "Map", "std::map", "Set", "std::set"}) {
+                for (const char* operation : {"insert/", "find/", "equalRange/", "iterate/", "copy/", "erase/", "teardown/"}) {
+                    needed = needed || runner.matches(operation + suffix + container + tail);
+                }
+            }
+            if (!needed) {
+                continue;
+            }
+            Workload workload = makeWorkload(distribution, size);
+            runContainer<Tree>(runner, suffix + "BinarySearchTree" + tail, workload);
+            runContainer<std::multimap<Key, Key>>(runner, suffix + "std::multimap" + tail, workload);
+            runContainer<TreeMap>(runner, suffix + "Map" + tail, workload);
+            runContainer<std::map<Key, Key>>(runner, suffix + "std::map" + tail, workload);
+            runContainer<TreeSet>(runner, suffix + "Set" + tail, workload);
+            runContainer<std::set<Key>>(runner, suffix + "std::set" + tail, workload);
+        }
+    }
+
+    if (options.out.empty()) {
+        runner.writeJson(std::cout);
+    }
+    else {
+        std::ofstream file(options.out);
+        runner.writeJson(file);
+        if (!file) {
+            std::cerr << "cannot write " << options.out << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "../ConcurrentMap.h"
+#include "BenchUtil.h"
+
+/*
+    Пропускная способность словаря при одновременной работе потоков
+    ConcurrentMap сравнивается с Map под одним общим мьютексом
+    при разном числе потоков и разной доле чтений
+
+    Сборка: g++ -std=c++17 -O2 -pthread bench/concurrent_bench.cpp -o concurrent_bench
+    Запуск: ./concurrent_bench [число ключей, по умолчанию 1000000] [операций на поток, по умолчанию 500000]
+*/
+
+//! Map под глобальным мьютексом - текущий способ разделять словарь между потоками
+class LockedMap
+{
+public:
+    bool find(int key, int& value) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _map.find(key);
+        if (it == _map.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    bool insert(int key, int value) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _map.insert(key, value).second;
+    }
+
+    bool erase(int key) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _map.erase(key);
+        return true;
+    }
+
+private:
+    std::mutex _mutex;
+    Map<int, int> _map;
+};
+
+template <typename Container>
+double measure(Container& container, size_t keyCount, size_t threadCount, size_t operations, unsigned readPercent) {
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (size_t t = 0; t < threadCount; t++) {
+        threads.emplace_back([&container, keyCount, operations, readPercent, t] {
+            std::mt19937 random(unsigned(t + 1));
+            int value = 0;
+            for (size_t i = 0; i < operations; i++) {
+                int key = int(random() % (2 * keyCount));
+                unsigned operation = random() % 100;
+                if (operation < readPercent) {
+                    container.find(key, value);
+                }
+                else if (operation % 2 == 0) {
+                    container.insert(key, key);
+                }
+                else {
+                    container.erase(key);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return double(threadCount * operations) / secondsSince(start) / 1e6;
+}
+
+template <typename Container>
+void fill(Container& container, size_t keyCount) {
+    for (size_t i = 0; i < keyCount; i++) {
+        container.insert(int(2 * i), int(i));
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t keyCount = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t operations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 500000;
+
+    std::cout << "threads, reads %, ConcurrentMap Mops/s, Map + mutex Mops/s" << std::endl;
+    for (unsigned readPercent : {100u, 90u, 50u}) {
+        for (size_t threadCount : {1, 2, 4, 8, 16, 32}) {
+            ConcurrentMap<int, int> concurrent;
+            fill(concurrent, keyCount);
+            LockedMap locked;
+            fill(locked, keyCount);
+            double concurrentRate = measure(concurrent, keyCount, threadCount, operations, readPercent);
+            double lockedRate = measure(locked, keyCount, threadCount, operations, readPercent);
+            std::cout << threadCount << ", " << readPercent << ", "
+                      << concurrentRate << ", " << lockedRate << std::endl;
+        }
+    }
+    return 0;
+}
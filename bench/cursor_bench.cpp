@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "BenchUtil.h"
+
+/*
+    Последовательный доступ к BinarySearchTree: добавление по возрастанию ключей
+    обычной вставкой и вставкой с подсказкой end(), постраничный обход
+    (lowerBound от последнего ключа страницы против Cursor::nextBatch)
+    и удаление каждого второго элемента по ключу и по итератору
+    В конце добавление с подсказкой end() повторяется для размеров от count / 64
+    до count: без спуска от корня цена элемента не должна расти вместе с n
+
+    Сборка: g++ -std=c++17 -O2 -pthread bench/cursor_bench.cpp -o cursor_bench
+    Запуск: ./cursor_bench [число элементов, по умолчанию 4000000] [размер страницы, по умолчанию 64]
+*/
+
+using Tree = BinarySearchTree<int, int>;
+
+static void report(const char* name, double seconds, size_t operations, std::int64_t check) {
+    std::cout << name << ": " << seconds * 1e9 / double(operations ? operations : 1)
+              << " ns per element (check " << check << ")" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+    size_t page = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 64;
+    if (page == 0) {
+        page = 1;
+    }
+
+    auto start = Clock::now();
+    Tree plain;
+    for (size_t i = 0; i < count; i++) {
+        plain.insert(int(i), int(i));
+    }
+    report("append, insert(key, value)", secondsSince(start), count, std::int64_t(plain.size()));
+
+    start = Clock::now();
+    Tree hinted;
+    for (size_t i = 0; i < count; i++) {
+        hinted.insert(hinted.end(), int(i), int(i));
+    }
+    report("append, insert(end(), key, value)", secondsSince(start), count, std::int64_t(hinted.size()));
+
+    // страница начинается с первого ключа больше последнего ключа прошлой страницы
+    std::vector<std::pair<int, int>> buffer(page);
+    const Tree& constTree = hinted;
+    start = Clock::now();
+    std::int64_t sum = 0;
+    size_t pages = 0;
+    auto it = constTree.cbegin();
+    while (it != constTree.cend()) {
+        int last = 0;
+        for (size_t i = 0; i < page && it != constTree.cend(); i++, ++it) {
+            buffer[i] = *it;
+            sum += buffer[i].second;
+            last = buffer[i].first;
+        }
+        pages++;
+        it = constTree.upperBound(last);
+    }
+    report("pages, upperBound per page", secondsSince(start), count, sum);
+
+    start = Clock::now();
+    sum = 0;
+    Tree::Cursor cursor(hinted);
+    while (size_t taken = cursor.nextBatch(buffer.data(), page)) {
+        for (size_t i = 0; i < taken; i++) {
+            sum += buffer[i].second;
+        }
+    }
+    report("pages, Cursor::nextBatch", secondsSince(start), count, sum);
+
+    start = Clock::now();
+    for (size_t i = 0; i < count; i += 2) {
+        plain.erase(int(i));
+    }
+    report("erase every second, erase(key)", secondsSince(start), count / 2, std::int64_t(plain.size()));
+
+    start = Clock::now();
+    for (auto position = hinted.begin(); position != hinted.end();) {
+        position = hinted.erase(position);
+        if (position != hinted.end()) {
+            ++position;
+        }
+    }
+    report("erase every second, erase(iterator)", secondsSince(start), count / 2, std::int64_t(hinted.size()));
+    std::cout << pages << " pages of " << page << std::endl;
+
+    for (size_t n = std::max<size_t>(count / 64, 1); n <= count; n *= 4) {
+        start = Clock::now();
+        Tree appended;
+        for (size_t i = 0; i < n; i++) {
+            appended.insert(appended.end(), int(i), int(i));
+        }
+        double hintedTime = secondsSince(start);
+        start = Clock::now();
+        Tree descended;
+        for (size_t i = 0; i < n; i++) {
+            descended.insert(int(i), int(i));
+        }
+        double plainTime = secondsSince(start);
+        std::cout << "append " << n << ": insert(end(), ...) " << hintedTime * 1e9 / double(n)
+                  << " ns, insert(key, value) " << plainTime * 1e9 / double(n) << " ns per element" << std::endl;
+    }
+    return 0;
+}
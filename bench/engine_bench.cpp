@@ -0,0 +1,62 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "../BPlusTree.h"
+#include "BenchUtil.h"
+
+/*
+    Сравнение движков Map: красно-черное дерево и B+-дерево
+    Замеряются случайные вставки, случайный поиск и полный обход
+
+    Сборка: g++ -std=c++17 -O2 bench/engine_bench.cpp -o engine_bench
+    Запуск: ./engine_bench [число элементов, по умолчанию 4000000]
+*/
+
+template <typename Tree>
+void measure(const char* name, const std::vector<int>& keys, const std::vector<int>& queries) {
+    auto start = Clock::now();
+    Tree tree;
+    const Tree& constTree = tree;
+    for (int key : keys) {
+        tree.tryEmplace(key, key);
+    }
+    double insertTime = secondsSince(start);
+
+    start = Clock::now();
+    size_t found = 0;
+    for (int key : queries) {
+        found += constTree.find(key) != constTree.cend();
+    }
+    double findTime = secondsSince(start);
+
+    start = Clock::now();
+    std::int64_t sum = 0;
+    for (auto it = tree.cbegin(); it != tree.cend(); ++it) {
+        sum += it->second;
+    }
+    double scanTime = secondsSince(start);
+
+    std::cout << name << ": insert " << insertTime
+              << " s, find " << findTime << " s (" << found << " found)"
+              << ", scan " << scanTime << " s (sum " << sum << ")" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+
+    std::mt19937 random(42);
+    std::vector<int> keys(count);
+    std::vector<int> queries(count);
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = int(random() % (4 * count));
+        queries[i] = int(random() % (4 * count));
+    }
+
+    measure<BinarySearchTree<int, int>>("BinarySearchTree", keys, queries);
+    measure<BPlusTree<int, int>>("BPlusTree", keys, queries);
+    return 0;
+}
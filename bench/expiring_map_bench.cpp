@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "../ExpiringMap.h"
+#include "BenchUtil.h"
+
+/*
+    Задержки операций кэша со сроком жизни элементов: Map, из которого
+    просроченные элементы удаляются полным обходом раз в scanPeriod операций,
+    против ExpiringMap с постепенным вытеснением
+    Время кэша идет по модельным часам (1 мс на 100 операций), каждая операция
+    замеряется отдельно, печатаются перцентили и максимум
+
+    Сборка: g++ -std=c++17 -O2 -pthread bench/expiring_map_bench.cpp -o expiring_map_bench
+    Запуск: ./expiring_map_bench [число ключей, по умолчанию 1000000] [операций, по умолчанию 4000000]
+*/
+
+//! Модельные часы кэша
+struct SimulatedClock
+{
+    using duration = std::chrono::milliseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<SimulatedClock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now() { return current; }
+    static time_point current;
+};
+
+SimulatedClock::time_point SimulatedClock::current{};
+
+static const SimulatedClock::duration ttl(5000);
+static const size_t scanPeriod = 100000;
+
+static void report(const char* name, std::vector<double>& latencies, double total) {
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[std::min(latencies.size() - 1, size_t(p * double(latencies.size())))];
+    };
+    std::cout << name << ": total " << total << " s, p50 " << percentile(0.5) * 1e9 << " ns, p99 "
+              << percentile(0.99) * 1e9 << " ns, p99.9 " << percentile(0.999) * 1e9 << " ns, max "
+              << latencies.back() * 1e3 << " ms" << std::endl;
+}
+
+template <typename Operation>
+void run(const char* name, const std::vector<std::pair<int, bool>>& operations, Operation operation) {
+    SimulatedClock::current = SimulatedClock::time_point();
+    std::vector<double> latencies;
+    latencies.reserve(operations.size());
+    auto start = Clock::now();
+    for (size_t i = 0; i < operations.size(); i++) {
+        if (i % 100 == 0) {
+            SimulatedClock::current += std::chrono::milliseconds(1);
+        }
+        auto operationStart = Clock::now();
+        operation(i, operations[i].first, operations[i].second);
+        latencies.push_back(secondsSince(operationStart));
+    }
+    report(name, latencies, secondsSince(start));
+}
+
+int main(int argc, char** argv) {
+    size_t keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t count = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4000000;
+
+    // половина операций - вставки, половина - поиски
+    std::mt19937 random(42);
+    std::vector<std::pair<int, bool>> operations(count);
+    for (auto& operation : operations) {
+        operation = {int(random() % keys), random() % 2 == 0};
+    }
+
+    size_t hits = 0;
+    Map<int, std::pair<int, SimulatedClock::time_point>> scanned;
+    run("Map + full scan", operations, [&](size_t i, int key, bool isInsert) {
+        auto now = SimulatedClock::now();
+        if (isInsert) {
+            scanned.insert(key, {key, now + ttl});
+        }
+        else {
+            auto found = scanned.find(key);
+            hits += found != scanned.end() && found->second.second > now;
+        }
+        if (i % scanPeriod == scanPeriod - 1) {
+            std::vector<int> expired;
+            for (auto it = scanned.begin(); it != scanned.end(); ++it) {
+                if (it->second.second <= now) {
+                    expired.push_back(it->first);
+                }
+            }
+            scanned.eraseBatch(expired.begin(), expired.end());
+        }
+    });
+
+    ExpiringMap<int, int, std::less<int>, SimulatedClock> expiring(ttl);
+    run("ExpiringMap", operations, [&](size_t, int key, bool isInsert) {
+        if (isInsert) {
+            expiring.insert(key, key);
+        }
+        else {
+            hits += expiring.find(key) != nullptr;
+        }
+    });
+
+    ExpiringMap<int, int, std::less<int>, SimulatedClock> capped(ttl, keys / 4);
+    run("ExpiringMap, LRU cap n / 4", operations, [&](size_t, int key, bool isInsert) {
+        if (isInsert) {
+            capped.insert(key, key);
+        }
+        else {
+            hits += capped.find(key) != nullptr;
+        }
+    });
+    std::cout << "hits " << hits << std::endl;
+    return 0;
+}
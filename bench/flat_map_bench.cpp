@@ -0,0 +1,75 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "../BPlusTree.h"
+#include "../FlatMap.h"
+#include "BenchUtil.h"
+
+/*
+    Задержка поиска в словарях только для чтения: Map на узлах дерева
+    против FlatMap на отсортированном массиве и в порядке Эйтцингера
+    FlatMap строится из готового Map, замеряются построение, случайный
+    поиск (нс на запрос) и полный обход
+
+    Сборка: g++ -std=c++17 -O2 -pthread bench/flat_map_bench.cpp -o flat_map_bench
+    Запуск: ./flat_map_bench [число элементов, по умолчанию 4000000]
+*/
+
+template <typename Container>
+void measure(const char* name, const Container& container, double buildTime, const std::vector<int>& queries) {
+    auto start = Clock::now();
+    size_t found = 0;
+    for (int key : queries) {
+        found += container.find(key) != container.cend();
+    }
+    double findTime = secondsSince(start);
+
+    start = Clock::now();
+    std::int64_t sum = 0;
+    for (auto it = container.cbegin(); it != container.cend(); ++it) {
+        sum += it->second;
+    }
+    double scanTime = secondsSince(start);
+
+    std::cout << name << ": build " << buildTime << " s, find " << findTime * 1e9 / double(queries.size())
+              << " ns per key (" << found << " found), scan " << scanTime << " s (sum " << sum << ")" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+
+    std::mt19937 random(42);
+    std::vector<int> queries(count);
+    for (int& key : queries) {
+        key = int(random() % (4 * count));
+    }
+
+    auto start = Clock::now();
+    Map<int, int> tree;
+    for (size_t i = 0; i < count; i++) {
+        int key = int(random() % (4 * count));
+        tree.insert(key, key);
+    }
+    double treeTime = secondsSince(start);
+    measure("Map", tree, treeTime, queries);
+
+    start = Clock::now();
+    Map<int, int, std::less<int>, BPlusTree<int, int>> bplus;
+    for (auto it = tree.cbegin(); it != tree.cend(); ++it) {
+        bplus.insert(it->first, it->second);
+    }
+    measure("Map on BPlusTree", bplus, secondsSince(start), queries);
+
+    start = Clock::now();
+    FlatMap<int, int> sorted(tree);
+    measure("FlatMap, SortedLayout", sorted, secondsSince(start), queries);
+
+    start = Clock::now();
+    FlatMap<int, int, std::less<int>, EytzingerLayout> eytzinger(tree);
+    measure("FlatMap, EytzingerLayout", eytzinger, secondsSince(start), queries);
+    return 0;
+}
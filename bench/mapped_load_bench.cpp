@@ -0,0 +1,80 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "../MappedFile.h"
+#include "BenchUtil.h"
+
+/*
+    Перезапуск с готовым словарем: повторная вставка всех пар из файла
+    против openMapped, который отображает файл save в память
+    Замеряются сохранение, загрузка, первые случайные поиски и полный обход
+    Страницы файла после save обычно остаются в кэше ОС; для холодного старта
+    сбросьте кэш между запусками (echo 3 > /proc/sys/vm/drop_caches)
+
+    Сборка: g++ -std=c++17 -O2 -pthread bench/mapped_load_bench.cpp -o mapped_load_bench
+    Запуск: ./mapped_load_bench [число элементов, по умолчанию 10000000] [файл, по умолчанию map.bin]
+*/
+
+template <typename Container>
+void measure(const char* name, const Container& container, double loadTime, const std::vector<std::int64_t>& queries) {
+    auto start = Clock::now();
+    size_t found = 0;
+    for (std::int64_t key : queries) {
+        found += container.find(key) != container.cend();
+    }
+    double findTime = secondsSince(start);
+
+    start = Clock::now();
+    std::int64_t sum = 0;
+    for (auto it = container.cbegin(); it != container.cend(); ++it) {
+        sum += it->second;
+    }
+    double scanTime = secondsSince(start);
+
+    std::cout << name << ": load " << loadTime * 1e3 << " ms, " << queries.size() << " finds " << findTime * 1e3
+              << " ms (" << found << " found), scan " << scanTime * 1e3 << " ms (sum " << sum << ")" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+    std::string path = argc > 2 ? argv[2] : "map.bin";
+
+    std::mt19937_64 random(42);
+    std::vector<std::pair<std::int64_t, std::int64_t>> pairs(count);
+    for (size_t i = 0; i < count; i++) {
+        pairs[i] = {std::int64_t(2 * i), std::int64_t(random() % 1000)};
+    }
+    std::vector<std::int64_t> queries(1000000);
+    for (std::int64_t& key : queries) {
+        key = std::int64_t(random() % (2 * count));
+    }
+
+    Map<std::int64_t, std::int64_t> source(pairs.begin(), pairs.end());
+    auto start = Clock::now();
+    source.save(path);
+    std::cout << "save: " << secondsSince(start) * 1e3 << " ms" << std::endl;
+
+    // прежний путь: прочитать пары и вставить их по одной
+    start = Clock::now();
+    Map<std::int64_t, std::int64_t> reloaded;
+    {
+        auto file = Map<std::int64_t, std::int64_t>::openMapped(path);
+        for (auto it = file.cbegin(); it != file.cend(); ++it) {
+            reloaded.insert(it->first, it->second);
+        }
+    }
+    measure("Map, insert every pair", reloaded, secondsSince(start), queries);
+
+    start = Clock::now();
+    auto mapped = Map<std::int64_t, std::int64_t>::openMapped(path);
+    measure("openMapped", mapped, secondsSince(start), queries);
+
+    std::remove(path.c_str());
+    return 0;
+}
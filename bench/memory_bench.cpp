@@ -0,0 +1,113 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "../BPlusTree.h"
+#include "../CompactTree.h"
+#include "BenchUtil.h"
+
+/*
+    Память на элемент у движков Map: красно-черное дерево на указателях,
+    компактное дерево на 32-битных индексах, B+-дерево и std::map
+    Байты считаются по запросам к operator new без служебных данных malloc,
+    заодно замеряются случайные вставки, поиск и полный обход
+
+    Сборка: g++ -std=c++17 -O2 -pthread bench/memory_bench.cpp -o memory_bench
+    Запуск: ./memory_bench [число элементов, по умолчанию 4000000]
+*/
+
+static size_t liveBytes = 0;
+
+void* operator new(size_t size) {
+    void* pointer = std::malloc(size + sizeof(std::max_align_t));
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    *static_cast<size_t*>(pointer) = size;
+    liveBytes += size;
+    return static_cast<char*>(pointer) + sizeof(std::max_align_t);
+}
+
+void operator delete(void* pointer) noexcept {
+    if (!pointer) {
+        return;
+    }
+    void* block = static_cast<char*>(pointer) - sizeof(std::max_align_t);
+    liveBytes -= *static_cast<size_t*>(block);
+    std::free(block);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+template <typename Tree, typename T>
+void measure(const char* name, const std::vector<T>& keys, const std::vector<T>& queries) {
+    size_t before = liveBytes;
+    auto start = Clock::now();
+    Tree tree;
+    const Tree& constTree = tree;
+    for (T key : keys) {
+        tree.tryEmplace(key, key);
+    }
+    double insertTime = secondsSince(start);
+    double bytesPerEntry = double(liveBytes - before) / double(tree.size());
+
+    start = Clock::now();
+    size_t found = 0;
+    for (T key : queries) {
+        found += constTree.find(key) != constTree.cend();
+    }
+    double findTime = secondsSince(start);
+
+    start = Clock::now();
+    T sum = 0;
+    for (auto it = tree.cbegin(); it != tree.cend(); ++it) {
+        sum += it->second;
+    }
+    double scanTime = secondsSince(start);
+
+    std::cout << name << ": " << bytesPerEntry << " bytes per entry; insert " << insertTime
+              << " s, find " << findTime << " s (" << found << " found)"
+              << ", scan " << scanTime << " s (sum " << sum << ")" << std::endl;
+}
+
+//! std::map с интерфейсом движка
+template <typename Key, typename Value>
+struct StdMap : std::map<Key, Value>
+{
+    template <typename... Args>
+    auto tryEmplace(const Key& key, Args&&... args) {
+        return this->try_emplace(key, std::forward<Args>(args)...);
+    }
+};
+
+template <typename T>
+void measureAll(const char* type, size_t count) {
+    std::mt19937_64 random(42);
+    std::vector<T> keys(count);
+    std::vector<T> queries(count);
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = T(random() % (4 * count));
+        queries[i] = T(random() % (4 * count));
+    }
+
+    std::cout << type << std::endl;
+    measure<BinarySearchTree<T, T>>("  BinarySearchTree", keys, queries);
+    measure<CompactTree<T, T>>("  CompactTree", keys, queries);
+    measure<BPlusTree<T, T>>("  BPlusTree", keys, queries);
+    measure<StdMap<T, T>>("  std::map", keys, queries);
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+
+    measureAll<std::int32_t>("pair<int32_t, int32_t>", count);
+    measureAll<std::int64_t>("pair<int64_t, int64_t>", count);
+    return 0;
+}
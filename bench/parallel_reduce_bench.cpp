@@ -0,0 +1,65 @@
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "../BinarySearchTree.h"
+#include "BenchUtil.h"
+
+/*
+    Параллельные reduce и forEach против последовательного обхода итератором
+    Сумма значений всего словаря и половины диапазона ключей,
+    затем изменение всех значений через forEach
+
+    Сборка: g++ -std=c++17 -O2 -pthread bench/parallel_reduce_bench.cpp -o parallel_reduce_bench
+    Запуск: ./parallel_reduce_bench [число элементов, по умолчанию 10000000]
+*/
+
+template <typename Container>
+void measure(const char* name, size_t count) {
+    std::mt19937 random(42);
+    Container container;
+    for (size_t i = 0; i < count; i++) {
+        int key = int(random() % (4 * count));
+        container.insert(key, long(key % 1000));
+    }
+    auto sum = [](long left, long right) { return left + right; };
+    int middle = int(2 * count);
+
+    auto start = Clock::now();
+    long loopTotal = 0;
+    for (auto it = container.cbegin(); it != container.cend(); ++it) {
+        loopTotal += it->second;
+    }
+    double loopTime = secondsSince(start);
+    start = Clock::now();
+    long total = container.reduce(0L, sum);
+    double reduceTime = secondsSince(start);
+
+    start = Clock::now();
+    long loopRange = 0;
+    for (auto it = container.cbegin(); it != container.cend() && it->first < middle; ++it) {
+        loopRange += it->second;
+    }
+    double loopRangeTime = secondsSince(start);
+    start = Clock::now();
+    long range = container.reduce(0, middle, 0L, sum);
+    double reduceRangeTime = secondsSince(start);
+
+    start = Clock::now();
+    container.forEach([](std::pair<int, long>& pair) { pair.second++; });
+    double forEachTime = secondsSince(start);
+
+    std::cout << name << ": loop " << loopTime << " s, reduce " << reduceTime << " s; range loop " << loopRangeTime
+              << " s, range reduce " << reduceRangeTime << " s; forEach " << forEachTime << " s"
+              << (loopTotal == total && loopRange == range ? "" : " MISMATCH") << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+
+    std::cout << "threads: " << ThreadPool::global().threadCount() + 1 << std::endl;
+    measure<BinarySearchTree<int, long>>("BinarySearchTree", count);
+    measure<BinarySearchTree<int, long, std::less<int>, AvlBalance, SizeAugmentation>>("BinarySearchTree, AVL + sizes",
+                                                                                       count);
+    return 0;
+}
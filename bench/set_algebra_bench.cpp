@@ -0,0 +1,93 @@
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "BenchUtil.h"
+
+/*
+    Объединение, пересечение и разность множеств через split/join
+    против цикла contains по меньшему множеству и insert/erase в копию
+    Большое множество из N случайных чисел, малое - от N / 1000 до N элементов
+
+    Сборка: g++ -std=c++17 -O2 -pthread bench/set_algebra_bench.cpp -o set_algebra_bench
+    Запуск: ./set_algebra_bench [размер большого множества, по умолчанию 10000000]
+*/
+
+static std::vector<int> randomValues(size_t count, unsigned seed) {
+    std::mt19937 random(seed);
+    std::vector<int> values(count);
+    for (int& value : values) {
+        value = int(random() % (4 * count + 1));
+    }
+    return values;
+}
+
+static void fill(Set<int>& set, const std::vector<int>& values) {
+    set.insertBatch(values.begin(), values.end());
+}
+
+static void measure(size_t count, size_t smallCount) {
+    std::vector<int> bigValues = randomValues(count, 1);
+    std::vector<int> smallValues = randomValues(smallCount, 2);
+    for (int& value : smallValues) {
+        value = int(value * (double(count) / double(smallCount)));
+    }
+    Set<int> big;
+    fill(big, bigValues);
+    Set<int> small;
+    fill(small, smallValues);
+
+    // пересечение: оставить в малом множестве значения большого
+    auto start = Clock::now();
+    Set<int> looped;
+    for (int value : smallValues) {
+        if (big.contains(value)) {
+            looped.insert(value);
+        }
+    }
+    double loopIntersect = secondsSince(start);
+    Set<int> intersected(small);
+    start = Clock::now();
+    intersected.intersect(big);
+    double intersect = secondsSince(start);
+
+    // объединение: добавить малое множество в большое
+    Set<int> loopedUnion(big);
+    start = Clock::now();
+    for (int value : smallValues) {
+        loopedUnion.insert(value);
+    }
+    double loopUnite = secondsSince(start);
+    Set<int> united(big);
+    start = Clock::now();
+    united.unite(small);
+    double unite = secondsSince(start);
+
+    // разность: убрать малое множество из большого
+    Set<int> loopedDifference(big);
+    start = Clock::now();
+    for (int value : smallValues) {
+        loopedDifference.erase(value);
+    }
+    double loopDifference = secondsSince(start);
+    Set<int> difference(big);
+    start = Clock::now();
+    difference.difference(small);
+    double differenceTime = secondsSince(start);
+
+    std::cout << count << " / " << smallCount << ": intersect loop " << loopIntersect << " s, intersect "
+              << intersect << " s; unite loop " << loopUnite << " s, unite " << unite
+              << " s; difference loop " << loopDifference << " s, difference " << differenceTime << " s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+
+    std::cout << "threads: " << ThreadPool::global().threadCount() + 1 << std::endl;
+    for (size_t divisor : {1000, 100, 10, 1}) {
+        measure(count, count / divisor);
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "../BPlusTree.h"
+#include "../SimdSearch.h"
+#include "BenchUtil.h"
+
+/*
+    Замер векторного поиска ключей
+    1. Поиск в отсортированных массивах размером с узел: двоичный поиск и SimdSearch
+    2. find и lowerBound: BinarySearchTree (_findNode), B+-дерево со скалярным
+       и с векторным поиском внутри узлов
+
+    Сборка: g++ -std=c++17 -O2 bench/simd_search_bench.cpp -o simd_search_bench
+    Запуск: ./simd_search_bench [число элементов дерева, по умолчанию 2000000]
+*/
+
+//! Тот же порядок, что у std::less, но без векторного поиска
+struct ScalarLess
+{
+    bool operator()(int left, int right) const {
+        return left < right;
+    }
+};
+
+static void measureKernel(size_t nodeKeys, const std::vector<int>& queries) {
+    std::vector<int> keys(nodeKeys);
+    for (size_t i = 0; i < nodeKeys; i++) {
+        keys[i] = int(i * 16);
+    }
+    int range = int(nodeKeys * 16);
+
+    auto start = Clock::now();
+    size_t scalarSum = 0;
+    for (int query : queries) {
+        scalarSum += KeySearch<int, ScalarLess>::lowerIndex(keys.data(), nodeKeys, query % range, ScalarLess());
+    }
+    double scalarTime = secondsSince(start);
+
+    start = Clock::now();
+    size_t vectorSum = 0;
+    for (int query : queries) {
+        vectorSum += SimdSearch::countLess(keys.data(), nodeKeys, query % range);
+    }
+    double vectorTime = secondsSince(start);
+
+    std::cout << nodeKeys << " keys: binary " << scalarTime << " s, simd " << vectorTime
+              << " s" << (scalarSum == vectorSum ? "" : " MISMATCH") << std::endl;
+}
+
+template <typename Tree>
+void measureTree(const char* name, const std::vector<int>& keys, const std::vector<int>& queries) {
+    Tree tree;
+    for (int key : keys) {
+        tree.tryEmplace(key, std::to_string(key));
+    }
+    const Tree& constTree = tree;
+
+    auto start = Clock::now();
+    size_t found = 0;
+    for (int key : queries) {
+        found += constTree.find(key) != constTree.cend();
+    }
+    double findTime = secondsSince(start);
+
+    start = Clock::now();
+    size_t bounded = 0;
+    for (int key : queries) {
+        bounded += constTree.lowerBound(key) != constTree.cend();
+    }
+    double boundTime = secondsSince(start);
+
+    std::cout << name << ": find " << findTime << " s (" << found << ")"
+              << ", lowerBound " << boundTime << " s (" << bounded << ")" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+
+    const char* levels[] = {"scalar", "sse2", "avx2"};
+    std::cout << "instruction set: " << levels[SimdSearch::level()] << std::endl;
+
+    std::mt19937 random(42);
+    std::vector<int> queries(count);
+    for (int& query : queries) {
+        query = int(random() % (4 * count));
+    }
+    for (size_t nodeKeys : {8, 16, 32, 64}) {
+        measureKernel(nodeKeys, queries);
+    }
+
+    std::vector<int> keys(count);
+    for (int& key : keys) {
+        key = int(random() % (4 * count));
+    }
+    measureTree<BinarySearchTree<int, std::string>>("BinarySearchTree", keys, queries);
+    measureTree<BPlusTree<int, std::string, ScalarLess>>("BPlusTree, scalar", keys, queries);
+    measureTree<BPlusTree<int, std::string>>("BPlusTree, simd", keys, queries);
+    return 0;
+}
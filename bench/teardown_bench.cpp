@@ -0,0 +1,49 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "../BinarySearchTree.h"
+#include "BenchUtil.h"
+
+/*
+    Замер времени удаления дерева
+
+    Сборка: g++ -std=c++17 -O2 bench/teardown_bench.cpp -o teardown_bench
+    Запуск: ./teardown_bench [число узлов, по умолчанию 10000000]
+*/
+
+template <typename Tree, typename MakeValue>
+void measure(const char* name, size_t count, MakeValue makeValue) {
+    auto start = Clock::now();
+    auto* tree = new Tree;
+    for (size_t i = 0; i < count; i++) {
+        tree->insert(int(i), makeValue(i));
+    }
+    double buildTime = secondsSince(start);
+
+    start = Clock::now();
+    delete tree;
+    double destroyTime = secondsSince(start);
+
+    Tree reused;
+    for (size_t i = 0; i < count; i++) {
+        reused.insert(int(i), makeValue(i));
+    }
+    start = Clock::now();
+    reused.clear();
+    double clearTime = secondsSince(start);
+
+    std::cout << name << ": " << count << " nodes, build " << buildTime 
+              << " s, destructor " << destroyTime 
+              << " s, clear " << clearTime << " s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+
+    measure<BinarySearchTree<int, int>>("<int, int>", count, 
+        [](size_t i) { return int(i); });
+    measure<BinarySearchTree<int, std::string>>("<int, std::string>", count, 
+        [](size_t i) { return std::string(32, char('a' + i % 26)); });
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../BinarySearchTree.h"
+#include "BenchUtil.h"
+
+/*
+    Политики балансировки BinarySearchTree при неудобном порядке ключей:
+    без балансировки, красно-черное, АВЛ и декартово дерево (TreapBalance)
+    Порядки вставки: случайный с повторами, возрастающий, убывающий и "пила"
+    (попеременно наименьший и наибольший из оставшихся ключей). Замеряются
+    вставка, высота, случайный поиск, сканы диапазонов по scanWidth элементов
+    от lowerBound и удаление половины ключей
+
+    Дерево без балансировки на упорядоченных ключах вырождается в список
+    и строится за O(n^2), поэтому для него берется не больше plainLimit ключей
+
+    Сборка: g++ -std=c++17 -O2 -pthread bench/treap_bench.cpp -o treap_bench
+    Запуск: ./treap_bench [число элементов, по умолчанию 1000000]
+*/
+
+static constexpr size_t plainLimit = 20000;
+static constexpr size_t scanWidth = 100;
+
+static std::vector<int> makeKeys(const std::string& order, size_t count, std::mt19937& random) {
+    std::vector<int> keys(count);
+    for (size_t i = 0; i < count; i++) {
+        if (order == "random") {
+            keys[i] = int(random() % (count / 2 + 1));
+        }
+        else if (order == "ascending") {
+            keys[i] = int(i);
+        }
+        else if (order == "descending") {
+            keys[i] = int(count - i);
+        }
+        else {
+            keys[i] = int(i % 2 ? count - i / 2 : i / 2);
+        }
+    }
+    return keys;
+}
+
+template <typename Balance>
+void measure(const char* name, const std::vector<int>& keys, size_t queryCount) {
+    using Tree = BinarySearchTree<int, int, std::less<int>, Balance>;
+    if (keys.empty()) {
+        return;
+    }
+    std::mt19937 random(7);
+    int range = *std::max_element(keys.begin(), keys.end()) + 1;
+
+    auto start = Clock::now();
+    Tree tree;
+    const Tree& constTree = tree;
+    for (int key : keys) {
+        tree.insert(key, key);
+    }
+    double insertTime = secondsSince(start);
+
+    start = Clock::now();
+    size_t found = 0;
+    for (size_t i = 0; i < queryCount; i++) {
+        found += constTree.find(int(random() % range)) != constTree.cend();
+    }
+    double findTime = secondsSince(start);
+
+    start = Clock::now();
+    std::int64_t sum = 0;
+    size_t scans = queryCount / scanWidth;
+    for (size_t i = 0; i < scans; i++) {
+        auto it = constTree.lowerBound(int(random() % range));
+        for (size_t step = 0; step < scanWidth && it != constTree.cend(); step++, ++it) {
+            sum += it->second;
+        }
+    }
+    double scanTime = secondsSince(start);
+
+    start = Clock::now();
+    for (size_t i = 0; i < keys.size(); i += 2) {
+        tree.erase(keys[i]);
+    }
+    double eraseTime = secondsSince(start);
+
+    std::cout << "  " << name << " (" << keys.size() << "): insert " << insertTime * 1e9 / double(keys.size())
+              << " ns, height " << constTree.height()
+              << ", find " << findTime * 1e9 / double(queryCount) << " ns (" << found << " found)"
+              << ", scan " << scanTime * 1e9 / double(scans ? scans : 1) << " ns per " << scanWidth
+              << " (sum " << sum << "), erase half " << eraseTime << " s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    for (const char* order : {"random", "ascending", "descending", "sawtooth"}) {
+        std::mt19937 random(42);
+        std::vector<int> keys = makeKeys(order, count, random);
+        bool degenerate = std::string(order) != "random";
+        std::vector<int> plainKeys(keys.begin(), keys.begin() + (degenerate ? std::min(count, plainLimit) : count));
+
+        std::cout << order << ":" << std::endl;
+        measure<NoBalance>("NoBalance", plainKeys, count);
+        measure<RedBlackBalance>("RedBlackBalance", keys, count);
+        measure<AvlBalance>("AvlBalance", keys, count);
+        measure<TreapBalance>("TreapBalance", keys, count);
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../ConcurrentMap.h"
+
+/*
+    Проверка ConcurrentMap и ConcurrentSet под одновременной нагрузкой
+    Потоки вперемешку вставляют, удаляют, ищут и обновляют общий небольшой
+    набор ключей, отдельный поток все это время обходит словарь forEach.
+    Словарь проверяется с тривиально копируемым значением (чтение по версии)
+    и со строкой (чтение через подменяемый указатель).
+    После остановки сверяется итог: размер равен числу успешных вставок
+    минус число успешных удалений, обход идет строго по возрастанию и видит
+    size() элементов, значение каждого элемента принадлежит его ключу.
+    Затем потоки с непересекающимися ключами проверяют точные результаты
+    insert, contains и erase у ConcurrentSet.
+    Проверки не зависят от assert и работают в Release; при ошибке код возврата 1.
+    Имеет смысл запускать и в сборках с -fsanitize=thread или address
+
+    Сборка: g++ -std=c++17 -O2 -pthread tests/concurrent_stress.cpp -o concurrent_stress
+    Запуск: ./concurrent_stress [число потоков, по умолчанию 8] [операций на поток, по умолчанию 200000]
+*/
+
+//! Значение помнит свой ключ, поэтому разорванное или чужое значение видно сразу
+struct Entry
+{
+    int key = 0;
+    long updates = 0;
+};
+
+//! То же со строкой: значение хранится отдельным объектом
+struct NamedEntry
+{
+    std::string key;
+    long updates = 0;
+};
+
+static Entry makeEntry(int key, const Entry*) {
+    return Entry{key, 0};
+}
+
+static NamedEntry makeEntry(int key, const NamedEntry*) {
+    return NamedEntry{std::to_string(key), 0};
+}
+
+static bool owns(const Entry& entry, int key) {
+    return entry.key == key;
+}
+
+static bool owns(const NamedEntry& entry, int key) {
+    return entry.key == std::to_string(key);
+}
+
+static bool check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+    return condition;
+}
+
+template <typename Value>
+static bool stressMap(const char* name, size_t threadCount, size_t operations) {
+    constexpr int keyCount = 2000;
+    const Value* tag = nullptr;
+    ConcurrentMap<int, Value> map;
+    std::atomic<long> inserted{0};
+    std::atomic<long> erased{0};
+    std::atomic<bool> failed{false};
+    std::atomic<bool> done{false};
+
+    // обход во время изменений: порядок строгий, значения принадлежат своим ключам
+    std::thread scanner([&] {
+        while (!done.load()) {
+            int previous = -1;
+            map.forEach([&](const int& key, const Value& entry) {
+                if (key <= previous || !owns(entry, key)) {
+                    failed = true;
+                }
+                previous = key;
+            });
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; t++) {
+        threads.emplace_back([&, t] {
+            std::mt19937 random(unsigned(t) + 1);
+            for (size_t i = 0; i < operations; i++) {
+                int key = int(random() % keyCount);
+                unsigned operation = random() % 10;
+                if (operation < 3) {
+                    inserted += map.tryEmplace(key, makeEntry(key, tag)) ? 1 : 0;
+                }
+                else if (operation < 4) {
+                    inserted += map.insert(key, makeEntry(key, tag)) ? 1 : 0;
+                }
+                else if (operation < 6) {
+                    erased += map.erase(key) ? 1 : 0;
+                }
+                else if (operation < 7) {
+                    map.update(key, [&](Value& entry) {
+                        if (!owns(entry, key)) {
+                            failed = true;
+                        }
+                        entry.updates++;
+                    });
+                }
+                else {
+                    Value entry;
+                    if (map.find(key, entry) && !owns(entry, key)) {
+                        failed = true;
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    done = true;
+    scanner.join();
+
+    size_t counted = 0;
+    int previous = -1;
+    bool ordered = true;
+    map.forEach([&](const int& key, const Value& entry) {
+        ordered = ordered && key > previous && owns(entry, key);
+        previous = key;
+        counted++;
+    });
+    bool ok = check(!failed, "find, update or a concurrent forEach saw a foreign value or broken order");
+    ok = check(ordered, "final forEach is not strictly ascending") && ok;
+    ok = check(long(map.size()) == inserted - erased, "size() != successful inserts - successful erases") && ok;
+    ok = check(counted == map.size(), "forEach visited a different number of elements than size()") && ok;
+    std::cout << name << ": " << inserted << " inserts, " << erased << " erases, "
+              << map.size() << " left" << std::endl;
+    return ok;
+}
+
+static bool stressSet(size_t threadCount) {
+    constexpr int valueCount = 4000;
+    constexpr int rounds = 20;
+    ConcurrentSet<int> set;
+    std::atomic<bool> failed{false};
+
+    // у каждого потока свои значения, поэтому результат каждой операции известен заранее
+    std::vector<std::thread> threads;
+    int step = int(threadCount);
+    for (int t = 0; t < step; t++) {
+        threads.emplace_back([&, t] {
+            for (int round = 0; round < rounds; round++) {
+                for (int value = t; value < valueCount; value += step) {
+                    failed = failed || !set.insert(value);
+                }
+                for (int value = t; value < valueCount; value += step) {
+                    failed = failed || !set.contains(value) || set.insert(value);
+                }
+                for (int value = t; value < valueCount; value += 2 * step) {
+                    failed = failed || !set.erase(value) || set.contains(value);
+                }
+                for (int value = t + step; value < valueCount; value += 2 * step) {
+                    failed = failed || !set.erase(value);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    bool ok = check(!failed, "ConcurrentSet returned a wrong result for a thread-private value");
+    ok = check(set.size() == 0, "ConcurrentSet is not empty after every value was erased") && ok;
+    std::cout << "ConcurrentSet: " << threadCount << " threads x " << rounds << " rounds" << std::endl;
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    size_t threadCount = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 8;
+    size_t operations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 200000;
+    threadCount = std::max<size_t>(threadCount, 2);
+
+    bool ok = stressMap<Entry>("ConcurrentMap<int, Entry>", threadCount, operations);
+    ok = stressMap<NamedEntry>("ConcurrentMap<int, NamedEntry>", threadCount, operations) && ok;
+    ok = stressSet(threadCount) && ok;
+    std::cout << (ok ? "ok" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
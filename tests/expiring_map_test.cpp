@@ -0,0 +1,177 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+#include "../ExpiringMap.h"
+
+/*
+    Проверка ExpiringMap на модельных часах
+    Случайные insert, find, touch, erase и tick сверяются с простой моделью
+    (ключ -> значение и момент истечения), при capacity > 0 проверяется,
+    что размер не превышает capacity. Затем присваивание значения бросает
+    исключение при замене существующего ключа: прежнее значение и срок должны
+    остаться, а последующее вытеснение - удалить элемент без обращения
+    к отсутствующим записям
+    Проверки не зависят от assert и работают в Release; при ошибке код возврата 1
+
+    Сборка: g++ -std=c++17 -O2 -pthread tests/expiring_map_test.cpp -o expiring_map_test
+    Запуск: ./expiring_map_test [операций, по умолчанию 200000]
+*/
+
+//! Модельные часы кэша
+struct SimulatedClock
+{
+    using duration = std::chrono::milliseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<SimulatedClock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now() { return current; }
+    static time_point current;
+};
+
+SimulatedClock::time_point SimulatedClock::current{};
+
+//! Значение, присваивание которого бросает исключение по требованию
+struct Fragile
+{
+    int value = 0;
+
+    Fragile() = default;
+    Fragile(int value) : value(value) {}
+    Fragile(const Fragile& other) = default;
+    Fragile& operator=(const Fragile& other) {
+        if (failAssign) {
+            throw std::runtime_error("assignment failed");
+        }
+        value = other.value;
+        return *this;
+    }
+
+    static bool failAssign;
+};
+
+bool Fragile::failAssign = false;
+
+static bool check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+    return condition;
+}
+
+static bool randomOperations(size_t operations, size_t capacity) {
+    constexpr int keyCount = 500;
+    using Duration = SimulatedClock::duration;
+    ExpiringMap<int, int, std::less<int>, SimulatedClock> cache(Duration(50), capacity);
+    // модель: значение и момент истечения, 0 - ключа нет; вытеснение LRU модель не повторяет
+    std::vector<int> values(keyCount);
+    std::vector<SimulatedClock::time_point> expiry(keyCount);
+    std::vector<bool> present(keyCount);
+    std::mt19937 random(unsigned(capacity) + 1);
+    bool ok = true;
+
+    for (size_t i = 0; i < operations && ok; i++) {
+        SimulatedClock::current += Duration(random() % 3);
+        SimulatedClock::time_point now = SimulatedClock::now();
+        int key = int(random() % keyCount);
+        bool alive = present[key] && expiry[key] > now;
+        unsigned operation = random() % 10;
+        if (operation < 4) {
+            Duration ttl(random() % 100);
+            cache.insert(key, int(i), ttl);
+            values[key] = int(i);
+            expiry[key] = now + ttl;
+            present[key] = true;
+        }
+        else if (operation < 7) {
+            int* found = cache.find(key);
+            if (capacity == 0) {
+                ok = check((found != nullptr) == alive, "find disagrees with the model") && ok;
+            }
+            else if (found) {
+                ok = check(alive, "find returned an expired or erased key") && ok;
+            }
+            if (found) {
+                ok = check(*found == values[key], "find returned a stale value") && ok;
+            }
+            else {
+                present[key] = false;
+            }
+        }
+        else if (operation < 8) {
+            Duration ttl(random() % 100);
+            if (cache.touch(key, ttl)) {
+                ok = check(alive, "touch renewed an expired or erased key") && ok;
+                expiry[key] = now + ttl;
+            }
+            else if (capacity == 0) {
+                ok = check(!alive, "touch missed a live key") && ok;
+            }
+        }
+        else if (operation < 9) {
+            bool erased = cache.erase(key);
+            if (capacity == 0) {
+                ok = check(erased == alive, "erase disagrees with the model") && ok;
+            }
+            present[key] = false;
+        }
+        else {
+            cache.tick(8);
+        }
+        if (capacity) {
+            ok = check(cache.size() <= capacity, "size() exceeds capacity") && ok;
+        }
+    }
+    // после истечения всех сроков вытеснение опустошает кэш
+    SimulatedClock::current += Duration(1000);
+    while (cache.tick(64) != 0) {
+    }
+    ok = check(cache.size() == 0, "expired elements left after tick") && ok;
+    std::cout << "random operations, capacity " << capacity << ": " << (ok ? "ok" : "FAILED") << std::endl;
+    return ok;
+}
+
+static bool throwingAssignment(size_t capacity) {
+    using Duration = SimulatedClock::duration;
+    ExpiringMap<int, Fragile, std::less<int>, SimulatedClock> cache(Duration(10), capacity);
+    for (int key = 0; key < 4; key++) {
+        cache.insert(key, Fragile(key));
+    }
+    Fragile::failAssign = true;
+    bool threw = false;
+    try {
+        cache.insert(1, Fragile(100), Duration(1000));
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+    Fragile::failAssign = false;
+
+    bool ok = check(threw, "assignment of the existing value did not throw");
+    Fragile* found = cache.find(1);
+    ok = check(found && found->value == 1, "failed replacement changed the value") && ok;
+    // прежний срок сохранен: элемент истекает вместе с остальными
+    SimulatedClock::current += Duration(20);
+    ok = check(!cache.contains(1), "failed replacement extended the expiry") && ok;
+    cache.tick(16);
+    ok = check(cache.size() == 0, "tick left elements after a failed replacement") && ok;
+    cache.insert(7, Fragile(7));
+    ok = check(cache.find(7) && cache.find(7)->value == 7, "cache unusable after a failed replacement") && ok;
+    std::cout << "throwing assignment, capacity " << capacity << ": " << (ok ? "ok" : "FAILED") << std::endl;
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    size_t operations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+
+    bool ok = randomOperations(operations, 0);
+    ok = randomOperations(operations, 64) && ok;
+    ok = throwingAssignment(0) && ok;
+    ok = throwingAssignment(3) && ok;
+    std::cout << (ok ? "ok" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../PersistentTree.h"
+
+/*
+    Проверка PersistentTree
+    Один писатель вставляет повторяющиеся ключи, удаляет их, заменяет значения
+    insertOrAssign и целиком меняет содержимое assign, читатели все это время
+    берут снимки и обходят их: ключи не убывают, значение принадлежит своему
+    ключу, число обойденных элементов равно size() снимка, повторный обход
+    снимка дает то же самое. Ключ hot вставляется только assign по три раза
+    и удаляется одним erase, поэтому снимок видит его 0 или 3 раза.
+    В конце дерево сверяется с std::multimap, который писатель вел параллельно.
+    Затем копирование значения бросает исключение в каждой возможной точке
+    insert, insertOrAssign, erase и assign: содержимое должно остаться прежним,
+    а после уничтожения дерева не должно остаться ни одного значения
+    Проверки не зависят от assert и работают в Release; при ошибке код возврата 1.
+    Имеет смысл запускать и в сборках с -fsanitize=thread или address
+
+    Сборка: g++ -std=c++17 -O2 -pthread tests/persistent_tree_test.cpp -o persistent_tree_test
+    Запуск: ./persistent_tree_test [число читателей, по умолчанию 4] [операций писателя, по умолчанию 100000]
+*/
+
+static constexpr long valueBase = 1000000;
+static constexpr int hot = -1;
+
+static bool check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+    return condition;
+}
+
+static bool concurrentSnapshots(size_t readerCount, size_t operations) {
+    constexpr int keyCount = 500;
+    PersistentTree<int, long> tree;
+    std::multimap<int, long> model;
+    std::atomic<bool> failed{false};
+    std::atomic<bool> done{false};
+    std::atomic<size_t> snapshots{0};
+
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < readerCount; r++) {
+        readers.emplace_back([&] {
+            while (!done.load()) {
+                PersistentTree<int, long>::Snapshot snapshot = tree.snapshot();
+                size_t counted = 0;
+                size_t hotCount = 0;
+                long sum = 0;
+                int previous = hot;
+                for (auto it = snapshot.cbegin(); it != snapshot.cend(); ++it) {
+                    bool owned = it->first == hot ? it->second == hot * valueBase : it->second / valueBase == it->first;
+                    if (it->first < previous || !owned) {
+                        failed = true;
+                    }
+                    previous = it->first;
+                    hotCount += it->first == hot;
+                    sum += it->second;
+                    counted++;
+                }
+                long again = 0;
+                for (auto it = snapshot.cbegin(); it != snapshot.cend(); ++it) {
+                    again += it->second;
+                }
+                if (counted != snapshot.size() || sum != again || (hotCount != 0 && hotCount != 3)) {
+                    failed = true;
+                }
+                snapshots++;
+            }
+        });
+    }
+
+    std::mt19937 random(7);
+    for (size_t i = 0; i < operations; i++) {
+        int key = int(random() % keyCount);
+        long value = key * valueBase + long(i % valueBase);
+        unsigned operation = random() % 10;
+        if (operation < 5) {
+            tree.insert(key, value);
+            model.emplace(key, value);
+        }
+        else if (operation < 7) {
+            // удаляются все повторы ключа сразу
+            tree.erase(key);
+            model.erase(key);
+        }
+        else if (operation < 9) {
+            auto found = model.find(key);
+            bool inserted = tree.insertOrAssign(key, value);
+            if (found == model.end()) {
+                model.emplace(key, value);
+            }
+            else {
+                found->second = value;
+            }
+            failed = failed || inserted != (found == model.end());
+        }
+        else {
+            // то же содержимое и три повтора hot одной публикацией, затем их удаление
+            std::vector<std::pair<int, long>> items(3, std::pair<int, long>(hot, hot * valueBase));
+            PersistentTree<int, long>::Snapshot current = tree.snapshot();
+            for (auto it = current.cbegin(); it != current.cend(); ++it) {
+                items.push_back(*it);
+            }
+            tree.assign(items.begin(), items.end());
+            tree.erase(hot);
+        }
+    }
+    done = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    PersistentTree<int, long>::Snapshot final = tree.snapshot();
+    bool same = final.size() == model.size();
+    auto expected = model.begin();
+    for (auto it = final.cbegin(); same && it != final.cend(); ++it, ++expected) {
+        same = it->first == expected->first && it->second == expected->second;
+    }
+    bool ok = check(!failed, "a snapshot was out of order, changed, or saw a partial erase");
+    ok = check(same, "final tree differs from the std::multimap model") && ok;
+    std::cout << "snapshots: " << readerCount << " readers took " << snapshots << " snapshots, "
+              << final.size() << " elements left" << std::endl;
+    return ok;
+}
+
+//! Значение, копирование которого бросает исключение после заданного числа копий
+struct Fragile
+{
+    int value;
+
+    explicit Fragile(int value) : value(value) { live++; }
+    Fragile(const Fragile& other) : value(other.value) {
+        if (budget == 0) {
+            throw std::runtime_error("copy failed");
+        }
+        if (budget > 0) {
+            budget--;
+        }
+        live++;
+    }
+    Fragile& operator=(const Fragile& other) = delete;
+    ~Fragile() { live--; }
+
+    static inline int budget = -1; //!< копий до исключения, -1 - без ограничения
+    static inline long live = 0;
+};
+
+using FragileTree = PersistentTree<int, Fragile>;
+
+static std::vector<std::pair<int, int>> contents(const FragileTree& tree) {
+    std::vector<std::pair<int, int>> items;
+    FragileTree::Snapshot snapshot = tree.snapshot();
+    for (auto it = snapshot.cbegin(); it != snapshot.cend(); ++it) {
+        items.emplace_back(it->first, it->second.value);
+    }
+    return items;
+}
+
+// вызывать change с бюджетом копий 0, 1, 2, ..., пока он не пройдет без исключения;
+// после каждого исключения содержимое должно совпадать с исходным
+template <typename Change>
+static bool failEverywhere(FragileTree& tree, Change change) {
+    bool ok = true;
+    for (int budget = 0;; budget++) {
+        std::vector<std::pair<int, int>> before = contents(tree);
+        Fragile::budget = budget;
+        try {
+            change();
+            Fragile::budget = -1;
+            return ok;
+        }
+        catch (const std::runtime_error&) {
+            Fragile::budget = -1;
+        }
+        ok = check(contents(tree) == before, "a throwing copy changed the tree") && ok;
+    }
+}
+
+static bool throwingCopies() {
+    bool ok = true;
+    {
+        FragileTree tree;
+        for (int i = 0; i < 200; i++) {
+            tree.insert(i % 20, Fragile(i));
+        }
+        std::vector<std::pair<int, Fragile>> source;
+        for (int i = 0; i < 60; i++) {
+            source.emplace_back(i / 2, Fragile(i));
+        }
+        for (int trial = 0; trial < 40; trial++) {
+            ok = failEverywhere(tree, [&] { tree.insert(trial % 25, Fragile(trial)); }) && ok;
+            ok = failEverywhere(tree, [&] { tree.insertOrAssign(trial % 30, Fragile(-trial)); }) && ok;
+            ok = failEverywhere(tree, [&] { tree.erase(trial % 20); }) && ok;
+            if (trial % 8 == 0) {
+                ok = failEverywhere(tree, [&] { tree.assign(source.begin(), source.end()); }) && ok;
+            }
+        }
+    }
+    // дерево уничтожено, отложенные освобождения выполняются после двух смен эпохи
+    for (int i = 0; i < 4; i++) {
+        EpochReclaimer::collect();
+    }
+    ok = check(Fragile::live == 0, "values leaked or were freed twice after throwing copies") && ok;
+    std::cout << "throwing copies: " << Fragile::live << " values left" << std::endl;
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    size_t readerCount = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4;
+    size_t operations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000;
+
+    bool ok = concurrentSnapshots(readerCount, operations);
+    ok = throwingCopies() && ok;
+    std::cout << (ok ? "ok" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}